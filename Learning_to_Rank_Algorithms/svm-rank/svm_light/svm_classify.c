@@ -16,49 +16,115 @@
 /*                                                                     */
 /************************************************************************/
 
+# include <pthread.h>
 # include "svm_common.h"
 
+# define MAX(x,y) ((x) < (y) ? (y) : (x))
+
+/* The test file is classified by a pipeline of threads. The main
+   thread reads the raw lines into blocks, the scorer threads parse and
+   classify the blocks, and the writer thread prints the predictions of
+   the blocks in file order. The blocks are allocated once and passed
+   around in a ring, so no memory is allocated per document. */
+
+# define BLOCK_DOCS    1024      /* maximum number of lines in a block */
+# define BLOCK_TEXT    (1<<20)   /* size of the text buffer of a block,
+				    unless a single line is longer */
+# define SCRATCH_WORDS (1<<16)   /* size of the WORD buffer of a scorer */
+
+# define BLOCK_FREE   0
+# define BLOCK_READ   1
+# define BLOCK_SCORED 2
+
+typedef struct block {
+  long    seq;          /* position of the block in the file */
+  int     state;        /* BLOCK_FREE, BLOCK_READ or BLOCK_SCORED */
+  long    n;            /* number of documents */
+  char    *text;        /* the lines, each terminated by 0 */
+  long    *start;       /* line i starts at text+start[i] */
+  double  *label;       /* filled in by the scorer */
+  double  *dist;
+  long    nseg;         /* with --latency-report, the runs of documents */
+  long    *seg_qid;     /* with the same qid in the block, their number */
+  long    *seg_docs;    /* of documents and the wall-clock time it took */
+  double  *seg_time;    /* to parse and classify them */
+} BLOCK;
+
+typedef struct scratch {
+  WORD    *words;       /* features of the documents of one batch */
+  long    size;
+  DOC     *doc;         /* BLOCK_DOCS documents pointing into words */
+  SVECTOR *vec;
+  SVECTOR **fvec;
+} SCRATCH;
+
 char docfile[200];
 char modelfile[200];
 char predictionsfile[200];
+char latencyfile[200];
 
-void read_input_parameters(int, char **, char *, char *, char *, long *, 
-			   long *);
+/* ring of blocks; lock protects the state of all blocks and the
+   counters below */
+pthread_mutex_t lock=PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t  block_read=PTHREAD_COND_INITIALIZER;
+pthread_cond_t  block_scored=PTHREAD_COND_INITIALIZER;
+pthread_cond_t  block_freed=PTHREAD_COND_INITIALIZER;
+BLOCK   *ring;
+long    ring_size;
+long    blocks_read=0;       /* blocks handed to the scorers so far */
+long    next_score=0;        /* next block a scorer takes */
+int     reading_done=0;
+
+MODEL   *model;
+long    max_words_doc,pred_format;
+FILE    *predfl;
+double  runtime=0;           /* cpu time of the scorers (without IO) */
+long    totdoc=0,correct=0,incorrect=0,no_accuracy=0;
+long    res_a=0,res_b=0,res_c=0,res_d=0;
+double  *qlatency=NULL;      /* latency and size of each query */
+long    *qdocs=NULL,nqueries=0;
+
+void read_input_parameters(int, char **, char *, char *, char *, char *,
+			   long *, long *, long *);
 void print_help(void);
+void *scorer(void *);
+void *writer(void *);
+void score_block(BLOCK *, SCRATCH *);
+double score_batch(SCRATCH *, long, double *);
 
 
 int main (int argc, char* argv[])
 {
-  DOC *doc;   /* test example */
-  WORD *words;
-  long max_docs,max_words_doc,lld;
-  long totdoc=0,queryid,slackid;
-  long correct=0,incorrect=0,no_accuracy=0;
-  long res_a=0,res_b=0,res_c=0,res_d=0,wnum,pred_format;
-  long j;
-  double t1,runtime=0;
-  double dist,doc_label,costfactor;
-  char *line,*comment; 
-  FILE *predfl,*docfl;
-  MODEL *model; 
+  long max_docs,lld,threads,textsize,used,i;
+  double elapsed;
+  char *line;
+  FILE *docfl;
+  BLOCK *b;
+  pthread_t *scorers,writethread;
 
   read_input_parameters(argc,argv,docfile,modelfile,predictionsfile,
-			&verbosity,&pred_format);
+			latencyfile,&verbosity,&pred_format,&threads);
 
   nol_ll(docfile,&max_docs,&max_words_doc,&lld); /* scan size of input file */
   max_words_doc+=2;
   lld+=2;
 
-  line = (char *)my_malloc(sizeof(char)*lld);
-  words = (WORD *)my_malloc(sizeof(WORD)*(max_words_doc+10));
-
   model=read_model(modelfile);
 
   if(model->kernel_parm.kernel_type == 0) { /* linear kernel */
     /* compute weight vector */
     add_weight_vector_to_linear_model(model);
   }
-  
+  else { /* pack support vectors for batched kernel evaluation */
+    add_kernel_block_to_model(model);
+  }
+  if((threads>1) && (model->kernel_parm.kernel_type != LINEAR)
+     && (model->kernel_parm.kernel_type != POLY_EXPANDED)
+     && (!model->kernel_block)) {
+    printf("\nNOTE: This kernel is evaluated by a single scoring thread (-j).\n\n");
+    threads=1;
+  }
+
   if(verbosity>=2) {
     printf("Classifying test examples.."); fflush(stdout);
   }
@@ -68,59 +134,84 @@ int main (int argc, char* argv[])
   if ((predfl = fopen (predictionsfile, "w")) == NULL)
   { perror (predictionsfile); exit (1); }
 
-  while((!feof(docfl)) && fgets(line,(int)lld,docfl)) {
-    if(line[0] == '#') continue;  /* line contains comments */
-    parse_document(line,words,&doc_label,&queryid,&slackid,&costfactor,&wnum,
-		   max_words_doc,&comment);
-    totdoc++;
-    if(model->kernel_parm.kernel_type == LINEAR) {/* For linear kernel,     */
-      for(j=0;(words[j]).wnum != 0;j++) {     /* check if feature numbers   */
-	if((words[j]).wnum>model->totwords)   /* are not larger than in     */
-	  (words[j]).wnum=0;                  /* model. Remove feature if   */
-      }                                       /* necessary.                 */
+  /* two blocks per scorer keep all scorers busy while the writer
+     empties the oldest block */
+  ring_size=2*threads+2;
+  textsize=MAX(BLOCK_TEXT,lld);
+  ring=(BLOCK *)my_malloc(sizeof(BLOCK)*ring_size);
+  for(i=0;i<ring_size;i++) {
+    ring[i].state=BLOCK_FREE;
+    ring[i].text=(char *)my_malloc(sizeof(char)*textsize);
+    ring[i].start=(long *)my_malloc(sizeof(long)*BLOCK_DOCS);
+    ring[i].label=(double *)my_malloc(sizeof(double)*BLOCK_DOCS);
+    ring[i].dist=(double *)my_malloc(sizeof(double)*BLOCK_DOCS);
+    if(latencyfile[0]) {
+      ring[i].seg_qid=(long *)my_malloc(sizeof(long)*BLOCK_DOCS);
+      ring[i].seg_docs=(long *)my_malloc(sizeof(long)*BLOCK_DOCS);
+      ring[i].seg_time=(double *)my_malloc(sizeof(double)*BLOCK_DOCS);
     }
-    doc = create_example(-1,0,0,0.0,create_svector(words,comment,1.0));
-    t1=get_runtime();
+  }
 
-    if(model->kernel_parm.kernel_type == LINEAR) {   /* linear kernel */
-      dist=classify_example_linear(model,doc);
-    }
-    else {                                           /* non-linear kernel */
-      dist=classify_example(model,doc);
+  elapsed=get_wall_time();
+  scorers=(pthread_t *)my_malloc(sizeof(pthread_t)*threads);
+  for(i=0;i<threads;i++)
+    pthread_create(&scorers[i],NULL,scorer,NULL);
+  pthread_create(&writethread,NULL,writer,NULL);
+
+  line=NULL;
+  while(!feof(docfl)) {
+    b=&ring[blocks_read%ring_size];
+    pthread_mutex_lock(&lock);
+    while(b->state != BLOCK_FREE)
+      pthread_cond_wait(&block_freed,&lock);
+    pthread_mutex_unlock(&lock);
+    b->n=0;
+    used=0;
+    while((b->n<BLOCK_DOCS) && (used+lld<=textsize)) {
+      line=b->text+used;
+      if(!fgets(line,(int)lld,docfl)) break;
+      if(line[0] == '#') continue;  /* line contains comments */
+      b->start[b->n++]=used;
+      used+=strlen(line)+1;
     }
+    if(b->n == 0) break;
+    pthread_mutex_lock(&lock);
+    b->seq=blocks_read++;
+    b->state=BLOCK_READ;
+    pthread_cond_signal(&block_read);
+    pthread_mutex_unlock(&lock);
+  }
+  pthread_mutex_lock(&lock);
+  reading_done=1;
+  pthread_cond_broadcast(&block_read);
+  pthread_cond_broadcast(&block_scored);
+  pthread_mutex_unlock(&lock);
 
-    runtime+=(get_runtime()-t1);
-    free_example(doc,1);
+  for(i=0;i<threads;i++)
+    pthread_join(scorers[i],NULL);
+  pthread_join(writethread,NULL);
+  elapsed=get_wall_time()-elapsed;
 
-    if(dist>0) {
-      if(pred_format==0) { /* old weired output format */
-	fprintf(predfl,"%.8g:+1 %.8g:-1\n",dist,-dist);
-      }
-      if(doc_label>0) correct++; else incorrect++;
-      if(doc_label>0) res_a++; else res_b++;
-    }
-    else {
-      if(pred_format==0) { /* old weired output format */
-	fprintf(predfl,"%.8g:-1 %.8g:+1\n",-dist,dist);
-      }
-      if(doc_label<0) correct++; else incorrect++;
-      if(doc_label>0) res_c++; else res_d++;
-    }
-    if(pred_format==1) { /* output the value of decision function */
-      fprintf(predfl,"%.8g\n",dist);
-    }
-    if((int)(0.01+(doc_label*doc_label)) != 1) 
-      { no_accuracy=1; } /* test data is not binary labeled */
-    if(verbosity>=2) {
-      if(totdoc % 100 == 0) {
-	printf("%ld..",totdoc); fflush(stdout);
-      }
-    }
-  }  
+  if(latencyfile[0]) {
+    write_latency_report(latencyfile,qlatency,qdocs,nqueries,elapsed,threads);
+    free(qlatency);
+    free(qdocs);
+  }
   fclose(predfl);
   fclose(docfl);
-  free(line);
-  free(words);
+  for(i=0;i<ring_size;i++) {
+    free(ring[i].text);
+    free(ring[i].start);
+    free(ring[i].label);
+    free(ring[i].dist);
+    if(latencyfile[0]) {
+      free(ring[i].seg_qid);
+      free(ring[i].seg_docs);
+      free(ring[i].seg_time);
+    }
+  }
+  free(ring);
+  free(scorers);
   free_model(model,1);
 
   if(verbosity>=2) {
@@ -132,7 +223,7 @@ int main (int argc, char* argv[])
 /*        0.01 secs, the timer was underflowing.                       */
     printf("Runtime (without IO) in cpu-seconds: %.2f\n",
 	   (float)(runtime/100.0));
-    
+
   }
   if((!no_accuracy) && (verbosity>=1)) {
     printf("Accuracy on test set: %.2f%% (%ld correct, %ld incorrect, %ld total)\n",(float)(correct)*100.0/totdoc,correct,incorrect,totdoc);
@@ -142,24 +233,264 @@ int main (int argc, char* argv[])
   return(0);
 }
 
-void read_input_parameters(int argc, char **argv, char *docfile, 
-			   char *modelfile, char *predictionsfile, 
-			   long int *verbosity, long int *pred_format)
+void *scorer(void *arg)
+     /* takes the blocks that have been read in file order and
+	classifies them */
+{
+  SCRATCH s;
+  BLOCK *b;
+
+  s.size=MAX(SCRATCH_WORDS,2*(max_words_doc+1));
+  s.words=(WORD *)my_malloc(sizeof(WORD)*s.size);
+  s.doc=(DOC *)my_malloc(sizeof(DOC)*BLOCK_DOCS);
+  s.vec=(SVECTOR *)my_malloc(sizeof(SVECTOR)*BLOCK_DOCS);
+  s.fvec=(SVECTOR **)my_malloc(sizeof(SVECTOR *)*BLOCK_DOCS);
+  for(;;) {
+    pthread_mutex_lock(&lock);
+    while((next_score == blocks_read) && (!reading_done))
+      pthread_cond_wait(&block_read,&lock);
+    if(next_score == blocks_read) {
+      pthread_mutex_unlock(&lock);
+      break;
+    }
+    b=&ring[(next_score++)%ring_size];
+    pthread_mutex_unlock(&lock);
+
+    score_block(b,&s);
+
+    pthread_mutex_lock(&lock);
+    b->state=BLOCK_SCORED;
+    pthread_cond_signal(&block_scored);
+    pthread_mutex_unlock(&lock);
+  }
+  free(s.words);
+  free(s.doc);
+  free(s.vec);
+  free(s.fvec);
+  return(NULL);
+}
+
+void score_block(BLOCK *b, SCRATCH *s)
+     /* parses the lines of block b into the scratch buffers of the
+	scorer and computes the labels and the values of the decision
+	function. With --latency-report, each query is classified as a
+	batch of its own and timed. */
+{
+  long i,j,k,first,used,queryid,slackid,docid,wnum;
+  double costfactor,time=0,t0=0,tparse=0,ts,te;
+  char *comment;
+  WORD *words;
+
+  first=0;
+  used=0;
+  b->nseg=0;
+  if(latencyfile[0])
+    t0=get_wall_time();
+  for(i=0;i<b->n;i++) {
+    if(used+max_words_doc+1 > s->size) { /* scratch full */
+      time+=score_batch(s,i-first,b->dist+first);
+      first=i;
+      used=0;
+    }
+    if(latencyfile[0])
+      tparse=get_wall_time();
+    words=s->words+used;
+    if(!parse_document_docid(b->text+b->start[i],words,&(b->label[i]),
+			     &queryid,&slackid,&costfactor,&docid,&wnum,
+			     max_words_doc,&comment)) {
+      b->label[i]=0;                          /* empty line */
+      words[0].wnum=0;
+      wnum=1;
+      docid=-1;
+      comment=NULL;
+    }
+    if(model->kernel_parm.kernel_type == LINEAR) {/* For linear kernel,     */
+      for(j=0;(words[j]).wnum != 0;j++) {     /* check if feature numbers   */
+	if((words[j]).wnum>model->totwords)   /* are not larger than in     */
+	  (words[j]).wnum=0;                  /* model. Remove feature if   */
+      }                                       /* necessary.                 */
+    }
+    used+=wnum;
+    /* the same fields create_example(-1,0,0,0.0,create_svector(..))
+       would set */
+    k=i-first;
+    s->vec[k].words=words;
+    s->vec[k].twonorm_sq=-1;
+    s->vec[k].userdefined=comment;
+    s->vec[k].kernel_id=0;
+    s->vec[k].docid=docid;
+    s->vec[k].next=NULL;
+    s->vec[k].factor=1.0;
+    s->vec[k].dense=NULL;
+    s->vec[k].size=-1;
+    s->doc[k].docnum=-1;
+    s->doc[k].kernelid=-1;
+    s->doc[k].queryid=0;
+    s->doc[k].slackid=0;
+    s->doc[k].costfactor=0.0;
+    s->doc[k].fvec=&(s->vec[k]);
+
+    if(!latencyfile[0])
+      continue;
+    if((b->nseg > 0) && (queryid != 0) 
+       && (queryid == b->seg_qid[b->nseg-1])) {
+      b->seg_docs[b->nseg-1]++;
+      continue;
+    }
+    if(b->nseg > 0) { /* document i starts a new query */
+      ts=get_wall_time();
+      time+=score_batch(s,k,b->dist+first);
+      te=get_wall_time();
+      b->seg_time[b->nseg-1]=(tparse-t0)+(te-ts);
+      t0=te-(ts-tparse);  /* the new query took the parsing of i */
+      s->vec[0]=s->vec[k];
+      s->doc[0]=s->doc[k];
+      s->doc[0].fvec=&(s->vec[0]);
+      first=i;
+    }
+    b->seg_qid[b->nseg]=queryid;
+    b->seg_docs[b->nseg]=1;
+    b->nseg++;
+  }
+  time+=score_batch(s,b->n-first,b->dist+first);
+  if(b->nseg > 0)
+    b->seg_time[b->nseg-1]=get_wall_time()-t0;
+
+  pthread_mutex_lock(&lock);
+  runtime+=time;
+  pthread_mutex_unlock(&lock);
+}
+
+double score_batch(SCRATCH *s, long n, double *dist)
+     /* classifies the first n documents of the scratch buffers and
+	returns the cpu time this took */
 {
   long i;
-  
+  double t1;
+
+  t1=get_thread_runtime();
+  if(model->kernel_parm.kernel_type == LINEAR) {   /* linear kernel */
+    for(i=0;i<n;i++)
+      dist[i]=classify_example_linear(model,&(s->doc[i]));
+  }
+  else if(model->kernel_block) {  /* all documents against each tile */
+    for(i=0;i<n;i++)
+      s->fvec[i]=&(s->vec[i]);
+    kernel_block_eval_many(&model->kernel_parm,model->kernel_block,s->fvec,
+			   n,dist);
+    for(i=0;i<n;i++)
+      dist[i]-=model->b;
+  }
+  else {                                           /* non-linear kernel */
+    for(i=0;i<n;i++)
+      dist[i]=classify_example(model,&(s->doc[i]));
+  }
+  return(get_thread_runtime()-t1);
+}
+
+void *writer(void *arg)
+     /* prints the predictions of the scored blocks in file order and
+	counts the accuracy */
+{
+  BLOCK *b;
+  long seq,i,last,lastqid=0,maxqueries=0;
+  double dist,doc_label;
+
+  for(seq=0;;seq++) {
+    b=&ring[seq%ring_size];
+    pthread_mutex_lock(&lock);
+    while((!reading_done || (seq<blocks_read))
+	  && ((seq>=blocks_read) || (b->state != BLOCK_SCORED)))
+      pthread_cond_wait(&block_scored,&lock);
+    last=(seq>=blocks_read);
+    pthread_mutex_unlock(&lock);
+    if(last)
+      break;
+
+    for(i=0;i<b->n;i++) {
+      dist=b->dist[i];
+      doc_label=b->label[i];
+      totdoc++;
+      if(dist>0) {
+	if(pred_format==0) { /* old weired output format */
+	  fprintf(predfl,"%.8g:+1 %.8g:-1\n",dist,-dist);
+	}
+	if(doc_label>0) correct++; else incorrect++;
+	if(doc_label>0) res_a++; else res_b++;
+      }
+      else {
+	if(pred_format==0) { /* old weired output format */
+	  fprintf(predfl,"%.8g:-1 %.8g:+1\n",-dist,dist);
+	}
+	if(doc_label<0) correct++; else incorrect++;
+	if(doc_label>0) res_c++; else res_d++;
+      }
+      if(pred_format==1) { /* output the value of decision function */
+	fprintf(predfl,"%.8g\n",dist);
+      }
+      if((int)(0.01+(doc_label*doc_label)) != 1)
+	{ no_accuracy=1; } /* test data is not binary labeled */
+      if(verbosity>=2) {
+	if(totdoc % 100 == 0) {
+	  printf("%ld..",totdoc); fflush(stdout);
+	}
+      }
+    }
+    for(i=0;i<b->nseg;i++) {
+      if((i == 0) && (nqueries > 0) && (b->seg_qid[0] != 0)
+	 && (b->seg_qid[0] == lastqid)) { /* query continues from the
+					     previous block */
+	qlatency[nqueries-1]+=b->seg_time[0];
+	qdocs[nqueries-1]+=b->seg_docs[0];
+	continue;
+      }
+      if(nqueries == maxqueries) {
+	maxqueries=2*maxqueries+1024;
+	qlatency=(double *)realloc(qlatency,sizeof(double)*maxqueries);
+	qdocs=(long *)realloc(qdocs,sizeof(long)*maxqueries);
+      }
+      qlatency[nqueries]=b->seg_time[i];
+      qdocs[nqueries++]=b->seg_docs[i];
+    }
+    if(b->nseg > 0)
+      lastqid=b->seg_qid[b->nseg-1];
+
+    pthread_mutex_lock(&lock);
+    b->state=BLOCK_FREE;
+    pthread_cond_signal(&block_freed);
+    pthread_mutex_unlock(&lock);
+  }
+  return(NULL);
+}
+
+void read_input_parameters(int argc, char **argv, char *docfile,
+			   char *modelfile, char *predictionsfile,
+			   char *latencyfile, long int *verbosity, long int *pred_format,
+			   long int *threads)
+{
+  long i;
+
   /* set default */
   strcpy (modelfile, "svm_model");
-  strcpy (predictionsfile, "svm_predictions"); 
+  strcpy (predictionsfile, "svm_predictions");
+  latencyfile[0]=0;
   (*verbosity)=2;
   (*pred_format)=1;
+  (*threads)=1;
 
   for(i=1;(i<argc) && ((argv[i])[0] == '-');i++) {
-    switch ((argv[i])[1]) 
-      { 
+    switch ((argv[i])[1])
+      {
       case 'h': print_help(); exit(0);
       case 'v': i++; (*verbosity)=atol(argv[i]); break;
       case 'f': i++; (*pred_format)=atol(argv[i]); break;
+      case 'j': i++; (*threads)=atol(argv[i]); break;
+      case '-': if(strcmp(argv[i],"--latency-report") == 0) {
+		  i++; strcpy(latencyfile,argv[i]); break;
+		}
+		printf("\nUnrecognized option %s!\n\n",argv[i]);
+		print_help();
+		exit(0);
       default: printf("\nUnrecognized option %s!\n\n",argv[i]);
 	       print_help();
 	       exit(0);
@@ -180,6 +511,11 @@ void read_input_parameters(int argc, char **argv, char *docfile,
     print_help();
     exit(0);
   }
+  if((*threads)<1) {
+    printf("\nThe number of scoring threads must be at least 1!\n\n");
+    print_help();
+    exit(0);
+  }
 }
 
 void print_help(void)
@@ -190,7 +526,15 @@ void print_help(void)
   printf("options: -h         -> this help\n");
   printf("         -v [0..3]  -> verbosity level (default 2)\n");
   printf("         -f [0,1]   -> 0: old output format of V1.0\n");
-  printf("                    -> 1: output the value of decision function (default)\n\n");
+  printf("                    -> 1: output the value of decision function (default)\n");
+  printf("         -j int     -> number of threads that parse and classify the\n");
+  printf("                       examples (default 1)\n");
+  printf("         --latency-report file\n");
+  printf("                    -> write the wall-clock time to parse and classify\n");
+  printf("                       each query (run of lines with the same qid, or\n");
+  printf("                       single line without qid) as percentiles,\n");
+  printf("                       documents per second, and latency by query size\n");
+  printf("                       to file in JSON format\n\n");
 }
 
 
@@ -19,13 +19,19 @@
 # include "ctype.h"
 # include "svm_common.h"
 # include "kernel.h"           /* this contains a user supplied kernel */
+# include <sys/types.h>
+# include <sys/stat.h>
+# include <sys/mman.h>
+# include <fcntl.h>
+# include <unistd.h>
 
 #define MAX(x,y)      ((x) < (y) ? (y) : (x))
 #define MIN(x,y)      ((x) > (y) ? (y) : (x))
 #define SIGN(x)       ((x) > (0) ? (1) : (((x) < (0) ? (-1) : (0))))
 
 long   verbosity;              /* verbosity level (0-4) */
-long   kernel_cache_statistic;
+long   kernel_cache_statistic;  /* approximate when kernel rows are
+				   computed by several threads */
 
 double classify_example(MODEL *model, DOC *ex) 
      /* classifies one example */
@@ -35,7 +41,13 @@ double classify_example(MODEL *model, DOC *ex)
 
   if((model->kernel_parm.kernel_type == LINEAR) && (model->lin_weights))
     return(classify_example_linear(model,ex));
+  if(model->kernel_parm.kernel_type == POLY_EXPANDED)
+    return(classify_example_poly_expanded(model,ex));
 	   
+  if(model->kernel_block)
+    return(kernel_block_eval(&model->kernel_parm,model->kernel_block,NULL,0,
+			     ex->fvec,NULL)-model->b);
+
   dist=0;
   for(i=1;i<model->sv_num;i++) {  
     dist+=kernel(&model->kernel_parm,model->supvec[i],ex)*model->alpha[i];
@@ -43,6 +55,29 @@ double classify_example(MODEL *model, DOC *ex)
   return(dist-model->b);
 }
 
+void classify_examples(MODEL *model, DOC **ex, long n, double *dist)
+     /* classifies the n examples in ex and returns the results in
+	dist. With a kernel block, the examples are evaluated in
+	batches. */
+{
+  SVECTOR **b;
+  long i;
+
+  if(model->kernel_block) {
+    b=(SVECTOR **)my_malloc(sizeof(SVECTOR *)*(n+1));
+    for(i=0;i<n;i++)
+      b[i]=ex[i]->fvec;
+    kernel_block_eval_many(&model->kernel_parm,model->kernel_block,b,n,dist);
+    for(i=0;i<n;i++)
+      dist[i]-=model->b;
+    free(b);
+  }
+  else {
+    for(i=0;i<n;i++)
+      dist[i]=classify_example(model,ex[i]);
+  }
+}
+
 double classify_example_linear(MODEL *model, DOC *ex) 
      /* classifies example for linear kernel */
      
@@ -61,6 +96,23 @@ double classify_example_linear(MODEL *model, DOC *ex)
   return(sum-model->b);
 }
 
+double classify_example_poly_expanded(MODEL *model, DOC *ex) 
+     /* classifies example for a polynomial kernel that is stored as
+	weight vector over its explicit feature map */
+     /* important: the model must have the linear weight vector
+	computed, which read_model does for this kernel type */
+{
+  double sum=0;
+  SVECTOR *phi,*f;
+
+  phi=create_svector_poly2(ex->fvec,&(model->kernel_parm));
+  /* products with features that did not occur in training are zero */
+  for(f=phi;f;f=f->next)  
+    sum+=f->factor*sprod_ns_boundcheck(model->lin_weights,f,model->totwords);
+  free_svector(phi);
+  return(sum-model->b);
+}
+
 
 double kernel(KERNEL_PARM *kernel_parm, DOC *a, DOC *b) 
      /* calculate the kernel function */
@@ -111,24 +163,100 @@ double single_kernel(KERNEL_PARM *kernel_parm, SVECTOR *a, SVECTOR *b)
      /* calculate the kernel function between two vectors, lists are
 	not followed. factor is not used and kernel_id is not checked. */
 {
-  kernel_cache_statistic++;
+#pragma omp atomic
+  kernel_cache_statistic++; /* svm_struct_classify -j calls it in threads */
+  if(kernel_parm->kernel_type == RBF) {
+    if(a->twonorm_sq<0) a->twonorm_sq=sprod_ss(a,a);
+    if(b->twonorm_sq<0) b->twonorm_sq=sprod_ss(b,b);
+  }
+  return(single_kernel_value(kernel_parm,a,b));
+}
+
+double kernel_value(KERNEL_PARM *kernel_parm, DOC *a, DOC *b, long *evals) 
+     /* calculate the kernel function like kernel, but a, b and the
+	kernel_cache_statistic are left unchanged, so that it can be
+	called from several threads. The number of kernel evaluations
+	is added to evals. For the RBF kernel, call kernel_twonorms on
+	a and b first, otherwise the norms are recomputed each time. */
+{
+  double sum=0;
+  SVECTOR *fa,*fb;
+
+  if(kernel_parm->kernel_type == GRAM) 
+    return(kernel(kernel_parm,a,b));
+  for(fa=a->fvec;fa;fa=fa->next) { 
+    for(fb=b->fvec;fb;fb=fb->next) {
+      if(fa->kernel_id == fb->kernel_id) {
+	sum+=fa->factor*fb->factor*single_kernel_value(kernel_parm,fa,fb);
+	(*evals)++;
+      }
+    }
+  }
+  return(sum);
+}
+
+void kernel_twonorms(KERNEL_PARM *kernel_parm, DOC *a)
+     /* computes the squared two-norms of the vectors of a that the
+	RBF kernel needs, if they are not known yet */
+{
+  SVECTOR *f;
+
+  if(kernel_parm->kernel_type != RBF)
+    return;
+  for(f=a->fvec;f;f=f->next) 
+    if(f->twonorm_sq<0) 
+      f->twonorm_sq=sprod_ss(f,f);
+}
+
+double single_kernel_value(KERNEL_PARM *kernel_parm, SVECTOR *a, SVECTOR *b) 
+     /* calculate the kernel function between two vectors like
+	single_kernel, without writing to a, b or global state */
+{
+  double na,nb;
+
+  if(kernel_parm->store && (a->docid >= 0) && (b->docid >= 0))
+    return(kernel_store_value(kernel_parm,a->docid,b->docid));
   switch(kernel_parm->kernel_type) {
     case LINEAR: /* linear */ 
             return(sprod_ss(a,b)); 
     case POLY:   /* polynomial */
+    case POLY_EXPANDED:
             return(pow(kernel_parm->coef_lin*sprod_ss(a,b)+kernel_parm->coef_const,(double)kernel_parm->poly_degree)); 
     case RBF:    /* radial basis function */
-            if(a->twonorm_sq<0) a->twonorm_sq=sprod_ss(a,a);
-            if(b->twonorm_sq<0) b->twonorm_sq=sprod_ss(b,b);
-            return(exp(-kernel_parm->rbf_gamma*(a->twonorm_sq-2*sprod_ss(a,b)+b->twonorm_sq)));
+            na=(a->twonorm_sq<0)?sprod_ss(a,a):a->twonorm_sq;
+            nb=(b->twonorm_sq<0)?sprod_ss(b,b):b->twonorm_sq;
+            return(exp(-kernel_parm->rbf_gamma*(na-2*sprod_ss(a,b)+nb)));
     case SIGMOID:/* sigmoid neural net */
             return(tanh(kernel_parm->coef_lin*sprod_ss(a,b)+kernel_parm->coef_const)); 
     case CUSTOM: /* custom-kernel supplied in file kernel.h*/
             return(custom_kernel(kernel_parm,a,b)); 
+    case PRECOMPUTED: /* precomputed kernel needs did: of both documents */
+            printf("Error: Precomputed kernel needs kernel matrix and did: of document\n"); exit(1);
     default: printf("Error: Unknown kernel function\n"); exit(1);
   }
 }
 
+double kernel_store_value(KERNEL_PARM *kernel_parm, long i, long j)
+     /* returns the kernel between the documents with docid i and j
+	from the kernel store of kernel_parm */
+{
+  KERNEL_STORE *store=kernel_parm->store;
+  double value;
+
+  if((i >= store->n) || (j >= store->n)) {
+    printf("\nDocument id %ld is larger than the kernel matrix (%ld documents)!\n",
+	   MAX(i,j)+1,store->n);
+    exit(1);
+  }
+  if(store->full)
+    value=store->values[i*store->n+j];
+  else
+    value=store->values[MAX(i,j)*(MAX(i,j)+1)/2+MIN(i,j)];
+  if(store->sqdist)
+    return(exp(-kernel_parm->rbf_gamma*value));
+  return(value);
+}
+
 SVECTOR *create_svector(WORD *words,char *userdefined,double factor)
 {
   SVECTOR *vec;
@@ -159,6 +287,7 @@ SVECTOR *create_svector(WORD *words,char *userdefined,double factor)
     vec->userdefined = NULL;
 
   vec->kernel_id=0;
+  vec->docid=-1;
   vec->next=NULL;
   vec->factor=factor;
   vec->dense=NULL;
@@ -176,6 +305,7 @@ SVECTOR *create_svector_shallow(WORD *words,char *userdefined,double factor)
   vec->twonorm_sq=-1;
   vec->userdefined=userdefined;
   vec->kernel_id=0;
+  vec->docid=-1;
   vec->next=NULL;
   vec->factor=factor;
   vec->dense=NULL;
@@ -218,6 +348,7 @@ SVECTOR *create_svector_n_r(double *nonsparsevec, long maxfeatnum, char *userdef
     vec->userdefined = NULL;
 
   vec->kernel_id=0;
+  vec->docid=-1;
   vec->next=NULL;
   vec->factor=factor;
   vec->dense=NULL;
@@ -234,12 +365,60 @@ SVECTOR *create_svector_nvector_n(double *nonsparsevec, long maxfeatnum, char *u
   return(vec);
 }
 
+SVECTOR *create_svector_poly2(SVECTOR *vec, KERNEL_PARM *kernel_parm)
+     /* returns the explicit feature map phi(vec) of the polynomial
+	kernel of degree 2, so that phi(a)*phi(b)=(s a*b+c)^2. With
+	u=(sqrt(c),sqrt(s)*vec), feature j*(j+1)/2+i+1 holds u_i*u_j
+	for i<=j, multiplied by sqrt(2) for i<j. Lists are mapped
+	element by element, keeping factors and kernel_id's. */
+{
+  SVECTOR *phi;
+  WORD    *words;
+  double  *u,w;
+  long    *fnum,n,i,j,k;
+
+  if(!vec) 
+    return(NULL);
+  n=num_nonzero_svector(vec);
+  u=(double *)my_malloc(sizeof(double)*(n+1));
+  fnum=(long *)my_malloc(sizeof(long)*(n+1));
+  u[0]=sqrt(kernel_parm->coef_const);
+  fnum[0]=0;
+  for(i=0;i<n;i++) {
+    u[i+1]=sqrt(kernel_parm->coef_lin)*vec->words[i].weight;
+    fnum[i+1]=vec->words[i].wnum;
+  }
+  words=(WORD *)my_malloc(sizeof(WORD)*((n+1)*(n+2)/2+1));
+  /* feature numbers increase with j; stop before they overflow */
+  for(k=0,j=0;(j<=n) && (fnum[j]*(fnum[j]+1)/2+fnum[j]+1 <= FNUM_MAX);j++) {
+    for(i=0;i<=j;i++) {
+      w=u[i]*u[j];
+      if(i<j) 
+	w*=M_SQRT2;
+      if(w != 0) {
+	words[k].wnum=fnum[j]*(fnum[j]+1)/2+fnum[i]+1;
+	words[k].weight=(FVAL)w;
+	k++;
+      }
+    }
+  }
+  words[k].wnum=0;
+  phi=create_svector(words,vec->userdefined,vec->factor);
+  phi->kernel_id=vec->kernel_id;
+  phi->next=create_svector_poly2(vec->next,kernel_parm);
+  free(words);
+  free(fnum);
+  free(u);
+  return(phi);
+}
+
 SVECTOR *copy_svector(SVECTOR *vec)
 {
   SVECTOR *newvec=NULL;
   if(vec) {
     newvec=create_svector(vec->words,vec->userdefined,vec->factor);
     newvec->kernel_id=vec->kernel_id;
+    newvec->docid=vec->docid;
     newvec->size=vec->size;
     if(vec->dense)
       newvec->dense=copy_nvector(vec->dense,vec->size);
@@ -255,6 +434,7 @@ SVECTOR *copy_svector_shallow(SVECTOR *vec)
   if(vec) {
     newvec=create_svector_shallow(vec->words,vec->userdefined,vec->factor);
     newvec->kernel_id=vec->kernel_id;
+    newvec->docid=vec->docid;
     if(vec->dense)
       newvec->dense=vec->dense;
     newvec->size=vec->size;
@@ -935,6 +1115,160 @@ void add_weight_vector_to_linear_model(MODEL *model)
   }
 }
 
+typedef struct feature_bound {
+  double bound;
+  long   fnum;
+} FEATURE_BOUND;
+
+int compare_feature_bound(const void *a, const void *b)
+     /* decreasing bound, then increasing feature number */
+{
+  const FEATURE_BOUND *fa=(const FEATURE_BOUND *)a,*fb=(const FEATURE_BOUND *)b;
+
+  if(fa->bound != fb->bound)
+    return((fa->bound < fb->bound) - (fa->bound > fb->bound));
+  return((fa->fnum > fb->fnum) - (fa->fnum < fb->fnum));
+}
+
+LINEAR_BOUND *create_linear_bound(MODEL *model, double *maxabs)
+     /* orders the features of a linear model by the largest
+	contribution |w_j|*maxabs[j] they can make to a score. maxabs
+	has the entries 1..totwords. The model must have its weight
+	vector (add_weight_vector_to_linear_model). */
+{
+  LINEAR_BOUND *bound;
+  FEATURE_BOUND *fb;
+  long j,n=0;
+
+  fb=(FEATURE_BOUND *)my_malloc(sizeof(FEATURE_BOUND)*(model->totwords+1));
+  for(j=1;j<=model->totwords;j++) {
+    fb[n].bound=fabs(model->lin_weights[j])*maxabs[j];
+    fb[n].fnum=j;
+    if(fb[n].bound > 0)
+      n++;
+  }
+  qsort(fb,n,sizeof(FEATURE_BOUND),compare_feature_bound);
+  bound=(LINEAR_BOUND *)my_malloc(sizeof(LINEAR_BOUND));
+  bound->n=n;
+  bound->order=(long *)my_malloc(sizeof(long)*(n+1));
+  bound->rest=(double *)my_malloc(sizeof(double)*(n+1));
+  bound->maxabs=(double *)my_malloc(sizeof(double)*(model->totwords+1));
+  bound->rest[n]=0;
+  for(j=n-1;j>=0;j--) {
+    bound->order[j]=fb[j].fnum;
+    bound->rest[j]=bound->rest[j+1]+fb[j].bound;
+  }
+  bound->maxabs[0]=0;
+  for(j=1;j<=model->totwords;j++)
+    bound->maxabs[j]=maxabs[j];
+  free(fb);
+  return(bound);
+}
+
+void free_linear_bound(LINEAR_BOUND *bound)
+{
+  if(bound) {
+    free(bound->order);
+    free(bound->rest);
+    free(bound->maxabs);
+    free(bound);
+  }
+}
+
+long bounded_linear_products(MODEL *model, LINEAR_BOUND *bound, FVAL *x,
+			     double *prod, double threshold, long *mults)
+     /* computes prod[j]=w_j*x[j] for the features of the dense
+	document x, by decreasing bound. Stops and returns 0 as soon as
+	the score w*x-b is certain to be at most threshold; returns 1,
+	if all products were computed. Then the score is the sum of
+	prod over the features of the document, added up in the order
+	of classify_example_linear. |x[j]| must be at most
+	bound->maxabs[j]. Products of features that are not in the order
+	stay untouched (zero). mults counts the non-zero products
+	computed. */
+{
+  long t,j,n=0;
+  double s=0,limit;
+
+  /* the score is at most s+rest[t]-b. The margin covers the rounding
+     of s, which is summed in a different order than the score. */
+  limit=threshold+model->b+1E-9*(bound->rest[0]+fabs(model->b));
+  for(t=0;t<bound->n;t++) {
+    if(s+bound->rest[t] <= limit) {
+      (*mults)+=n;
+      return(0);
+    }
+    j=bound->order[t];
+    prod[j]=model->lin_weights[j]*(double)x[j];
+    s+=prod[j];
+    n+=(x[j] != 0);
+  }
+  (*mults)+=n;
+  return(1);
+}
+
+WEIGHT_MATRIX *create_weight_matrix(MODEL **models, long m)
+     /* stacks the weight vectors of the m linear models, which must
+	have them (add_weight_vector_to_linear_model) */
+{
+  WEIGHT_MATRIX *wm;
+  long j,k;
+
+  wm=(WEIGHT_MATRIX *)my_malloc(sizeof(WEIGHT_MATRIX));
+  wm->m=m;
+  wm->totwords=0;
+  for(k=0;k<m;k++)
+    if(models[k]->totwords > wm->totwords)
+      wm->totwords=models[k]->totwords;
+  wm->w=(double *)my_malloc(sizeof(double)*(wm->totwords+1)*m);
+  wm->b=(double *)my_malloc(sizeof(double)*m);
+  for(k=0;k<m;k++) {
+    for(j=0;j<=wm->totwords;j++)
+      wm->w[j*m+k]=(j<=models[k]->totwords) ? models[k]->lin_weights[j] : 0;
+    wm->b[k]=models[k]->b;
+  }
+  return(wm);
+}
+
+void free_weight_matrix(WEIGHT_MATRIX *wm)
+{
+  if(!wm) return;
+  free(wm->w);
+  free(wm->b);
+  free(wm);
+}
+
+void classify_examples_stacked(WEIGHT_MATRIX *wm, DOC **ex, long n,
+			       double *dist)
+     /* scores the n examples with all models of wm: dist[i*m+k] is
+	the score of example i under model k, the same value as
+	classify_example_linear. Each feature of an example is read
+	once and multiplied with a row of the matrix. */
+{
+  long i,k,m=wm->m;
+  double *s,*row,v;
+  SVECTOR *f;
+  WORD *w;
+
+  for(i=0;i<n;i++) {
+    s=dist+i*m;
+    for(k=0;k<m;k++)
+      s[k]=0;
+    for(f=ex[i]->fvec;f;f=f->next) {
+      for(w=f->words;w->wnum;w++) {
+	if(w->wnum>wm->totwords)
+	  continue;
+	v=f->factor*(double)w->weight;
+	row=wm->w+w->wnum*m;
+	for(k=0;k<m;k++)
+	  s[k]+=row[k]*v;
+      }
+    }
+    for(k=0;k<m;k++)
+      s[k]-=wm->b[k];
+  }
+}
+
 void add_dense_vectors_to_model(MODEL *model)
      /* for each support vector, add a dense vector
 	representation. This makes inner products much faster, if the
@@ -945,6 +1279,335 @@ void add_dense_vectors_to_model(MODEL *model)
     add_dense_vector_to_svector(model->supvec[i]->fvec,n);
 }
 
+void add_kernel_block_to_model(MODEL *model)
+     /* packs the support vectors into one dense block weighted by
+	their alphas, so that classify_example can evaluate the
+	non-linear kernel for all of them in one batch. Does nothing, if
+	the kernel is not supported or the vectors are too sparse. */
+{
+  SVECTOR **lists;
+  long i;
+
+  model->kernel_block=NULL;
+  if(model->sv_num<=1)
+    return;
+  lists=(SVECTOR **)my_malloc(sizeof(SVECTOR *)*model->sv_num);
+  for(i=1;i<model->sv_num;i++) 
+    lists[i-1]=model->supvec[i]->fvec;
+  if(kernel_block_applicable(&model->kernel_parm,lists,model->sv_num-1,
+			     model->totwords+1)) 
+    model->kernel_block=create_kernel_block(lists,model->alpha+1,
+					    model->sv_num-1,
+					    model->totwords+1);
+  free(lists);
+}
+
+long kernel_block_applicable(KERNEL_PARM *kernel_parm, SVECTOR **lists, 
+			     long n, long dim)
+     /* decides whether packing the n lists into a dense block with
+	rows of length dim pays off. The kernel has to be one of the
+	built-in non-linear kernels and at least a quarter of the dense
+	entries have to be non-zero. Kernel values from a kernel store
+	are looked up instead. */
+{
+  long i,rows=0,nonzero=0;
+  SVECTOR *f;
+  WORD *w;
+
+  if((kernel_parm->kernel_type != POLY) && (kernel_parm->kernel_type != RBF) 
+     && (kernel_parm->kernel_type != SIGMOID))
+    return(0);
+  if(kernel_parm->store)
+    return(0);
+  for(i=0;i<n;i++) {
+    for(f=lists[i];f;f=f->next) {
+      rows++;
+      for(w=f->words;w->wnum;w++) 
+	nonzero++;
+    }
+  }
+  if((rows == 0) || ((double)rows*dim > KERNEL_BLOCK_MAXELEMS))
+    return(0);
+  return(4*nonzero >= rows*dim);
+}
+
+KERNEL_BLOCK *create_kernel_block(SVECTOR **lists, double *listcoef, long n,
+				  long dim)
+     /* packs the n lists of SVECTORs into one contiguous block of
+	dense rows. The coefficient of each row is the factor of its
+	SVECTOR, multiplied by listcoef[i] if listcoef is not
+	NULL. Features with numbers of dim or larger are dropped from
+	the rows, but not from the norms used by the RBF kernel. */
+{
+  KERNEL_BLOCK *block;
+  SVECTOR *f;
+  WORD *w;
+  FVAL *x;
+  long i,j,r;
+
+  block=(KERNEL_BLOCK *)my_malloc(sizeof(KERNEL_BLOCK));
+  block->n=n;
+  block->dim=dim;
+  block->rows=0;
+  for(i=0;i<n;i++) 
+    for(f=lists[i];f;f=f->next) 
+      block->rows++;
+  block->x=(FVAL *)my_malloc(sizeof(FVAL)*block->rows*dim);
+  block->twonorm_sq=(double *)my_malloc(sizeof(double)*block->rows);
+  block->coef=(double *)my_malloc(sizeof(double)*block->rows);
+  block->kernel_id=(long *)my_malloc(sizeof(long)*block->rows);
+  block->start=(long *)my_malloc(sizeof(long)*(n+1));
+  block->list=(long *)my_malloc(sizeof(long)*block->rows);
+  r=0;
+  for(i=0;i<n;i++) {
+    block->start[i]=r;
+    for(f=lists[i];f;f=f->next) {
+      x=block->x+r*dim;
+      for(j=0;j<dim;j++)
+	x[j]=0;
+      for(w=f->words;w->wnum;w++) 
+	if(w->wnum<dim)
+	  x[w->wnum]=w->weight;
+      block->twonorm_sq[r]=sprod_ss(f,f);
+      block->coef[r]=f->factor;
+      if(listcoef)
+	block->coef[r]*=listcoef[i];
+      block->kernel_id[r]=f->kernel_id;
+      block->list[r]=i;
+      r++;
+    }
+  }
+  block->start[n]=r;
+  return(block);
+}
+
+void free_kernel_block(KERNEL_BLOCK *block)
+{
+  if(block) {
+    free(block->x);
+    free(block->twonorm_sq);
+    free(block->coef);
+    free(block->kernel_id);
+    free(block->start);
+    free(block->list);
+    free(block);
+  }
+}
+
+void unpack_kernel_block_query(KERNEL_BLOCK *block, SVECTOR *g, FVAL *qx,
+			       double *qnorm)
+     /* writes g as dense row of the same length as the rows of block */
+{
+  long j;
+  WORD *w;
+
+  for(j=0;j<block->dim;j++)
+    qx[j]=0;
+  for(w=g->words;w->wnum;w++) 
+    if(w->wnum<block->dim)
+      qx[w->wnum]=w->weight;
+  (*qnorm)=(g->twonorm_sq>=0) ? g->twonorm_sq : sprod_ss(g,g);
+}
+
+void kernel_block_tiles(KERNEL_PARM *kernel_parm, KERNEL_BLOCK *block, 
+			long *rowidx, long *rowsel, long rows, 
+			FVAL *qx, double *qnorm, double *qfactor, long *qid,
+			long nq, double *kval, double *qsum)
+     /* Multiplies the rows rowidx[0..rows-1] of block (the first
+	rows rows, if rowidx is NULL) with the nq unpacked vectors in
+	qx, tile by tile, and applies the kernel function to each tile
+	of inner products. The kernel values, weighted with the
+	coefficients of the rows and qfactor, are summed up per vector
+	into qsum[q] and, if kval is not NULL, into kval[rowsel[r]] for
+	the list of the row. Does not count the evaluations in
+	kernel_cache_statistic; that is left to the caller. */
+{
+  long   dim=block->dim,q,r,r0,nr,j,ri[KERNEL_BLOCK_ROWS];
+  double dot[KERNEL_BLOCK_QUERIES*KERNEL_BLOCK_ROWS];
+  double rnorm[KERNEL_BLOCK_ROWS],rcoef[KERNEL_BLOCK_ROWS];
+  double *d,s,v,gamma,coef_lin,coef_const;
+  FVAL   *xr,*qv;
+
+  gamma=kernel_parm->rbf_gamma;
+  coef_lin=kernel_parm->coef_lin;
+  coef_const=kernel_parm->coef_const;
+  for(q=0;q<nq;q++)
+    qsum[q]=0;
+
+  for(r0=0;r0<rows;r0+=KERNEL_BLOCK_ROWS) {
+    nr=MIN(KERNEL_BLOCK_ROWS,rows-r0);
+    /* inner products of the tile with all vectors; each row is
+       loaded once and reused for all of them */
+    for(r=0;r<nr;r++) {
+      ri[r]=rowidx ? rowidx[r0+r] : r0+r;
+      xr=block->x+ri[r]*dim;
+      rnorm[r]=block->twonorm_sq[ri[r]];
+      rcoef[r]=block->coef[ri[r]];
+      for(q=0;q<nq;q++) {
+	qv=qx+q*dim;
+	s=0;
+#pragma omp simd reduction(+:s)
+	for(j=0;j<dim;j++)
+	  s+=xr[j]*qv[j];   /* FVAL products, as in sprod_ss */
+	dot[q*KERNEL_BLOCK_ROWS+r]=s;
+      }
+    }
+    /* apply the kernel function to the whole tile */
+    for(q=0;q<nq;q++) {
+      d=dot+q*KERNEL_BLOCK_ROWS;
+      switch(kernel_parm->kernel_type) {
+      case POLY:
+	for(r=0;r<nr;r++) {
+	  v=coef_lin*d[r]+coef_const;
+	  s=1;
+	  for(j=0;j<kernel_parm->poly_degree;j++)
+	    s*=v;
+	  d[r]=s;
+	}
+	break;
+      case RBF:
+#pragma omp simd
+	for(r=0;r<nr;r++) 
+	  d[r]=exp(-gamma*(rnorm[r]-2*d[r]+qnorm[q]));
+	break;
+      case SIGMOID:
+#pragma omp simd
+	for(r=0;r<nr;r++) 
+	  d[r]=tanh(coef_lin*d[r]+coef_const);
+	break;
+      default: printf("Error: Kernel function not supported by kernel block\n"); exit(1);
+      }
+      for(r=0;r<nr;r++) {
+	if(block->kernel_id[ri[r]] == qid[q]) {
+	  v=rcoef[r]*qfactor[q]*d[r];
+	  qsum[q]+=v;
+	  if(kval)
+	    kval[rowsel[r0+r]]+=v;
+	}
+      }
+    }
+  }
+}
+
+long kernel_block_select(KERNEL_BLOCK *block, long *lists, long nlists,
+			 long **rowidx, long **rowsel)
+     /* returns the rows of the lists lists[0..nlists-1] (or of all
+	lists, if lists is NULL) and for each row the position of its
+	list in lists. */
+{
+  long k,i,r,rows,nsel;
+
+  nsel=lists ? nlists : block->n;
+  rows=0;
+  for(k=0;k<nsel;k++) {
+    i=lists ? lists[k] : k;
+    rows+=block->start[i+1]-block->start[i];
+  }
+  (*rowidx)=(long *)my_malloc(sizeof(long)*rows);
+  (*rowsel)=(long *)my_malloc(sizeof(long)*rows);
+  rows=0;
+  for(k=0;k<nsel;k++) {
+    i=lists ? lists[k] : k;
+    for(r=block->start[i];r<block->start[i+1];r++) {
+      (*rowidx)[rows]=r;
+      (*rowsel)[rows]=k;
+      rows++;
+    }
+  }
+  return(rows);
+}
+
+double kernel_block_eval(KERNEL_PARM *kernel_parm, KERNEL_BLOCK *block,
+			 long *lists, long nlists, SVECTOR *b, double *kval)
+     /* computes the kernel between the lists lists[0..nlists-1] of the
+	block (all lists of the block, if lists is NULL) and the list
+	b, including the coefficients of the rows and the factors of
+	b. If kval is not NULL, the value for the k-th selected list is
+	returned in kval[k]. Returns the sum over all selected lists. */
+     /* Only uses local buffers, so it can be called from several
+	threads at once. */
+{
+  long   k,nq,rows,*rowidx=NULL,*rowsel,qid[KERNEL_BLOCK_QUERIES],evals=0;
+  double qnorm[KERNEL_BLOCK_QUERIES],qfactor[KERNEL_BLOCK_QUERIES];
+  double qsum[KERNEL_BLOCK_QUERIES],sum;
+  FVAL   qbuf[KERNEL_BLOCK_QUERIES*KERNEL_BLOCK_STACKDIM],*qx=qbuf;
+  SVECTOR *g;
+
+  if(lists)
+    rows=kernel_block_select(block,lists,nlists,&rowidx,&rowsel);
+  else {
+    rows=block->rows;
+    rowsel=block->list;
+  }
+  if(kval)
+    for(k=0;k<(lists ? nlists : block->n);k++) 
+      kval[k]=0;
+  if(block->dim > KERNEL_BLOCK_STACKDIM)
+    qx=(FVAL *)my_malloc(sizeof(FVAL)*KERNEL_BLOCK_QUERIES*block->dim);
+  sum=0;
+  for(g=b;g;) {  /* take the vectors of b a few at a time */
+    for(nq=0;g && (nq<KERNEL_BLOCK_QUERIES);g=g->next,nq++) {
+      unpack_kernel_block_query(block,g,qx+nq*block->dim,&qnorm[nq]);
+      qfactor[nq]=g->factor;
+      qid[nq]=g->kernel_id;
+    }
+    kernel_block_tiles(kernel_parm,block,rowidx,rowsel,rows,qx,qnorm,qfactor,
+		       qid,nq,kval,qsum);
+    evals+=rows*nq;
+    for(k=0;k<nq;k++)
+      sum+=qsum[k];
+  }
+  if(qx != qbuf)
+    free(qx);
+  if(lists) {
+    free(rowidx);
+    free(rowsel);
+  }
+#pragma omp atomic
+  kernel_cache_statistic+=evals;
+  return(sum);
+}
+
+void kernel_block_eval_many(KERNEL_PARM *kernel_parm, KERNEL_BLOCK *block,
+			    SVECTOR **b, long nb, double *bval)
+     /* computes bval[i] as the kernel between all lists of block and
+	the list b[i], including all coefficients and factors. The
+	vectors of several b[i] are evaluated against each tile of the
+	block together, which keeps the block in cache. */
+{
+  long   i,k,nq,qid[KERNEL_BLOCK_QUERIES],evals=0;
+  long   owner[KERNEL_BLOCK_QUERIES];
+  double qnorm[KERNEL_BLOCK_QUERIES],qfactor[KERNEL_BLOCK_QUERIES];
+  double qsum[KERNEL_BLOCK_QUERIES];
+  FVAL   qbuf[KERNEL_BLOCK_QUERIES*KERNEL_BLOCK_STACKDIM],*qx=qbuf;
+  SVECTOR *g;
+
+  if(block->dim > KERNEL_BLOCK_STACKDIM)
+    qx=(FVAL *)my_malloc(sizeof(FVAL)*KERNEL_BLOCK_QUERIES*block->dim);
+  for(i=0;i<nb;i++)
+    bval[i]=0;
+  g=NULL;
+  for(i=0;(i<nb) && (!(g=b[i]));i++);
+  while(g) {  /* take the vectors of all b[i] a few at a time */
+    for(nq=0;g && (nq<KERNEL_BLOCK_QUERIES);nq++) {
+      unpack_kernel_block_query(block,g,qx+nq*block->dim,&qnorm[nq]);
+      qfactor[nq]=g->factor;
+      qid[nq]=g->kernel_id;
+      owner[nq]=i;
+      for(g=g->next;(!g) && (++i<nb);g=b[i]);
+    }
+    kernel_block_tiles(kernel_parm,block,NULL,block->list,block->rows,qx,
+		       qnorm,qfactor,qid,nq,NULL,qsum);
+    evals+=block->rows*nq;
+    for(k=0;k<nq;k++)
+      bval[owner[k]]+=qsum[k];
+  }
+  if(qx != qbuf)
+    free(qx);
+#pragma omp atomic
+  kernel_cache_statistic+=evals;
+}
+
 DOC *create_example(long docnum, long queryid, long slackid, 
 		    double costfactor, SVECTOR *fvec)
 {
@@ -1627,6 +2290,13 @@ void write_model(char *modelfile, MODEL *model)
       printf("done)"); fflush(stdout);
     }
   }
+  /* Merge identical support vectors, which svm-struct produces for
+     each constraint that contains them */
+  if((model->kernel_parm.kernel_type != LINEAR) 
+     && (model->kernel_parm.kernel_type != POLY_EXPANDED)) {
+    compact_model=compact_kernel_model(model);
+    model=compact_model;
+  }
 
   if ((modelfl = fopen (modelfile, "w")) == NULL)
   { perror (modelfile); exit (1); }
@@ -1658,6 +2328,8 @@ void write_model(char *modelfile, MODEL *model)
       fprintf(modelfl,"%.32g ",model->alpha[i]*v->factor);
       if(v->kernel_id) 
 	fprintf(modelfl,"qid:%ld ",v->kernel_id);
+      if(v->docid >= 0) 
+	fprintf(modelfl,"did:%ld ",v->docid+1);
       for (j=0; (v->words[j]).wnum; j++) {
 	fprintf(modelfl,"%ld:%.8g ",
 		(long)(v->words[j]).wnum,
@@ -1667,9 +2339,6 @@ void write_model(char *modelfile, MODEL *model)
 	fprintf(modelfl,"#%s\n",v->userdefined);
       else
 	fprintf(modelfl,"#\n");
-    /* NOTE: this could be made more efficient by summing the
-       alpha's of identical vectors before writing them to the
-       file. */
     }
   }
   fclose(modelfl);
@@ -1684,13 +2353,27 @@ void write_model(char *modelfile, MODEL *model)
 MODEL *read_model(char *modelfile)
 {
   FILE *modelfl;
-  long i,queryid,slackid;
+  long i,queryid,slackid,docid;
   double costfactor;
   long max_sv,max_words,ll,wpos;
   char *line,*comment;
   WORD *words;
   char version_buffer[100];
-  MODEL *model;
+  MODEL *model,*compact_model;
+
+  if(is_binary_model(modelfile)) {
+    if(verbosity>=1) {
+      printf("Reading binary model..."); fflush(stdout);
+    }
+    if((model=read_binary_model(modelfile)) == NULL) {
+      printf("\nModel file %s is not a valid binary model!\n",modelfile);
+      exit(1);
+    }
+    if(verbosity>=1) {
+      printf("OK. (%ld support vectors read)\n",model->sv_num-1);
+    }
+    return(model);
+  }
 
   if(verbosity>=1) {
     printf("Reading model..."); fflush(stdout);
@@ -1728,11 +2411,14 @@ MODEL *read_model(char *modelfile)
   model->alpha = (double *)my_malloc(sizeof(double)*model->sv_num);
   model->index=NULL;
   model->lin_weights=NULL;
+  model->kernel_block=NULL;
+  model->kernel_parm.store=NULL;
 
   for(i=1;i<model->sv_num;i++) {
     fgets(line,(int)ll,modelfl);
-    if(!parse_document(line,words,&(model->alpha[i]),&queryid,&slackid,
-		       &costfactor,&wpos,max_words,&comment)) {
+    if(!parse_document_docid(line,words,&(model->alpha[i]),&queryid,
+			     &slackid,&costfactor,&docid,&wpos,max_words,
+			     &comment)) {
       printf("\nParsing error while reading model file in SV %ld!\n%s",
 	     i,line);
       exit(1);
@@ -1742,13 +2428,192 @@ MODEL *read_model(char *modelfile)
 				      0.0,
 				      create_svector(words,comment,1.0));
     model->supvec[i]->fvec->kernel_id=queryid;
+    model->supvec[i]->fvec->docid=docid;
   }
+  if(model->kernel_parm.kernel_type == POLY_EXPANDED)
+    add_weight_vector_to_linear_model(model);
   fclose(modelfl);
   free(line);
   free(words);
   if(verbosity>=1) {
     fprintf(stdout, "OK. (%d support vectors read)\n",(int)(model->sv_num-1));
   }
+  if((model->kernel_parm.kernel_type != LINEAR) 
+     && (model->kernel_parm.kernel_type != POLY_EXPANDED)) {
+    /* models written by older versions may contain duplicates */
+    compact_model=compact_kernel_model(model);
+    if((verbosity>=1) && (compact_model->sv_num < model->sv_num))
+      printf("Merged identical support vectors (%ld remaining).\n",
+	     compact_model->sv_num-1);
+    free_model(model,1);
+    model=compact_model;
+  }
+  return(model);
+}
+
+/* Binary model files hold the same model as text model files, but are
+   read without parsing. They are written in the byte order and type
+   sizes of the machine, which are checked when reading. Layout:
+   magic, sizeof(long), sizeof(WORD), kernel_type, poly_degree (long),
+   rbf_gamma, coef_lin, coef_const (double), custom (char[50]),
+   totwords, totdoc, number of SVECTORs plus 1 (long), b (double), and
+   for each SVECTOR its coefficient alpha*factor (double), kernel_id,
+   docid, number of words (long) and the words without terminator. */
+# define BINARY_MODEL_MAGIC "SVMRBIN1"
+
+long is_binary_model(char *modelfile)
+     /* returns 1, if modelfile starts with the binary model magic */
+{
+  FILE *modelfl;
+  char magic[8];
+  long binary;
+
+  if ((modelfl = fopen (modelfile, "rb")) == NULL)
+    return(0);
+  binary=((fread(magic,1,8,modelfl) == 8) 
+	  && (!memcmp(magic,BINARY_MODEL_MAGIC,8)));
+  fclose(modelfl);
+  return(binary);
+}
+
+void write_binary_model(char *modelfile, MODEL *model)
+{
+  FILE *modelfl;
+  long i,sv_num,nwords,size[2];
+  double coef;
+  SVECTOR *v;
+  MODEL *compact_model=NULL;
+
+  if((model->kernel_parm.kernel_type != LINEAR) 
+     && (model->kernel_parm.kernel_type != POLY_EXPANDED)) {
+    compact_model=compact_kernel_model(model);
+    model=compact_model;
+  }
+
+  if ((modelfl = fopen (modelfile, "wb")) == NULL)
+  { perror (modelfile); exit (1); }
+  size[0]=sizeof(long);
+  size[1]=sizeof(WORD);
+  sv_num=1;
+  for(i=1;i<model->sv_num;i++) 
+    for(v=model->supvec[i]->fvec;v;v=v->next) 
+      sv_num++;
+  fwrite(BINARY_MODEL_MAGIC,1,8,modelfl);
+  fwrite(size,sizeof(long),2,modelfl);
+  fwrite(&model->kernel_parm.kernel_type,sizeof(long),1,modelfl);
+  fwrite(&model->kernel_parm.poly_degree,sizeof(long),1,modelfl);
+  fwrite(&model->kernel_parm.rbf_gamma,sizeof(double),1,modelfl);
+  fwrite(&model->kernel_parm.coef_lin,sizeof(double),1,modelfl);
+  fwrite(&model->kernel_parm.coef_const,sizeof(double),1,modelfl);
+  fwrite(model->kernel_parm.custom,1,sizeof(model->kernel_parm.custom),
+	 modelfl);
+  fwrite(&model->totwords,sizeof(long),1,modelfl);
+  fwrite(&model->totdoc,sizeof(long),1,modelfl);
+  fwrite(&sv_num,sizeof(long),1,modelfl);
+  fwrite(&model->b,sizeof(double),1,modelfl);
+  for(i=1;i<model->sv_num;i++) {
+    for(v=model->supvec[i]->fvec;v;v=v->next) {
+      coef=model->alpha[i]*v->factor;
+      for(nwords=0;v->words[nwords].wnum;nwords++);
+      fwrite(&coef,sizeof(double),1,modelfl);
+      fwrite(&v->kernel_id,sizeof(long),1,modelfl);
+      fwrite(&v->docid,sizeof(long),1,modelfl);
+      fwrite(&nwords,sizeof(long),1,modelfl);
+      fwrite(v->words,sizeof(WORD),nwords,modelfl);
+    }
+  }
+  if(ferror(modelfl) || fclose(modelfl))
+  { perror (modelfile); exit (1); }
+  if(compact_model)
+    free_model(compact_model,1);
+}
+
+MODEL *read_binary_model(char *modelfile)
+     /* reads a model written by write_binary_model. Returns NULL, if
+	the file cannot be read or is not a valid binary model of this
+	machine. Prints nothing. */
+{
+  FILE *modelfl;
+  long j,n,size[2],kernel_id,docid,nwords,filesize;
+  double coef;
+  char magic[8];
+  WORD *words;
+  MODEL *model;
+  int ok;
+
+  if ((modelfl = fopen (modelfile, "rb")) == NULL)
+    return(NULL);
+  fseek(modelfl,0,SEEK_END);
+  filesize=ftell(modelfl);
+  rewind(modelfl);
+  if((fread(magic,1,8,modelfl) != 8) || memcmp(magic,BINARY_MODEL_MAGIC,8)
+     || (fread(size,sizeof(long),2,modelfl) != 2) 
+     || (size[0] != sizeof(long)) || (size[1] != sizeof(WORD))) {
+    fclose(modelfl);
+    return(NULL);
+  }
+  model = (MODEL *)my_malloc(sizeof(MODEL));
+  ok=((fread(&model->kernel_parm.kernel_type,sizeof(long),1,modelfl) == 1)
+      && (fread(&model->kernel_parm.poly_degree,sizeof(long),1,modelfl) == 1)
+      && (fread(&model->kernel_parm.rbf_gamma,sizeof(double),1,modelfl) == 1)
+      && (fread(&model->kernel_parm.coef_lin,sizeof(double),1,modelfl) == 1)
+      && (fread(&model->kernel_parm.coef_const,sizeof(double),1,modelfl) == 1)
+      && (fread(model->kernel_parm.custom,1,
+		sizeof(model->kernel_parm.custom),modelfl) 
+	  == sizeof(model->kernel_parm.custom))
+      && (fread(&model->totwords,sizeof(long),1,modelfl) == 1)
+      && (fread(&model->totdoc,sizeof(long),1,modelfl) == 1)
+      && (fread(&model->sv_num,sizeof(long),1,modelfl) == 1)
+      && (fread(&model->b,sizeof(double),1,modelfl) == 1)
+      && (model->sv_num >= 1) && (model->totwords >= 0)
+      /* each SVECTOR takes at least 4 numbers */
+      && (model->sv_num-1 <= filesize/(4*sizeof(long))));
+  if(!ok) {
+    fclose(modelfl);
+    free(model);
+    return(NULL);
+  }
+  model->kernel_parm.custom[sizeof(model->kernel_parm.custom)-1]=0;
+  model->supvec = (DOC **)my_malloc(sizeof(DOC *)*model->sv_num);
+  model->alpha = (double *)my_malloc(sizeof(double)*model->sv_num);
+  model->index=NULL;
+  model->lin_weights=NULL;
+  model->kernel_block=NULL;
+  model->kernel_parm.store=NULL;
+  model->supvec[0]=NULL;
+  model->alpha[0]=0;
+  for(n=1;n<model->sv_num;n++) {
+    ok=((fread(&coef,sizeof(double),1,modelfl) == 1)
+	&& (fread(&kernel_id,sizeof(long),1,modelfl) == 1)
+	&& (fread(&docid,sizeof(long),1,modelfl) == 1)
+	&& (fread(&nwords,sizeof(long),1,modelfl) == 1)
+	&& (nwords >= 0) && (nwords <= model->totwords));
+    if(!ok)
+      break;
+    words=(WORD *)my_malloc(sizeof(WORD)*(nwords+1));
+    ok=(fread(words,sizeof(WORD),nwords,modelfl) == (size_t)nwords);
+    for(j=0;ok && (j<nwords);j++)   /* increasing, no terminator inside */
+      ok=((words[j].wnum > 0) && (words[j].wnum <= model->totwords)
+	  && ((j == 0) || (words[j-1].wnum < words[j].wnum)));
+    words[nwords].wnum=0;
+    model->alpha[n]=coef;
+    model->supvec[n]=create_example(-1,0,0,0.0,
+				    create_svector_shallow(words,NULL,1.0));
+    model->supvec[n]->fvec->kernel_id=kernel_id;
+    model->supvec[n]->fvec->docid=docid;
+    if(!ok) {
+      n++;
+      break;
+    }
+  }
+  fclose(modelfl);
+  if(!ok) {
+    model->sv_num=n;  /* free the SVs read so far */
+    free_model(model,1);
+    return(NULL);
+  }
+  if(model->kernel_parm.kernel_type == POLY_EXPANDED)
+    add_weight_vector_to_linear_model(model);
   return(model);
 }
 
@@ -1774,6 +2639,7 @@ MODEL *copy_model(MODEL *model)
   if(model->lin_weights) {
     newmodel->lin_weights=copy_nvector(model->lin_weights,model->totwords);
   }
+  newmodel->kernel_block=NULL; /* kernel block is not copied */
   return(newmodel);
 }
 
@@ -1799,7 +2665,585 @@ MODEL *compact_linear_model(MODEL *model)
 							NULL,1.0));
   newmodel->alpha[1] = 1.0;
   newmodel->sv_num=2;
+  newmodel->kernel_block=NULL;
+
+  return(newmodel);
+}
+
+long poly2_expansion_size(long totwords)
+     /* number of features of the explicit feature map of the
+	polynomial kernel of degree 2 for vectors with feature numbers
+	up to totwords */
+{
+  return((totwords+1)*(totwords+2)/2);
+}
+
+long poly2_expansion_applicable(KERNEL_PARM *kernel_parm, DOC **docs,
+				long totdoc, long totwords)
+     /* decides whether to train the polynomial kernel in kernel_parm
+	as a linear model over its explicit feature map. The kernel has
+	to be of degree 2 with non-negative coefficients, the number of
+	features has to be small, and the expanded documents have to
+	fit into memory. */
+{
+  long i,nz,elems=0;
+  SVECTOR *f;
+
+  if((kernel_parm->kernel_type != POLY) || (kernel_parm->poly_degree != 2)
+     || (kernel_parm->coef_lin <= 0) || (kernel_parm->coef_const < 0)
+     || (totwords > POLY2_EXPAND_MAXWORDS))
+    return(0);
+  for(i=0;i<totdoc;i++) {
+    for(f=docs[i]->fvec;f;f=f->next) {
+      nz=num_nonzero_svector(f);
+      elems+=(nz+1)*(nz+2)/2;
+    }
+    if(elems > POLY2_EXPAND_MAXELEMS) 
+      return(0);
+  }
+  return(1);
+}
+
+void expand_poly2_documents(DOC **docs, long totdoc, 
+			    KERNEL_PARM *kernel_parm)
+     /* replaces the feature vectors of the documents by their explicit
+	feature map for the polynomial kernel of degree 2. A linear
+	kernel on the result equals the polynomial kernel on the
+	original vectors. */
+{
+  long i;
+  SVECTOR *phi;
+
+#pragma omp parallel for private(phi) schedule(dynamic,64)
+  for(i=0;i<totdoc;i++) {
+    phi=create_svector_poly2(docs[i]->fvec,kernel_parm);
+    free_svector(docs[i]->fvec);
+    docs[i]->fvec=phi;
+  }
+}
+
+MODEL *compact_poly2_model(MODEL *model, KERNEL_PARM *kernel_parm)
+     /* Makes a copy of the linear model that was trained on documents
+	expanded by expand_poly2_documents, where the support vectors
+	are replaced by the weight vector over the expanded
+	features. kernel_parm is the polynomial kernel of the
+	expansion. The copy classifies original documents with the same
+	scores as the corresponding polynomial kernel model. */
+{
+  MODEL *newmodel;
 
+  newmodel=compact_linear_model(model);
+  newmodel->kernel_parm=(*kernel_parm);
+  newmodel->kernel_parm.kernel_type=POLY_EXPANDED;
+  return(newmodel);
+}
+
+KERNEL_STORE *map_kernel_store(char *file, size_t offset, long n, long full,
+			       long sqdist)
+     /* maps the kernel values that start at byte offset in file into
+	memory. full tells whether all n*n values or only the lower
+	triangle are stored. Reads the values into memory, if the file
+	cannot be mapped. */
+{
+  KERNEL_STORE *store;
+  size_t size;
+  FILE *fl;
+  void *map;
+  int fd;
+
+  size=sizeof(float)*(full ? (size_t)n*n : (size_t)n*(n+1)/2);
+  store=(KERNEL_STORE *)my_malloc(sizeof(KERNEL_STORE));
+  store->n=n;
+  store->full=full;
+  store->sqdist=sqdist;
+  store->map=NULL;
+  store->mapsize=0;
+  if((fd=open(file,O_RDONLY)) < 0) 
+  { perror (file); exit (1); }
+  map=mmap(NULL,offset+size,PROT_READ,MAP_SHARED,fd,0);
+  close(fd);
+  if(map != MAP_FAILED) {
+    store->map=map;
+    store->mapsize=offset+size;
+    store->values=(float *)((char *)map+offset);
+  }
+  else {
+    store->values=(float *)my_malloc(size);
+    if(((fl=fopen(file,"rb")) == NULL) || fseek(fl,(long)offset,SEEK_SET)
+       || (fread(store->values,1,size,fl) != size))
+    { perror (file); exit (1); }
+    fclose(fl);
+  }
+  return(store);
+}
+
+KERNEL_STORE *read_kernel_matrix(char *file, long sqdist)
+     /* maps a precomputed kernel matrix into memory. The file contains
+	the n*n values of the matrix row by row as 32-bit floats (as
+	written by numpy's tofile for a float32 array). Row i belongs to
+	the document with did:i+1. If sqdist is set, the values are
+	squared euclidian distances that are turned into rbf kernel
+	values. */
+{
+  KERNEL_STORE *store;
+  struct stat st;
+  long n;
+
+  if(stat(file,&st))
+  { perror (file); exit (1); }
+  n=(long)(sqrt((double)st.st_size/sizeof(float))+0.5);
+  if((n < 1) || ((size_t)st.st_size != sizeof(float)*(size_t)n*n)) {
+    printf("\nFile %s does not contain a square matrix of floats!\n\n",file);
+    exit(1);
+  }
+  if(verbosity>=1) {
+    printf("Mapping %ldx%ld %s matrix...",n,n,sqdist ? "distance" : "kernel");
+    fflush(stdout);
+  }
+  store=map_kernel_store(file,0,n,1,sqdist);
+  if(verbosity>=1) {
+    printf("done\n"); fflush(stdout);
+  }
+  return(store);
+}
+
+uint64_t hash_bytes(uint64_t hash, void *data, size_t len)
+     /* continues the FNV-1a hash with len bytes of data */
+{
+  unsigned char *p=(unsigned char *)data;
+  size_t i;
+
+  for(i=0;i<len;i++) {
+    hash^=p[i];
+    hash*=1099511628211ULL;
+  }
+  return(hash);
+}
+
+uint64_t kernel_store_hash(KERNEL_PARM *kernel_parm, DOC **docs, long totdoc)
+     /* hash of the documents and of the kernel parameters that matter
+	for the kernel type */
+{
+  uint64_t hash=14695981039346656037ULL;
+  long i,n,t=kernel_parm->kernel_type;
+  SVECTOR *f;
+
+  hash=hash_bytes(hash,&t,sizeof(long));
+  if((t == POLY) || (t == CUSTOM)) 
+    hash=hash_bytes(hash,&kernel_parm->poly_degree,sizeof(long));
+  if(t == CUSTOM)  /* RBF stores hold distances and work for any gamma */
+    hash=hash_bytes(hash,&kernel_parm->rbf_gamma,sizeof(double));
+  if((t == POLY) || (t == SIGMOID) || (t == CUSTOM)) {
+    hash=hash_bytes(hash,&kernel_parm->coef_lin,sizeof(double));
+    hash=hash_bytes(hash,&kernel_parm->coef_const,sizeof(double));
+  }
+  if(t == CUSTOM) 
+    hash=hash_bytes(hash,kernel_parm->custom,strlen(kernel_parm->custom));
+  hash=hash_bytes(hash,&totdoc,sizeof(long));
+  for(i=0;i<totdoc;i++) {
+    /* all vectors of the document with their factors and kernel ids,
+       each ending with its terminating WORD */
+    for(f=docs[i]->fvec;f;f=f->next) {
+      n=num_nonzero_svector(f);
+      hash=hash_bytes(hash,f->words,sizeof(WORD)*(n+1));
+      hash=hash_bytes(hash,&f->factor,sizeof(double));
+      hash=hash_bytes(hash,&f->kernel_id,sizeof(long));
+    }
+    hash=hash_bytes(hash,&i,sizeof(long));
+  }
+  return(hash);
+}
+
+float *compute_kernel_store(KERNEL_PARM *kernel_parm, DOC **docs, 
+			    long totdoc, long sqdist)
+     /* computes the lower triangle of the kernel matrix of the totdoc
+	documents, or of their squared distances if sqdist is set */
+{
+  long i,j,*index,maxfeat=0,evals=0;
+  float *values,*row;
+  double *kval;
+  SVECTOR **lists;
+  KERNEL_PARM dot_parm;
+  KERNEL_BLOCK *block=NULL;
+
+  values=(float *)my_malloc(sizeof(float)*(size_t)totdoc*(totdoc+1)/2);
+  lists=(SVECTOR **)my_malloc(sizeof(SVECTOR *)*totdoc);
+  index=(long *)my_malloc(sizeof(long)*totdoc);
+  for(i=0;i<totdoc;i++) {
+    lists[i]=docs[i]->fvec;
+    index[i]=i;
+    maxfeat=MAX(maxfeat,maxfeatnum_svector(docs[i]->fvec));
+    if(sqdist && (docs[i]->fvec->twonorm_sq<0))
+      docs[i]->fvec->twonorm_sq=sprod_ss(docs[i]->fvec,docs[i]->fvec);
+    kernel_twonorms(kernel_parm,docs[i]);
+  }
+  /* for distances, the block computes plain inner products as a
+     polynomial kernel of degree 1 */
+  dot_parm=(*kernel_parm);
+  if(sqdist) {
+    dot_parm.kernel_type=POLY;
+    dot_parm.poly_degree=1;
+    dot_parm.coef_lin=1;
+    dot_parm.coef_const=0;
+  }
+  if(kernel_block_applicable(&dot_parm,lists,totdoc,maxfeat+1))
+    block=create_kernel_block(lists,NULL,totdoc,maxfeat+1);
+
+#pragma omp parallel for private(j,row,kval) schedule(dynamic,16) reduction(+:evals) \
+        if(kernel_parm->kernel_type != CUSTOM)
+  for(i=0;i<totdoc;i++) {
+    row=values+(size_t)i*(i+1)/2;
+    kval=(double *)my_malloc(sizeof(double)*(i+1));
+    if(block) 
+      kernel_block_eval(&dot_parm,block,index,i+1,docs[i]->fvec,kval);
+    else {
+      for(j=0;j<=i;j++)
+	if(sqdist)
+	  kval[j]=sprod_ss(docs[i]->fvec,docs[j]->fvec);
+	else {
+	  kval[j]=single_kernel_value(kernel_parm,docs[i]->fvec,
+				      docs[j]->fvec);
+	  evals++;
+	}
+    }
+    for(j=0;j<=i;j++)
+      if(sqdist)
+	row[j]=(float)MAX(0,docs[i]->fvec->twonorm_sq-2*kval[j]
+			  +docs[j]->fvec->twonorm_sq);
+      else
+	row[j]=(float)kval[j];
+    free(kval);
+  }
+  kernel_cache_statistic+=evals;
+  if(block) free_kernel_block(block);
+  free(index);
+  free(lists);
+  return(values);
+}
+
+KERNEL_STORE *open_kernel_store(char *dir, KERNEL_PARM *kernel_parm, 
+				DOC **docs, long totdoc)
+     /* returns the kernel values between all pairs of the totdoc
+	documents from a file in directory dir. The file is identified
+	by a hash of the documents and the kernel parameters, so that
+	later runs on the same data with the same kernel (e.g. with a
+	different C) can reuse it. For the RBF kernel the store holds
+	squared distances and does not depend on gamma. If there is no
+	such file yet, the values are computed and written to it. If
+	dir is NULL, the values are only kept in memory. Sets the docid
+	of each document to its position. Returns NULL, if the
+	documents are not single vectors or the store would be too
+	large. */
+{
+  char file[1024],tmpfile[1100],magic[9],*kind;
+  int64_t n64;
+  uint64_t hash,hash_in;
+  long i,ok=0,sqdist;
+  size_t size;
+  float *values;
+  KERNEL_STORE *store;
+  FILE *fl;
+
+  for(i=0;i<totdoc;i++) 
+    if(docs[i]->fvec->next || (docs[i]->fvec->factor != 1.0))
+      return(NULL);
+  if(sizeof(float)*(double)totdoc*(totdoc+1)/2 > KERNEL_STORE_MAXBYTES) {
+    if(verbosity>=1) 
+      printf("NOTE: Kernel store for %ld documents is too large, not used.\n",
+	     totdoc);
+    return(NULL);
+  }
+  size=sizeof(float)*(size_t)totdoc*(totdoc+1)/2;
+  sqdist=(kernel_parm->kernel_type == RBF);
+  kind=sqdist ? "SVMKSD01" : "SVMKST01";
+  for(i=0;i<totdoc;i++) 
+    docs[i]->fvec->docid=i;
+
+  if(!dir) {
+    if(verbosity>=1) {
+      printf("Computing kernel store in memory..."); fflush(stdout);
+    }
+    store=(KERNEL_STORE *)my_malloc(sizeof(KERNEL_STORE));
+    store->n=totdoc;
+    store->full=0;
+    store->sqdist=sqdist;
+    store->values=compute_kernel_store(kernel_parm,docs,totdoc,sqdist);
+    store->map=NULL;
+    store->mapsize=0;
+    if(verbosity>=1) {
+      printf("done\n"); fflush(stdout);
+    }
+    return(store);
+  }
+
+  hash=kernel_store_hash(kernel_parm,docs,totdoc);
+  sprintf(file,"%s/svm_kernel_%016llx.bin",dir,(unsigned long long)hash);
+
+  /* check for existing store with matching header */
+  if((fl=fopen(file,"rb")) != NULL) {
+    ok=((fread(magic,1,8,fl) == 8) && (fread(&n64,sizeof(n64),1,fl) == 1)
+	&& (fread(&hash_in,sizeof(hash_in),1,fl) == 1) 
+	&& (!strncmp(magic,kind,8)) && (n64 == totdoc) 
+	&& (hash_in == hash) && (!fseek(fl,0,SEEK_END))
+	&& (ftell(fl) == (long)(24+size)));
+    fclose(fl);
+  }
+  if(!ok) {
+    if(verbosity>=1) {
+      printf("Computing kernel store %s...",file); fflush(stdout);
+    }
+    values=compute_kernel_store(kernel_parm,docs,totdoc,sqdist);
+
+    /* write under a temporary name first, so that concurrent runs
+       never see a partial file */
+    sprintf(tmpfile,"%s.%ld",file,(long)getpid());
+    n64=totdoc;
+    if(((fl=fopen(tmpfile,"wb")) == NULL) 
+       || (fwrite(kind,1,8,fl) != 8) 
+       || (fwrite(&n64,sizeof(n64),1,fl) != 1)
+       || (fwrite(&hash,sizeof(hash),1,fl) != 1)
+       || (fwrite(values,1,size,fl) != size) || fclose(fl)
+       || rename(tmpfile,file)) 
+    { perror (tmpfile); exit (1); }
+    free(values);
+    if(verbosity>=1) {
+      printf("done\n"); fflush(stdout);
+    }
+  }
+  else if(verbosity>=1) {
+    printf("Using kernel store %s\n",file); fflush(stdout);
+  }
+  return(map_kernel_store(file,24,totdoc,0,sqdist));
+}
+
+void free_kernel_store(KERNEL_STORE *store)
+{
+  if(store->map)
+    munmap(store->map,store->mapsize);
+  else
+    free(store->values);
+  free(store);
+}
+
+MODEL *compact_kernel_model(MODEL *model)
+     /* Makes a copy of model where every vector of the lists of the
+	support vectors becomes a support vector of its own, and
+	identical vectors (same features, kernel_id and docid) are
+	merged into one with the sum of their coefficients
+	alpha*factor. Since the kernel between lists is the sum over
+	their vectors, the copy computes the same decision function. */
+{
+  MODEL *newmodel;
+  long i,k,n,sv,size,slot,*table,*len;
+  uint64_t h,*hash;
+  SVECTOR *v,*f;
+
+  n=0;
+  for(i=1;i<model->sv_num;i++) 
+    for(v=model->supvec[i]->fvec;v;v=v->next) 
+      n++;
+  newmodel=(MODEL *)my_malloc(sizeof(MODEL));
+  (*newmodel)=(*model);
+  newmodel->supvec=(DOC **)my_malloc(sizeof(DOC *)*(n+1));
+  newmodel->alpha=(double *)my_malloc(sizeof(double)*(n+1));
+  newmodel->index=NULL; /* index is not copied */
+  newmodel->lin_weights=NULL;
+  newmodel->kernel_block=NULL;
+  newmodel->supvec[0]=NULL;
+  newmodel->alpha[0]=0;
+
+  for(size=2;size<2*n;size*=2);
+  table=(long *)my_malloc(sizeof(long)*size);
+  for(slot=0;slot<size;slot++)
+    table[slot]=-1;
+  hash=(uint64_t *)my_malloc(sizeof(uint64_t)*(n+1));
+  len=(long *)my_malloc(sizeof(long)*(n+1));
+  sv=1;
+  for(i=1;i<model->sv_num;i++) {
+    for(v=model->supvec[i]->fvec;v;v=v->next) {
+      k=num_nonzero_svector(v)+1;
+      h=hash_bytes(14695981039346656037ULL,v->words,sizeof(WORD)*k);
+      h=hash_bytes(h,&v->kernel_id,sizeof(long));
+      h=hash_bytes(h,&v->docid,sizeof(long));
+      for(slot=h&(size-1);table[slot]>=0;slot=(slot+1)&(size-1)) {
+	f=newmodel->supvec[table[slot]]->fvec;
+	if((hash[table[slot]] == h) && (len[table[slot]] == k)
+	   && (f->kernel_id == v->kernel_id) && (f->docid == v->docid)
+	   && (!memcmp(f->words,v->words,sizeof(WORD)*k)))
+	  break;
+      }
+      if(table[slot] < 0) {
+	f=create_svector(v->words,v->userdefined,1.0);
+	f->kernel_id=v->kernel_id;
+	f->docid=v->docid;
+	newmodel->supvec[sv]=create_example(-1,0,0,0.0,f);
+	newmodel->alpha[sv]=0;
+	hash[sv]=h;
+	len[sv]=k;
+	table[slot]=sv++;
+      }
+      newmodel->alpha[table[slot]]+=model->alpha[i]*v->factor;
+    }
+  }
+  /* coefficients that cancel out leave no support vector */
+  for(i=1,k=1;i<sv;i++) {
+    if(newmodel->alpha[i] != 0) {
+      newmodel->alpha[k]=newmodel->alpha[i];
+      newmodel->supvec[k++]=newmodel->supvec[i];
+    }
+    else
+      free_example(newmodel->supvec[i],1);
+  }
+  newmodel->sv_num=k;
+  free(len);
+  free(hash);
+  free(table);
+  return(newmodel);
+}
+
+MODEL *reduce_kernel_model(MODEL *model, long budget, double *residual)
+     /* Approximates the kernel model by a model with at most budget
+	support vectors, selected greedily from the support vectors of
+	model by orthogonal matching pursuit in feature space: each step
+	adds the vector that brings the weight vector w' of the new
+	model closest to the weight vector w of model, and the
+	coefficients are refit so that w' is the projection of w onto
+	the span of the selected vectors. The kernel has to be positive
+	semi-definite. Returns in residual the distance |w-w'|/|w|. */
+{
+  MODEL *cmodel,*newmodel;
+  long i,t,k,n,best,*sel,*used,evals=0;
+  double *f,*proj,*d,*diag,*col,**G,*u,gain,bestgain,wnorm,rest,sum,pivot;
+  SVECTOR **lists;
+  KERNEL_BLOCK *block=NULL;
+  MATRIX *L,*invL;
+
+  cmodel=compact_kernel_model(model);
+  n=cmodel->sv_num-1;
+  budget=MIN(budget,n);
+  f=create_nvector(n);
+  proj=create_nvector(n);
+  d=create_nvector(n);
+  diag=create_nvector(n);
+  col=create_nvector(n);
+  u=create_nvector(budget);
+  G=(double **)my_malloc(sizeof(double *)*(budget+1));
+  sel=(long *)my_malloc(sizeof(long)*(budget+1));
+  used=(long *)my_malloc(sizeof(long)*(n+1));
+  lists=(SVECTOR **)my_malloc(sizeof(SVECTOR *)*(n+1));
+
+  /* f[i] is the inner product of w with the i-th support vector */
+  add_kernel_block_to_model(cmodel);
+  for(i=0;i<n;i++) 
+    lists[i]=cmodel->supvec[i+1]->fvec;
+  classify_examples(cmodel,cmodel->supvec+1,n,f);
+  wnorm=0;
+  for(i=0;i<n;i++) {
+    f[i]+=cmodel->b;
+    wnorm+=cmodel->alpha[i+1]*f[i];
+    /* also computes the norms that kernel_value needs below */
+    d[i]=diag[i]=kernel(&cmodel->kernel_parm,cmodel->supvec[i+1],
+			cmodel->supvec[i+1]);
+    proj[i]=0;
+    used[i]=0;
+  }
+  if(n && kernel_block_applicable(&cmodel->kernel_parm,lists,n,
+				  cmodel->totwords+1))
+    block=create_kernel_block(lists,NULL,n,cmodel->totwords+1);
+
+  /* G holds the coordinates of the support vectors in an orthonormal
+     basis of the span of the selected ones, as in the incomplete
+     Cholesky decomposition; u holds the coordinates of w */
+  rest=wnorm;
+  for(t=0;t<budget;t++) {
+    best=-1;
+    bestgain=0;
+    for(i=0;i<n;i++) {
+      /* vectors (almost) in the span of the selected ones would
+	 need huge coefficients of opposite signs */
+      if(used[i] || (d[i] <= REDUCED_SET_EPSILON*diag[i]))
+	continue;
+      gain=(f[i]-proj[i])*(f[i]-proj[i])/d[i];
+      if(gain > bestgain) {
+	bestgain=gain;
+	best=i;
+      }
+    }
+    if((best < 0) || (bestgain <= REDUCED_SET_EPSILON*REDUCED_SET_EPSILON*wnorm))
+      break;
+    if(block)
+      kernel_block_eval(&cmodel->kernel_parm,block,NULL,0,lists[best],col);
+    else {
+#pragma omp parallel for schedule(dynamic,64) reduction(+:evals) \
+        if(cmodel->kernel_parm.kernel_type != CUSTOM)
+      for(i=0;i<n;i++)
+	col[i]=kernel_value(&cmodel->kernel_parm,cmodel->supvec[i+1],
+			    cmodel->supvec[best+1],&evals);
+      kernel_cache_statistic+=evals;
+      evals=0;
+    }
+    pivot=sqrt(d[best]);
+    G[t]=create_nvector(n);
+    u[t]=(f[best]-proj[best])/pivot;
+#pragma omp parallel for private(k,sum) schedule(static)
+    for(i=0;i<n;i++) {
+      sum=col[i];
+      for(k=0;k<t;k++)
+	sum-=G[k][i]*G[k][best];
+      G[t][i]=sum/pivot;
+      proj[i]+=G[t][i]*u[t];
+      d[i]-=G[t][i]*G[t][i];
+    }
+    used[best]=1;
+    sel[t]=best;
+    rest-=u[t]*u[t];
+  }
+  budget=t;
+  (*residual)=(wnorm>0) ? sqrt(MAX(0,rest)/wnorm) : 0;
+
+  /* w'=sum_t u_t e_t, and the basis vectors e are invL times the
+     selected support vectors, so their coefficients are invL^T*u */
+  newmodel=(MODEL *)my_malloc(sizeof(MODEL));
+  (*newmodel)=(*cmodel);
+  newmodel->supvec=(DOC **)my_malloc(sizeof(DOC *)*(budget+1));
+  newmodel->alpha=(double *)my_malloc(sizeof(double)*(budget+1));
+  newmodel->index=NULL;
+  newmodel->lin_weights=NULL;
+  newmodel->kernel_block=NULL;
+  newmodel->supvec[0]=NULL;
+  newmodel->alpha[0]=0;
+  newmodel->sv_num=budget+1;
+  if(budget) {
+    L=create_matrix(budget,budget);
+    for(i=0;i<budget;i++)
+      for(k=0;k<budget;k++)
+	L->element[i][k]=(k<=i) ? G[k][sel[i]] : 0;
+    invL=invert_ltriangle_matrix(L);
+    for(k=0;k<budget;k++) {
+      for(sum=0,i=k;i<budget;i++)
+	sum+=invL->element[i][k]*u[i];
+      newmodel->alpha[k+1]=sum;
+      newmodel->supvec[k+1]=create_example(-1,0,0,0.0,
+				   copy_svector(cmodel->supvec[sel[k]+1]->fvec));
+    }
+    free_matrix(invL);
+    free_matrix(L);
+  }
+
+  for(t=0;t<budget;t++)
+    free(G[t]);
+  if(block) free_kernel_block(block);
+  free(lists);
+  free(used);
+  free(sel);
+  free(G);
+  free(u);
+  free(col);
+  free(diag);
+  free(d);
+  free(proj);
+  free(f);
+  free_model(cmodel,1);
   return(newmodel);
 }
 
@@ -1818,6 +3262,7 @@ void free_model(MODEL *model, int deep)
   if(model->alpha) free(model->alpha);
   if(model->index) free(model->index);
   if(model->lin_weights) free(model->lin_weights);
+  if(model->kernel_block) free_kernel_block(model->kernel_block);
   free(model);
 }
 
@@ -1827,7 +3272,7 @@ void read_documents(char *docfile, DOC ***docs, double **label,
 {
   char *line,*comment;
   WORD *words;
-  long dnum=0,wpos,dpos=0,dneg=0,dunlab=0,queryid,slackid,max_docs;
+  long dnum=0,wpos,dpos=0,dneg=0,dunlab=0,queryid,slackid,docid,max_docs;
   long max_words_doc, ll;
   double doc_label,costfactor;
   FILE *docfl;
@@ -1858,8 +3303,9 @@ void read_documents(char *docfile, DOC ***docs, double **label,
   (*totwords)=0;
   while((!feof(docfl)) && fgets(line,(int)ll,docfl)) {
     if(line[0] == '#') continue;  /* line contains comments */
-    if(!parse_document(line,words,&doc_label,&queryid,&slackid,&costfactor,
-		       &wpos,max_words_doc,&comment)) {
+    if(!parse_document_docid(line,words,&doc_label,&queryid,&slackid,
+			     &costfactor,&docid,&wpos,max_words_doc,
+			     &comment)) {
       printf("\nParsing error in line %ld!\n%s",dnum,line);
       exit(1);
     }
@@ -1877,6 +3323,7 @@ void read_documents(char *docfile, DOC ***docs, double **label,
     }
     (*docs)[dnum] = create_example(dnum,queryid,slackid,costfactor,
 				   create_svector(words,comment,1.0));
+    (*docs)[dnum]->fvec->docid=docid;
     /* printf("\nNorm=%f\n",((*docs)[dnum]->fvec)->twonorm_sq);  */
     dnum++;  
     if(verbosity>=1) {
@@ -1899,6 +3346,20 @@ int parse_document(char *line, WORD *words, double *label,
 		   long *queryid, long *slackid, double *costfactor,
 		   long int *numwords, long int max_words_doc,
 		   char **comment)
+     /* parses one line of an example file, ignoring a document id */
+{
+  long docid;
+
+  return(parse_document_docid(line,words,label,queryid,slackid,costfactor,
+			      &docid,numwords,max_words_doc,comment));
+}
+
+int parse_document_docid(char *line, WORD *words, double *label,
+			 long *queryid, long *slackid, double *costfactor,
+			 long *docid, long int *numwords, 
+			 long int max_words_doc, char **comment)
+     /* like parse_document, but also returns the document id given
+	as did:<n> in docid (n-1, or -1 if there is none) */
 {
   register long wpos,pos;
   long wnum;
@@ -1908,6 +3369,7 @@ int parse_document(char *line, WORD *words, double *label,
   (*queryid)=0;
   (*slackid)=0;
   (*costfactor)=1;
+  (*docid)=-1;
 
   pos=0;
   (*comment)=NULL;
@@ -1958,6 +3420,16 @@ int parse_document(char *line, WORD *words, double *label,
 	exit (1); 
       }
     }
+    else if(sscanf(featurepair,"did:%ld%s",&wnum,junk)==1) {
+      /* it is the document id in a precomputed kernel matrix */
+      if(wnum > 0) 
+	(*docid)=(long)wnum-1;
+      else {
+	perror ("Document-id must be greater or equal to 1!!!\n"); 
+	printf("LINE: %s\n",line);
+	exit (1); 
+      }
+    }
     else if(sscanf(featurepair,"cost:%lf%s",&weight,junk)==1) {
       /* it is the example-dependent cost factor */
       (*costfactor)=(double)weight;
@@ -2050,6 +3522,7 @@ void set_learning_defaults(LEARN_PARM *learn_parm, KERNEL_PARM *kernel_parm)
   kernel_parm->coef_lin=1;
   kernel_parm->coef_const=1;
   strcpy(kernel_parm->custom,"empty");
+  kernel_parm->store=NULL;
 }
 
 int check_learning_parms(LEARN_PARM *learn_parm, KERNEL_PARM *kernel_parm)
@@ -2169,6 +3642,109 @@ double get_runtime(void)
   return((double)start/((double)(CLOCKS_PER_SEC)/100.0));
 }
 
+double get_thread_runtime(void)
+{
+  /* returns the processor time of the calling thread in hundredth of a
+     second. get_runtime counts all threads of the process. */
+#ifdef CLOCK_THREAD_CPUTIME_ID
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID,&ts);
+  return(ts.tv_sec*100.0+ts.tv_nsec/1e7);
+#else
+  return(get_runtime());
+#endif
+}
+
+double get_wall_time(void)
+{
+  /* returns the time in seconds on a monotonic clock. Unlike
+     get_runtime, this is the elapsed time, also with several threads. */
+#ifdef CLOCK_MONOTONIC
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return(ts.tv_sec+ts.tv_nsec/1e9);
+#else
+  return(get_runtime()/100.0);
+#endif
+}
+
+void print_latency_stats(FILE *fl, double *sorted, long n, 
+			 const char *suffix)
+     /* prints mean, percentiles and maximum of the n sorted latencies
+	(seconds) in milliseconds as JSON members */
+{
+  double sum=0;
+  long i;
+
+  for(i=0;i<n;i++)
+    sum+=sorted[i];
+  fprintf(fl,"\"mean%s\": %.4f, \"p50%s\": %.4f, \"p90%s\": %.4f, \"p99%s\": %.4f, \"max%s\": %.4f",
+	  suffix,1e3*sum/n,suffix,1e3*sorted[(long)(0.50*(n-1))],
+	  suffix,1e3*sorted[(long)(0.90*(n-1))],
+	  suffix,1e3*sorted[(long)(0.99*(n-1))],suffix,1e3*sorted[n-1]);
+}
+
+void write_latency_report(char *file, double *latency, long *docs, long n,
+			  double elapsed, long threads)
+     /* writes the wall-clock latencies latency[i] (seconds) of n
+	queries with docs[i] documents each to file as JSON: the
+	throughput over elapsed seconds, the latency percentiles over
+	all queries, and the percentiles for the queries of each size
+	range 1, 2-3, 4-7, ... */
+{
+  FILE *fl;
+  double *sorted;
+  long i,k,lo,hi,totdocs=0,maxdocs=0,first;
+
+  if ((fl = fopen (file, "w")) == NULL)
+  { perror (file); exit (1); }
+  for(i=0;i<n;i++) {
+    totdocs+=docs[i];
+    maxdocs=maxl(maxdocs,docs[i]);
+  }
+  fprintf(fl,"{\n");
+  fprintf(fl,"  \"queries\": %ld,\n",n);
+  fprintf(fl,"  \"documents\": %ld,\n",totdocs);
+  fprintf(fl,"  \"threads\": %ld,\n",threads);
+  fprintf(fl,"  \"elapsed_seconds\": %.6f,\n",elapsed);
+  fprintf(fl,"  \"documents_per_second\": %.1f,\n",
+	  elapsed>0 ? totdocs/elapsed : 0);
+  fprintf(fl,"  \"queries_per_second\": %.1f,\n",elapsed>0 ? n/elapsed : 0);
+  if(n == 0) {
+    fprintf(fl,"  \"latency_ms\": null,\n");
+    fprintf(fl,"  \"latency_by_query_size\": []\n}\n");
+    fclose(fl);
+    return;
+  }
+
+  sorted=(double *)my_malloc(sizeof(double)*n);
+  memcpy(sorted,latency,sizeof(double)*n);
+  qsort(sorted,n,sizeof(double),compare_double);
+  fprintf(fl,"  \"latency_ms\": { ");
+  print_latency_stats(fl,sorted,n,"");
+  fprintf(fl," },\n");
+
+  fprintf(fl,"  \"latency_by_query_size\": [");
+  first=1;
+  for(lo=1;lo<=maxdocs;lo*=2) {
+    hi=2*lo-1;
+    for(i=0,k=0;i<n;i++) 
+      if((docs[i]>=lo) && (docs[i]<=hi))
+	sorted[k++]=latency[i];
+    if(k == 0)
+      continue;
+    qsort(sorted,k,sizeof(double),compare_double);
+    fprintf(fl,"%s\n    { \"min_documents\": %ld, \"max_documents\": %ld, \"queries\": %ld, ",
+	    first ? "" : ",",lo,hi,k);
+    print_latency_stats(fl,sorted,k,"_ms");
+    fprintf(fl," }");
+    first=0;
+  }
+  fprintf(fl,"\n  ]\n}\n");
+  fclose(fl);
+  free(sorted);
+}
+
 
 # ifdef _MSC_VER
 
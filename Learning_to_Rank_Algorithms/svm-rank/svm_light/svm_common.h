@@ -46,6 +46,11 @@
 # define SIGMOID 3           /* sigmoid kernel type */
 # define CUSTOM  4           /* userdefined kernel function from kernel.h */
 # define GRAM    5           /* use explicit gram matrix from kernel_parm */
+# define POLY_EXPANDED 6     /* polynomial kernel of degree 2 that is stored
+				as weight vector over its explicit feature
+				map (only in models) */
+# define PRECOMPUTED 7       /* kernel values from a precomputed matrix,
+				indexed by the did: of the documents */
 
 # define CLASSIFICATION 1    /* train classification model */
 # define REGRESSION     2    /* train regression model */
@@ -54,6 +59,29 @@
 
 # define MAXSHRINK     50000    /* maximum number of shrinking rounds */
 
+# define KERNEL_BLOCK_ROWS    64  /* rows of a kernel block processed in one
+				     tile */
+# define KERNEL_BLOCK_QUERIES 4   /* vectors evaluated against a tile at
+				     the same time */
+# define KERNEL_BLOCK_MAXELEMS 33554432 /* largest dense kernel block
+					   (in doubles) that is built */
+# define KERNEL_BLOCK_STACKDIM 512 /* longest rows for which the vectors
+				      evaluated against a block are
+				      unpacked on the stack */
+# define POLY2_EXPAND_MAXWORDS 300 /* largest feature number for which the
+				      degree 2 polynomial kernel is
+				      trained through its explicit
+				      feature map */
+# define POLY2_EXPAND_MAXELEMS 134217728 /* largest total number of
+					    features of the expanded
+					    training documents */
+# define KERNEL_STORE_MAXBYTES 8589934592.0 /* largest kernel store
+					       that is built on disk */
+# define REDUCED_SET_EPSILON 1E-4    /* smallest part of the squared
+				       norm of a support vector outside
+				       the span of the ones already in a
+				       reduced model, for adding it */
+
 typedef struct word {
   FNUM    wnum;	               /* word number */
   FVAL    weight;              /* word weight */
@@ -83,6 +111,10 @@ typedef struct svector {
 				  are a sum of several different
 				  weight vectors. (currently not
 				  implemented). */
+  long    docid;               /* Row of the document in the kernel
+				  store of the kernel_parm (from did:
+				  in the input file, counting from
+				  0). -1, if the document has none. */
   struct svector *next;        /* Let's you set up a list of SVECTOR's
 				  for linear constraints which are a
 				  sum of multiple feature
@@ -201,9 +233,23 @@ typedef struct matrix {
   double **element;
 } MATRIX;
 
+typedef struct kernel_store {
+  long    n;             /* number of documents */
+  long    full;          /* 1, if all n*n values are stored, 0 if only
+			    the lower triangle is stored */
+  long    sqdist;        /* 1, if the values are squared euclidian
+			    distances for the rbf kernel instead of
+			    kernel values */
+  float   *values;       /* the values row by row */
+  void    *map;          /* memory mapping that contains the values
+			    (NULL, if they were read into memory) */
+  size_t  mapsize;       /* length of the mapping */
+} KERNEL_STORE;
+
 typedef struct kernel_parm {
   long    kernel_type;   /* 0=linear, 1=poly, 2=rbf, 3=sigmoid,
-			    4=custom, 5=matrix */
+			    4=custom, 5=matrix, 6=expanded poly,
+			    7=precomputed */
   long    poly_degree;
   double  rbf_gamma;
   double  coef_lin;
@@ -213,8 +259,23 @@ typedef struct kernel_parm {
 			    matrix. The matrix is accessed if
 			    kernel_type=5 is selected. */
   long    totwords;      /* highest valid feature index */
+  KERNEL_STORE *store;   /* precomputed values of the kernel between
+			    documents with a docid (NULL, if none) */
 } KERNEL_PARM;
 
+typedef struct kernel_block {
+  long    n;            /* number of SVECTOR lists packed into the block */
+  long    rows;         /* total number of SVECTORs in these lists */
+  long    dim;          /* length of each row (highest feature number+1) */
+  FVAL    *x;           /* the rows as dense vectors, stored one after
+			   the other. Row r starts at x+r*dim. */
+  double  *twonorm_sq;  /* squared euclidian length of each row */
+  double  *coef;        /* factor of each row in the sum */
+  long    *kernel_id;   /* kernel_id of the SVECTOR of each row */
+  long    *start;       /* rows of list i are start[i]..start[i+1]-1 */
+  long    *list;        /* list of each row */
+} KERNEL_BLOCK;
+
 typedef struct model {
   long    sv_num;	
   long    at_upper_bound;
@@ -233,8 +294,34 @@ typedef struct model {
 						 folding */
   double  maxdiff;                            /* precision, up to which this 
 						 model is accurate */
+  KERNEL_BLOCK *kernel_block;                 /* support vectors as dense
+						 block for fast non-linear
+						 classification */
 } MODEL;
 
+typedef struct linear_bound {
+  /* order in which the products of a linear model are computed for
+     top-k ranking with early termination (MaxScore). The bound of
+     feature j is |w_j|*maxabs[j]. */
+  long    n;            /* number of features with a non-zero bound */
+  long    *order;       /* these features by decreasing bound */
+  double  *rest;        /* rest[t] is the sum of the bounds of
+			   order[t..n-1]; rest[n]=0 */
+  double  *maxabs;      /* largest absolute value of each feature that
+			   the bounds hold for (1..totwords) */
+} LINEAR_BOUND;
+
+typedef struct weight_matrix {
+  /* weight vectors of several linear models side by side, so that a
+     document is scored with all of them in one pass over its
+     features */
+  long    m;            /* number of models */
+  long    totwords;     /* highest feature number of all models */
+  double  *w;           /* w[j*m+k] is the weight of feature j in
+			   model k (j=1..totwords) */
+  double  *b;           /* threshold of model k */
+} WEIGHT_MATRIX;
+
 /* The following specifies a quadratic problem of the following form
 
   minimize   g0 * x + 1/2 x' * G * x
@@ -265,6 +352,7 @@ typedef struct kernel_cache {
   long   time;
   long   activenum;
   long   buffsize;
+  KERNEL_BLOCK *block; /* training vectors as dense block, if used */
 } KERNEL_CACHE;
 
 
@@ -293,18 +381,25 @@ typedef struct randpair {
 } RANDPAIR;
 
 double classify_example(MODEL *, DOC *);
+void   classify_examples(MODEL *, DOC **, long, double *);
 double classify_example_linear(MODEL *, DOC *);
+double classify_example_poly_expanded(MODEL *model, DOC *ex);
 double kernel(KERNEL_PARM *, DOC *, DOC *); 
 double kernel_s(KERNEL_PARM *kernel_parm, SVECTOR *a, SVECTOR *b);
 double single_kernel_s(KERNEL_PARM *kernel_parm, SVECTOR *a, SVECTOR *b);
 double single_kernel(KERNEL_PARM *, SVECTOR *, SVECTOR *); 
+double single_kernel_value(KERNEL_PARM *, SVECTOR *, SVECTOR *); 
+double kernel_value(KERNEL_PARM *, DOC *, DOC *, long *); 
+void   kernel_twonorms(KERNEL_PARM *, DOC *);
 double custom_kernel(KERNEL_PARM *, SVECTOR *, SVECTOR *); 
+double kernel_store_value(KERNEL_PARM *kernel_parm, long i, long j);
 SVECTOR *create_svector(WORD *, char *, double);
 SVECTOR *create_svector_shallow(WORD *, char *, double);
 SVECTOR *create_svector_n(double *, long, char *, double);
 SVECTOR *create_svector_n_r(double *, long, char *, double, double);
 SVECTOR *create_svector_nvector_n(double *nonsparsevec, long maxfeatnum, 
 				  char *userdefined, double factor);
+SVECTOR *create_svector_poly2(SVECTOR *vec, KERNEL_PARM *kernel_parm);
 SVECTOR *copy_svector(SVECTOR *);
 SVECTOR *copy_svector_shallow(SVECTOR *);
 void   free_svector(SVECTOR *);
@@ -345,7 +440,33 @@ void   add_vector_ns(double *, SVECTOR *, double);
 double sprod_ns(double *, SVECTOR *);
 double sprod_ns_boundcheck(double *vec_n, SVECTOR *vec_s, long n);
 void   add_weight_vector_to_linear_model(MODEL *);
+LINEAR_BOUND *create_linear_bound(MODEL *model, double *maxabs);
+void   free_linear_bound(LINEAR_BOUND *bound);
+long   bounded_linear_products(MODEL *model, LINEAR_BOUND *bound, FVAL *x,
+				double *prod, double threshold, long *mults);
+WEIGHT_MATRIX *create_weight_matrix(MODEL **models, long m);
+void   free_weight_matrix(WEIGHT_MATRIX *wm);
+void   classify_examples_stacked(WEIGHT_MATRIX *wm, DOC **ex, long n,
+				 double *dist);
 void   add_dense_vectors_to_model(MODEL *model);
+void   add_kernel_block_to_model(MODEL *model);
+long   kernel_block_applicable(KERNEL_PARM *kernel_parm, SVECTOR **lists, 
+			       long n, long dim);
+KERNEL_BLOCK *create_kernel_block(SVECTOR **lists, double *listcoef, long n,
+				  long dim);
+void   free_kernel_block(KERNEL_BLOCK *block);
+void   unpack_kernel_block_query(KERNEL_BLOCK *block, SVECTOR *g, FVAL *qx,
+				  double *qnorm);
+void   kernel_block_tiles(KERNEL_PARM *kernel_parm, KERNEL_BLOCK *block, 
+			  long *rowidx, long *rowsel, long rows, 
+			  FVAL *qx, double *qnorm, double *qfactor, long *qid,
+			  long nq, double *kval, double *qsum);
+long   kernel_block_select(KERNEL_BLOCK *block, long *lists, long nlists,
+			   long **rowidx, long **rowsel);
+double kernel_block_eval(KERNEL_PARM *kernel_parm, KERNEL_BLOCK *block,
+			 long *lists, long nlists, SVECTOR *b, double *kval);
+void   kernel_block_eval_many(KERNEL_PARM *kernel_parm, KERNEL_BLOCK *block,
+			      SVECTOR **b, long nb, double *bval);
 DOC    *create_example(long, long, long, double, SVECTOR *);
 void   free_example(DOC *, long);
 long   *random_order(long n);
@@ -382,13 +503,32 @@ void   print_matrix(MATRIX *matrix);
 void   print_nvector(double *vec, long n);
 double mean_nvector(double *vec, long n);
 double variance_nvector(double *vec, long n);
+int    compare_double(const void *, const void *);
 double percentile_nvector(double *vec, long n, double percent);
 MODEL  *read_model(char *);
+long   is_binary_model(char *);
+void   write_binary_model(char *, MODEL *);
+MODEL  *read_binary_model(char *);
 MODEL  *copy_model(MODEL *);
 MODEL  *compact_linear_model(MODEL *model);
+MODEL  *compact_kernel_model(MODEL *model);
+MODEL  *reduce_kernel_model(MODEL *model, long budget, double *residual);
+long   poly2_expansion_size(long totwords);
+long   poly2_expansion_applicable(KERNEL_PARM *kernel_parm, DOC **docs,
+				  long totdoc, long totwords);
+void   expand_poly2_documents(DOC **docs, long totdoc, 
+			      KERNEL_PARM *kernel_parm);
+MODEL  *compact_poly2_model(MODEL *model, KERNEL_PARM *kernel_parm);
+KERNEL_STORE *read_kernel_matrix(char *file, long sqdist);
+float  *compute_kernel_store(KERNEL_PARM *kernel_parm, DOC **docs, 
+			     long totdoc, long sqdist);
+KERNEL_STORE *open_kernel_store(char *dir, KERNEL_PARM *kernel_parm, 
+				DOC **docs, long totdoc);
+void   free_kernel_store(KERNEL_STORE *store);
 void   free_model(MODEL *, int);
 void   read_documents(char *, DOC ***, double **, long *, long *);
 int    parse_document(char *, WORD *, double *, long *, long *, double *, long *, long, char **);
+int    parse_document_docid(char *, WORD *, double *, long *, long *, double *, long *, long *, long, char **);
 int    read_word(char *in, char *out);
 double *read_alphas(char *,long);
 void   set_learning_defaults(LEARN_PARM *, KERNEL_PARM *);
@@ -397,6 +537,10 @@ void   nol_ll(char *, long *, long *, long *);
 long   minl(long, long);
 long   maxl(long, long);
 double get_runtime(void);
+double get_thread_runtime(void);
+double get_wall_time(void);
+void   print_latency_stats(FILE *, double *, long, const char *);
+void   write_latency_report(char *, double *, long *, long, double, long);
 int    space_or_null(int);
 void   *my_malloc(size_t); 
 void   copyright_notice(void);
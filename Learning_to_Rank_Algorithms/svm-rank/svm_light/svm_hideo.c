@@ -51,6 +51,7 @@ long verbosity;
 # define EPSILON_EQ             1E-5
 
 double *optimize_qp(QP *, double *, long, double *, LEARN_PARM *);
+void   reset_qp_optimizer(void);
 double *primal=0,*dual=0;
 long   precision_violations=0;
 double opt_precision=DEF_PRECISION;
@@ -232,6 +233,24 @@ LEARN_PARM *learn_parm;
   return(primal);
 }
 
+void reset_qp_optimizer(void)
+     /* frees the buffers of the optimizer and forgets its history
+	(round counters, precision violations), so that the next
+	training run behaves exactly like the first one in a process */
+{
+  if(primal) {
+    free(primal);
+    free(dual);
+    free(nonoptimal);
+    free(buffer);
+    primal=0;
+    dual=0;
+  }
+  precision_violations=0;
+  smallroundcount=0;
+  roundnumber=0;
+}
+
 
 
 int optimize_hildreth_despo(n,m,precision,epsilon_crit,epsilon_a,maxiter,goal,
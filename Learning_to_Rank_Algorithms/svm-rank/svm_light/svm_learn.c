@@ -19,6 +19,9 @@
 
 # include "svm_common.h"
 # include "svm_learn.h"
+#ifdef _OPENMP
+# include <omp.h>
+#endif
 
 #define MAX(x,y)      ((x) < (y) ? (y) : (x))
 #define MIN(x,y)      ((x) > (y) ? (y) : (x))
@@ -115,6 +118,7 @@ void svm_learn_classification(DOC **docs, double *class, long int
   model->supvec[0]=0;  /* element 0 reserved and empty for now */
   model->alpha[0]=0;
   model->lin_weights=NULL;
+  model->kernel_block=NULL;
   model->totwords=totwords;
   model->totdoc=totdoc;
   model->kernel_parm=(*kernel_parm);
@@ -572,6 +576,7 @@ void svm_learn_regression(DOC **docs, double *value, long int totdoc,
   model->supvec[0]=0;  /* element 0 reserved and empty for now */
   model->alpha[0]=0;
   model->lin_weights=NULL;
+  model->kernel_block=NULL;
   model->totwords=totwords;
   model->totdoc=totdoc;
   model->kernel_parm=(*kernel_parm);
@@ -843,6 +848,7 @@ void svm_learn_ranking(DOC **docs, double *rankvalue, long int totdoc,
   model->at_upper_bound=0;
   model->b=0;	       
   model->lin_weights=NULL;
+  model->kernel_block=NULL;
   model->totwords=totwords;
   model->totdoc=totdoc;
   model->kernel_parm=(*kernel_parm);
@@ -945,6 +951,7 @@ void svm_learn_optimization(DOC **docs, double *rhs, long int
   model->supvec[0]=0;  /* element 0 reserved and empty for now */
   model->alpha[0]=0;
   model->lin_weights=NULL;
+  model->kernel_block=NULL;
   model->totwords=totwords;
   model->totdoc=totdoc;
   model->kernel_parm=(*kernel_parm);
@@ -1290,6 +1297,8 @@ long optimize_to_convergence(DOC **docs, long int *label, long int totdoc,
   }
   else 
     weights=NULL;
+  if(kernel_cache)
+    kernel_cache_add_block(kernel_cache,docs,totdoc,totwords,kernel_parm);
 
   choosenum=0;
   inconsistentnum=0;
@@ -1649,6 +1658,7 @@ long optimize_to_convergence(DOC **docs, long int *label, long int totdoc,
   free(qp.opt_low);
   free(qp.opt_up);
   if(weights) free(weights);
+  if(kernel_cache) kernel_cache_remove_block(kernel_cache);
 
   learn_parm->epsilon_crit=epsilon_crit_org; /* restore org */
   model->maxdiff=(*maxdiff);
@@ -1735,6 +1745,8 @@ long optimize_to_convergence_sharedslack(DOC **docs, long int *label,
   }
   else 
     weights=NULL;
+  if(kernel_cache)
+    kernel_cache_add_block(kernel_cache,docs,totdoc,totwords,kernel_parm);
   maxslackid=0;
   for(i=0;i<totdoc;i++) {    /* determine size of slack array */
     if(maxslackid<docs[i]->slackid)
@@ -2094,6 +2106,7 @@ long optimize_to_convergence_sharedslack(DOC **docs, long int *label,
   free(qp.opt_low);
   free(qp.opt_up);
   if(weights) free(weights);
+  if(kernel_cache) kernel_cache_remove_block(kernel_cache);
 
   learn_parm->epsilon_crit=epsilon_crit_org; /* restore org */
   model->maxdiff=(*maxdiff);
@@ -2405,8 +2418,8 @@ long check_optimality(MODEL *model, long int *label, long int *unlabeled,
 		      long int iteration, KERNEL_PARM *kernel_parm)
      /* Check KT-conditions */
 {
-  long i,ii,retrain;
-  double dist,ex_c,target;
+  long i,ii,retrain,activenum,misclassnum;
+  double dist,ex_c,target,maxviol;
 
   if(kernel_parm->kernel_type == LINEAR) {  /* be optimistic */
     learn_parm->epsilon_shrink=-learn_parm->epsilon_crit+epsilon_crit_org;  
@@ -2415,24 +2428,29 @@ long check_optimality(MODEL *model, long int *label, long int *unlabeled,
     learn_parm->epsilon_shrink=learn_parm->epsilon_shrink*0.7+(*maxdiff)*0.3; 
   }
   retrain=0;
-  (*maxdiff)=0;
-  (*misclassified)=0;
-  for(ii=0;(i=active2dnum[ii])>=0;ii++) {
+  maxviol=0;
+  misclassnum=0;
+  for(activenum=0;active2dnum[activenum]>=0;activenum++);
+#pragma omp parallel for private(i,dist,ex_c,target) schedule(static) \
+        reduction(max:maxviol) reduction(+:misclassnum) \
+        if(activenum >= PARALLEL_MIN_ACTIVE)
+  for(ii=0;ii<activenum;ii++) {
+    i=active2dnum[ii];
     if((!inconsistent[i]) && label[i]) {
       dist=(lin[i]-model->b)*(double)label[i];/* 'distance' from
 						 hyperplane*/
       target=-(learn_parm->eps-(double)label[i]*c[i]);
       ex_c=learn_parm->svm_cost[i]-learn_parm->epsilon_a;
       if(dist <= 0) {       
-	(*misclassified)++;  /* does not work due to deactivation of var */
+	misclassnum++;  /* does not work due to deactivation of var */
       }
       if((a[i]>learn_parm->epsilon_a) && (dist > target)) {
-	if((dist-target)>(*maxdiff))  /* largest violation */
-	  (*maxdiff)=dist-target;
+	if((dist-target)>maxviol)  /* largest violation */
+	  maxviol=dist-target;
       }
       else if((a[i]<ex_c) && (dist < target)) {
-	if((target-dist)>(*maxdiff))  /* largest violation */
-	  (*maxdiff)=target-dist;
+	if((target-dist)>maxviol)  /* largest violation */
+	  maxviol=target-dist;
       }
       /* Count how long a variable was at lower/upper bound (and optimal).*/
       /* Variables, which were at the bound and optimal for a long */
@@ -2453,6 +2471,8 @@ long check_optimality(MODEL *model, long int *label, long int *unlabeled,
       }
     }   
   }
+  (*maxdiff)=maxviol;
+  (*misclassified)=misclassnum;
   /* termination criterion */
   if((!retrain) && ((*maxdiff) > learn_parm->epsilon_crit)) {  
     retrain=1;
@@ -2471,8 +2491,8 @@ long check_optimality_sharedslack(DOC **docs, MODEL *model, long int *label,
 		      long int iteration, KERNEL_PARM *kernel_parm)
      /* Check KT-conditions */
 {
-  long i,ii,retrain;
-  double dist,dist_noslack,ex_c=0,target;
+  long i,ii,retrain,activenum;
+  double dist,dist_noslack,ex_c=0,target,maxviol;
 
   if(kernel_parm->kernel_type == LINEAR) {  /* be optimistic */
     learn_parm->epsilon_shrink=-learn_parm->epsilon_crit/2.0;
@@ -2482,26 +2502,31 @@ long check_optimality_sharedslack(DOC **docs, MODEL *model, long int *label,
   }
 
   retrain=0;
-  (*maxdiff)=0;
+  maxviol=0;
   (*misclassified)=0;
-  for(ii=0;(i=active2dnum[ii])>=0;ii++) {
+  for(activenum=0;active2dnum[activenum]>=0;activenum++);
+#pragma omp parallel for private(i,dist,dist_noslack,target) \
+        firstprivate(ex_c) schedule(static) reduction(max:maxviol) \
+        if(activenum >= PARALLEL_MIN_ACTIVE)
+  for(ii=0;ii<activenum;ii++) {
+    i=active2dnum[ii];
     /* 'distance' from hyperplane*/
     dist_noslack=(lin[i]-model->b)*(double)label[i];
     dist=dist_noslack+slack[docs[i]->slackid];
     target=-(learn_parm->eps-(double)label[i]*c[i]);
     ex_c=learn_parm->svm_c-learn_parm->epsilon_a;
     if((a[i]>learn_parm->epsilon_a) && (dist > target)) {
-      if((dist-target)>(*maxdiff)) {  /* largest violation */
-	(*maxdiff)=dist-target;
+      if((dist-target)>maxviol) {  /* largest violation */
+	maxviol=dist-target;
 	if(verbosity>=5) printf("sid %ld: dist=%.2f, target=%.2f, slack=%.2f, a=%f, alphaslack=%f\n",docs[i]->slackid,dist,target,slack[docs[i]->slackid],a[i],alphaslack[docs[i]->slackid]);
-	if(verbosity>=5) printf(" (single %f)\n",(*maxdiff));
+	if(verbosity>=5) printf(" (single %f)\n",maxviol);
       }
     }
     if((alphaslack[docs[i]->slackid]<ex_c) && (slack[docs[i]->slackid]>0)) {
-      if((slack[docs[i]->slackid])>(*maxdiff)) { /* largest violation */
-	(*maxdiff)=slack[docs[i]->slackid];
+      if((slack[docs[i]->slackid])>maxviol) { /* largest violation */
+	maxviol=slack[docs[i]->slackid];
 	if(verbosity>=5) printf("sid %ld: dist=%.2f, target=%.2f, slack=%.2f, a=%f, alphaslack=%f\n",docs[i]->slackid,dist,target,slack[docs[i]->slackid],a[i],alphaslack[docs[i]->slackid]);
-	if(verbosity>=5) printf(" (joint %f)\n",(*maxdiff));
+	if(verbosity>=5) printf(" (joint %f)\n",maxviol);
       }
     }
     /* Count how long a variable was at lower/upper bound (and optimal).*/
@@ -2519,6 +2544,7 @@ long check_optimality_sharedslack(DOC **docs, MODEL *model, long int *label,
       last_suboptimal_at[i]=iteration;  /* not likely optimal */
     }
   }   
+  (*maxdiff)=maxviol;
   /* termination criterion */
   if((!retrain) && ((*maxdiff) > learn_parm->epsilon_crit)) {  
     retrain=1;
@@ -2653,11 +2679,16 @@ void update_linear_component(DOC **docs, long int *label,
      /* in the current working set */
      /* WARNING: Assumes that array of weights is initialized to all zero 
  	         values for linear kernel! */
+     /* The sweeps over the active set are split over threads, if the
+	code is compiled with OpenMP. */
 {
   register long i,ii,j,jj;
-  register double tec;
+  long activenum;
+  double tec;
   SVECTOR *f;
 
+  for(activenum=0;active2dnum[activenum]>=0;activenum++);
+
   if(kernel_parm->kernel_type==0) { /* special linear case */
     /* clear_vector_n(weights,totwords); */
     for(ii=0;(i=working2dnum[ii])>=0;ii++) {
@@ -2667,7 +2698,10 @@ void update_linear_component(DOC **docs, long int *label,
 			f->factor*((a[i]-a_old[i])*(double)label[i]));
       }
     }
-    for(jj=0;(j=active2dnum[jj])>=0;jj++) {
+#pragma omp parallel for private(j,f) schedule(static) \
+        if(activenum >= PARALLEL_MIN_ACTIVE)
+    for(jj=0;jj<activenum;jj++) {
+      j=active2dnum[jj];
       for(f=docs[j]->fvec;f;f=f->next)  
 	lin[j]+=f->factor*sprod_ns(weights,f);
     }
@@ -2683,7 +2717,10 @@ void update_linear_component(DOC **docs, long int *label,
       if(a[i] != a_old[i]) {
 	get_kernel_row(kernel_cache,docs,i,totdoc,active2dnum,aicache,
 		       kernel_parm);
-	for(ii=0;(j=active2dnum[ii])>=0;ii++) {
+#pragma omp parallel for private(j,tec) schedule(static) \
+        if(activenum >= PARALLEL_MIN_ACTIVE)
+	for(ii=0;ii<activenum;ii++) {
+	  j=active2dnum[ii];
 	  tec=aicache[j];
 	  lin[j]+=(((a[i]*tec)-(a_old[i]*tec))*(double)label[i]);
 	}
@@ -3396,24 +3433,54 @@ void reactivate_inactive_examples(long int *label,
      /* Computes lin for those variables from scratch. */
      /* WARNING: Assumes that array of weights is initialized to all zero 
  	         values for linear kernel! */
+     /* With OpenMP, the linear weight vector is summed up in one
+	accumulator per thread and lin is recomputed in parallel. */
 {
   register long i,j,ii,jj,t,*changed2dnum,*inactive2dnum;
-  long *changed,*inactive;
-  register double kernel_val,*a_old,dist;
-  double ex_c,target;
+  long *changed,*inactive,k,inactivenum,nthreads;
+  register double kernel_val,*a_old;
+  double ex_c,target,dist,maxviol,*wsum,*tweights;
   SVECTOR *f;
 
   if(kernel_parm->kernel_type == LINEAR) { /* special linear case */
     /* clear_vector_n(weights,totwords);  set weights to zero */
     a_old=shrink_state->last_a;    
-    for(i=0;i<totdoc;i++) {
-      if(a[i] != a_old[i]) {
-	for(f=docs[i]->fvec;f;f=f->next)  
-	  add_vector_ns(weights,f,
-			f->factor*((a[i]-a_old[i])*(double)label[i]));
-	a_old[i]=a[i];
+    nthreads=1;
+#ifdef _OPENMP
+    if(totdoc >= PARALLEL_MIN_ACTIVE)
+      nthreads=omp_get_max_threads();
+#endif
+    wsum=NULL;
+    if(nthreads>1) {  /* one private accumulator per thread */
+      wsum=(double *)my_malloc(sizeof(double)*(totwords+1)*nthreads);
+      for(k=0;k<(totwords+1)*nthreads;k++)
+	wsum[k]=0;
+    }
+#pragma omp parallel num_threads(nthreads) private(i,f,tweights)
+    {
+      tweights=weights;
+#ifdef _OPENMP
+      if(wsum)
+	tweights=wsum+(totwords+1)*omp_get_thread_num();
+#endif
+#pragma omp for schedule(static)
+      for(i=0;i<totdoc;i++) {
+	if(a[i] != a_old[i]) {
+	  for(f=docs[i]->fvec;f;f=f->next)  
+	    add_vector_ns(tweights,f,
+			  f->factor*((a[i]-a_old[i])*(double)label[i]));
+	  a_old[i]=a[i];
+	}
       }
     }
+    if(wsum) {        /* reduce thread accumulators in fixed order */
+      for(t=0;t<nthreads;t++) 
+	for(k=0;k<=totwords;k++)
+	  weights[k]+=wsum[(totwords+1)*t+k];
+      free(wsum);
+    }
+#pragma omp parallel for private(f) schedule(static) \
+        if(totdoc >= PARALLEL_MIN_ACTIVE)
     for(i=0;i<totdoc;i++) {
       if(!shrink_state->active[i]) {
 	for(f=docs[i]->fvec;f;f=f->next)  
@@ -3421,10 +3488,7 @@ void reactivate_inactive_examples(long int *label,
       }
       shrink_state->last_lin[i]=lin[i];
     }
-    for(i=0;i<totdoc;i++) {
-      for(f=docs[i]->fvec;f;f=f->next)  
-	mult_vector_ns(weights,f,0.0); /* set weights back to zero */
-    }
+    clear_nvector(weights,totwords); /* set weights back to zero */
   }
   else {
     changed=(long *)my_malloc(sizeof(long)*totdoc);
@@ -3441,13 +3505,16 @@ void reactivate_inactive_examples(long int *label,
 		     && (shrink_state->inactive_since[i] == t));
 	changed[i]= (a[i] != a_old[i]);
       }
-      compute_index(inactive,totdoc,inactive2dnum);
+      inactivenum=compute_index(inactive,totdoc,inactive2dnum);
       compute_index(changed,totdoc,changed2dnum);
       
       for(ii=0;(i=changed2dnum[ii])>=0;ii++) {
 	get_kernel_row(kernel_cache,docs,i,totdoc,inactive2dnum,aicache,
 		       kernel_parm);
-	for(jj=0;(j=inactive2dnum[jj])>=0;jj++) {
+#pragma omp parallel for private(j,kernel_val) schedule(static) \
+        if(inactivenum >= PARALLEL_MIN_ACTIVE)
+	for(jj=0;jj<inactivenum;jj++) {
+	  j=inactive2dnum[jj];
 	  kernel_val=aicache[j];
 	  lin[j]+=(((a[i]*kernel_val)-(a_old[i]*kernel_val))*(double)label[i]);
 	}
@@ -3458,7 +3525,9 @@ void reactivate_inactive_examples(long int *label,
     free(inactive);
     free(inactive2dnum);
   }
-  (*maxdiff)=0;
+  maxviol=0;
+#pragma omp parallel for private(dist,target,ex_c) schedule(static) \
+        reduction(max:maxviol) if(totdoc >= PARALLEL_MIN_ACTIVE)
   for(i=0;i<totdoc;i++) {
     shrink_state->inactive_since[i]=shrink_state->deactnum-1;
     if(!inconsistent[i]) {
@@ -3466,12 +3535,12 @@ void reactivate_inactive_examples(long int *label,
       target=-(learn_parm->eps-(double)label[i]*c[i]);
       ex_c=learn_parm->svm_cost[i]-learn_parm->epsilon_a;
       if((a[i]>learn_parm->epsilon_a) && (dist > target)) {
-	if((dist-target)>(*maxdiff))  /* largest violation */
-	  (*maxdiff)=dist-target;
+	if((dist-target)>maxviol)  /* largest violation */
+	  maxviol=dist-target;
       }
       else if((a[i]<ex_c) && (dist < target)) {
-	if((target-dist)>(*maxdiff))  /* largest violation */
-	  (*maxdiff)=target-dist;
+	if((target-dist)>maxviol)  /* largest violation */
+	  maxviol=target-dist;
       }
       if((a[i]>(0+learn_parm->epsilon_a)) 
 	 && (a[i]<ex_c)) { 
@@ -3489,6 +3558,7 @@ void reactivate_inactive_examples(long int *label,
       }
     }
   }
+  (*maxdiff)=maxviol;
   if(kernel_parm->kernel_type != LINEAR) { /* update history for non-linear */
     for(i=0;i<totdoc;i++) {
       (shrink_state->a_history[shrink_state->deactnum-1])[i]=a[i];
@@ -3512,27 +3582,67 @@ void get_kernel_row(KERNEL_CACHE *kernel_cache, DOC **docs,
      /* y_i * y_j * a_i * a_j */
      /* Takes the values from the cache if available. */
 {
-  register long i,j,start;
+  long i,j,k,start,activenum,misses,*miss,evals=0;
+  double *kval;
   DOC *ex;
 
   ex=docs[docnum];
-
-  if(kernel_cache && (kernel_cache->index[docnum] != -1)) {/* row is cached? */
+  for(activenum=0;active2dnum[activenum]>=0;activenum++);
+
+  if(kernel_cache && kernel_cache->block) { /* batch all uncached columns */
+    miss=(long *)my_malloc(sizeof(long)*(activenum+1));
+    kval=(double *)my_malloc(sizeof(double)*(activenum+1));
+    start=-1;
+    if(kernel_cache->index[docnum] != -1) {/* row is cached? */
+      kernel_cache->lru[kernel_cache->index[docnum]]=kernel_cache->time;
+      start=kernel_cache->activenum*kernel_cache->index[docnum];
+    }
+    misses=0;
+    for(i=0;i<activenum;i++) {
+      j=active2dnum[i];
+      if((start>=0) && (kernel_cache->totdoc2active[j] >= 0)) 
+	buffer[j]=kernel_cache->buffer[start+kernel_cache->totdoc2active[j]];
+      else 
+	miss[misses++]=j;
+    }
+    kernel_block_columns(kernel_parm,kernel_cache->block,miss,misses,
+			 ex->fvec,kval);
+    for(k=0;k<misses;k++) 
+      buffer[miss[k]]=(CFLOAT)kval[k];
+    free(miss);
+    free(kval);
+  }
+  else if(kernel_cache && (kernel_cache->index[docnum] != -1)) {/* row is cached? */
     kernel_cache->lru[kernel_cache->index[docnum]]=kernel_cache->time;/* lru */
     start=kernel_cache->activenum*kernel_cache->index[docnum];
-    for(i=0;(j=active2dnum[i])>=0;i++) {
+    kernel_twonorms(kernel_parm,ex);
+    for(i=0;i<activenum;i++) 
+      if(kernel_cache->totdoc2active[active2dnum[i]] < 0)
+	kernel_twonorms(kernel_parm,docs[active2dnum[i]]);
+#pragma omp parallel for private(j) schedule(dynamic,64) reduction(+:evals) \
+        if((activenum >= PARALLEL_MIN_ACTIVE) && (kernel_parm->kernel_type != CUSTOM))
+    for(i=0;i<activenum;i++) {
+      j=active2dnum[i];
       if(kernel_cache->totdoc2active[j] >= 0) { /* column is cached? */
 	buffer[j]=kernel_cache->buffer[start+kernel_cache->totdoc2active[j]];
       }
       else {
-	buffer[j]=(CFLOAT)kernel(kernel_parm,ex,docs[j]);
+	buffer[j]=(CFLOAT)kernel_value(kernel_parm,ex,docs[j],&evals);
       }
     }
+    kernel_cache_statistic+=evals;
   }
   else {
-    for(i=0;(j=active2dnum[i])>=0;i++) {
-      buffer[j]=(CFLOAT)kernel(kernel_parm,ex,docs[j]);
+    kernel_twonorms(kernel_parm,ex);
+    for(i=0;i<activenum;i++) 
+      kernel_twonorms(kernel_parm,docs[active2dnum[i]]);
+#pragma omp parallel for private(j) schedule(static) reduction(+:evals) \
+        if((activenum >= PARALLEL_MIN_ACTIVE) && (kernel_parm->kernel_type != CUSTOM))
+    for(i=0;i<activenum;i++) {
+      j=active2dnum[i];
+      buffer[j]=(CFLOAT)kernel_value(kernel_parm,ex,docs[j],&evals);
     }
+    kernel_cache_statistic+=evals;
   }
 }
 
@@ -3541,15 +3651,49 @@ void cache_kernel_row(KERNEL_CACHE *kernel_cache, DOC **docs,
 		      long int m, KERNEL_PARM *kernel_parm)
      /* Fills cache for the row m */
 {
-  register DOC *ex;
-  register long j,k,l;
-  register CFLOAT *cache;
+  DOC *ex;
+  long j,k,l,misses,*miss,*misspos,evals=0;
+  double *kval;
+  CFLOAT *cache;
 
   if(!kernel_cache_check(kernel_cache,m)) {  /* not cached yet*/
     cache = kernel_cache_clean_and_malloc(kernel_cache,m);
-    if(cache) {
+    if(cache && kernel_cache->block) { /* batch all uncached columns */
+      l=kernel_cache->totdoc2active[m];
+      ex=docs[m];
+      miss=(long *)my_malloc(sizeof(long)*(kernel_cache->activenum+1));
+      misspos=(long *)my_malloc(sizeof(long)*(kernel_cache->activenum+1));
+      kval=(double *)my_malloc(sizeof(double)*(kernel_cache->activenum+1));
+      misses=0;
+      for(j=0;j<kernel_cache->activenum;j++) {  /* fill cache */
+	k=kernel_cache->active2totdoc[j];
+	if((kernel_cache->index[k] != -1) && (l != -1) && (k != m)) {
+	  cache[j]=kernel_cache->buffer[kernel_cache->activenum
+				       *kernel_cache->index[k]+l];
+	}
+	else {
+	  miss[misses]=k;
+	  misspos[misses]=j;
+	  misses++;
+	} 
+      }
+      kernel_block_columns(kernel_parm,kernel_cache->block,miss,misses,
+			   ex->fvec,kval);
+      for(k=0;k<misses;k++) 
+	cache[misspos[k]]=(CFLOAT)kval[k];
+      free(miss);
+      free(misspos);
+      free(kval);
+    }
+    else if(cache) {
       l=kernel_cache->totdoc2active[m];
       ex=docs[m];
+      kernel_twonorms(kernel_parm,ex);
+      for(j=0;j<kernel_cache->activenum;j++) 
+	kernel_twonorms(kernel_parm,docs[kernel_cache->active2totdoc[j]]);
+#pragma omp parallel for private(k) schedule(dynamic,64) reduction(+:evals) \
+        if((kernel_cache->activenum >= PARALLEL_MIN_ACTIVE) \
+           && (kernel_parm->kernel_type != CUSTOM))
       for(j=0;j<kernel_cache->activenum;j++) {  /* fill cache */
 	k=kernel_cache->active2totdoc[j];
 	if((kernel_cache->index[k] != -1) && (l != -1) && (k != m)) {
@@ -3557,9 +3701,10 @@ void cache_kernel_row(KERNEL_CACHE *kernel_cache, DOC **docs,
 				       *kernel_cache->index[k]+l];
 	}
 	else {
-	  cache[j]=kernel(kernel_parm,ex,docs[k]);
+	  cache[j]=kernel_value(kernel_parm,ex,docs[k],&evals);
 	} 
       }
+      kernel_cache_statistic+=evals;
     }
     else {
       perror("Error: Kernel cache full! => increase cache size");
@@ -3567,6 +3712,51 @@ void cache_kernel_row(KERNEL_CACHE *kernel_cache, DOC **docs,
   }
 }
 
+void kernel_block_columns(KERNEL_PARM *kernel_parm, KERNEL_BLOCK *block,
+			  long *cols, long n, SVECTOR *b, double *kval)
+     /* Computes kval[k] as the kernel between b and the training
+	vector cols[k] of the block for k<n. Chunks of the columns are
+	split over threads. */
+{
+  long k;
+
+#pragma omp parallel for schedule(dynamic) if(n >= PARALLEL_MIN_ACTIVE)
+  for(k=0;k<n;k+=KERNEL_BLOCK_CHUNK) 
+    kernel_block_eval(kernel_parm,block,cols+k,MIN(KERNEL_BLOCK_CHUNK,n-k),
+		      b,kval+k);
+}
+
+void kernel_cache_add_block(KERNEL_CACHE *kernel_cache, DOC **docs, 
+			    long int totdoc, long int totwords, 
+			    KERNEL_PARM *kernel_parm)
+     /* Packs the training vectors into a dense kernel block, so that
+	the kernel values of a row that are not in the cache can be
+	computed in one batch. Nothing is done if the kernel or the
+	data are not suited for it. */
+{
+  SVECTOR **lists;
+  long i;
+
+  kernel_cache->block=NULL;
+  lists=(SVECTOR **)my_malloc(sizeof(SVECTOR *)*(totdoc+1));
+  for(i=0;i<totdoc;i++) 
+    lists[i]=docs[i]->fvec;
+  if(kernel_block_applicable(kernel_parm,lists,totdoc,totwords+1)) {
+    kernel_cache->block=create_kernel_block(lists,NULL,totdoc,totwords+1);
+    if(verbosity>=2) {
+      printf(" Packed training vectors into dense kernel block (%ld rows).\n",
+	     kernel_cache->block->rows);
+    }
+  }
+  free(lists);
+}
+
+void kernel_cache_remove_block(KERNEL_CACHE *kernel_cache)
+{
+  free_kernel_block(kernel_cache->block);
+  kernel_cache->block=NULL;
+}
+
  
 void cache_multiple_kernel_rows(KERNEL_CACHE *kernel_cache, DOC **docs, 
 				long int *key, long int varnum, 
@@ -3688,6 +3878,7 @@ KERNEL_CACHE *kernel_cache_init(long int totdoc, long int buffsize)
   }
 
   kernel_cache->time=0;  
+  kernel_cache->block=NULL;
 
   return(kernel_cache);
 } 
@@ -3714,6 +3905,7 @@ void kernel_cache_cleanup(KERNEL_CACHE *kernel_cache)
   free(kernel_cache->active2totdoc);
   free(kernel_cache->totdoc2active);
   free(kernel_cache->buffer);
+  free_kernel_block(kernel_cache->block);
   free(kernel_cache);
 }
 
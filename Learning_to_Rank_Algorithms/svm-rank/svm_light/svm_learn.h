@@ -19,6 +19,13 @@
 #ifndef SVM_LEARN
 #define SVM_LEARN
 
+/* minimum number of examples in a sweep over the active set before
+   the sweep is split over OpenMP threads */
+# define PARALLEL_MIN_ACTIVE 1000
+/* number of columns of a kernel row computed from the kernel block
+   as one unit of work */
+# define KERNEL_BLOCK_CHUNK 256
+
 void   svm_learn_classification(DOC **, double *, long, long, LEARN_PARM *, 
 				KERNEL_PARM *, KERNEL_CACHE *, MODEL *,
 				double *);
@@ -117,6 +124,11 @@ void   kernel_cache_cleanup(KERNEL_CACHE *);
 void   get_kernel_row(KERNEL_CACHE *,DOC **, long, long, long *, CFLOAT *, 
 		      KERNEL_PARM *);
 void   cache_kernel_row(KERNEL_CACHE *,DOC **, long, KERNEL_PARM *);
+void   kernel_block_columns(KERNEL_PARM *, KERNEL_BLOCK *, long *, long, 
+			     SVECTOR *, double *);
+void   kernel_cache_add_block(KERNEL_CACHE *, DOC **, long, long, 
+			       KERNEL_PARM *);
+void   kernel_cache_remove_block(KERNEL_CACHE *);
 void   cache_multiple_kernel_rows(KERNEL_CACHE *,DOC **, long *, long, 
 				  KERNEL_PARM *);
 void   kernel_cache_shrink(KERNEL_CACHE *,long, long, long *);
@@ -156,6 +168,7 @@ void   write_model(char *, MODEL *);
 void   write_prediction(char *, MODEL *, double *, double *, long *, long *,
 			long, LEARN_PARM *);
 void   write_alphas(char *, double *, long *, long);
+void   reset_qp_optimizer(void);  /* in the QP solver (svm_hideo.c) */
 
 typedef struct cache_parm_s {
   KERNEL_CACHE *kernel_cache;
@@ -33,6 +33,8 @@ extern "C" {
 char docfile[200];           /* file with training examples */
 char modelfile[200];         /* file for resulting classifier */
 char restartfile[200];       /* file with initial alphas */
+long poly2_expand=0;         /* train degree 2 polynomial kernels over
+				their explicit feature map, if possible */
 
 void   read_input_parameters(int, char **, char *, char *, char *, long *, 
 			     LEARN_PARM *, KERNEL_PARM *);
@@ -49,14 +51,32 @@ int main (int argc, char* argv[])
   double *alpha_in=NULL;
   KERNEL_CACHE *kernel_cache;
   LEARN_PARM learn_parm;
-  KERNEL_PARM kernel_parm;
-  MODEL *model=(MODEL *)my_malloc(sizeof(MODEL));
+  KERNEL_PARM kernel_parm,poly_parm;
+  MODEL *model=(MODEL *)my_malloc(sizeof(MODEL)),*poly_model;
+  long poly_expanded=0;
 
   read_input_parameters(argc,argv,docfile,modelfile,restartfile,&verbosity,
 			&learn_parm,&kernel_parm);
   read_documents(docfile,&docs,&target,&totwords,&totdoc);
   if(restartfile[0]) alpha_in=read_alphas(restartfile,totdoc);
 
+  /* For a polynomial kernel of degree 2 on few features, it is faster
+     to train a linear model over the explicit feature map. */
+  if(poly2_expand && poly2_expansion_applicable(&kernel_parm,docs,totdoc,totwords)) {
+    if(verbosity>=1) {
+      printf("Expanding polynomial kernel into %ld features...",
+	     poly2_expansion_size(totwords)); fflush(stdout);
+    }
+    expand_poly2_documents(docs,totdoc,&kernel_parm);
+    poly_parm=kernel_parm;
+    poly_expanded=1;
+    kernel_parm.kernel_type=LINEAR;
+    totwords=poly2_expansion_size(totwords);
+    if(verbosity>=1) {
+      printf("done\n"); fflush(stdout);
+    }
+  }
+
   if(kernel_parm.kernel_type == LINEAR) { /* don't need the cache */
     kernel_cache=NULL;
   }
@@ -92,7 +112,13 @@ int main (int argc, char* argv[])
      If you want to free the original data, and only keep the model, you 
      have to make a deep copy of 'model'. */
   /* deep_copy_of_model=copy_model(model); */
-  write_model(modelfile,model);
+  if(poly_expanded) {
+    poly_model=compact_poly2_model(model,&poly_parm);
+    write_model(modelfile,poly_model);
+    free_model(poly_model,1);
+  }
+  else
+    write_model(modelfile,model);
 
   free(alpha_in);
   free_model(model,0);
@@ -148,6 +174,7 @@ void read_input_parameters(int argc,char *argv[],char *docfile,char *modelfile,
       case 's': i++; kernel_parm->coef_lin=atof(argv[i]); break;
       case 'r': i++; kernel_parm->coef_const=atof(argv[i]); break;
       case 'u': i++; strcpy(kernel_parm->custom,argv[i]); break;
+      case 'E': i++; poly2_expand=atol(argv[i]); break;
       case 'l': i++; strcpy(learn_parm->predfile,argv[i]); break;
       case 'a': i++; strcpy(learn_parm->alphafile,argv[i]); break;
       case 'y': i++; strcpy(restartfile,argv[i]); break;
@@ -252,6 +279,14 @@ void print_help()
   printf("                        3: sigmoid tanh(s a*b + c)\n");
   printf("                        4: user defined kernel from kernel.h\n");
   printf("         -d int      -> parameter d in polynomial kernel\n");
+  printf("         -E [0,1]    -> for -t 1 -d 2 with s>0, c>=0 and up to %d features:\n",POLY2_EXPAND_MAXWORDS);
+  printf("                        0: train with the exact kernel\n");
+  printf("                        1: train a linear model over the explicit\n");
+  printf("                           feature map of the kernel, which is faster.\n");
+  printf("                           The model is written as kernel type %d,\n",POLY_EXPANDED);
+  printf("                           which older versions of svm_classify\n");
+  printf("                           cannot read, and its scores can differ\n");
+  printf("                           slightly from those of 0. (default 0)\n");
   printf("         -g float    -> parameter gamma in rbf kernel\n");
   printf("         -s float    -> parameter s in sigmoid/poly kernel\n");
   printf("         -r float    -> parameter c in sigmoid/poly kernel\n");
@@ -209,3 +209,19 @@ LEARN_PARM *learn_parm;
   }
 }
 
+void reset_qp_optimizer(void)
+     /* frees the buffers of the optimizer and forgets the settings it
+	adapted during previous runs */
+{
+  if(primal) {
+    free(primal);
+    free(dual);
+    primal=0;
+    dual=0;
+  }
+  init_margin=0.15;
+  init_iter=500;
+  precision_violations=0;
+  opt_precision=DEF_PRECISION_LINEAR;
+}
+
@@ -0,0 +1,180 @@
+/***********************************************************************/
+/*                                                                     */
+/*   svm_rank_compress.c                                               */
+/*                                                                     */
+/*   Reduces the number of support vectors of a kernel model, so that  */
+/*   scoring needs fewer kernel evaluations.                           */
+/*                                                                     */
+/***********************************************************************/
+
+# include "svm_light/svm_common.h"
+# include "svm_light/svm_learn.h"
+
+char modelfile[200];
+char outfile[200];
+char valfile[200];
+
+void read_input_parameters(int, char **, char *, char *, char *, long *,
+			   long *);
+void print_validation_error(MODEL *, MODEL *, char *);
+void print_help(void);
+
+
+int main (int argc, char* argv[])
+{
+  long budget;
+  double residual;
+  MODEL *model,*reduced;
+
+  read_input_parameters(argc,argv,modelfile,outfile,valfile,&verbosity,
+			&budget);
+
+  model=read_model(modelfile);
+  if((model->kernel_parm.kernel_type == LINEAR)
+     || (model->kernel_parm.kernel_type == POLY_EXPANDED)) {
+    printf("\nModel %s is linear and has no support vectors to reduce!\n\n",
+	   modelfile);
+    exit(1);
+  }
+  if(model->kernel_parm.kernel_type == PRECOMPUTED) {
+    printf("\nModels with a precomputed kernel cannot be reduced!\n\n");
+    exit(1);
+  }
+
+  if(verbosity>=1) {
+    printf("Selecting at most %ld support vectors...",budget); fflush(stdout);
+  }
+  reduced=reduce_kernel_model(model,budget,&residual);
+  if(verbosity>=1) {
+    printf("done\n");
+    printf("Support vectors: %ld -> %ld\n",model->sv_num-1,reduced->sv_num-1);
+    printf("Relative distance of the weight vectors |w-w'|/|w|: %.6f\n",
+	   residual);
+  }
+  write_model(outfile,reduced);
+
+  if(valfile[0])
+    print_validation_error(model,reduced,valfile);
+
+  free_model(reduced,1);
+  free_model(model,1);
+  return(0);
+}
+
+void print_validation_error(MODEL *model, MODEL *reduced, char *file)
+     /* compares the rankings that both models produce for the
+	queries in file */
+{
+  DOC **docs;
+  double *label,*s0,*s1,diff,sqdiff=0,maxdiff=0;
+  double swapped0=0,swapped1=0,pairs,sw0,sw1,flips=0,allpairs=0;
+  long totwords,totdoc,i,j,start,end,queries=0;
+
+  read_documents(file,&docs,&label,&totwords,&totdoc);
+  s0=(double *)my_malloc(sizeof(double)*(totdoc+1));
+  s1=(double *)my_malloc(sizeof(double)*(totdoc+1));
+  add_kernel_block_to_model(model);
+  add_kernel_block_to_model(reduced);
+  classify_examples(model,docs,totdoc,s0);
+  classify_examples(reduced,docs,totdoc,s1);
+
+  for(i=0;i<totdoc;i++) {
+    diff=fabs(s0[i]-s1[i]);
+    sqdiff+=diff*diff;
+    if(diff > maxdiff)
+      maxdiff=diff;
+  }
+  /* swapped pairs per query, as reported by svm_rank_classify */
+  for(start=0;start<totdoc;start=end) {
+    for(end=start+1;(end<totdoc)
+	  && (docs[end]->queryid == docs[start]->queryid);end++);
+    pairs=sw0=sw1=0;
+    for(i=start;i<end;i++) {
+      for(j=start;j<end;j++) {
+	if(label[i]>label[j]) {
+	  pairs++;
+	  if(s0[i]<=s0[j]) sw0++;
+	  if(s1[i]<=s1[j]) sw1++;
+	}
+	if((i<j) && ((s0[i]<s0[j]) != (s1[i]<s1[j])))
+	  flips++;
+	if(i<j)
+	  allpairs++;
+      }
+    }
+    if(pairs) {
+      swapped0+=sw0/pairs;
+      swapped1+=sw1/pairs;
+    }
+    queries++;
+  }
+
+  printf("Validation set: %ld documents, %ld queries\n",totdoc,queries);
+  printf("Score difference: RMS %.6g, maximum %.6g\n",
+	 totdoc ? sqrt(sqdiff/totdoc) : 0,maxdiff);
+  printf("Avg swapped pairs percent: %.2f (original), %.2f (reduced)\n",
+	 queries ? 100.0*swapped0/queries : 0,
+	 queries ? 100.0*swapped1/queries : 0);
+  printf("Pairs ranked in different order: %.2f%%\n",
+	 allpairs ? 100.0*flips/allpairs : 0);
+
+  for(i=0;i<totdoc;i++)
+    free_example(docs[i],1);
+  free(docs);
+  free(label);
+  free(s0);
+  free(s1);
+}
+
+void read_input_parameters(int argc, char **argv, char *modelfile,
+			   char *outfile, char *valfile,
+			   long int *verbosity, long int *budget)
+{
+  long i;
+
+  /* set default */
+  strcpy (valfile, "");
+  (*verbosity)=1;
+  (*budget)=100;
+
+  for(i=1;(i<argc) && ((argv[i])[0] == '-');i++) {
+    switch ((argv[i])[1])
+      {
+      case 'h': print_help(); exit(0);
+      case 'v': i++; (*verbosity)=atol(argv[i]); break;
+      case 'b': i++; (*budget)=atol(argv[i]); break;
+      case 'e': i++; strcpy(valfile,argv[i]); break;
+      default: printf("\nUnrecognized option %s!\n\n",argv[i]);
+	       print_help();
+	       exit(0);
+      }
+  }
+  if((i+1)>=argc) {
+    printf("\nNot enough input parameters!\n\n");
+    print_help();
+    exit(0);
+  }
+  strcpy (modelfile, argv[i]);
+  strcpy (outfile, argv[i+1]);
+  if((*budget) < 1) {
+    printf("\nThe number of support vectors must be at least 1!\n\n");
+    print_help();
+    exit(0);
+  }
+}
+
+void print_help(void)
+{
+  printf("\nSVM-rank model compression, based on SVM-light %s\n",VERSION);
+  copyright_notice();
+  printf("   usage: svm_rank_compress [options] model_file output_file\n\n");
+  printf("Approximates a kernel model with fewer support vectors. They are\n");
+  printf("selected greedily from the support vectors of the model, and their\n");
+  printf("coefficients are refit after each step. The output is a standard\n");
+  printf("model file for svm_rank_classify.\n\n");
+  printf("options: -h         -> this help\n");
+  printf("         -v [0..3]  -> verbosity level (default 1)\n");
+  printf("         -b int     -> maximum number of support vectors (default 100)\n");
+  printf("         -e file    -> validation examples; reports how much the scores\n");
+  printf("                       and rankings of the reduced model differ\n\n");
+}
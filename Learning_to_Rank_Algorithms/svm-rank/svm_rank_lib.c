@@ -0,0 +1,1416 @@
+/***********************************************************************/
+/*                                                                     */
+/*   svm_rank_lib.c                                                    */
+/*                                                                     */
+/*   Scoring library for SVM-rank models (libsvmrank). Scoring only    */
+/*   reads the model and writes to the workspace of the caller; it     */
+/*   neither allocates memory nor prints anything.                     */
+/*                                                                     */
+/***********************************************************************/
+
+# include "svm_light/svm_common.h"
+# include "svm_rank_lib.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) \
+    && !defined(SVMRANK_NO_SIMD)
+# include <immintrin.h>
+# define QUANT_X86      /* SIMD dot products and dense scorers, chosen at
+			   run time */
+#endif
+
+#define MIN(x,y) ((x) > (y) ? (y) : (x))
+#define MAX(x,y) ((x) < (y) ? (y) : (x))
+
+#define QUANT_PAD 32    /* rows of quantized models are padded with
+			   zeros to a multiple of this length */
+#define QUANT_INT8_MAX_FEATURES 65536  /* 127*255 per feature still fits
+					  into a 32 bit sum */
+#define DENSE_ROWS 16   /* support vectors and documents that the dense */
+#define DENSE_DOCS 4    /* scorers evaluate at a time */
+
+typedef struct quant_model {
+  int    type;         /* SVMRANK_INT8 or SVMRANK_FP16 */
+  long   dim;          /* features 1..dim are used */
+  long   pad;          /* dim rounded up to QUANT_PAD, the row length */
+  long   rows;         /* 1 for linear models, else one per support
+			  vector */
+  signed char *w8;     /* SVMRANK_INT8: rows*pad weights */
+  unsigned short *w16; /* SVMRANK_FP16: rows*pad weights */
+  float  *rowscale;    /* the product of a document with row r is
+			  rowscale[r] times the dot product of the
+			  quantized values */
+  double *coef;        /* kernel models: alpha*factor of row r */
+  double *twonorm;     /* kernel models: squared norm of row r */
+  float  *invrange;    /* feature j+1 is multiplied by invrange[j] */
+  long   (*dot8)(const unsigned char *, const signed char *, long);
+  float  (*dot16)(const float *, const unsigned short *, long);
+  const char *simd;    /* name of the dot product in use */
+} QUANT_MODEL;
+
+typedef struct dense_model {
+  int    type;         /* kernel type of the model */
+  long   dim;          /* features 1..dim are scored; the model has no
+			  weight for higher features */
+  double b;            /* threshold of the model */
+  const double *lin;   /* linear models: weight of feature j+1 is lin[j] */
+  long   rows;         /* kernel models: number of support vectors,
+			  padded to a multiple of DENSE_ROWS */
+  float  *x;           /* feature j+1 of row r is x[j*rows+r] */
+  double *coef;        /* factor of row r in the sum, 0 for padding */
+  float  gamma,coef_lin,coef_const; /* kernel parameters */
+  long   degree;
+  int    mode;         /* SVMRANK_DENSE_AUTO or SVMRANK_DENSE_GENERIC */
+  char   name[40];     /* of the scorer in use, e.g. "rbf-136-avx2" */
+  void   (*score)(const struct dense_model *, const SVMRANK_BATCH *,
+		  const long *, long, float *);
+} DENSE_MODEL;
+
+struct svmrank_model {
+  MODEL  *model;       /* as read by read_scoring_model */
+  long   dim;          /* highest feature number of the model+1 */
+  long   *rows;        /* 0..rows-1, to evaluate all rows of the kernel
+			  block */
+  LINEAR_BOUND *bound; /* for early termination of top-k ranking */
+  QUANT_MODEL *quant;  /* quantized copy of the model that is scored
+			  instead, or NULL */
+  DENSE_MODEL *dense;  /* scorer for dense batches, or NULL */
+  int    dense_on;     /* 0: dense batches are scored like CSR batches */
+  const SVMRANK_MODEL *first; /* linear model that scores all documents
+			  before this one, or NULL */
+  long   cascade_n;    /* number of documents re-scored by this model */
+};
+
+struct svmrank_workspace {
+  long   max_docs;     /* largest batch the buffers are made for */
+  FVAL   *qx;          /* documents unpacked for the kernel block */
+  FVAL   *dense;       /* one document as dense vector, for kernels
+			  without kernel block; all zero between calls */
+  float  *scores;      /* scores of a batch for svmrank_rank_topk */
+  long   *heap;        /* positions of the k best documents so far */
+  FVAL   *x;           /* linear models: one document as dense vector
+			  and */
+  double *prod;        /* its products with the weights; all zero
+			  between calls */
+  long   saved;        /* multiplications skipped by early termination */
+  unsigned char *xq;   /* quantized models: one document as dense */
+  float  *xf;          /* vector; all zero between calls */
+  float  *dot;         /* its dot products with the rows */
+  long   *rescored;    /* cascades: positions of the documents of the */
+  float  *stage2;      /* second stage and their scores */
+};
+
+/* a document of a batch is read feature by feature, with p running
+   from batch_row_start to batch_row_end */
+#define batch_row_start(b,i) ((b)->dim ? 0 : (b)->rowptr[i])
+#define batch_row_end(b,i)   ((b)->dim ? (b)->dim : (b)->rowptr[(i)+1])
+#define batch_fnum(b,i,p)    ((b)->dim ? (p)+1 : (b)->index[p])
+#define batch_value(b,i,p)   ((b)->dim ? (b)->x[(i)*(b)->dim+(p)] \
+                                       : (b)->value[p])
+
+static double score_linear(MODEL *model, const SVMRANK_BATCH *batch, long i)
+     /* same sum as classify_example_linear */
+{
+  long p,fnum;
+  double sum=0;
+
+  for(p=batch_row_start(batch,i);p<batch_row_end(batch,i);p++) {
+    fnum=batch_fnum(batch,i,p);
+    if((fnum>0) && (fnum<=model->totwords))
+      sum+=model->lin_weights[fnum]*(FVAL)batch_value(batch,i,p);
+  }
+  return(sum-model->b);
+}
+
+static double score_poly_expanded(MODEL *model, const SVMRANK_BATCH *batch,
+				  long i)
+     /* same sum as classify_example_poly_expanded, but the features of
+	the explicit feature map are generated on the fly. p=start-1
+	stands for the constant u_0=sqrt(c). */
+{
+  long pi,pj,start,end,fi,fj,k;
+  double ui,uj,w,sum=0;
+  FVAL v;
+
+  start=batch_row_start(batch,i);
+  end=batch_row_end(batch,i);
+  for(pj=start-1;pj<end;pj++) {
+    if(pj<start) {
+      fj=0;
+      uj=sqrt(model->kernel_parm.coef_const);
+    }
+    else {
+      fj=batch_fnum(batch,i,pj);
+      v=(FVAL)batch_value(batch,i,pj);
+      if(v == 0) continue;
+      uj=sqrt(model->kernel_parm.coef_lin)*v;
+    }
+    if(fj*(fj+1)/2+1 > model->totwords)  /* all further features too */
+      break;
+    for(pi=start-1;pi<=pj;pi++) {
+      if(pi<start) {
+	fi=0;
+	ui=sqrt(model->kernel_parm.coef_const);
+      }
+      else {
+	fi=batch_fnum(batch,i,pi);
+	v=(FVAL)batch_value(batch,i,pi);
+	if(v == 0) continue;
+	ui=sqrt(model->kernel_parm.coef_lin)*v;
+      }
+      w=ui*uj;
+      if(pi<pj)
+	w*=M_SQRT2;
+      k=fj*(fj+1)/2+fi+1;
+      if((w != 0) && (k <= model->totwords))
+	sum+=model->lin_weights[k]*(FVAL)w;
+    }
+  }
+  return(sum-model->b);
+}
+
+static void score_kernel_block(const SVMRANK_MODEL *m, SVMRANK_WORKSPACE *ws,
+			       const SVMRANK_BATCH *batch, const long *pos,
+			       long nq, double *score)
+     /* scores the documents pos[0..nq-1] (nq at most
+	KERNEL_BLOCK_QUERIES) against all rows of the kernel block */
+{
+  KERNEL_BLOCK *block=m->model->kernel_block;
+  long   q,j,p,fnum,qid[KERNEL_BLOCK_QUERIES];
+  double qnorm[KERNEL_BLOCK_QUERIES],qfactor[KERNEL_BLOCK_QUERIES];
+  double qsum[KERNEL_BLOCK_QUERIES];
+  FVAL   v,*qx;
+
+  for(q=0;q<nq;q++) {
+    qx=ws->qx+q*block->dim;
+    for(j=0;j<block->dim;j++)
+      qx[j]=0;
+    qnorm[q]=0;
+    for(p=batch_row_start(batch,pos[q]);p<batch_row_end(batch,pos[q]);p++) {
+      fnum=batch_fnum(batch,pos[q],p);
+      v=(FVAL)batch_value(batch,pos[q],p);
+      if((fnum>0) && (fnum<block->dim))
+	qx[fnum]=v;
+      qnorm[q]+=v*v;
+    }
+    qfactor[q]=1;
+    qid[q]=0;
+  }
+  kernel_block_tiles(&m->model->kernel_parm,block,m->rows,m->rows,block->rows,
+		     ws->qx,qnorm,qfactor,qid,nq,NULL,qsum);
+  for(q=0;q<nq;q++)
+    score[q]=qsum[q]-m->model->b;
+}
+
+static double score_kernel(const SVMRANK_MODEL *m, SVMRANK_WORKSPACE *ws,
+			   const SVMRANK_BATCH *batch, long i)
+     /* scores document i against the support vectors one by one, with
+	the same kernel functions as single_kernel */
+{
+  MODEL  *model=m->model;
+  KERNEL_PARM *kp=&model->kernel_parm;
+  long   s,p,fnum;
+  double dot,k,qnorm=0,sum=0;
+  SVECTOR *f;
+  WORD   *w;
+  FVAL   v;
+
+  for(p=batch_row_start(batch,i);p<batch_row_end(batch,i);p++) {
+    fnum=batch_fnum(batch,i,p);
+    v=(FVAL)batch_value(batch,i,p);
+    if((fnum>0) && (fnum<m->dim))
+      ws->dense[fnum]=v;
+    qnorm+=v*v;
+  }
+  for(s=1;s<model->sv_num;s++) {
+    for(f=model->supvec[s]->fvec;f;f=f->next) {
+      if(f->kernel_id != 0)
+	continue;
+      dot=0;
+      for(w=f->words;w->wnum;w++)
+	if(w->wnum<m->dim)
+	  dot+=w->weight*ws->dense[w->wnum];
+      switch(kp->kernel_type) {
+      case POLY:
+	k=pow(kp->coef_lin*dot+kp->coef_const,(double)kp->poly_degree);
+	break;
+      case RBF:
+	k=exp(-kp->rbf_gamma*(f->twonorm_sq-2*dot+qnorm));
+	break;
+      default: /* SIGMOID */
+	k=tanh(kp->coef_lin*dot+kp->coef_const);
+      }
+      sum+=model->alpha[s]*f->factor*k;
+    }
+  }
+  for(p=batch_row_start(batch,i);p<batch_row_end(batch,i);p++) {
+    fnum=batch_fnum(batch,i,p);
+    if((fnum>0) && (fnum<m->dim))
+      ws->dense[fnum]=0;
+  }
+  return(sum-model->b);
+}
+
+/* Dot products of quantized rows (length a multiple of QUANT_PAD) with
+   a quantized document. The SIMD versions are compiled for their
+   instruction set whatever the compiler flags are, and are only called
+   if the CPU has it. */
+
+static long dot_int8(const unsigned char *x, const signed char *w, long n)
+{
+  long j,sum=0;
+
+  for(j=0;j<n;j++)
+    sum+=(long)x[j]*w[j];
+  return(sum);
+}
+
+static float half_to_float(unsigned short h)
+{
+  long  exp=(h>>10)&0x1f,mant=h&0x3ff;
+  float v;
+
+  if(exp == 0)  /* subnormal */
+    v=ldexpf((float)mant,-24);
+  else
+    v=ldexpf((float)(mant|0x400),(int)exp-25);
+  return((h & 0x8000) ? -v : v);
+}
+
+static unsigned short float_to_half(float v)
+     /* rounds to the nearest half precision float; |v| <= 1 here, so
+	there is no overflow */
+{
+  unsigned short sign=0;
+  long mant;
+  int  e;
+
+  if(v < 0) {
+    sign=0x8000;
+    v=-v;
+  }
+  frexpf(v,&e);    /* v=m*2^e with 0.5 <= m < 1 */
+  if((v == 0) || (e-1 < -14))   /* subnormal, in units of 2^-24 */
+    return(sign | (unsigned short)lrintf(ldexpf(v,24)));
+  mant=lrintf(ldexpf(v,11-e));  /* 1024..2048 */
+  if(mant == 2048) {
+    mant=1024;
+    e++;
+  }
+  return(sign | (unsigned short)(((e+14)<<10) | (mant-1024)));
+}
+
+static float dot_fp16(const float *x, const unsigned short *w, long n)
+{
+  long  j;
+  float sum=0;
+
+  for(j=0;j<n;j++)
+    sum+=x[j]*half_to_float(w[j]);
+  return(sum);
+}
+
+#ifdef QUANT_X86
+
+__attribute__((target("avx2")))
+static long dot_int8_avx2(const unsigned char *x, const signed char *w,
+			  long n)
+     /* widens to 16 bit, since _mm256_maddubs_epi16 would saturate */
+{
+  __m256i acc0=_mm256_setzero_si256(),acc1=_mm256_setzero_si256();
+  __m128i s;
+  long j;
+
+  for(j=0;j<n;j+=32) {
+    acc0=_mm256_add_epi32(acc0,_mm256_madd_epi16(
+	   _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(x+j))),
+	   _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)(w+j)))));
+    acc1=_mm256_add_epi32(acc1,_mm256_madd_epi16(
+	   _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(x+j+16))),
+	   _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)(w+j+16)))));
+  }
+  acc0=_mm256_add_epi32(acc0,acc1);
+  s=_mm_add_epi32(_mm256_castsi256_si128(acc0),
+		  _mm256_extracti128_si256(acc0,1));
+  s=_mm_add_epi32(s,_mm_shuffle_epi32(s,0x4e));
+  s=_mm_add_epi32(s,_mm_shuffle_epi32(s,0xb1));
+  return(_mm_cvtsi128_si32(s));
+}
+
+__attribute__((target("avx512f,avx512bw,avx512vnni")))
+static long dot_int8_vnni(const unsigned char *x, const signed char *w,
+			  long n)
+{
+  __m512i acc=_mm512_setzero_si512();
+  __mmask64 half=0xffffffffULL;
+  long j;
+
+  for(j=0;j+64<=n;j+=64)
+    acc=_mm512_dpbusd_epi32(acc,_mm512_loadu_si512(x+j),
+			    _mm512_loadu_si512(w+j));
+  if(j < n)  /* the last 32 */
+    acc=_mm512_dpbusd_epi32(acc,_mm512_maskz_loadu_epi8(half,x+j),
+			    _mm512_maskz_loadu_epi8(half,w+j));
+  return(_mm512_reduce_add_epi32(acc));
+}
+
+__attribute__((target("avx2,f16c,fma")))
+static float dot_fp16_avx2(const float *x, const unsigned short *w, long n)
+{
+  __m256 acc0=_mm256_setzero_ps(),acc1=_mm256_setzero_ps();
+  __m128 s;
+  long j;
+
+  for(j=0;j<n;j+=16) {
+    acc0=_mm256_fmadd_ps(_mm256_loadu_ps(x+j),
+	   _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)(w+j))),acc0);
+    acc1=_mm256_fmadd_ps(_mm256_loadu_ps(x+j+8),
+	   _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)(w+j+8))),acc1);
+  }
+  acc0=_mm256_add_ps(acc0,acc1);
+  s=_mm_add_ps(_mm256_castps256_ps128(acc0),_mm256_extractf128_ps(acc0,1));
+  s=_mm_add_ps(s,_mm_movehl_ps(s,s));
+  s=_mm_add_ss(s,_mm_movehdup_ps(s));
+  return(_mm_cvtss_f32(s));
+}
+
+__attribute__((target("avx512f")))
+static float dot_fp16_avx512(const float *x, const unsigned short *w,
+			     long n)
+{
+  __m512 acc0=_mm512_setzero_ps(),acc1=_mm512_setzero_ps();
+  long j;
+
+  for(j=0;j<n;j+=32) {
+    acc0=_mm512_fmadd_ps(_mm512_loadu_ps(x+j),
+	   _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i *)(w+j))),acc0);
+    acc1=_mm512_fmadd_ps(_mm512_loadu_ps(x+j+16),
+	   _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i *)(w+j+16))),acc1);
+  }
+  return(_mm512_reduce_add_ps(_mm512_add_ps(acc0,acc1)));
+}
+
+#endif
+
+static void choose_dot_products(QUANT_MODEL *q)
+     /* the fastest dot product the CPU can run */
+{
+  q->dot8=dot_int8;
+  q->dot16=dot_fp16;
+  q->simd="scalar";
+#ifdef QUANT_X86
+  __builtin_cpu_init();
+  if(q->type == SVMRANK_INT8) {
+    if(__builtin_cpu_supports("avx512vnni")
+       && __builtin_cpu_supports("avx512bw")) {
+      q->dot8=dot_int8_vnni;
+      q->simd="avx512-vnni";
+    }
+    else if(__builtin_cpu_supports("avx2")) {
+      q->dot8=dot_int8_avx2;
+      q->simd="avx2";
+    }
+  }
+  else {
+    if(__builtin_cpu_supports("avx512f")) {
+      q->dot16=dot_fp16_avx512;
+      q->simd="avx512";
+    }
+    else if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("f16c")
+	    && __builtin_cpu_supports("fma")) {
+      q->dot16=dot_fp16_avx2;
+      q->simd="avx2-f16c";
+    }
+  }
+#endif
+}
+
+static double score_quantized(const SVMRANK_MODEL *m, SVMRANK_WORKSPACE *ws,
+			      const SVMRANK_BATCH *batch, long i)
+     /* scores document i with the quantized rows. The norm of the
+	document for RBF is exact, only the dot products are not. */
+{
+  QUANT_MODEL *q=m->quant;
+  KERNEL_PARM *kp=&m->model->kernel_parm;
+  long   p,fnum,r,n,dim=q->dim,rbf=(kp->kernel_type == RBF);
+  double qnorm=0,sum=0;
+  /* local copies of everything the loops read, since stores through
+     unsigned char may alias anything */
+  const float *invrange=q->invrange,*x,*value;
+  const long  *index;
+  unsigned char *xq=ws->xq;
+  float  *xf=ws->xf,*dot=ws->dot,u;
+
+  if(batch->dim) {  /* dense rows in one go, which vectorizes */
+    x=batch->x+i*batch->dim;
+    if(rbf)
+      for(p=0;p<batch->dim;p++)
+	qnorm+=x[p]*x[p];
+    n=MIN(batch->dim,dim);
+    if(xq)
+      for(p=0;p<n;p++)
+	xq[p]=(unsigned char)(int)(255*MAX(0,MIN(1,x[p]*invrange[p]))+0.5f);
+    else
+      for(p=0;p<n;p++)
+	xf[p]=x[p]*invrange[p];
+  }
+  else {
+    index=batch->index;
+    value=batch->value;
+    n=batch->rowptr[i+1];
+    for(p=batch->rowptr[i];p<n;p++) {
+      fnum=index[p];
+      if(rbf)
+	qnorm+=value[p]*value[p];
+      if((fnum>0) && (fnum<=dim)) {
+	u=value[p]*invrange[fnum-1];
+	if(xq)
+	  xq[fnum-1]=(unsigned char)(int)(255*MAX(0,MIN(1,u))+0.5f);
+	else
+	  xf[fnum-1]=u;
+      }
+    }
+  }
+  if(xq)
+    for(r=0;r<q->rows;r++)
+      dot[r]=q->rowscale[r]*q->dot8(xq,q->w8+r*q->pad,q->pad);
+  else
+    for(r=0;r<q->rows;r++)
+      dot[r]=q->rowscale[r]*q->dot16(xf,q->w16+r*q->pad,q->pad);
+  /* separate loops over the rows, so that the kernels vectorize */
+  switch(kp->kernel_type) {
+  case LINEAR:
+    sum=dot[0];
+    break;
+  case POLY:
+    for(r=0;r<q->rows;r++)
+      sum+=q->coef[r]*pow(kp->coef_lin*dot[r]+kp->coef_const,
+			  (double)kp->poly_degree);
+    break;
+  case RBF:
+    for(r=0;r<q->rows;r++)
+      sum+=q->coef[r]*exp(-kp->rbf_gamma*(q->twonorm[r]-2*dot[r]+qnorm));
+    break;
+  default: /* SIGMOID */
+    for(r=0;r<q->rows;r++)
+      sum+=q->coef[r]*tanh(kp->coef_lin*dot[r]+kp->coef_const);
+  }
+  /* rows are short, clearing them is cheaper than visiting the
+     features again */
+  if(xq)
+    memset(xq,0,q->pad);
+  else
+    memset(xf,0,sizeof(float)*q->pad);
+  return(sum-m->model->b);
+}
+
+static void quantize_row(QUANT_MODEL *q, long r, double *row)
+     /* scales row r to the largest absolute value of its entries */
+{
+  double max=0;
+  long   j;
+
+  for(j=0;j<q->pad;j++)
+    max=MAX(max,fabs(row[j]));
+  for(j=0;j<q->pad;j++) {
+    if(q->type == SVMRANK_INT8)
+      q->w8[r*q->pad+j]=(max>0) ? (signed char)lrint(127*row[j]/max) : 0;
+    else
+      q->w16[r*q->pad+j]=(max>0) ? float_to_half((float)(row[j]/max)) : 0;
+  }
+  if(q->type == SVMRANK_INT8)
+    q->rowscale[r]=(float)(max/(127.0*255.0));
+  else
+    q->rowscale[r]=(float)max;
+}
+
+static void free_quant_model(QUANT_MODEL *q)
+{
+  if(!q) return;
+  if(q->w8) free(q->w8);
+  if(q->w16) free(q->w16);
+  free(q->rowscale);
+  free(q->coef);
+  free(q->twonorm);
+  free(q->invrange);
+  free(q);
+}
+
+/* Scorers for dense batches, specialized for a fixed number of
+   features. DENSE_SCORERS generates them from the inline bodies below
+   with the number of features as a constant, so that the compiler
+   unrolls and vectorizes their loops for it; the "any" versions read
+   it from the model. AVX2 versions are compiled for the instruction
+   set and chosen at load time, if the CPU has it. */
+
+#ifdef __GNUC__
+# define DENSE_INLINE static inline __attribute__((always_inline))
+#else
+# define DENSE_INLINE static inline
+#endif
+
+DENSE_INLINE void dense_linear(const DENSE_MODEL *d, long dim,
+			       const SVMRANK_BATCH *batch, const long *pos,
+			       long n, float *scores)
+     /* same sum as score_linear */
+{
+  const float *x;
+  double sum;
+  long i,j;
+
+  for(i=0;i<n;i++) {
+    x=batch->x+pos[i]*batch->dim;
+    sum=0;
+    for(j=0;j<dim;j++)
+      sum+=d->lin[j]*x[j];
+    scores[i]=(float)(sum-d->b);
+  }
+}
+
+DENSE_INLINE void dense_kernel(const DENSE_MODEL *d, long dim,
+			       const SVMRANK_BATCH *batch, const long *pos,
+			       long n, float *scores)
+     /* evaluates DENSE_ROWS support vectors against DENSE_DOCS
+	documents at a time, so that each support vector is read once
+	for all of them. The RBF kernel sums up squared differences,
+	which needs no norms and loses no precision in float. */
+{
+  const float *x[DENSE_DOCS],*col;
+  float acc[DENSE_DOCS][DENSE_ROWS],k[DENSE_ROWS],tail[DENSE_DOCS];
+  float xj,t,v;
+  double sum[DENSE_DOCS];
+  long i,j,q,r,r0,e,nd;
+
+  for(i=0;i<n;i+=nd) {
+    /* missing documents of the last group repeat its first one */
+    nd=MIN(DENSE_DOCS,n-i);
+    for(q=0;q<DENSE_DOCS;q++) {
+      x[q]=batch->x+pos[i+((q < nd) ? q : 0)]*batch->dim;
+      /* features the model does not have */
+      for(tail[q]=0,j=dim;j<batch->dim;j++)
+	tail[q]+=x[q][j]*x[q][j];
+      sum[q]=0;
+    }
+    for(r0=0;r0<d->rows;r0+=DENSE_ROWS) {
+      for(q=0;q<DENSE_DOCS;q++)
+	for(r=0;r<DENSE_ROWS;r++)
+	  acc[q][r]=(d->type == RBF) ? tail[q] : 0;
+      for(j=0;j<dim;j++) {
+	col=d->x+j*d->rows+r0;
+	for(q=0;q<DENSE_DOCS;q++) {
+	  xj=x[q][j];
+	  if(d->type == RBF)
+	    for(r=0;r<DENSE_ROWS;r++) {
+	      t=col[r]-xj;
+	      acc[q][r]+=t*t;
+	    }
+	  else
+	    for(r=0;r<DENSE_ROWS;r++)
+	      acc[q][r]+=col[r]*xj;
+	}
+      }
+      for(q=0;q<DENSE_DOCS;q++) {
+	if(d->type == RBF) {
+#pragma omp simd
+	  for(r=0;r<DENSE_ROWS;r++)
+	    k[r]=expf(-d->gamma*acc[q][r]);
+	}
+	else if(d->type == POLY) {
+	  for(r=0;r<DENSE_ROWS;r++) {
+	    v=d->coef_lin*acc[q][r]+d->coef_const;
+	    for(k[r]=1,e=0;e<d->degree;e++)
+	      k[r]*=v;
+	  }
+	}
+	else {
+#pragma omp simd
+	  for(r=0;r<DENSE_ROWS;r++)
+	    k[r]=tanhf(d->coef_lin*acc[q][r]+d->coef_const);
+	}
+	for(r=0;r<DENSE_ROWS;r++)
+	  sum[q]+=d->coef[r0+r]*k[r];
+      }
+    }
+    for(q=0;q<nd;q++)
+      scores[i+q]=(float)(sum[q]-d->b);
+  }
+}
+
+#define DENSE_SCORERS(ATTR,NAME,DIM)					\
+  ATTR static void dense_linear_##NAME(const DENSE_MODEL *d,		\
+	 const SVMRANK_BATCH *batch, const long *pos, long n, float *s)	\
+  { dense_linear(d,DIM,batch,pos,n,s); }				\
+  ATTR static void dense_kernel_##NAME(const DENSE_MODEL *d,		\
+	 const SVMRANK_BATCH *batch, const long *pos, long n, float *s)	\
+  { dense_kernel(d,DIM,batch,pos,n,s); }
+
+DENSE_SCORERS(,4,4)
+DENSE_SCORERS(,46,46)
+DENSE_SCORERS(,136,136)
+DENSE_SCORERS(,any,d->dim)
+#ifdef QUANT_X86
+DENSE_SCORERS(__attribute__((target("avx2,fma"))),4_avx2,4)
+DENSE_SCORERS(__attribute__((target("avx2,fma"))),46_avx2,46)
+DENSE_SCORERS(__attribute__((target("avx2,fma"))),136_avx2,136)
+DENSE_SCORERS(__attribute__((target("avx2,fma"))),any_avx2,d->dim)
+#endif
+
+static void choose_dense_scorer(DENSE_MODEL *d, int mode)
+     /* the scorer for the number of features of the model, or for any
+	number (SVMRANK_DENSE_GENERIC) */
+{
+  const char *kernel,*simd="";
+  long dim=(mode == SVMRANK_DENSE_AUTO) ? d->dim : 0;
+  int avx2=0;
+
+#ifdef QUANT_X86
+  __builtin_cpu_init();
+  avx2=__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+# define DENSE_CHOOSE(NAME)						\
+  d->score=(d->type == LINEAR)						\
+	    ? (avx2 ? dense_linear_##NAME##_avx2 : dense_linear_##NAME)	\
+	    : (avx2 ? dense_kernel_##NAME##_avx2 : dense_kernel_##NAME)
+#else
+# define DENSE_CHOOSE(NAME)						\
+  d->score=(d->type == LINEAR) ? dense_linear_##NAME : dense_kernel_##NAME
+#endif
+  switch(dim) {
+  case 4:   DENSE_CHOOSE(4); break;
+  case 46:  DENSE_CHOOSE(46); break;
+  case 136: DENSE_CHOOSE(136); break;
+  default:  DENSE_CHOOSE(any); dim=0;
+  }
+#undef DENSE_CHOOSE
+  switch(d->type) {
+  case LINEAR: kernel="linear"; break;
+  case POLY:   kernel="poly"; break;
+  case RBF:    kernel="rbf"; break;
+  default:     kernel="sigmoid";
+  }
+  if(avx2)
+    simd="-avx2";
+  if(dim)
+    sprintf(d->name,"%s-%ld%s",kernel,dim,simd);
+  else
+    sprintf(d->name,"%s-any%s",kernel,simd);
+  d->mode=mode;
+}
+
+static DENSE_MODEL *create_dense_model(MODEL *model)
+     /* dense scorers for linear models and for kernel models with a
+	kernel block, i.e. support vectors that are dense enough. The
+	scorer is chosen by the highest feature that the model uses,
+	since models of svm_rank_learn count one feature more than the
+	training data has. */
+{
+  DENSE_MODEL *d;
+  KERNEL_BLOCK *block=model->kernel_block;
+  long j,r;
+
+  if((model->kernel_parm.kernel_type != LINEAR) && !block)
+    return(NULL);
+  d=(DENSE_MODEL *)my_malloc(sizeof(DENSE_MODEL));
+  d->type=model->kernel_parm.kernel_type;
+  d->b=model->b;
+  d->lin=NULL;
+  d->x=NULL;
+  d->coef=NULL;
+  d->rows=0;
+  if(d->type == LINEAR) {
+    for(d->dim=model->totwords;(d->dim>0) && !model->lin_weights[d->dim];)
+      d->dim--;
+    d->lin=model->lin_weights+1;
+  }
+  else {
+    for(d->dim=block->dim-1;d->dim>0;d->dim--) {
+      for(r=0;(r<block->rows) && !block->x[r*block->dim+d->dim];r++);
+      if(r < block->rows)
+	break;
+    }
+    d->gamma=(float)model->kernel_parm.rbf_gamma;
+    d->coef_lin=(float)model->kernel_parm.coef_lin;
+    d->coef_const=(float)model->kernel_parm.coef_const;
+    d->degree=model->kernel_parm.poly_degree;
+    /* the support vectors column by column, padded with zero rows */
+    d->rows=(block->rows+DENSE_ROWS-1)/DENSE_ROWS*DENSE_ROWS;
+    d->x=(float *)my_malloc(sizeof(float)*d->dim*d->rows);
+    d->coef=(double *)my_malloc(sizeof(double)*d->rows);
+    for(r=0;r<d->rows;r++) {
+      for(j=0;j<d->dim;j++)
+	d->x[j*d->rows+r]=(r < block->rows) ? block->x[r*block->dim+j+1] : 0;
+      d->coef[r]=((r < block->rows) && (block->kernel_id[r] == 0))
+	? block->coef[r] : 0;
+    }
+  }
+  choose_dense_scorer(d,SVMRANK_DENSE_AUTO);
+  return(d);
+}
+
+static void free_dense_model(DENSE_MODEL *d)
+{
+  if(!d)
+    return;
+  if(d->x) free(d->x);
+  if(d->coef) free(d->coef);
+  free(d);
+}
+
+static int scorable_kernel(long type)
+{
+  return((type == LINEAR) || (type == POLY_EXPANDED) || (type == POLY)
+	 || (type == RBF) || (type == SIGMOID));
+}
+
+static char *read_model_line(FILE *fl, char **line, long *size)
+     /* reads the next line of fl into *line, which is enlarged as
+	needed. Returns NULL at the end of the file. */
+{
+  long len=0;
+  char *larger;
+
+  while(fgets((*line)+len,(int)((*size)-len),fl)) {
+    len+=strlen((*line)+len);
+    if((len > 0) && ((*line)[len-1] == '\n'))
+      return(*line);
+    if(len < (*size)-1)   /* last line without newline */
+      return(*line);
+    if((larger=(char *)realloc(*line,2*(*size))) == NULL)
+      return(NULL);
+    (*line)=larger;
+    (*size)*=2;
+  }
+  return(len ? (*line) : NULL);
+}
+
+static int parse_model_sv(char *line, WORD *words, long totwords,
+			  double *alpha, long *kernel_id, long *docid,
+			  char **comment)
+     /* parses a support vector line as written by write_model into
+	words, like parse_document. Returns 0 for lines that
+	parse_document rejects, for features above totwords, and for
+	lines without a coefficient. */
+{
+  char *p,*end;
+  long wpos=0,wnum;
+  double value;
+
+  (*kernel_id)=0;
+  (*docid)=-1;
+  (*comment)=NULL;
+  if((p=strchr(line,'#')) != NULL) {
+    *p=0;
+    (*comment)=p+1;
+    if((p=strchr(*comment,'\n')) != NULL) 
+      *p=0;
+  }
+  (*alpha)=strtod(line,&end);
+  if((end == line) || (*end && !isspace((int)*end)))
+    return(0);
+  for(p=end;;p=end) {
+    while(isspace((int)*p)) 
+      p++;
+    if(!(*p))
+      break;
+    if(!strncmp(p,"qid:",4) || !strncmp(p,"sid:",4) 
+       || !strncmp(p,"did:",4)) {
+      wnum=strtol(p+4,&end,10);
+      if((end == p+4) || (*end && !isspace((int)*end)))
+	return(0);
+      if(p[0] == 'q')
+	(*kernel_id)=wnum;
+      else if(wnum <= 0)
+	return(0);
+      else if(p[0] == 'd')
+	(*docid)=wnum-1;
+      continue;
+    }
+    if(!strncmp(p,"cost:",5)) {
+      (void)strtod(p+5,&end);
+      if((end == p+5) || (*end && !isspace((int)*end)))
+	return(0);
+      continue;
+    }
+    wnum=strtol(p,&end,10);
+    if((end == p) || (*end != ':') || (wnum <= 0) || (wnum > totwords)
+       || ((wpos > 0) && (words[wpos-1].wnum >= wnum)))
+      return(0);
+    p=end+1;
+    value=strtod(p,&end);
+    if((end == p) || (*end && !isspace((int)*end)))
+      return(0);
+    words[wpos].wnum=wnum;
+    words[wpos].weight=(FVAL)value;
+    wpos++;
+  }
+  words[wpos].wnum=0;
+  if(!(*comment))
+    (*comment)=line+strlen(line);
+  return(1);
+}
+
+static MODEL *read_scoring_model(const char *modelfile)
+     /* reads a text or binary model like read_model, but prints
+	nothing and returns NULL instead of exiting if the file cannot
+	be read, is not a complete model of this version, or has a
+	kernel that the library cannot score */
+{
+  FILE *fl;
+  MODEL *model,*compact_model;
+  WORD *words;
+  char version[100],*line,*comment;
+  long i,size=1024,queryid,docid,ok,filesize;
+  double alpha;
+
+  if(is_binary_model((char *)modelfile)) {
+    if((model=read_binary_model((char *)modelfile)) == NULL)
+      return(NULL);
+  }
+  else {
+    if((fl=fopen(modelfile,"r")) == NULL)
+      return(NULL);
+    fseek(fl,0,SEEK_END);
+    filesize=ftell(fl);
+    rewind(fl);
+    model=(MODEL *)my_malloc(sizeof(MODEL));
+    model->kernel_parm.custom[0]=0;
+    ok=((fscanf(fl,"SVM-light Version %99s\n",version) == 1)
+	&& (!strcmp(version,VERSION))
+	&& (fscanf(fl,"%ld%*[^\n]\n",&model->kernel_parm.kernel_type) == 1)
+	&& (fscanf(fl,"%ld%*[^\n]\n",&model->kernel_parm.poly_degree) == 1)
+	&& (fscanf(fl,"%lf%*[^\n]\n",&model->kernel_parm.rbf_gamma) == 1)
+	&& (fscanf(fl,"%lf%*[^\n]\n",&model->kernel_parm.coef_lin) == 1)
+	&& (fscanf(fl,"%lf%*[^\n]\n",&model->kernel_parm.coef_const) == 1)
+	&& (fscanf(fl,"%49[^#\n]",model->kernel_parm.custom) >= 0)
+	&& (fscanf(fl,"%*[^\n]\n") >= 0)
+	&& (fscanf(fl,"%ld%*[^\n]\n",&model->totwords) == 1)
+	&& (fscanf(fl,"%ld%*[^\n]\n",&model->totdoc) == 1)
+	&& (fscanf(fl,"%ld%*[^\n]\n",&model->sv_num) == 1)
+	&& (fscanf(fl,"%lf%*[^\n]\n",&model->b) == 1)
+	&& scorable_kernel(model->kernel_parm.kernel_type)
+	&& (model->totwords >= 0) && (model->sv_num >= 1)
+	/* each support vector takes a line of at least 2 characters */
+	&& (model->sv_num-1 <= filesize/2));
+    if(!ok) {
+      fclose(fl);
+      free(model);
+      return(NULL);
+    }
+    model->supvec=(DOC **)my_malloc(sizeof(DOC *)*model->sv_num);
+    model->alpha=(double *)my_malloc(sizeof(double)*model->sv_num);
+    model->index=NULL;
+    model->lin_weights=NULL;
+    model->kernel_block=NULL;
+    model->kernel_parm.store=NULL;
+    model->supvec[0]=NULL;
+    model->alpha[0]=0;
+    line=(char *)my_malloc(size);
+    words=NULL;
+    for(i=1;ok && (i<model->sv_num);i++) {
+      ok=(read_model_line(fl,&line,&size) != NULL);
+      if(ok) {
+	/* a line of n characters has fewer than n/2+1 features */
+	words=(WORD *)realloc(words,sizeof(WORD)*(strlen(line)/2+2));
+	ok=(words 
+	    && parse_model_sv(line,words,model->totwords,&alpha,&queryid,
+			      &docid,&comment));
+      }
+      if(!ok)
+	break;
+      model->alpha[i]=alpha;
+      model->supvec[i]=create_example(-1,0,0,0.0,
+				      create_svector(words,comment,1.0));
+      model->supvec[i]->fvec->kernel_id=queryid;
+      model->supvec[i]->fvec->docid=docid;
+    }
+    fclose(fl);
+    if(line) free(line);
+    if(words) free(words);
+    if(!ok) {
+      model->sv_num=i;  /* free the SVs read so far */
+      free_model(model,1);
+      return(NULL);
+    }
+    if(model->kernel_parm.kernel_type == POLY_EXPANDED)
+      add_weight_vector_to_linear_model(model);
+  }
+  if(!scorable_kernel(model->kernel_parm.kernel_type)) {
+    free_model(model,1);
+    return(NULL);
+  }
+  if((model->kernel_parm.kernel_type != LINEAR) 
+     && (model->kernel_parm.kernel_type != POLY_EXPANDED)) {
+    /* models written by older versions may contain duplicates */
+    compact_model=compact_kernel_model(model);
+    free_model(model,1);
+    model=compact_model;
+  }
+  return(model);
+}
+
+SVMRANK_MODEL *svmrank_load_model(const char *modelfile)
+{
+  SVMRANK_MODEL *m;
+  MODEL *model;
+  long i,type;
+
+  if((model=read_scoring_model(modelfile)) == NULL)
+    return(NULL);
+  type=model->kernel_parm.kernel_type;
+  m=(SVMRANK_MODEL *)my_malloc(sizeof(SVMRANK_MODEL));
+  m->model=model;
+  m->dim=model->totwords+1;
+  m->rows=NULL;
+  m->bound=NULL;
+  m->quant=NULL;
+  m->first=NULL;
+  m->cascade_n=0;
+  if(type == LINEAR)
+    add_weight_vector_to_linear_model(model);
+  else if(type != POLY_EXPANDED) {
+    add_kernel_block_to_model(model);
+    if(model->kernel_block) {
+      m->rows=(long *)my_malloc(sizeof(long)*model->kernel_block->rows);
+      for(i=0;i<model->kernel_block->rows;i++)
+	m->rows[i]=i;
+    }
+    /* norms are computed here once, not while scoring */
+    for(i=1;i<model->sv_num;i++)
+      if(model->supvec[i]->fvec->twonorm_sq<0)
+	model->supvec[i]->fvec->twonorm_sq=sprod_ss(model->supvec[i]->fvec,
+						    model->supvec[i]->fvec);
+  }
+  m->dense=create_dense_model(model);
+  m->dense_on=(m->dense != NULL);
+  return(m);
+}
+
+void svmrank_free_model(SVMRANK_MODEL *m)
+{
+  free_model(m->model,1);
+  if(m->rows) free(m->rows);
+  free_linear_bound(m->bound);
+  free_quant_model(m->quant);
+  free_dense_model(m->dense);
+  free(m);
+}
+
+long svmrank_num_features(const SVMRANK_MODEL *m)
+{
+  return(m->model->totwords);
+}
+
+SVMRANK_WORKSPACE *svmrank_create_workspace(const SVMRANK_MODEL *m,
+					    long max_docs)
+{
+  SVMRANK_WORKSPACE *ws;
+  long j;
+
+  ws=(SVMRANK_WORKSPACE *)my_malloc(sizeof(SVMRANK_WORKSPACE));
+  ws->max_docs=max_docs;
+  ws->qx=NULL;
+  ws->dense=NULL;
+  ws->x=NULL;
+  ws->prod=NULL;
+  ws->saved=0;
+  ws->xq=NULL;
+  ws->xf=NULL;
+  ws->dot=NULL;
+  ws->rescored=NULL;
+  ws->stage2=NULL;
+  if(m->first) {
+    ws->rescored=(long *)my_malloc(sizeof(long)*(max_docs+1));
+    ws->stage2=(float *)my_malloc(sizeof(float)*(max_docs+1));
+  }
+  if(m->quant) {
+    ws->dot=(float *)my_malloc(sizeof(float)*MAX(1,m->quant->rows));
+    if(m->quant->type == SVMRANK_INT8) {
+      ws->xq=(unsigned char *)my_malloc(m->quant->pad);
+      memset(ws->xq,0,m->quant->pad);
+    }
+    else {
+      ws->xf=(float *)my_malloc(sizeof(float)*m->quant->pad);
+      for(j=0;j<m->quant->pad;j++)
+	ws->xf[j]=0;
+    }
+  }
+  else if(m->model->kernel_parm.kernel_type == LINEAR) {
+    ws->x=(FVAL *)my_malloc(sizeof(FVAL)*(m->dim+1));
+    ws->prod=(double *)my_malloc(sizeof(double)*(m->dim+1));
+    for(j=0;j<=m->dim;j++) {
+      ws->x[j]=0;
+      ws->prod[j]=0;
+    }
+  }
+  else if(m->model->kernel_block)
+    ws->qx=(FVAL *)my_malloc(sizeof(FVAL)*KERNEL_BLOCK_QUERIES
+			     *m->model->kernel_block->dim);
+  else if(m->model->kernel_parm.kernel_type != LINEAR) {
+    ws->dense=(FVAL *)my_malloc(sizeof(FVAL)*m->dim);
+    for(j=0;j<m->dim;j++)
+      ws->dense[j]=0;
+  }
+  ws->scores=(float *)my_malloc(sizeof(float)*(max_docs+1));
+  ws->heap=(long *)my_malloc(sizeof(long)*(max_docs+1));
+  return(ws);
+}
+
+void svmrank_free_workspace(SVMRANK_WORKSPACE *ws)
+{
+  if(ws->qx) free(ws->qx);
+  if(ws->dense) free(ws->dense);
+  if(ws->x) free(ws->x);
+  if(ws->prod) free(ws->prod);
+  if(ws->xq) free(ws->xq);
+  if(ws->xf) free(ws->xf);
+  if(ws->dot) free(ws->dot);
+  if(ws->rescored) free(ws->rescored);
+  if(ws->stage2) free(ws->stage2);
+  free(ws->scores);
+  free(ws->heap);
+  free(ws);
+}
+
+/* document a ranks before document b */
+#define ranks_before(s,a,b) (((s)[a]>(s)[b]) || (((s)[a]==(s)[b]) && ((a)<(b))))
+
+static void sift_down(long *heap, long n, long pos, float *s)
+     /* restores the heap property below pos; the root of the heap is
+	the document that ranks last */
+{
+  long child,tmp;
+
+  while((child=2*pos+1) < n) {
+    if((child+1<n) && ranks_before(s,heap[child],heap[child+1]))
+      child++;
+    if(!ranks_before(s,heap[pos],heap[child]))
+      break;
+    tmp=heap[pos]; heap[pos]=heap[child]; heap[child]=tmp;
+    pos=child;
+  }
+}
+
+static void score_documents(const SVMRANK_MODEL *m, SVMRANK_WORKSPACE *ws,
+			    const SVMRANK_BATCH *batch, const long *pos,
+			    long n, float *scores)
+     /* scores[j] is the score of document pos[j] of batch, j=0..n-1 */
+{
+  long j,nq,q;
+  double score[KERNEL_BLOCK_QUERIES];
+
+  if(m->quant) {
+    for(j=0;j<n;j++)
+      scores[j]=(float)score_quantized(m,ws,batch,pos[j]);
+  }
+  else if(m->dense_on && batch->dim && (batch->dim >= m->dense->dim))
+    m->dense->score(m->dense,batch,pos,n,scores);
+  else if(m->model->kernel_parm.kernel_type == LINEAR) {
+    for(j=0;j<n;j++)
+      scores[j]=(float)score_linear(m->model,batch,pos[j]);
+  }
+  else if(m->model->kernel_parm.kernel_type == POLY_EXPANDED) {
+    for(j=0;j<n;j++)
+      scores[j]=(float)score_poly_expanded(m->model,batch,pos[j]);
+  }
+  else if(m->model->kernel_block) {
+    for(j=0;j<n;j+=nq) {
+      nq=MIN(KERNEL_BLOCK_QUERIES,n-j);
+      score_kernel_block(m,ws,batch,pos+j,nq,score);
+      for(q=0;q<nq;q++)
+	scores[j+q]=(float)score[q];
+    }
+  }
+  else {
+    for(j=0;j<n;j++)
+      scores[j]=(float)score_kernel(m,ws,batch,pos[j]);
+  }
+}
+
+static void score_cascade(const SVMRANK_MODEL *m, SVMRANK_WORKSPACE *ws,
+			  const SVMRANK_BATCH *batch, float *scores)
+     /* scores all documents with m->first, and the m->cascade_n best
+	of them again with m */
+{
+  long i,j,k,*heap=ws->rescored;
+  float low,high=-FLT_MAX;
+
+  for(i=0;i<batch->n;i++)
+    scores[i]=(float)score_linear(m->first->model,batch,i);
+  k=MIN(m->cascade_n,batch->n);
+  if(k<=0)
+    return;
+  for(i=0;i<k;i++)
+    heap[i]=i;
+  for(i=k/2-1;i>=0;i--)
+    sift_down(heap,k,i,scores);
+  for(i=k;i<batch->n;i++) {
+    j=i;
+    if(ranks_before(scores,i,heap[0])) {
+      j=heap[0];
+      heap[0]=i;
+      sift_down(heap,k,0,scores);
+    }
+    high=MAX(high,scores[j]);  /* best document that is not re-scored */
+  }
+  score_documents(m,ws,batch,heap,k,ws->stage2);
+  /* the other documents keep the order of the first stage, below all
+     re-scored documents */
+  if(k < batch->n) {
+    for(low=ws->stage2[0],j=1;j<k;j++)
+      low=MIN(low,ws->stage2[j]);
+    for(i=0;i<batch->n;i++)
+      scores[i]+=low-high-1;
+  }
+  for(j=0;j<k;j++)
+    scores[heap[j]]=ws->stage2[j];
+}
+
+int svmrank_score(const SVMRANK_MODEL *m, SVMRANK_WORKSPACE *ws,
+		  const SVMRANK_BATCH *batch, float *scores)
+{
+  long i,j,nq,pos[KERNEL_BLOCK_QUERIES];
+
+  if(batch->n > ws->max_docs)
+    return(-1);
+  if(m->first)
+    score_cascade(m,ws,batch,scores);
+  else {
+    /* in pieces of KERNEL_BLOCK_QUERIES documents, so that their
+       positions fit into pos */
+    for(i=0;i<batch->n;i+=nq) {
+      nq=MIN(KERNEL_BLOCK_QUERIES,batch->n-i);
+      for(j=0;j<nq;j++)
+	pos[j]=i+j;
+      score_documents(m,ws,batch,pos,nq,scores+i);
+    }
+  }
+  return(0);
+}
+
+static int score_linear_bounded(const SVMRANK_MODEL *m,
+				SVMRANK_WORKSPACE *ws,
+				const SVMRANK_BATCH *batch, long i,
+				double threshold, float *score)
+     /* scores document i like score_linear, unless it turns out to be
+	at most threshold on the way (returns 0) */
+{
+  MODEL *model=m->model;
+  long p,fnum,nnz=0,mults=0;
+  double sum=0;
+  int inrange=1,complete;
+
+  for(p=batch_row_start(batch,i);p<batch_row_end(batch,i);p++) {
+    fnum=batch_fnum(batch,i,p);
+    if((fnum>0) && (fnum<=model->totwords)) {
+      ws->x[fnum]=(FVAL)batch_value(batch,i,p);
+      if(fabs(ws->x[fnum]) > m->bound->maxabs[fnum])
+	inrange=0;
+      nnz++;
+    }
+  }
+  if(inrange) 
+    complete=bounded_linear_products(model,m->bound,ws->x,ws->prod,
+				     threshold,&mults);
+  else {
+    complete=1;
+    mults=nnz;
+    for(p=batch_row_start(batch,i);p<batch_row_end(batch,i);p++) {
+      fnum=batch_fnum(batch,i,p);
+      if((fnum>0) && (fnum<=model->totwords))
+	ws->prod[fnum]=model->lin_weights[fnum]*ws->x[fnum];
+    }
+  }
+  ws->saved+=nnz-mults;
+  /* the sum in the order of score_linear, and clean up */
+  for(p=batch_row_start(batch,i);p<batch_row_end(batch,i);p++) {
+    fnum=batch_fnum(batch,i,p);
+    if((fnum>0) && (fnum<=model->totwords)) {
+      sum+=ws->prod[fnum];
+      ws->x[fnum]=0;
+      ws->prod[fnum]=0;
+    }
+  }
+  (*score)=(float)(sum-model->b);
+  return(complete);
+}
+
+long svmrank_rank_topk(const SVMRANK_MODEL *m, SVMRANK_WORKSPACE *ws,
+		       const SVMRANK_BATCH *batch, long k, long *top,
+		       float *topscores)
+{
+  long i,n,tmp,*heap=ws->heap;
+  float *s=ws->scores;
+
+  if(batch->n > ws->max_docs)
+    return(-1);
+  k=MIN(k,batch->n);
+  if(k<=0)
+    return(0);
+  if(m->bound && !m->quant && !m->first) {
+    /* score the documents one by one; a document that cannot rank
+       before the root of the full heap is dropped */
+    for(i=0,n=0;i<batch->n;i++) {
+      if(n < k) {
+	score_linear_bounded(m,ws,batch,i,-DBL_MAX,&s[i]);
+	heap[n++]=i;
+	if(n == k)
+	  for(tmp=k/2-1;tmp>=0;tmp--)
+	    sift_down(heap,k,tmp,s);
+      }
+      else if(score_linear_bounded(m,ws,batch,i,s[heap[0]],&s[i])
+	      && ranks_before(s,i,heap[0])) {
+	heap[0]=i;
+	sift_down(heap,k,0,s);
+      }
+    }
+  }
+  else {
+    svmrank_score(m,ws,batch,s);
+    /* keep the k best documents in a heap with the worst at the
+       root, so that each further document costs one comparison
+       unless it enters the top k */
+    for(i=0;i<k;i++)
+      heap[i]=i;
+    for(i=k/2-1;i>=0;i--)
+      sift_down(heap,k,i,s);
+    for(i=k;i<batch->n;i++) {
+      if(ranks_before(s,i,heap[0])) {
+	heap[0]=i;
+	sift_down(heap,k,0,s);
+      }
+    }
+  }
+  /* heap sort, the worst document goes to the end */
+  for(n=k-1;n>0;n--) {
+    tmp=heap[0]; heap[0]=heap[n]; heap[n]=tmp;
+    sift_down(heap,n,0,s);
+  }
+  for(i=0;i<k;i++) {
+    top[i]=heap[i];
+    topscores[i]=s[heap[i]];
+  }
+  return(k);
+}
+
+int svmrank_set_feature_bounds(SVMRANK_MODEL *m, const float *maxabs)
+{
+  double *bound;
+  long j;
+
+  if(m->model->kernel_parm.kernel_type != LINEAR)
+    return(-1);
+  bound=create_nvector(m->model->totwords);
+  bound[0]=0;
+  for(j=1;j<=m->model->totwords;j++)
+    bound[j]=fabs(maxabs[j-1]);
+  free_linear_bound(m->bound);
+  m->bound=create_linear_bound(m->model,bound);
+  free_nvector(bound);
+  return(0);
+}
+
+long svmrank_saved_multiplications(const SVMRANK_WORKSPACE *ws)
+{
+  return(ws->saved);
+}
+
+int svmrank_quantize_model(SVMRANK_MODEL *m, int type, const float *range)
+{
+  MODEL  *model=m->model;
+  QUANT_MODEL *q;
+  SVECTOR *f;
+  WORD   *w;
+  double *row;
+  long   r,j,s,kernel_type=model->kernel_parm.kernel_type;
+
+  if(((type != SVMRANK_INT8) && (type != SVMRANK_FP16))
+     || (kernel_type == POLY_EXPANDED)
+     || ((type == SVMRANK_INT8) && (model->totwords > QUANT_INT8_MAX_FEATURES)))
+    return(-1);
+  q=(QUANT_MODEL *)my_malloc(sizeof(QUANT_MODEL));
+  q->type=type;
+  q->dim=model->totwords;
+  q->pad=MAX(1,(q->dim+QUANT_PAD-1)/QUANT_PAD)*QUANT_PAD;
+  q->rows=0;
+  if(kernel_type == LINEAR)
+    q->rows=1;
+  else
+    for(s=1;s<model->sv_num;s++)
+      for(f=model->supvec[s]->fvec;f;f=f->next)
+	if(f->kernel_id == 0)
+	  q->rows++;
+  q->w8=NULL;
+  q->w16=NULL;
+  if(type == SVMRANK_INT8)
+    q->w8=(signed char *)my_malloc(MAX(1,q->rows)*q->pad);
+  else
+    q->w16=(unsigned short *)my_malloc(sizeof(unsigned short)
+				       *MAX(1,q->rows)*q->pad);
+  q->rowscale=(float *)my_malloc(sizeof(float)*MAX(1,q->rows));
+  q->coef=(double *)my_malloc(sizeof(double)*MAX(1,q->rows));
+  q->twonorm=(double *)my_malloc(sizeof(double)*MAX(1,q->rows));
+  q->invrange=(float *)my_malloc(sizeof(float)*q->pad);
+  for(j=0;j<q->pad;j++)
+    q->invrange[j]=(range && (j<q->dim) && (range[j]>0)) ? 1/range[j] : 1;
+
+  /* each row with the weight of feature j multiplied by its range */
+  row=(double *)my_malloc(sizeof(double)*q->pad);
+  if(kernel_type == LINEAR) {
+    for(j=0;j<q->pad;j++)
+      row[j]=(j<q->dim) ? model->lin_weights[j+1]/q->invrange[j] : 0;
+    quantize_row(q,0,row);
+    q->coef[0]=1;
+    q->twonorm[0]=0;
+  }
+  else {
+    r=0;
+    for(s=1;s<model->sv_num;s++)
+      for(f=model->supvec[s]->fvec;f;f=f->next) {
+	if(f->kernel_id != 0)
+	  continue;
+	for(j=0;j<q->pad;j++)
+	  row[j]=0;
+	for(w=f->words;w->wnum;w++)
+	  if(w->wnum<=q->dim)
+	    row[w->wnum-1]=w->weight/q->invrange[w->wnum-1];
+	quantize_row(q,r,row);
+	q->coef[r]=model->alpha[s]*f->factor;
+	q->twonorm[r]=sprod_ss(f,f);
+	r++;
+      }
+  }
+  free(row);
+  choose_dot_products(q);
+  free_quant_model(m->quant);
+  m->quant=q;
+  return(0);
+}
+
+int svmrank_set_cascade(SVMRANK_MODEL *m, const SVMRANK_MODEL *first, long n)
+{
+  if((first->model->kernel_parm.kernel_type != LINEAR) || first->quant
+     || first->first || (n < 1))
+    return(-1);
+  m->first=first;
+  m->cascade_n=n;
+  return(0);
+}
+
+int svmrank_set_dense_scoring(SVMRANK_MODEL *m, int mode)
+{
+  if(!m->dense || ((mode != SVMRANK_DENSE_OFF) && (mode != SVMRANK_DENSE_GENERIC)
+		   && (mode != SVMRANK_DENSE_AUTO)))
+    return(-1);
+  m->dense_on=(mode != SVMRANK_DENSE_OFF);
+  if(m->dense_on)
+    choose_dense_scorer(m->dense,mode);
+  return(0);
+}
+
+const char *svmrank_dense_scorer(const SVMRANK_MODEL *m)
+{
+  return(m->dense_on ? m->dense->name : NULL);
+}
+
+const char *svmrank_quantized_simd(const SVMRANK_MODEL *m)
+{
+  return(m->quant ? m->quant->simd : NULL);
+}
@@ -0,0 +1,150 @@
+/***********************************************************************/
+/*                                                                     */
+/*   svm_rank_lib.h                                                    */
+/*                                                                     */
+/*   Scoring library for SVM-rank models (libsvmrank). A model is      */
+/*   loaded once and is read-only afterwards, so that any number of    */
+/*   threads can score with it at the same time. Each thread passes    */
+/*   its own workspace, which holds all buffers that scoring needs.    */
+/*   libsvmrank.a and libsvmrank.so need only libm (-lm); they do not  */
+/*   use OpenMP and leave the floating point environment alone.        */
+/*                                                                     */
+/***********************************************************************/
+
+#ifndef SVM_RANK_LIB
+#define SVM_RANK_LIB
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* The library is compiled with -fvisibility=hidden, so that only the
+   functions marked with SVMRANK_API are exported. */
+#if defined(__GNUC__) && (__GNUC__ >= 4)
+# define SVMRANK_API __attribute__((visibility("default")))
+#else
+# define SVMRANK_API
+#endif
+
+typedef struct svmrank_model SVMRANK_MODEL;
+typedef struct svmrank_workspace SVMRANK_WORKSPACE;
+
+typedef struct svmrank_batch {
+  long  n;              /* number of documents */
+  long  dim;            /* > 0: the documents are dense rows of dim
+			   values, and x[i*dim+j] is feature j+1 of
+			   document i. 0: the documents are in CSR
+			   format. */
+  const float *x;       /* dense rows */
+  const long  *rowptr;  /* CSR: the features of document i are
+			   rowptr[i]..rowptr[i+1]-1 */
+  const long  *index;   /* CSR: feature numbers (starting at 1, as in
+			   the input files) by increasing number */
+  const float *value;   /* CSR: feature values */
+} SVMRANK_BATCH;
+
+/* Reads a text or binary model written by svm_rank_learn. Returns
+   NULL, if the file cannot be read, is not a complete model of this
+   version, or has a kernel that the library cannot score (user
+   defined and precomputed kernels). Nothing is printed. As everywhere
+   in SVM-light, running out of memory still ends the process. */
+SVMRANK_API SVMRANK_MODEL *svmrank_load_model(const char *modelfile);
+SVMRANK_API void   svmrank_free_model(SVMRANK_MODEL *model);
+SVMRANK_API long   svmrank_num_features(const SVMRANK_MODEL *model);
+
+/* Allocates the buffers for scoring batches of up to max_docs
+   documents with model. A workspace must not be used by two threads
+   at the same time. */
+SVMRANK_API SVMRANK_WORKSPACE *svmrank_create_workspace(
+				       const SVMRANK_MODEL *model, long max_docs);
+SVMRANK_API void   svmrank_free_workspace(SVMRANK_WORKSPACE *ws);
+
+/* Computes the score of each document of batch. Returns 0, or -1 if
+   the batch has more documents than the workspace was created for. */
+SVMRANK_API int    svmrank_score(const SVMRANK_MODEL *model,
+				 SVMRANK_WORKSPACE *ws,
+				 const SVMRANK_BATCH *batch, float *scores);
+
+/* Scores the documents of batch and returns the positions of the k
+   highest scoring ones in top[] and their scores in topscores[], by
+   decreasing score (ties by position). Returns the number of
+   documents returned (min(k,n)), or -1 as svmrank_score. */
+SVMRANK_API long   svmrank_rank_topk(const SVMRANK_MODEL *model,
+				     SVMRANK_WORKSPACE *ws,
+				     const SVMRANK_BATCH *batch, long k,
+				     long *top, float *topscores);
+
+/* Lets svmrank_rank_topk stop scoring a document of a linear model as
+   soon as it cannot enter the top k. maxabs[j-1] is the largest
+   absolute value that feature j takes in the documents to rank
+   (j=1..svmrank_num_features). Documents with larger values are
+   scored in full, so the top k stay exact. Call it before the model
+   is shared between threads. Returns 0, or -1 if the model is not
+   linear. */
+SVMRANK_API int    svmrank_set_feature_bounds(SVMRANK_MODEL *model,
+					      const float *maxabs);
+
+/* Number of feature multiplications that svmrank_rank_topk has
+   skipped with workspace ws so far. */
+SVMRANK_API long   svmrank_saved_multiplications(const SVMRANK_WORKSPACE *ws);
+
+# define SVMRANK_INT8  1  /* quantized models: int8 weights, uint8 features */
+# define SVMRANK_FP16  2  /* half precision weights, float features */
+
+/* Replaces the weights of a linear model, or the support vectors of a
+   kernel model, by quantized copies that are scored with SIMD dot
+   products (AVX-512 or AVX2, if the CPU has them). Feature j is
+   expected in [0,range[j-1]]: it is divided by range[j-1] and its
+   weights are multiplied by it, so that all features use the full
+   range of the quantized values. range=NULL means [0,1] for all
+   features, as in normalized LETOR data. With SVMRANK_INT8, feature
+   values outside the range are clipped. Scores are approximate, and
+   svmrank_set_feature_bounds has no effect on a quantized model. Call
+   it before the model is shared between threads and before creating
+   workspaces for it. Returns 0, or -1 if the type is unknown, the
+   kernel is the expanded polynomial, or an int8 model would have too
+   many features for 32 bit sums. */
+SVMRANK_API int    svmrank_quantize_model(SVMRANK_MODEL *model, int type,
+					  const float *range);
+
+# define SVMRANK_DENSE_OFF     0  /* dense batches: feature by feature */
+# define SVMRANK_DENSE_GENERIC 1  /* scorer for any number of features */
+# define SVMRANK_DENSE_AUTO    2  /* scorer for the number of features of
+				     the model, if there is one */
+
+/* Dense batches with at least as many features per row as the model
+   has are scored by a scorer for dense rows, if the model is linear or
+   its support vectors are dense. With SVMRANK_DENSE_AUTO (the
+   default), the scorer is specialized for models with 4, 46 or 136
+   features, as in the LETOR data sets. Kernels are evaluated in float
+   precision. Call it before the model is shared between threads.
+   Returns 0, or -1 if the model has no dense scorer or the mode is
+   unknown. */
+SVMRANK_API int    svmrank_set_dense_scoring(SVMRANK_MODEL *model, int mode);
+
+/* Name of the scorer for dense batches (e.g. "rbf-136-avx2" or
+   "linear-any"), or NULL if they are scored feature by feature. */
+SVMRANK_API const char *svmrank_dense_scorer(const SVMRANK_MODEL *model);
+
+/* Turns model into the second stage of a cascade: svmrank_score and
+   svmrank_rank_topk score all documents of a batch with the linear
+   model first, and only its n best documents (ties by position) with
+   model. The other documents keep the score of the linear model,
+   shifted so that they rank after the re-scored documents in the
+   order of the linear model. first must stay loaded as long as model
+   is used. Call it before the model is shared between threads and
+   before creating workspaces for it. Returns 0, or -1 if first is not
+   a linear model, is quantized or a cascade itself, or n < 1. */
+SVMRANK_API int    svmrank_set_cascade(SVMRANK_MODEL *model,
+				       const SVMRANK_MODEL *first, long n);
+
+/* Name of the dot product that scores a quantized model on this CPU
+   ("avx512-vnni", "avx512", "avx2", "avx2-f16c" or "scalar"), or NULL
+   if the model is not quantized. */
+SVMRANK_API const char *svmrank_quantized_simd(const SVMRANK_MODEL *model);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,373 @@
+/***********************************************************************/
+/*                                                                     */
+/*   svm_rank_lib_bench.c                                              */
+/*                                                                     */
+/*   Measures the latency of scoring with libsvmrank and checks its    */
+/*   scores against classify_example.                                  */
+/*                                                                     */
+/***********************************************************************/
+
+# include "svm_light/svm_common.h"
+# include "svm_rank_lib.h"
+
+char docfile[200];
+char modelfile[200];
+char cascadefile[200];
+
+void read_input_parameters(int, char **, char *, char *, long *, long *,
+			   long *, long *, long *, long *);
+double wall_time(void);
+void print_help(void);
+
+
+int main (int argc, char* argv[])
+{
+  DOC **docs;
+  double *label,maxdiff=0,t,t_batch,t_single,t_topk;
+  long totwords,totdoc,nnz,i,j,p,q,r,nq,*qstart,maxq=0,k,threads,repeats;
+  long bounds,nf,*reftop,*ntop,mults=0,diffs=0,cascade_n,dense;
+  long *rowptr,*index;
+  float *value,*scores;
+  WORD *w;
+  SVMRANK_MODEL *model,*first=NULL;
+  MODEL *refmodel;
+  SVMRANK_BATCH all;
+
+  read_input_parameters(argc,argv,docfile,modelfile,&threads,&repeats,&k,
+			&bounds,&cascade_n,&dense);
+
+  read_documents(docfile,&docs,&label,&totwords,&totdoc);
+  if((model=svmrank_load_model(modelfile)) == NULL) {
+    printf("\nCannot score model %s with libsvmrank!\n\n",modelfile);
+    exit(1);
+  }
+
+  /* documents in CSR format, split into queries */
+  for(nnz=0,i=0;i<totdoc;i++)
+    nnz+=num_nonzero_svector(docs[i]->fvec);
+  rowptr=(long *)my_malloc(sizeof(long)*(totdoc+1));
+  index=(long *)my_malloc(sizeof(long)*(nnz+1));
+  value=(float *)my_malloc(sizeof(float)*(nnz+1));
+  qstart=(long *)my_malloc(sizeof(long)*(totdoc+1));
+  for(p=0,nq=0,i=0;i<totdoc;i++) {
+    rowptr[i]=p;
+    for(w=docs[i]->fvec->words;w->wnum;w++,p++) {
+      index[p]=w->wnum;
+      value[p]=w->weight;
+    }
+    if((i == 0) || (docs[i]->queryid != docs[i-1]->queryid))
+      qstart[nq++]=i;
+  }
+  rowptr[totdoc]=p;
+  qstart[nq]=totdoc;
+  for(q=0;q<nq;q++)
+    maxq=(qstart[q+1]-qstart[q] > maxq) ? qstart[q+1]-qstart[q] : maxq;
+
+  /* compare with the scores of svm_rank_classify */
+  scores=(float *)my_malloc(sizeof(float)*(totdoc+1));
+  all.n=totdoc;
+  all.dim=0;
+  all.x=NULL;
+  all.rowptr=rowptr;
+  all.index=index;
+  all.value=value;
+  {
+    SVMRANK_WORKSPACE *ws=svmrank_create_workspace(model,totdoc);
+    svmrank_score(model,ws,&all,scores);
+    svmrank_free_workspace(ws);
+  }
+  refmodel=read_model(modelfile);
+  if(refmodel->kernel_parm.kernel_type == LINEAR)
+    add_weight_vector_to_linear_model(refmodel);
+  else
+    add_kernel_block_to_model(refmodel);
+  for(i=0;i<totdoc;i++) {
+    for(w=docs[i]->fvec->words;w->wnum;w++)
+      if((refmodel->kernel_parm.kernel_type == LINEAR)
+	 && (w->wnum>refmodel->totwords))
+	w->wnum=0;
+    t=fabs((float)classify_example(refmodel,docs[i])-scores[i]);
+    if(t > maxdiff) maxdiff=t;
+  }
+  free_model(refmodel,1);
+  printf("%ld documents, %ld queries, %ld threads\n",totdoc,nq,threads);
+  printf("Largest difference to classify_example: %g\n",maxdiff);
+
+  nf=svmrank_num_features(model);
+  if(bounds) {
+    /* top k of each query without and with early termination, with
+       the ranges of the features in the examples */
+    float *maxabs,*ts=(float *)my_malloc(sizeof(float)*(maxq+1));
+    long *tp=(long *)my_malloc(sizeof(long)*(maxq+1));
+    SVMRANK_WORKSPACE *ws=svmrank_create_workspace(model,maxq);
+    SVMRANK_BATCH b=all;
+
+    maxabs=(float *)my_malloc(sizeof(float)*(nf+1));
+    for(j=0;j<nf;j++)
+      maxabs[j]=0;
+    for(p=0;p<nnz;p++)
+      if((index[p]<=nf) && (fabs(value[p])>maxabs[index[p]-1]))
+	maxabs[index[p]-1]=fabs(value[p]);
+    reftop=(long *)my_malloc(sizeof(long)*(nq*k+1));
+    ntop=(long *)my_malloc(sizeof(long)*(nq+1));
+    for(q=0;q<nq;q++) {
+      b.n=qstart[q+1]-qstart[q];
+      b.rowptr=rowptr+qstart[q];
+      ntop[q]=svmrank_rank_topk(model,ws,&b,k,reftop+q*k,ts);
+      mults+=rowptr[qstart[q+1]]-rowptr[qstart[q]];
+    }
+    if(svmrank_set_feature_bounds(model,maxabs)) {
+      printf("\nEarly termination (-b) needs a linear model!\n\n");
+      exit(1);
+    }
+    for(q=0;q<nq;q++) {
+      b.n=qstart[q+1]-qstart[q];
+      b.rowptr=rowptr+qstart[q];
+      if(svmrank_rank_topk(model,ws,&b,k,tp,ts) != ntop[q])
+	diffs++;
+      else
+	for(j=0;j<ntop[q];j++)
+	  diffs+=(tp[j] != reftop[q*k+j]);
+    }
+    printf("Top-%ld with early termination: %s, %ld of %ld multiplications saved\n",
+	   k,diffs ? "DIFFERENT" : "identical",
+	   svmrank_saved_multiplications(ws),mults);
+    svmrank_free_workspace(ws);
+    free(maxabs);
+    free(reftop);
+    free(ntop);
+    free(tp);
+    free(ts);
+  }
+
+  if(dense) {
+    /* the documents as dense rows with the features of the model at
+       least, scored feature by feature, with the scorer for any number
+       of features and with the specialized one */
+    int mode[3]={SVMRANK_DENSE_OFF,SVMRANK_DENSE_GENERIC,SVMRANK_DENSE_AUTO};
+    long dim=(totwords > nf) ? totwords : nf;
+    float *x=(float *)my_malloc(sizeof(float)*(totdoc*dim+1));
+    float *s=(float *)my_malloc(sizeof(float)*(maxq+1));
+    const char *name;
+    SVMRANK_WORKSPACE *ws=svmrank_create_workspace(model,maxq);
+    SVMRANK_BATCH b=all;
+
+    for(p=0;p<totdoc*dim;p++)
+      x[p]=0;
+    for(i=0;i<totdoc;i++)
+      for(w=docs[i]->fvec->words;w->wnum;w++)
+	x[i*dim+w->wnum-1]=w->weight;
+    b.dim=dim;
+    for(j=0;j<3;j++) {
+      if(svmrank_set_dense_scoring(model,mode[j])) {
+	printf("Dense rows: the model has no dense scorer\n");
+	break;
+      }
+      if(!(name=svmrank_dense_scorer(model)))
+	name="feature by feature";
+      t_batch=wall_time();
+      for(r=0;r<repeats;r++)
+	for(q=0;q<nq;q++) {
+	  b.n=qstart[q+1]-qstart[q];
+	  b.x=x+qstart[q]*dim;
+	  svmrank_score(model,ws,&b,s);
+	}
+      t_batch=wall_time()-t_batch;
+      for(maxdiff=0,q=0;q<nq;q++) {
+	b.n=qstart[q+1]-qstart[q];
+	b.x=x+qstart[q]*dim;
+	svmrank_score(model,ws,&b,s);
+	for(i=0;i<b.n;i++)
+	  if(fabs(s[i]-scores[qstart[q]+i]) > maxdiff)
+	    maxdiff=fabs(s[i]-scores[qstart[q]+i]);
+      }
+      printf("Dense rows, %-20s: %.1f ns per document, largest difference %g\n",
+	     name,1e9*t_batch/repeats/totdoc,maxdiff);
+    }
+    svmrank_set_dense_scoring(model,SVMRANK_DENSE_AUTO);
+    svmrank_free_workspace(ws);
+    free(s);
+    free(x);
+  }
+
+  if(cascadefile[0]) {
+    /* top k of each query with the model alone and as the second
+       stage of a cascade */
+    float *ts=(float *)my_malloc(sizeof(float)*(maxq+1));
+    long *tp=(long *)my_malloc(sizeof(long)*(maxq+1));
+    SVMRANK_WORKSPACE *ws=svmrank_create_workspace(model,maxq);
+    SVMRANK_BATCH b=all;
+
+    reftop=(long *)my_malloc(sizeof(long)*(nq*k+1));
+    ntop=(long *)my_malloc(sizeof(long)*(nq+1));
+    for(q=0;q<nq;q++) {
+      b.n=qstart[q+1]-qstart[q];
+      b.rowptr=rowptr+qstart[q];
+      ntop[q]=svmrank_rank_topk(model,ws,&b,k,reftop+q*k,ts);
+    }
+    svmrank_free_workspace(ws);
+    if(((first=svmrank_load_model(cascadefile)) == NULL)
+       || svmrank_set_cascade(model,first,cascade_n)) {
+      printf("\nThe first stage of the cascade (-c) must be a linear model!\n\n");
+      exit(1);
+    }
+    ws=svmrank_create_workspace(model,maxq);
+    for(q=0;q<nq;q++) {
+      b.n=qstart[q+1]-qstart[q];
+      b.rowptr=rowptr+qstart[q];
+      if(svmrank_rank_topk(model,ws,&b,k,tp,ts) != ntop[q])
+	diffs++;
+      else
+	for(j=0;j<ntop[q];j++)
+	  if(tp[j] != reftop[q*k+j]) {
+	    diffs++;
+	    break;
+	  }
+    }
+    printf("Cascade re-scoring %ld documents per query: top-%ld different in %ld of %ld queries\n",
+	   cascade_n,k,diffs,nq);
+    printf("(latencies below are of the cascade)\n");
+    svmrank_free_workspace(ws);
+    free(reftop);
+    free(ntop);
+    free(tp);
+    free(ts);
+  }
+
+  /* each thread scores all queries repeats times with its own
+     workspace: one batch per query, one call per document, and the
+     top k of each query */
+  t_batch=t_single=t_topk=0;
+#pragma omp parallel num_threads(threads) private(q,r,j,t) reduction(+:t_batch,t_single,t_topk)
+  {
+    SVMRANK_WORKSPACE *ws=svmrank_create_workspace(model,maxq);
+    SVMRANK_BATCH b=all;
+    float *s=(float *)my_malloc(sizeof(float)*(maxq+1));
+    long *tp=(long *)my_malloc(sizeof(long)*(maxq+1));
+
+    t=wall_time();
+    for(r=0;r<repeats;r++)
+      for(q=0;q<nq;q++) {
+	b.n=qstart[q+1]-qstart[q];
+	b.rowptr=rowptr+qstart[q];
+	svmrank_score(model,ws,&b,s);
+      }
+    t_batch+=wall_time()-t;
+    t=wall_time();
+    b.n=1;
+    for(r=0;r<repeats;r++)
+      for(j=0;j<totdoc;j++) {
+	b.rowptr=rowptr+j;
+	svmrank_score(model,ws,&b,s);
+      }
+    t_single+=wall_time()-t;
+    t=wall_time();
+    for(r=0;r<repeats;r++)
+      for(q=0;q<nq;q++) {
+	b.n=qstart[q+1]-qstart[q];
+	b.rowptr=rowptr+qstart[q];
+	svmrank_rank_topk(model,ws,&b,k,tp,s);
+      }
+    t_topk+=wall_time()-t;
+    free(tp);
+    free(s);
+    svmrank_free_workspace(ws);
+  }
+  /* per document, averaged over threads (all threads run at once) */
+  printf("Latency per document (ns): %.1f per query batch, %.1f single, %.1f top-%ld\n",
+	 1e9*t_batch/threads/repeats/totdoc,1e9*t_single/threads/repeats/totdoc,
+	 1e9*t_topk/threads/repeats/totdoc,k);
+  printf("Throughput (documents/s): %.0f\n",
+	 (double)threads*repeats*totdoc/(t_batch/threads));
+
+  svmrank_free_model(model);
+  if(first) svmrank_free_model(first);
+  for(i=0;i<totdoc;i++)
+    free_example(docs[i],1);
+  free(docs);
+  free(label);
+  free(scores);
+  free(qstart);
+  free(value);
+  free(index);
+  free(rowptr);
+  return(0);
+}
+
+double wall_time(void)
+     /* elapsed time in seconds */
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return(ts.tv_sec+1e-9*ts.tv_nsec);
+}
+
+void read_input_parameters(int argc, char **argv, char *docfile,
+			   char *modelfile, long *threads, long *repeats,
+			   long *k, long *bounds, long *cascade_n,
+			   long *dense)
+{
+  long i;
+
+  /* set default */
+  (*threads)=1;
+  (*repeats)=10;
+  (*k)=10;
+  (*bounds)=0;
+  (*cascade_n)=100;
+  (*dense)=0;
+  cascadefile[0]=0;
+  verbosity=0;
+
+  for(i=1;(i<argc) && ((argv[i])[0] == '-');i++) {
+    switch ((argv[i])[1])
+      {
+      case 'h': print_help(); exit(0);
+      case 't': i++; (*threads)=atol(argv[i]); break;
+      case 'r': i++; (*repeats)=atol(argv[i]); break;
+      case 'k': i++; (*k)=atol(argv[i]); break;
+      case 'b': (*bounds)=1; break;
+      case 'd': (*dense)=1; break;
+      case 'c': i++; strcpy(cascadefile,argv[i]); break;
+      case 'n': i++; (*cascade_n)=atol(argv[i]); break;
+      default: printf("\nUnrecognized option %s!\n\n",argv[i]);
+	       print_help();
+	       exit(0);
+      }
+  }
+  if((i+1)>=argc) {
+    printf("\nNot enough input parameters!\n\n");
+    print_help();
+    exit(0);
+  }
+  strcpy (docfile, argv[i]);
+  strcpy (modelfile, argv[i+1]);
+#ifndef _OPENMP
+  (*threads)=1;  /* built without OpenMP */
+#endif
+  if(((*threads) < 1) || ((*repeats) < 1) || ((*k) < 1) || ((*cascade_n) < 1)) {
+    printf("\nThreads, repeats, k and n must be at least 1!\n\n");
+    print_help();
+    exit(0);
+  }
+}
+
+void print_help(void)
+{
+  printf("\nlibsvmrank micro-benchmark, based on SVM-light %s\n",VERSION);
+  printf("   usage: svm_rank_lib_bench [options] example_file model_file\n\n");
+  printf("options: -h         -> this help\n");
+  printf("         -t int     -> number of threads scoring at the same time (default 1)\n");
+  printf("         -r int     -> number of passes over the examples (default 10)\n");
+  printf("         -k int     -> k for the top-k ranking of each query (default 10)\n");
+  printf("         -b         -> linear models: top-k ranking with early termination,\n");
+  printf("                       with the feature ranges of example_file\n");
+  printf("         -d         -> score the examples as dense rows feature by feature,\n");
+  printf("                       with the generic and with the specialized dense\n");
+  printf("                       scorer, single-threaded\n");
+  printf("         -c file    -> score model_file as the second stage of a cascade\n");
+  printf("                       after the linear model in file\n");
+  printf("         -n int     -> documents of each query re-scored in the cascade\n");
+  printf("                       (default 100)\n\n");
+}
@@ -0,0 +1,396 @@
+/***********************************************************************/
+/*                                                                     */
+/*   svm_rank_loadgen.c                                                */
+/*                                                                     */
+/*   Load generator for svm_rank_serve. Several clients send the       */
+/*   queries of an example file to the server, one query per request, */
+/*   and the round trip latencies and the throughput are reported.    */
+/*                                                                     */
+/***********************************************************************/
+
+# include <pthread.h>
+# include <errno.h>
+# include <unistd.h>
+# include <sys/socket.h>
+# include <sys/un.h>
+# include "svm_light/svm_common.h"
+# include "svm_rank_serve.h"
+
+typedef struct query {
+  long    n;            /* number of documents */
+  char    *text;        /* the request in text format */
+  long    textlen;
+  char    *binary;      /* the request in binary format */
+  long    binlen;
+} QUERY;
+
+typedef struct client {
+  long    id;
+  double  *latency;     /* round trip time of each request (s) */
+  long    docs;         /* documents scored */
+  int     failed;
+} CLIENT;
+
+char docfile[200];
+char socketfile[200];
+char predfile[200];
+long clients,requests,binary;
+QUERY *queries;
+long nqueries;
+
+void   read_input_parameters(int, char **, char *, char *, char *, long *,
+			     long *, long *, long *, long *);
+void   print_help(void);
+void   read_queries(char *);
+int    connect_server(char *);
+int    request(int, unsigned int, char *, long, char **, long *,
+	       unsigned int *);
+void   *run_client(void *);
+double wall_time(void);
+int    read_full(int, void *, size_t);
+int    write_full(int, const void *, size_t);
+
+
+int main (int argc, char* argv[])
+{
+  CLIENT *c;
+  pthread_t *threads;
+  double t,*all,docs=0;
+  long i,j,n,size=0,stats;
+  char *answer=NULL;
+  unsigned int type;
+  FILE *predfl;
+  int fd;
+
+  read_input_parameters(argc,argv,docfile,socketfile,predfile,&verbosity,
+			&clients,&requests,&binary,&stats);
+  read_queries(docfile);
+  if(verbosity>=1) {
+    printf("%ld queries, %ld clients sending %ld %s requests each\n",
+	   nqueries,clients,requests,binary ? "binary" : "text");
+    fflush(stdout);
+  }
+
+  c=(CLIENT *)my_malloc(sizeof(CLIENT)*clients);
+  threads=(pthread_t *)my_malloc(sizeof(pthread_t)*clients);
+  t=wall_time();
+  for(i=0;i<clients;i++) {
+    c[i].id=i;
+    c[i].latency=(double *)my_malloc(sizeof(double)*(requests+1));
+    c[i].docs=0;
+    c[i].failed=0;
+    pthread_create(&threads[i],NULL,run_client,&c[i]);
+  }
+  for(i=0;i<clients;i++)
+    pthread_join(threads[i],NULL);
+  t=wall_time()-t;
+
+  all=(double *)my_malloc(sizeof(double)*(clients*requests+1));
+  for(n=0,i=0;i<clients;i++) {
+    if(c[i].failed) {
+      printf("\nClient %ld failed!\n\n",i);
+      exit(1);
+    }
+    for(j=0;j<requests;j++)
+      all[n++]=c[i].latency[j];
+    docs+=c[i].docs;
+    free(c[i].latency);
+  }
+  qsort(all,n,sizeof(double),compare_double);
+  printf("Requests: %ld in %.3f s, %.0f requests/s, %.0f documents/s\n",
+	 n,t,n/t,docs/t);
+  printf("Round trip latency (us): p50 %.1f, p99 %.1f, max %.1f\n",
+	 1e6*all[(long)(0.50*(n-1))],1e6*all[(long)(0.99*(n-1))],
+	 1e6*all[n-1]);
+
+  fd=connect_server(socketfile);
+  if(predfile[0]) {  /* scores of all documents in file order */
+    if ((predfl = fopen (predfile, "w")) == NULL)
+    { perror (predfile); exit (1); }
+    for(i=0;i<nqueries;i++) {
+      if(binary)
+	j=request(fd,SERVE_BINARY,queries[i].binary,queries[i].binlen,
+		  &answer,&size,&type);
+      else
+	j=request(fd,SERVE_TEXT,queries[i].text,queries[i].textlen,
+		  &answer,&size,&type);
+      if(j || (type != SERVE_SCORES)) {
+	printf("\nRequest for query %ld failed!\n\n",i+1);
+	exit(1);
+      }
+      for(j=0;j<queries[i].n;j++)
+	fprintf(predfl,"%.8f\n",((float *)answer)[j]);
+    }
+    fclose(predfl);
+  }
+  if(stats) {
+    if(request(fd,SERVE_STATS,NULL,0,&answer,&size,&type)
+       || (type != SERVE_STATS)) {
+      printf("\nStatistics request failed!\n\n");
+      exit(1);
+    }
+    printf("Server: %s",answer);
+  }
+  close(fd);
+
+  for(i=0;i<nqueries;i++) {
+    free(queries[i].text);
+    free(queries[i].binary);
+  }
+  free(queries);
+  free(answer);
+  free(all);
+  free(threads);
+  free(c);
+  return(0);
+}
+
+void *run_client(void *arg)
+     /* sends requests requests, starting at a different query for
+	each client */
+{
+  CLIENT *c=(CLIENT *)arg;
+  QUERY *q;
+  char *answer=NULL;
+  long r,size=0;
+  unsigned int type;
+  double t;
+  int fd;
+
+  fd=connect_server(socketfile);
+  for(r=0;r<requests;r++) {
+    q=&queries[(c->id*nqueries/clients+r)%nqueries];
+    t=wall_time();
+    if(binary)
+      c->failed=request(fd,SERVE_BINARY,q->binary,q->binlen,&answer,&size,
+			&type);
+    else
+      c->failed=request(fd,SERVE_TEXT,q->text,q->textlen,&answer,&size,
+			&type);
+    c->latency[r]=wall_time()-t;
+    if(c->failed || (type != SERVE_SCORES)) {
+      if(!c->failed)
+	printf("Server error: %s\n",answer);
+      c->failed=1;
+      break;
+    }
+    c->docs+=q->n;
+  }
+  close(fd);
+  free(answer);
+  return(NULL);
+}
+
+int request(int fd, unsigned int type, char *payload, long length,
+	    char **answer, long *size, unsigned int *answertype)
+     /* sends one frame and receives the answer into *answer, which is
+	grown as needed and NUL terminated. Returns 0, or -1 if the
+	connection failed. */
+{
+  SERVE_HEADER h;
+
+  h.type=type;
+  h.length=(unsigned int)length;
+  if(write_full(fd,&h,sizeof(h)) || write_full(fd,payload,length)
+     || read_full(fd,&h,sizeof(h)))
+    return(-1);
+  if((long)h.length+1 > (*size)) {
+    (*size)=h.length+1;
+    free(*answer);
+    (*answer)=(char *)my_malloc(*size);
+  }
+  if(read_full(fd,*answer,h.length))
+    return(-1);
+  (*answer)[h.length]=0;
+  (*answertype)=h.type;
+  return(0);
+}
+
+int connect_server(char *file)
+{
+  struct sockaddr_un addr;
+  int fd;
+
+  memset(&addr,0,sizeof(addr));
+  addr.sun_family=AF_UNIX;
+  if(strlen(file) >= sizeof(addr.sun_path)) {
+    printf("\nSocket path %s is too long!\n\n",file);
+    exit(1);
+  }
+  strcpy(addr.sun_path,file);
+  if(((fd=socket(AF_UNIX,SOCK_STREAM,0)) < 0)
+     || (connect(fd,(struct sockaddr *)&addr,sizeof(addr)) < 0))
+  { perror (file); exit (1); }
+  return(fd);
+}
+
+void read_queries(char *file)
+     /* reads the example file and prepares a text and a binary request
+	for each query */
+{
+  FILE *docfl;
+  char *line,*copy,*comment;
+  WORD *words;
+  long max_docs,max_words,ll,queryid,slackid,wpos,lastqid=-1,n;
+  long i,pos;
+  double label,costfactor;
+  unsigned int u;
+  QUERY *q=NULL;
+
+  nol_ll(file,&max_docs,&max_words,&ll);
+  max_words+=2;
+  ll+=2;
+  words=(WORD *)my_malloc(sizeof(WORD)*(max_words+10));
+  line=(char *)my_malloc(sizeof(char)*ll);
+  copy=(char *)my_malloc(sizeof(char)*ll);
+  queries=(QUERY *)my_malloc(sizeof(QUERY)*(max_docs+1));
+  nqueries=0;
+
+  if ((docfl = fopen (file, "r")) == NULL)
+  { perror (file); exit (1); }
+  while(fgets(line,(int)ll,docfl)) {
+    if(line[0] == '#') continue;
+    strcpy(copy,line);
+    if(!parse_document(line,words,&label,&queryid,&slackid,&costfactor,
+		       &wpos,max_words,&comment))
+      continue;
+    if((nqueries == 0) || (queryid != lastqid)) {
+      q=&queries[nqueries++];
+      q->n=0;
+      q->text=NULL;
+      q->textlen=0;
+      q->binary=(char *)my_malloc(sizeof(u));
+      q->binlen=sizeof(u);
+      lastqid=queryid;
+    }
+    /* text: the line as it is */
+    n=strlen(copy);
+    if((n == 0) || (copy[n-1] != '\n'))
+      copy[n++]='\n';
+    q->text=(char *)realloc(q->text,q->textlen+n);
+    memcpy(q->text+q->textlen,copy,n);
+    q->textlen+=n;
+    /* binary: count, then pairs of feature number and value */
+    wpos--;  /* without the terminating word */
+    q->binary=(char *)realloc(q->binary,q->binlen+sizeof(u)+8*wpos);
+    pos=q->binlen;
+    u=(unsigned int)wpos;
+    memcpy(q->binary+pos,&u,sizeof(u));
+    pos+=sizeof(u);
+    for(i=0;i<wpos;i++,pos+=8) {
+      u=(unsigned int)words[i].wnum;
+      memcpy(q->binary+pos,&u,sizeof(u));
+      memcpy(q->binary+pos+4,&words[i].weight,sizeof(float));
+    }
+    q->binlen=pos;
+    q->n++;
+    u=(unsigned int)q->n;
+    memcpy(q->binary,&u,sizeof(u));
+  }
+  fclose(docfl);
+  free(copy);
+  free(line);
+  free(words);
+  if(nqueries == 0) {
+    printf("\nNo examples in %s!\n\n",file);
+    exit(1);
+  }
+}
+
+int read_full(int fd, void *buf, size_t n)
+{
+  ssize_t r;
+
+  while(n > 0) {
+    if((r=read(fd,buf,n)) <= 0) {
+      if((r < 0) && (errno == EINTR))
+	continue;
+      return(-1);
+    }
+    buf=(char *)buf+r;
+    n-=r;
+  }
+  return(0);
+}
+
+int write_full(int fd, const void *buf, size_t n)
+{
+  ssize_t r;
+
+  while(n > 0) {
+    if((r=write(fd,buf,n)) < 0) {
+      if(errno == EINTR)
+	continue;
+      return(-1);
+    }
+    buf=(const char *)buf+r;
+    n-=r;
+  }
+  return(0);
+}
+
+double wall_time(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return(ts.tv_sec+1e-9*ts.tv_nsec);
+}
+
+void read_input_parameters(int argc, char **argv, char *docfile,
+			   char *socketfile, char *predfile, long *verbosity,
+			   long *clients, long *requests, long *binary,
+			   long *stats)
+{
+  long i;
+
+  /* set default */
+  strcpy (predfile, "");
+  (*verbosity)=1;
+  (*clients)=4;
+  (*requests)=1000;
+  (*binary)=0;
+  (*stats)=0;
+
+  for(i=1;(i<argc) && ((argv[i])[0] == '-');i++) {
+    switch ((argv[i])[1])
+      {
+      case 'h': print_help(); exit(0);
+      case 'v': i++; (*verbosity)=atol(argv[i]); break;
+      case 'c': i++; (*clients)=atol(argv[i]); break;
+      case 'n': i++; (*requests)=atol(argv[i]); break;
+      case 'B': (*binary)=1; break;
+      case 's': (*stats)=1; break;
+      case 'p': i++; strcpy(predfile,argv[i]); break;
+      default: printf("\nUnrecognized option %s!\n\n",argv[i]);
+	       print_help();
+	       exit(0);
+      }
+  }
+  if((i+1)>=argc) {
+    printf("\nNot enough input parameters!\n\n");
+    print_help();
+    exit(0);
+  }
+  strcpy (docfile, argv[i]);
+  strcpy (socketfile, argv[i+1]);
+  if(((*clients) < 1) || ((*requests) < 1)) {
+    printf("\nClients and requests must be at least 1!\n\n");
+    print_help();
+    exit(0);
+  }
+}
+
+void print_help(void)
+{
+  printf("\nLoad generator for svm_rank_serve, based on SVM-light %s\n",VERSION);
+  printf("   usage: svm_rank_loadgen [options] example_file socket_file\n\n");
+  printf("options: -h         -> this help\n");
+  printf("         -v [0..3]  -> verbosity level (default 1)\n");
+  printf("         -c int     -> number of clients sending at the same time (default 4)\n");
+  printf("         -n int     -> requests per client, one query each (default 1000)\n");
+  printf("         -B         -> send binary instead of text requests\n");
+  printf("         -s         -> print the statistics of the server at the end\n");
+  printf("         -p file    -> afterwards, score each query once and write the\n");
+  printf("                       scores to file, as svm_rank_classify does\n\n");
+}
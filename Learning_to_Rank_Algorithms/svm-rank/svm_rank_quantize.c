@@ -0,0 +1,322 @@
+/***********************************************************************/
+/*                                                                     */
+/*   svm_rank_quantize.c                                               */
+/*                                                                     */
+/*   Compares the rankings of a quantized model (int8 or fp16, see     */
+/*   svmrank_quantize_model) with those of the float model on a        */
+/*   validation file, to decide whether the quantized model can be     */
+/*   served instead (svm_rank_serve -q).                               */
+/*                                                                     */
+/***********************************************************************/
+
+# include "svm_light/svm_common.h"
+# include "svm_rank_lib.h"
+
+# define MAX(x,y) ((x) < (y) ? (y) : (x))
+
+char docfile[200];
+char modelfile[200];
+char rangefile[200];
+char writerangefile[200];
+
+void   read_input_parameters(int, char **, char *, char *, int *, char *,
+			     char *, long *, long *, long *);
+float  *read_ranges(char *, long);
+double wall_time(void);
+void   print_help(void);
+
+
+int main (int argc, char* argv[])
+{
+  DOC **docs;
+  double *label,t,t_float,t_quant,maxdiff=0,sumchange=0;
+  long totwords,totdoc,nnz,i,j,p,q,r,n,nq,*qstart,maxq=0,k,repeats;
+  long *rowptr,*index,*top,*rank_float,*rank_quant,change,maxchange=0;
+  long maxchange_qid=0,pairs=0,swapped=0,topk_differ=0,clipped=0,dense;
+  float *value,*x=NULL,*s_float,*s_quant,*topscores,*range;
+  int type,differ;
+  WORD *w;
+  SVMRANK_MODEL *fmodel,*qmodel;
+  SVMRANK_WORKSPACE *fws,*qws;
+  SVMRANK_BATCH b;
+  FILE *fl;
+
+  read_input_parameters(argc,argv,docfile,modelfile,&type,rangefile,
+			writerangefile,&k,&repeats,&dense);
+
+  read_documents(docfile,&docs,&label,&totwords,&totdoc);
+  if(((fmodel=svmrank_load_model(modelfile)) == NULL)
+     || ((qmodel=svmrank_load_model(modelfile)) == NULL)) {
+    printf("\nCannot score model %s with libsvmrank!\n\n",modelfile);
+    exit(1);
+  }
+
+  /* feature ranges: from a file, from the validation file, or [0,1] */
+  n=svmrank_num_features(fmodel);
+  range=NULL;
+  if(rangefile[0])
+    range=read_ranges(rangefile,n);
+  else if(writerangefile[0]) {
+    range=(float *)my_malloc(sizeof(float)*(n+1));
+    for(j=0;j<n;j++)
+      range[j]=0;
+    for(i=0;i<totdoc;i++)
+      for(w=docs[i]->fvec->words;w->wnum;w++)
+	if((w->wnum<=n) && (w->weight>range[w->wnum-1]))
+	  range[w->wnum-1]=w->weight;
+    if((fl=fopen(writerangefile,"w")) == NULL)
+    { perror (writerangefile); exit (1); }
+    for(j=0;j<n;j++)
+      fprintf(fl,"%ld %.8g\n",j+1,range[j]);
+    fclose(fl);
+  }
+  if(svmrank_quantize_model(qmodel,type,range)) {
+    printf("\nCannot quantize model %s!\n\n",modelfile);
+    exit(1);
+  }
+  if(type == SVMRANK_INT8)  /* values the quantized model sees clipped */
+    for(i=0;i<totdoc;i++)
+      for(w=docs[i]->fvec->words;w->wnum;w++)
+	if((w->wnum<=n) && ((w->weight<0)
+			    || (w->weight>(range ? range[w->wnum-1] : 1))))
+	  clipped++;
+
+  /* documents in CSR format, split into queries */
+  for(nnz=0,i=0;i<totdoc;i++)
+    nnz+=num_nonzero_svector(docs[i]->fvec);
+  rowptr=(long *)my_malloc(sizeof(long)*(totdoc+1));
+  index=(long *)my_malloc(sizeof(long)*(nnz+1));
+  value=(float *)my_malloc(sizeof(float)*(nnz+1));
+  qstart=(long *)my_malloc(sizeof(long)*(totdoc+1));
+  for(p=0,nq=0,i=0;i<totdoc;i++) {
+    rowptr[i]=p;
+    for(w=docs[i]->fvec->words;w->wnum;w++,p++) {
+      index[p]=w->wnum;
+      value[p]=w->weight;
+    }
+    if((i == 0) || (docs[i]->queryid != docs[i-1]->queryid))
+      qstart[nq++]=i;
+  }
+  rowptr[totdoc]=p;
+  qstart[nq]=totdoc;
+  for(q=0;q<nq;q++)
+    maxq=(qstart[q+1]-qstart[q] > maxq) ? qstart[q+1]-qstart[q] : maxq;
+  if(dense) {  /* the same documents as dense rows of n features */
+    x=(float *)my_malloc(sizeof(float)*(totdoc*n+1));
+    for(i=0;i<totdoc*n;i++)
+      x[i]=0;
+    for(i=0;i<totdoc;i++)
+      for(w=docs[i]->fvec->words;w->wnum;w++)
+	if(w->wnum<=n)
+	  x[i*n+w->wnum-1]=w->weight;
+  }
+
+  fws=svmrank_create_workspace(fmodel,maxq);
+  qws=svmrank_create_workspace(qmodel,maxq);
+  s_float=(float *)my_malloc(sizeof(float)*(maxq+1));
+  s_quant=(float *)my_malloc(sizeof(float)*(maxq+1));
+  topscores=(float *)my_malloc(sizeof(float)*(maxq+1));
+  top=(long *)my_malloc(sizeof(long)*(maxq+1));
+  rank_float=(long *)my_malloc(sizeof(long)*(maxq+1));
+  rank_quant=(long *)my_malloc(sizeof(long)*(maxq+1));
+  b.dim=dense ? n : 0;
+  b.index=index;
+  b.value=value;
+
+  /* compare the complete ranking of each query */
+  for(q=0;q<nq;q++) {
+    b.n=qstart[q+1]-qstart[q];
+    b.rowptr=rowptr+qstart[q];
+    b.x=dense ? x+qstart[q]*n : NULL;
+    svmrank_score(fmodel,fws,&b,s_float);
+    svmrank_score(qmodel,qws,&b,s_quant);
+    for(i=0;i<b.n;i++) {
+      t=fabs(s_float[i]-s_quant[i]);
+      if(t > maxdiff) maxdiff=t;
+    }
+    svmrank_rank_topk(fmodel,fws,&b,b.n,top,topscores);
+    for(i=0;i<b.n;i++)
+      rank_float[top[i]]=i;
+    svmrank_rank_topk(qmodel,qws,&b,b.n,top,topscores);
+    for(i=0;i<b.n;i++)
+      rank_quant[top[i]]=i;
+    differ=0;
+    for(i=0;i<b.n;i++) {
+      change=labs(rank_float[i]-rank_quant[i]);
+      sumchange+=change;
+      if(change > maxchange) {
+	maxchange=change;
+	maxchange_qid=docs[qstart[q]]->queryid;
+      }
+      for(j=i+1;j<b.n;j++)
+	if((rank_float[i]<rank_float[j]) != (rank_quant[i]<rank_quant[j]))
+	  swapped++;
+      if((rank_float[i]<k) && (rank_float[i] != rank_quant[i]))
+	differ=1;
+    }
+    topk_differ+=differ;
+    pairs+=b.n*(b.n-1)/2;
+  }
+
+  /* speed of both models, one batch per query */
+  t=wall_time();
+  for(r=0;r<repeats;r++)
+    for(q=0;q<nq;q++) {
+      b.n=qstart[q+1]-qstart[q];
+      b.rowptr=rowptr+qstart[q];
+      b.x=dense ? x+qstart[q]*n : NULL;
+      svmrank_score(fmodel,fws,&b,s_float);
+    }
+  t_float=wall_time()-t;
+  t=wall_time();
+  for(r=0;r<repeats;r++)
+    for(q=0;q<nq;q++) {
+      b.n=qstart[q+1]-qstart[q];
+      b.rowptr=rowptr+qstart[q];
+      b.x=dense ? x+qstart[q]*n : NULL;
+      svmrank_score(qmodel,qws,&b,s_quant);
+    }
+  t_quant=wall_time()-t;
+
+  printf("%s model, dot product: %s\n",(type == SVMRANK_INT8) ? "int8" : "fp16",
+	 svmrank_quantized_simd(qmodel));
+  printf("%ld documents, %ld queries%s\n",totdoc,nq,
+	 dense ? ", as dense rows" : "");
+  if(type == SVMRANK_INT8)
+    printf("Feature values outside of their range (clipped): %ld\n",clipped);
+  printf("Largest score difference: %g\n",maxdiff);
+  printf("Largest rank change: %ld positions (query %ld)\n",maxchange,
+	 maxchange_qid);
+  printf("Average rank change: %.4f positions\n",sumchange/MAX(1,totdoc));
+  printf("Pairs in a different order: %ld of %ld (%.4f%%)\n",swapped,pairs,
+	 100.0*swapped/MAX(1,pairs));
+  printf("Queries with a different top %ld: %ld of %ld\n",k,topk_differ,nq);
+  printf("Scoring time per document (ns): %.1f float, %.1f quantized\n",
+	 1e9*t_float/repeats/MAX(1,totdoc),1e9*t_quant/repeats/MAX(1,totdoc));
+
+  svmrank_free_workspace(fws);
+  svmrank_free_workspace(qws);
+  svmrank_free_model(fmodel);
+  svmrank_free_model(qmodel);
+  for(i=0;i<totdoc;i++)
+    free_example(docs[i],1);
+  free(docs);
+  free(label);
+  if(range) free(range);
+  if(x) free(x);
+  free(s_float);
+  free(s_quant);
+  free(topscores);
+  free(top);
+  free(rank_float);
+  free(rank_quant);
+  free(qstart);
+  free(value);
+  free(index);
+  free(rowptr);
+  return(0);
+}
+
+float *read_ranges(char *file, long n)
+     /* reads lines of feature number and range; features that are not
+	listed keep the range 1 */
+{
+  FILE *fl;
+  float *range,r;
+  long j,fnum;
+
+  range=(float *)my_malloc(sizeof(float)*(n+1));
+  for(j=0;j<n;j++)
+    range[j]=1;
+  if((fl=fopen(file,"r")) == NULL)
+  { perror (file); exit (1); }
+  while(fscanf(fl,"%ld %f",&fnum,&r) == 2)
+    if((fnum>0) && (fnum<=n))
+      range[fnum-1]=r;
+  fclose(fl);
+  return(range);
+}
+
+double wall_time(void)
+     /* elapsed time in seconds */
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return(ts.tv_sec+1e-9*ts.tv_nsec);
+}
+
+void read_input_parameters(int argc, char **argv, char *docfile,
+			   char *modelfile, int *type, char *rangefile,
+			   char *writerangefile, long *k, long *repeats,
+			   long *dense)
+{
+  long i;
+
+  /* set default */
+  (*type)=SVMRANK_INT8;
+  strcpy (rangefile, "");
+  strcpy (writerangefile, "");
+  (*k)=10;
+  (*repeats)=10;
+  (*dense)=0;
+  verbosity=0;
+
+  for(i=1;(i<argc) && ((argv[i])[0] == '-');i++) {
+    switch ((argv[i])[1])
+      {
+      case 'h': print_help(); exit(0);
+      case 'q': i++;
+	        if(strcmp(argv[i],"int8") == 0) (*type)=SVMRANK_INT8;
+		else if(strcmp(argv[i],"fp16") == 0) (*type)=SVMRANK_FP16;
+		else {
+		  printf("\nUnknown quantization %s!\n\n",argv[i]);
+		  print_help();
+		  exit(0);
+		}
+		break;
+      case 'R': i++; strcpy(rangefile,argv[i]); break;
+      case 'W': i++; strcpy(writerangefile,argv[i]); break;
+      case 'k': i++; (*k)=atol(argv[i]); break;
+      case 'r': i++; (*repeats)=atol(argv[i]); break;
+      case 'd': (*dense)=1; break;
+      default: printf("\nUnrecognized option %s!\n\n",argv[i]);
+	       print_help();
+	       exit(0);
+      }
+  }
+  if((i+1)>=argc) {
+    printf("\nNot enough input parameters!\n\n");
+    print_help();
+    exit(0);
+  }
+  strcpy (docfile, argv[i]);
+  strcpy (modelfile, argv[i+1]);
+  if(((*k) < 1) || ((*repeats) < 1)) {
+    printf("\nK and repeats must be at least 1!\n\n");
+    print_help();
+    exit(0);
+  }
+}
+
+void print_help(void)
+{
+  printf("\nQuantized SVM-rank models, based on SVM-light %s\n",VERSION);
+  copyright_notice();
+  printf("   usage: svm_rank_quantize [options] validation_file model_file\n\n");
+  printf("Ranks the queries of validation_file with model_file and with its\n");
+  printf("quantized copy and reports how far the rankings differ.\n\n");
+  printf("options: -h         -> this help\n");
+  printf("         -q type    -> int8: int8 weights and uint8 features (default)\n");
+  printf("                       fp16: half precision weights\n");
+  printf("         -R file    -> feature ranges, one line of feature number and\n");
+  printf("                       largest value per feature. Features are expected\n");
+  printf("                       in [0,range]. Default: [0,1] for all features.\n");
+  printf("         -W file    -> use the largest value of each feature in\n");
+  printf("                       validation_file as its range and write the\n");
+  printf("                       ranges to file, for use with -R\n");
+  printf("         -k int     -> k for comparing the top k of each query (default 10)\n");
+  printf("         -r int     -> number of passes for timing (default 10)\n");
+  printf("         -d         -> pass the documents as dense rows instead of in\n");
+  printf("                       CSR format\n\n");
+}
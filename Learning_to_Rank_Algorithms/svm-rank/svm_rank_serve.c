@@ -0,0 +1,774 @@
+/***********************************************************************/
+/*                                                                     */
+/*   svm_rank_serve.c                                                  */
+/*                                                                     */
+/*   Scoring daemon. Loads a model once and scores the documents that  */
+/*   clients send over a Unix domain socket. Requests that arrive at   */
+/*   about the same time are scored together in one batch. SIGHUP     */
+/*   reloads the model file without interrupting requests in flight.   */
+/*                                                                     */
+/***********************************************************************/
+
+# include <pthread.h>
+# include <signal.h>
+# include <errno.h>
+# include <unistd.h>
+# include <sys/time.h>
+# include <sys/socket.h>
+# include <sys/un.h>
+# include "svm_light/svm_common.h"
+# include "svm_rank_lib.h"
+# include "svm_rank_serve.h"
+
+# define MAX(x,y) ((x) < (y) ? (y) : (x))
+# define MIN(x,y) ((x) > (y) ? (y) : (x))
+
+# define LATENCY_WINDOW 100000  /* percentiles are taken over the latencies
+				   of this many most recent requests */
+
+typedef struct served_model {
+  SVMRANK_MODEL *model;
+  long    generation;   /* 1 for the first model, +1 for each reload */
+  long    readers;      /* batches scoring with this model right now */
+} SERVED_MODEL;
+
+typedef struct request {
+  long    n;            /* number of documents */
+  long    *rowptr;      /* documents in CSR format */
+  long    *index;
+  float   *value;
+  float   *scores;      /* filled in by the batcher */
+  double  arrival;      /* time the request was read completely */
+  int     done;
+  pthread_cond_t done_cond;
+  struct request *next;
+} REQUEST;
+
+char modelfile[200];
+char socketfile[200];
+char rangefile[200];
+long max_batch,batch_wait,batchers;
+int  quant_type;        /* 0, SVMRANK_INT8 or SVMRANK_FP16 */
+
+/* queue of requests waiting to be scored; lock protects the queue, the
+   shutdown flag and done of all requests */
+pthread_mutex_t lock=PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t  work=PTHREAD_COND_INITIALIZER;
+REQUEST *queue_head=NULL,*queue_tail=NULL;
+long    queued_docs=0;
+int     shutting_down=0;
+
+/* the current model. Batchers take a reference while they score; a
+   model replaced by SIGHUP is freed by whoever drops the last
+   reference to it, so that batches in flight finish with the model
+   they started with. */
+pthread_mutex_t model_lock=PTHREAD_MUTEX_INITIALIZER;
+SERVED_MODEL *current_model=NULL;
+
+/* statistics */
+pthread_mutex_t stats_lock=PTHREAD_MUTEX_INITIALIZER;
+long    stat_requests=0,stat_docs=0,stat_batches=0;
+double  *latency;       /* ring buffer of LATENCY_WINDOW latencies (s) */
+
+int     listen_fd=-1;
+
+void   read_input_parameters(int, char **, char *, char *, long *, long *,
+			     long *, long *, char *, int *, char *);
+void   print_help(void);
+double wall_time(void);
+SERVED_MODEL *load_served_model(char *, long);
+float  *read_ranges(char *, long);
+SERVED_MODEL *acquire_model(void);
+void   release_model(SERVED_MODEL *);
+void   *batcher(void *);
+void   *connection(void *);
+void   *signal_handler(void *);
+void   format_stats(char *, long);
+int    read_full(int, void *, size_t);
+int    write_full(int, const void *, size_t);
+int    send_frame(int, unsigned int, const void *, size_t);
+char   *parse_text_request(char *, long, REQUEST *);
+char   *parse_binary_request(char *, long, REQUEST *);
+void   free_request_documents(REQUEST *);
+
+
+int main (int argc, char* argv[])
+{
+  struct sockaddr_un addr;
+  pthread_t *threads,sigthread,conn;
+  sigset_t sigs;
+  char binfile[200],stats[500];
+  long i;
+  int fd,*arg;
+
+  read_input_parameters(argc,argv,modelfile,socketfile,&verbosity,
+			&max_batch,&batch_wait,&batchers,binfile,&quant_type,
+			rangefile);
+
+  if(binfile[0]) {  /* only convert the model */
+    MODEL *model=read_model(modelfile);
+    write_binary_model(binfile,model);
+    free_model(model,1);
+    return(0);
+  }
+
+  if((current_model=load_served_model(modelfile,1)) == NULL) {
+    printf("\nCannot read or score model %s!\n\n",modelfile);
+    exit(1);
+  }
+  latency=(double *)my_malloc(sizeof(double)*LATENCY_WINDOW);
+
+  /* signals are handled by one thread; writes to clients that went
+     away must not kill the server */
+  signal(SIGPIPE,SIG_IGN);
+  sigemptyset(&sigs);
+  sigaddset(&sigs,SIGHUP);
+  sigaddset(&sigs,SIGINT);
+  sigaddset(&sigs,SIGTERM);
+  pthread_sigmask(SIG_BLOCK,&sigs,NULL);
+
+  if((listen_fd=socket(AF_UNIX,SOCK_STREAM,0)) < 0)
+  { perror ("socket"); exit (1); }
+  memset(&addr,0,sizeof(addr));
+  addr.sun_family=AF_UNIX;
+  if(strlen(socketfile) >= sizeof(addr.sun_path)) {
+    printf("\nSocket path %s is too long!\n\n",socketfile);
+    exit(1);
+  }
+  strcpy(addr.sun_path,socketfile);
+  unlink(socketfile);
+  if((bind(listen_fd,(struct sockaddr *)&addr,sizeof(addr)) < 0)
+     || (listen(listen_fd,128) < 0))
+  { perror (socketfile); exit (1); }
+
+  threads=(pthread_t *)my_malloc(sizeof(pthread_t)*batchers);
+  for(i=0;i<batchers;i++)
+    pthread_create(&threads[i],NULL,batcher,NULL);
+  pthread_create(&sigthread,NULL,signal_handler,NULL);
+  pthread_detach(sigthread);
+  if(verbosity>=1) {
+    printf("Serving %s on %s (batches of up to %ld documents, %ld us wait, %ld threads)\n",
+	   modelfile,socketfile,max_batch,batch_wait,batchers);
+    if(quant_type)
+      printf("Quantized to %s, dot product: %s\n",
+	     (quant_type == SVMRANK_INT8) ? "int8" : "fp16",
+	     svmrank_quantized_simd(current_model->model));
+    fflush(stdout);
+  }
+
+  /* one thread per connection; it reads the requests of its client
+     and waits for their scores */
+  while((fd=accept(listen_fd,NULL,NULL)) >= 0 || (errno == EINTR)) {
+    if(fd < 0)
+      continue;
+    arg=(int *)my_malloc(sizeof(int));
+    (*arg)=fd;
+    if(pthread_create(&conn,NULL,connection,arg)) {
+      close(fd);
+      free(arg);
+      continue;
+    }
+    pthread_detach(conn);
+  }
+
+  /* shutting down: the batchers score what is queued and stop */
+  pthread_mutex_lock(&lock);
+  shutting_down=1;
+  pthread_cond_broadcast(&work);
+  pthread_mutex_unlock(&lock);
+  for(i=0;i<batchers;i++)
+    pthread_join(threads[i],NULL);
+  unlink(socketfile);
+  if(verbosity>=1) {
+    format_stats(stats,sizeof(stats));
+    printf("%s",stats);
+  }
+  return(0);
+}
+
+void *signal_handler(void *arg)
+     /* SIGHUP reloads the model file, SIGINT and SIGTERM stop the
+	server */
+{
+  sigset_t sigs;
+  SERVED_MODEL *model,*old;
+  int sig;
+
+  sigemptyset(&sigs);
+  sigaddset(&sigs,SIGHUP);
+  sigaddset(&sigs,SIGINT);
+  sigaddset(&sigs,SIGTERM);
+  while(!sigwait(&sigs,&sig)) {
+    if(sig != SIGHUP) {
+      /* stop accepting; main finishes the queued requests */
+      shutdown(listen_fd,SHUT_RDWR);
+      close(listen_fd);
+      return(NULL);
+    }
+    /* the new model is loaded while the old one keeps serving */
+    model=load_served_model(modelfile,current_model->generation+1);
+    if(!model) {
+      printf("Cannot reload model %s, keeping the current model.\n",
+	     modelfile);
+      fflush(stdout);
+      continue;
+    }
+    pthread_mutex_lock(&model_lock);
+    old=current_model;
+    current_model=model;
+    if(old->readers)
+      old=NULL;  /* freed by the last batch that uses it */
+    pthread_mutex_unlock(&model_lock);
+    if(old) {
+      svmrank_free_model(old->model);
+      free(old);
+    }
+    if(verbosity>=1) {
+      printf("Reloaded model %s (generation %ld)\n",modelfile,
+	     model->generation);
+      fflush(stdout);
+    }
+  }
+  return(NULL);
+}
+
+SERVED_MODEL *load_served_model(char *file, long generation)
+     /* returns the model in file, prepared for serving, or NULL if it
+	cannot be read or scored. Nothing here exits, so that a bad
+	file on SIGHUP leaves the current model in place. */
+{
+  SERVED_MODEL *m;
+  SVMRANK_MODEL *model;
+  float *range=NULL;
+  int failed;
+
+  /* svmrank_load_model validates the file and returns NULL instead
+     of exiting like read_model */
+  if((model=svmrank_load_model(file)) == NULL)
+    return(NULL);
+  if(quant_type) {
+    if(rangefile[0] 
+       && ((range=read_ranges(rangefile,svmrank_num_features(model))) == NULL)) {
+      svmrank_free_model(model);
+      return(NULL);
+    }
+    failed=svmrank_quantize_model(model,quant_type,range);
+    if(range) free(range);
+    if(failed) {
+      svmrank_free_model(model);
+      return(NULL);
+    }
+  }
+  m=(SERVED_MODEL *)my_malloc(sizeof(SERVED_MODEL));
+  m->model=model;
+  m->generation=generation;
+  m->readers=0;
+  return(m);
+}
+
+float *read_ranges(char *file, long n)
+     /* reads lines of feature number and range, as written by
+	svm_rank_quantize -W; features that are not listed keep the
+	range 1. Returns NULL, if file cannot be opened. */
+{
+  FILE *fl;
+  float *range,r;
+  long j,fnum;
+
+  if((fl=fopen(file,"r")) == NULL) {
+    perror(file);
+    return(NULL);
+  }
+  range=(float *)my_malloc(sizeof(float)*(n+1));
+  for(j=0;j<n;j++)
+    range[j]=1;
+  while(fscanf(fl,"%ld %f",&fnum,&r) == 2)
+    if((fnum>0) && (fnum<=n))
+      range[fnum-1]=r;
+  fclose(fl);
+  return(range);
+}
+
+SERVED_MODEL *acquire_model(void)
+{
+  SERVED_MODEL *m;
+
+  pthread_mutex_lock(&model_lock);
+  m=current_model;
+  m->readers++;
+  pthread_mutex_unlock(&model_lock);
+  return(m);
+}
+
+void release_model(SERVED_MODEL *m)
+{
+  int retired;
+
+  pthread_mutex_lock(&model_lock);
+  m->readers--;
+  retired=((m->readers == 0) && (m != current_model));
+  pthread_mutex_unlock(&model_lock);
+  if(retired) {
+    svmrank_free_model(m->model);
+    free(m);
+  }
+}
+
+void *batcher(void *arg)
+     /* takes requests from the queue and scores them in batches of up
+	to max_batch documents. A batch is started, when enough
+	documents are queued or the first request has waited
+	batch_wait microseconds. */
+{
+  REQUEST *batch,*r,*last;
+  SERVED_MODEL *model;
+  SVMRANK_WORKSPACE *ws=NULL;
+  SVMRANK_BATCH b;
+  struct timespec deadline;
+  double t,now;
+  long n,nnz,i,j,p,size=0,capacity=0,generation=0;
+  long *rowptr=NULL,*index=NULL;
+  float *value=NULL,*scores=NULL;
+
+  while(1) {
+    pthread_mutex_lock(&lock);
+    while((!queue_head) && (!shutting_down))
+      pthread_cond_wait(&work,&lock);
+    if(!queue_head) {
+      pthread_mutex_unlock(&lock);
+      break;
+    }
+    t=queue_head->arrival+1e-6*batch_wait;
+    deadline.tv_sec=(time_t)t;
+    deadline.tv_nsec=(long)(1e9*(t-(double)deadline.tv_sec));
+    while(queue_head && (queued_docs < max_batch) && (!shutting_down)
+	  && (pthread_cond_timedwait(&work,&lock,&deadline) != ETIMEDOUT));
+    if(!queue_head) {  /* taken by another batcher */
+      pthread_mutex_unlock(&lock);
+      continue;
+    }
+    /* take requests as long as they fit; a request larger than
+       max_batch forms a batch of its own */
+    batch=queue_head;
+    n=0;
+    for(last=NULL,r=queue_head;r && ((n == 0) || (n+r->n <= max_batch));
+	last=r,r=r->next)
+      n+=r->n;
+    last->next=NULL;
+    queue_head=r;
+    if(!queue_head)
+      queue_tail=NULL;
+    queued_docs-=n;
+    if(queue_head)
+      pthread_cond_signal(&work);
+    pthread_mutex_unlock(&lock);
+
+    /* concatenate the requests */
+    for(nnz=0,r=batch;r;r=r->next)
+      nnz+=r->rowptr[r->n];
+    if((n > capacity) || (nnz > size)) {
+      capacity=MAX(capacity,n);
+      size=MAX(size,nnz);
+      free(rowptr); free(index); free(value); free(scores);
+      rowptr=(long *)my_malloc(sizeof(long)*(capacity+1));
+      index=(long *)my_malloc(sizeof(long)*(size+1));
+      value=(float *)my_malloc(sizeof(float)*(size+1));
+      scores=(float *)my_malloc(sizeof(float)*(capacity+1));
+      if(ws) svmrank_free_workspace(ws);
+      ws=NULL;
+    }
+    for(i=0,p=0,r=batch;r;r=r->next) {
+      memcpy(index+p,r->index,sizeof(long)*r->rowptr[r->n]);
+      memcpy(value+p,r->value,sizeof(float)*r->rowptr[r->n]);
+      for(j=0;j<r->n;j++)
+	rowptr[i++]=p+r->rowptr[j];
+      p+=r->rowptr[r->n];
+    }
+    rowptr[i]=p;
+    b.n=i;
+    b.dim=0;
+    b.x=NULL;
+    b.rowptr=rowptr;
+    b.index=index;
+    b.value=value;
+
+    /* score with the current model; the workspace depends on it */
+    model=acquire_model();
+    if((!ws) || (model->generation != generation)) {
+      if(ws) svmrank_free_workspace(ws);
+      ws=svmrank_create_workspace(model->model,capacity);
+      generation=model->generation;
+    }
+    svmrank_score(model->model,ws,&b,scores);
+    release_model(model);
+
+    /* hand out the scores */
+    now=wall_time();
+    pthread_mutex_lock(&stats_lock);
+    stat_batches++;
+    for(r=batch;r;r=r->next) {
+      latency[stat_requests%LATENCY_WINDOW]=now-r->arrival;
+      stat_requests++;
+      stat_docs+=r->n;
+    }
+    pthread_mutex_unlock(&stats_lock);
+    pthread_mutex_lock(&lock);
+    for(i=0,r=batch;r;r=last) {
+      last=r->next;
+      memcpy(r->scores,scores+i,sizeof(float)*r->n);
+      i+=r->n;
+      r->done=1;
+      pthread_cond_signal(&r->done_cond);
+    }
+    pthread_mutex_unlock(&lock);
+  }
+  if(ws) svmrank_free_workspace(ws);
+  free(rowptr); free(index); free(value); free(scores);
+  return(NULL);
+}
+
+void *connection(void *arg)
+     /* serves one client until it closes the connection */
+{
+  SERVE_HEADER h;
+  REQUEST r;
+  char *payload=NULL,*error,stats[500];
+  long size=0;
+  int fd=*(int *)arg,failed;
+
+  free(arg);
+  pthread_cond_init(&r.done_cond,NULL);
+  while(read_full(fd,&h,sizeof(h)) == 0) {
+    if(h.length > SERVE_MAX_FRAME) {
+      send_frame(fd,SERVE_ERROR,"request too large",17);
+      break;
+    }
+    if(h.length+1 > size) {
+      size=h.length+1;
+      free(payload);
+      payload=(char *)my_malloc(size);
+    }
+    if(read_full(fd,payload,h.length))
+      break;
+    if(h.type == SERVE_STATS) {
+      format_stats(stats,sizeof(stats));
+      if(send_frame(fd,SERVE_STATS,stats,strlen(stats)))
+	break;
+      continue;
+    }
+    if(h.type == SERVE_TEXT)
+      error=parse_text_request(payload,h.length,&r);
+    else if(h.type == SERVE_BINARY)
+      error=parse_binary_request(payload,h.length,&r);
+    else
+      error="unknown request type";
+    if(error) {
+      if(send_frame(fd,SERVE_ERROR,error,strlen(error)))
+	break;
+      continue;
+    }
+    r.scores=(float *)my_malloc(sizeof(float)*(r.n+1));
+    r.arrival=wall_time();
+    r.done=0;
+    r.next=NULL;
+    if(r.n) {
+      pthread_mutex_lock(&lock);
+      if(queue_tail)
+	queue_tail->next=&r;
+      else
+	queue_head=&r;
+      queue_tail=&r;
+      queued_docs+=r.n;
+      pthread_cond_signal(&work);
+      while(!r.done)
+	pthread_cond_wait(&r.done_cond,&lock);
+      pthread_mutex_unlock(&lock);
+    }
+    failed=send_frame(fd,SERVE_SCORES,r.scores,sizeof(float)*r.n);
+    free(r.scores);
+    free_request_documents(&r);
+    if(failed)
+      break;
+  }
+  pthread_cond_destroy(&r.done_cond);
+  free(payload);
+  close(fd);
+  return(NULL);
+}
+
+char *parse_text_request(char *text, long length, REQUEST *r)
+     /* reads documents in svmlight format into r. Returns NULL, or an
+	error message. */
+{
+  char *line,*end,*tok,*next,*colon;
+  long n,nnz,p,fnum;
+  double v;
+
+  text[length]=0;
+  /* upper bounds for the number of documents and features */
+  for(n=1,nnz=0,p=0;p<length;p++) {
+    if(text[p] == '\n') n++;
+    if(text[p] == ':') nnz++;
+  }
+  r->rowptr=(long *)my_malloc(sizeof(long)*(n+1));
+  r->index=(long *)my_malloc(sizeof(long)*(nnz+1));
+  r->value=(float *)my_malloc(sizeof(float)*(nnz+1));
+  r->n=0;
+  p=0;
+  for(line=text;line;line=end) {
+    if((end=strchr(line,'\n')) != NULL)
+      (*end++)=0;
+    if((tok=strchr(line,'#')) != NULL)  /* cut off comments */
+      (*tok)=0;
+    tok=strtok_r(line," \t\r",&next);
+    if(!tok)
+      continue;  /* empty line */
+    r->rowptr[r->n]=p;
+    if(!strchr(tok,':'))  /* label */
+      tok=strtok_r(NULL," \t\r",&next);
+    for(;tok;tok=strtok_r(NULL," \t\r",&next)) {
+      if((!strncmp(tok,"qid:",4)) || (!strncmp(tok,"sid:",4))
+	 || (!strncmp(tok,"cost:",5)) || (!strncmp(tok,"did:",4)))
+	continue;
+      fnum=strtol(tok,&colon,10);
+      if((colon == tok) || ((*colon) != ':'))
+	break;
+      v=strtod(colon+1,&colon);
+      if((*colon) || (fnum < 1) || ((p > r->rowptr[r->n])
+				    && (fnum <= r->index[p-1])))
+	break;
+      r->index[p]=fnum;
+      r->value[p]=(float)v;
+      p++;
+    }
+    if(tok) {
+      free_request_documents(r);
+      return("malformed feature, or features not in increasing order");
+    }
+    r->n++;
+  }
+  r->rowptr[r->n]=p;
+  return(NULL);
+}
+
+char *parse_binary_request(char *payload, long length, REQUEST *r)
+     /* reads documents in the binary layout into r. Returns NULL, or
+	an error message. */
+{
+  unsigned int n,nwords,fnum,i,j;
+  long p,pos;
+  float v;
+
+  if(length < (long)sizeof(n))
+    return("truncated request");
+  memcpy(&n,payload,sizeof(n));
+  pos=sizeof(n);
+  /* every document takes at least its count */
+  if((length-pos)/(long)sizeof(nwords) < (long)n)
+    return("truncated request");
+  r->n=n;
+  r->rowptr=(long *)my_malloc(sizeof(long)*(n+1));
+  r->index=(long *)my_malloc(sizeof(long)*(length/8+1));
+  r->value=(float *)my_malloc(sizeof(float)*(length/8+1));
+  for(p=0,i=0;i<n;i++) {
+    r->rowptr[i]=p;
+    if(pos+(long)sizeof(nwords) > length)
+      break;
+    memcpy(&nwords,payload+pos,sizeof(nwords));
+    pos+=sizeof(nwords);
+    if((length-pos)/8 < (long)nwords)
+      break;
+    for(j=0;j<nwords;j++,pos+=8) {
+      memcpy(&fnum,payload+pos,sizeof(fnum));
+      memcpy(&v,payload+pos+4,sizeof(v));
+      if((fnum < 1) || ((j > 0) && (fnum <= r->index[p-1])))
+	break;
+      r->index[p]=fnum;
+      r->value[p++]=v;
+    }
+    if(j < nwords)
+      break;
+  }
+  if((i < n) || (pos != length)) {
+    free_request_documents(r);
+    return("malformed binary request");
+  }
+  r->rowptr[n]=p;
+  return(NULL);
+}
+
+void free_request_documents(REQUEST *r)
+{
+  free(r->rowptr);
+  free(r->index);
+  free(r->value);
+}
+
+void format_stats(char *buf, long size)
+     /* writes the statistics of the server as one line */
+{
+  double *sorted,p50=0,p99=0,max=0;
+  long requests,docs,batches,n,generation;
+
+  pthread_mutex_lock(&stats_lock);
+  requests=stat_requests;
+  docs=stat_docs;
+  batches=stat_batches;
+  n=MIN(requests,LATENCY_WINDOW);
+  sorted=(double *)my_malloc(sizeof(double)*(n+1));
+  memcpy(sorted,latency,sizeof(double)*n);
+  pthread_mutex_unlock(&stats_lock);
+  pthread_mutex_lock(&model_lock);
+  generation=current_model->generation;
+  pthread_mutex_unlock(&model_lock);
+
+  if(n) {
+    qsort(sorted,n,sizeof(double),compare_double);
+    p50=sorted[(long)(0.50*(n-1))];
+    p99=sorted[(long)(0.99*(n-1))];
+    max=sorted[n-1];
+  }
+  snprintf(buf,size,"requests %ld documents %ld batches %ld docs_per_batch %.1f latency_us p50 %.1f p99 %.1f max %.1f model_generation %ld\n",
+	   requests,docs,batches,batches ? (double)docs/batches : 0,
+	   1e6*p50,1e6*p99,1e6*max,generation);
+  free(sorted);
+}
+
+int read_full(int fd, void *buf, size_t n)
+     /* reads exactly n bytes. Returns 0, or -1 on errors and end of
+	file. */
+{
+  ssize_t r;
+
+  while(n > 0) {
+    if((r=read(fd,buf,n)) <= 0) {
+      if((r < 0) && (errno == EINTR))
+	continue;
+      return(-1);
+    }
+    buf=(char *)buf+r;
+    n-=r;
+  }
+  return(0);
+}
+
+int write_full(int fd, const void *buf, size_t n)
+{
+  ssize_t r;
+
+  while(n > 0) {
+    if((r=write(fd,buf,n)) < 0) {
+      if(errno == EINTR)
+	continue;
+      return(-1);
+    }
+    buf=(const char *)buf+r;
+    n-=r;
+  }
+  return(0);
+}
+
+int send_frame(int fd, unsigned int type, const void *payload, size_t n)
+{
+  SERVE_HEADER h;
+
+  h.type=type;
+  h.length=(unsigned int)n;
+  if(write_full(fd,&h,sizeof(h)))
+    return(-1);
+  return(write_full(fd,payload,n));
+}
+
+double wall_time(void)
+     /* time in seconds, on the clock of pthread_cond_timedwait */
+{
+  struct timeval tv;
+
+  gettimeofday(&tv,NULL);
+  return(tv.tv_sec+1e-6*tv.tv_usec);
+}
+
+void read_input_parameters(int argc, char **argv, char *modelfile,
+			   char *socketfile, long *verbosity,
+			   long *max_batch, long *batch_wait,
+			   long *batchers, char *binfile, int *quant_type,
+			   char *rangefile)
+{
+  long i;
+
+  /* set default */
+  (*verbosity)=1;
+  (*max_batch)=256;
+  (*batch_wait)=200;
+  (*batchers)=1;
+  strcpy (binfile, "");
+  (*quant_type)=0;
+  strcpy (rangefile, "");
+
+  for(i=1;(i<argc) && ((argv[i])[0] == '-');i++) {
+    switch ((argv[i])[1])
+      {
+      case 'h': print_help(); exit(0);
+      case 'v': i++; (*verbosity)=atol(argv[i]); break;
+      case 'b': i++; (*max_batch)=atol(argv[i]); break;
+      case 'w': i++; (*batch_wait)=atol(argv[i]); break;
+      case 't': i++; (*batchers)=atol(argv[i]); break;
+      case 'B': i++; strcpy(binfile,argv[i]); break;
+      case 'q': i++;
+	        if(strcmp(argv[i],"int8") == 0) (*quant_type)=SVMRANK_INT8;
+		else if(strcmp(argv[i],"fp16") == 0) (*quant_type)=SVMRANK_FP16;
+		else {
+		  printf("\nUnknown quantization %s!\n\n",argv[i]);
+		  print_help();
+		  exit(0);
+		}
+		break;
+      case 'R': i++; strcpy(rangefile,argv[i]); break;
+      default: printf("\nUnrecognized option %s!\n\n",argv[i]);
+	       print_help();
+	       exit(0);
+      }
+  }
+  if(binfile[0] && (i<argc)) {
+    strcpy (modelfile, argv[i]);
+    return;
+  }
+  if((i+1)>=argc) {
+    printf("\nNot enough input parameters!\n\n");
+    print_help();
+    exit(0);
+  }
+  strcpy (modelfile, argv[i]);
+  strcpy (socketfile, argv[i+1]);
+  if(((*max_batch) < 1) || ((*batch_wait) < 0) || ((*batchers) < 1)) {
+    printf("\nBatch size and threads must be at least 1, the wait at least 0!\n\n");
+    print_help();
+    exit(0);
+  }
+}
+
+void print_help(void)
+{
+  printf("\nSVM-rank scoring server, based on SVM-light %s\n",VERSION);
+  copyright_notice();
+  printf("   usage: svm_rank_serve [options] model_file socket_file\n");
+  printf("          svm_rank_serve -B binary_model_file model_file\n\n");
+  printf("Scores documents sent to the Unix domain socket socket_file with\n");
+  printf("model_file (text or binary model). See svm_rank_serve.h for the\n");
+  printf("protocol; svm_rank_loadgen is a client. On SIGHUP, model_file is\n");
+  printf("read again and replaces the model once it is loaded. Replace the\n");
+  printf("file by renaming, so that it is never read half written.\n\n");
+  printf("options: -h         -> this help\n");
+  printf("         -v [0..3]  -> verbosity level (default 1)\n");
+  printf("         -b int     -> maximum number of documents scored in one batch\n");
+  printf("                       (default 256)\n");
+  printf("         -w int     -> microseconds a request waits for others to join\n");
+  printf("                       its batch (default 200)\n");
+  printf("         -t int     -> number of threads scoring batches (default 1)\n");
+  printf("         -q type    -> score a quantized copy of the model: int8 or fp16.\n");
+  printf("                       Check it with svm_rank_quantize first.\n");
+  printf("         -R file    -> feature ranges for -q, as written by\n");
+  printf("                       svm_rank_quantize -W (default [0,1])\n");
+  printf("         -B file    -> write model_file as binary model to file and exit.\n");
+  printf("                       Binary models load without parsing.\n\n");
+}
@@ -0,0 +1,37 @@
+/***********************************************************************/
+/*                                                                     */
+/*   svm_rank_serve.h                                                  */
+/*                                                                     */
+/*   Protocol of the scoring daemon svm_rank_serve. Clients connect    */
+/*   to its Unix domain socket and send frames, each a header          */
+/*   followed by length bytes of payload. The server answers every     */
+/*   frame with one frame. All numbers are in the byte order of the    */
+/*   machine, since client and server run on the same host.            */
+/*                                                                     */
+/***********************************************************************/
+
+#ifndef SVM_RANK_SERVE
+#define SVM_RANK_SERVE
+
+# define SERVE_TEXT    1  /* request: documents in svmlight format, one
+			     per line. Labels, qid:, sid:, cost: and
+			     comments are allowed and ignored. */
+# define SERVE_BINARY  2  /* request: number of documents (unsigned
+			     int), then for each document the number of
+			     features (unsigned int) and as many pairs of
+			     feature number (unsigned int) and value
+			     (float), by increasing feature number */
+# define SERVE_STATS   3  /* request without payload; the answer is a
+			     line of server statistics as text */
+# define SERVE_SCORES  4  /* answer: one float per document of the
+			     request, in the order of the request */
+# define SERVE_ERROR   5  /* answer: error message as text */
+
+# define SERVE_MAX_FRAME 67108864 /* larger requests are refused */
+
+typedef struct serve_header {
+  unsigned int type;    /* one of the values above */
+  unsigned int length;  /* number of bytes of payload that follow */
+} SERVE_HEADER;
+
+#endif
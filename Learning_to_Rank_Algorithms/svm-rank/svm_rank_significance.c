@@ -0,0 +1,402 @@
+/***********************************************************************/
+/*                                                                     */
+/*   svm_rank_significance.c                                           */
+/*                                                                     */
+/*   Paired significance tests between the per-query values of a      */
+/*   retrieval measure of several systems, as SetRetrievalComparator   */
+/*   of IReval: sign test, randomization test, and a bootstrap         */
+/*   confidence interval of the difference of the means.               */
+/*                                                                     */
+/***********************************************************************/
+
+# include <unistd.h>
+# include "svm_light/svm_common.h"
+
+# define MAX(x,y) ((x) < (y) ? (y) : (x))
+# define MIN(x,y) ((x) > (y) ? (y) : (x))
+
+/* Resamples are drawn in chunks of this size, each from a random
+   number stream of its own, so that the results do not depend on the
+   number of threads. */
+# define CHUNK 1000
+
+typedef struct query_value {
+  char    qid[64];
+  double  value;
+} QUERY_VALUE;
+
+typedef struct run {
+  char        *file;
+  long        n;          /* number of queries */
+  QUERY_VALUE *q;         /* their values, ordered by qid */
+} RUN;
+
+char measure[100];
+
+void   read_run(char *, char *, RUN *);
+int    compare_qid(const void *, const void *);
+long   paired_differences(RUN *, RUN *, double *, double *, double *);
+double sign_test(double *, long, long *, long *);
+void   randomization_test(double *, long, long, unsigned long long, long,
+			  double *, double *);
+void   bootstrap_interval(double *, long, long, double, unsigned long long,
+			  long, double *, double *);
+unsigned long long random_stream(unsigned long long, long);
+unsigned long long next_random(unsigned long long *);
+void   read_input_parameters(int, char **, long *, long *, long *, double *,
+			     long *, long *, long *);
+void   print_help(void);
+
+
+int main (int argc, char* argv[])
+{
+  RUN *run;
+  long i,a,b,first,nruns,n,maxn=0,rounds,resamples,seed,threads,allpairs;
+  long better,worse;
+  double level,*d,mean_a,mean_b,p_sign,p_one,p_two,low,high;
+
+  read_input_parameters(argc,argv,&first,&rounds,&resamples,&level,&seed,
+			&threads,&allpairs);
+  nruns=argc-first;
+  run=(RUN *)my_malloc(sizeof(RUN)*nruns);
+  for(i=0;i<nruns;i++) {
+    read_run(argv[first+i],measure,&run[i]);
+    maxn=MAX(maxn,run[i].n);
+  }
+  d=(double *)my_malloc(sizeof(double)*(maxn+1));
+
+  if(verbosity>=1) {
+    printf("Measure %s, %ld permutations, %ld bootstrap samples (%g%% interval), %ld threads\n",
+	   measure,rounds,resamples,100.0*level,threads);
+    fflush(stdout);
+  }
+  printf("# baseline\tsystem\tqueries\tbaseline_mean\tsystem_mean\tdifference\tbetter\tworse\tp_sign\tp_random\tp_random_2sided\tci_low\tci_high\n");
+  /* each system against the first one, or all pairs with -a */
+  for(a=0;a<(allpairs ? nruns : 1);a++) {
+    for(b=a+1;b<nruns;b++) {
+      n=paired_differences(&run[a],&run[b],d,&mean_a,&mean_b);
+      if(n == 0) {
+	printf("\nNOTE: %s and %s have no query in common.\n\n",run[a].file,
+	       run[b].file);
+	continue;
+      }
+      p_sign=sign_test(d,n,&better,&worse);
+      randomization_test(d,n,rounds,seed,threads,&p_one,&p_two);
+      bootstrap_interval(d,n,resamples,level,seed,threads,&low,&high);
+      printf("%s\t%s\t%ld\t%.6f\t%.6f\t%.6f\t%ld\t%ld\t%.6g\t%.6g\t%.6g\t%.6f\t%.6f\n",
+	     run[a].file,run[b].file,n,mean_a,mean_b,mean_b-mean_a,better,
+	     worse,p_sign,p_one,p_two,low,high);
+      fflush(stdout);
+    }
+  }
+
+  for(i=0;i<nruns;i++)
+    free(run[i].q);
+  free(run);
+  free(d);
+  return(0);
+}
+
+void read_run(char *file, char *measure, RUN *run)
+     /* reads the values of measure for each query from file: the
+	trec_eval output of TrecEvaluator.java or of svm_rank_classify
+	--o (measure qid value), or the JSON output of svm_rank_classify
+	--o --f json. The means (qid 'all') are skipped. */
+{
+  FILE *fl;
+  char *text,*p,*end,*obj,key[120],name[100],qid[64];
+  long size,i,j;
+  double value;
+
+  if((fl=fopen(file,"rb")) == NULL)
+  { perror (file); exit (1); }
+  fseek(fl,0,SEEK_END);
+  size=ftell(fl);
+  fseek(fl,0,SEEK_SET);
+  text=(char *)my_malloc(size+1);
+  size=fread(text,1,size,fl);
+  text[size]=0;
+  fclose(fl);
+
+  run->file=file;
+  run->n=0;
+  run->q=(QUERY_VALUE *)my_malloc(sizeof(QUERY_VALUE)*(size/4+1));
+  for(p=text;isspace((int)(*p));p++);
+  if(*p == '{') {  /* JSON: one object with "qid" for each query */
+    sprintf(key,"\"%s\":",measure);
+    while((p=strstr(p,"\"qid\":")) != NULL) {
+      p+=6;
+      if((end=strchr(p,'}')) == NULL)
+	break;
+      (*end)=0;
+      obj=strstr(p,key);
+      if(obj && (sscanf(p," %63[^,}]",qid) == 1)) {
+	for(i=0,j=0;qid[i];i++)  /* numbers or strings */
+	  if(qid[i] != '"')
+	    qid[j++]=qid[i];
+	qid[j]=0;
+	strcpy(run->q[run->n].qid,qid);
+	run->q[run->n].value=strtod(obj+strlen(key),NULL);
+	run->n++;
+      }
+      p=end+1;
+    }
+  }
+  else {           /* lines of measure, qid and value */
+    for(p=strtok(text,"\n");p;p=strtok(NULL,"\n")) {
+      if((sscanf(p,"%99s %63s %lf",name,qid,&value) != 3)
+	 || strcmp(name,measure) || (!strcmp(qid,"all")))
+	continue;
+      strcpy(run->q[run->n].qid,qid);
+      run->q[run->n].value=value;
+      run->n++;
+    }
+  }
+  free(text);
+  if(run->n == 0) {
+    printf("\nNo values of measure %s in %s!\n\n",measure,file);
+    exit(1);
+  }
+  qsort(run->q,run->n,sizeof(QUERY_VALUE),compare_qid);
+}
+
+int compare_qid(const void *a, const void *b)
+{
+  return(strcmp(((QUERY_VALUE *)a)->qid,((QUERY_VALUE *)b)->qid));
+}
+
+long paired_differences(RUN *a, RUN *b, double *d, double *mean_a,
+			double *mean_b)
+     /* writes the differences b-a of the queries that a and b have in
+	common to d, and their means to mean_a and mean_b. Returns the
+	number of these queries. */
+{
+  long i,j,n=0;
+  int c;
+
+  (*mean_a)=(*mean_b)=0;
+  for(i=0,j=0;(i<a->n) && (j<b->n);) {
+    c=strcmp(a->q[i].qid,b->q[j].qid);
+    if(c < 0)
+      i++;
+    else if(c > 0)
+      j++;
+    else {
+      d[n++]=b->q[j].value-a->q[i].value;
+      (*mean_a)+=a->q[i].value;
+      (*mean_b)+=b->q[j].value;
+      i++;
+      j++;
+    }
+  }
+  (*mean_a)/=MAX(1,n);
+  (*mean_b)/=MAX(1,n);
+  return(n);
+}
+
+double sign_test(double *d, long n, long *better, long *worse)
+     /* Returns the probability that the system is better on at least
+	as many of the queries on which they differ, if either is
+	better with probability 1/2 (binomialProb in
+	SetRetrievalComparator.signTest). */
+{
+  long i,k,m;
+  double p=0;
+
+  (*better)=(*worse)=0;
+  for(i=0;i<n;i++) {
+    if(d[i] > 0) (*better)++;
+    if(d[i] < 0) (*worse)++;
+  }
+  m=(*better)+(*worse);
+  for(k=(*better);k<=m;k++)
+    p+=exp(lgamma(m+1.0)-lgamma(k+1.0)-lgamma(m-k+1.0)-m*log(2.0));
+  return(MIN(1,p));
+}
+
+void randomization_test(double *d, long n, long rounds,
+			unsigned long long seed, long threads, double *p_one,
+			double *p_two)
+     /* Swaps the two values of each query with probability 1/2 and
+	counts the rounds in which the difference of the means is at
+	least the observed one (p_one, as
+	SetRetrievalComparator.randomizedTest) or at least as large in
+	absolute value (p_two). A swap changes the sign of d[i], so the
+	sum of a round is the observed sum minus twice the sum over the
+	swapped queries. That sum is added up from tables of the sums
+	of all subsets of 8 consecutive queries, one lookup per 8
+	queries and 8 random bits. */
+{
+  long i,j,g,groups,chunks,c,r,end,m_one=0,m_two=0;
+  double *subset,total=0,eps,s;
+  unsigned long long state,bits=0;
+
+  groups=(n+7)/8;
+  subset=(double *)my_malloc(sizeof(double)*256*groups);
+  for(g=0;g<groups;g++)
+    for(j=0;j<256;j++) {
+      subset[g*256+j]=0;
+      for(i=0;i<8;i++)
+	if((j & (1<<i)) && (g*8+i < n))
+	  subset[g*256+j]+=d[g*8+i];
+    }
+  for(i=0;i<n;i++)
+    total+=d[i];
+  /* sums that are equal up to rounding count as equal */
+  eps=1e-9*MAX(1,fabs(total));
+  chunks=(rounds+CHUNK-1)/CHUNK;
+
+#pragma omp parallel for num_threads(threads) private(r,end,state,bits,g,s) schedule(dynamic) reduction(+:m_one,m_two)
+  for(c=0;c<chunks;c++) {
+    state=random_stream(seed,2*c);
+    bits=0;
+    end=MIN(rounds,(c+1)*CHUNK);
+    for(r=c*CHUNK;r<end;r++) {
+      s=0;
+      for(g=0;g<groups;g++) {
+	if((g & 7) == 0)
+	  bits=next_random(&state);
+	s+=subset[g*256+((bits>>(8*(g & 7))) & 255)];
+      }
+      s=total-2*s;
+      if(s >= total-eps)
+	m_one++;
+      if(fabs(s) >= fabs(total)-eps)
+	m_two++;
+    }
+  }
+  (*p_one)=(double)m_one/MAX(1,rounds);
+  (*p_two)=(double)m_two/MAX(1,rounds);
+  free(subset);
+}
+
+void bootstrap_interval(double *d, long n, long resamples, double level,
+			unsigned long long seed, long threads, double *low,
+			double *high)
+     /* percentile bootstrap interval of level for the mean of d, from
+	resamples samples of n queries drawn with replacement */
+{
+  long i,c,r,end,chunks;
+  double *mean,s;
+  unsigned long long state,x;
+
+  if(resamples < 1) {
+    (*low)=(*high)=0;
+    return;
+  }
+  mean=(double *)my_malloc(sizeof(double)*resamples);
+  chunks=(resamples+CHUNK-1)/CHUNK;
+
+#pragma omp parallel for num_threads(threads) private(r,end,state,x,i,s) schedule(dynamic)
+  for(c=0;c<chunks;c++) {
+    state=random_stream(seed,2*c+1);
+    end=MIN(resamples,(c+1)*CHUNK);
+    for(r=c*CHUNK;r<end;r++) {
+      s=0;
+      for(i=0;i<n;i++) {
+	x=next_random(&state);
+	/* the high 32 bits scaled to [0,n) */
+	s+=d[((x>>32)*(unsigned long long)n)>>32];
+      }
+      mean[r]=s/n;
+    }
+  }
+  qsort(mean,resamples,sizeof(double),compare_double);
+  (*low)=mean[MAX(0,(long)floor((1-level)/2*resamples))];
+  (*high)=mean[MIN(resamples-1,(long)ceil((1+level)/2*resamples)-1)];
+  free(mean);
+}
+
+unsigned long long random_stream(unsigned long long seed, long stream)
+     /* start of random number stream number stream for seed */
+{
+  unsigned long long state;
+
+  state=seed*0x9E3779B97F4A7C15ULL+(unsigned long long)stream;
+  next_random(&state);
+  return(state^((unsigned long long)stream<<32));
+}
+
+unsigned long long next_random(unsigned long long *state)
+     /* 64 random bits (SplitMix64) */
+{
+  unsigned long long z;
+
+  z=((*state)+=0x9E3779B97F4A7C15ULL);
+  z=(z^(z>>30))*0xBF58476D1CE4E5B9ULL;
+  z=(z^(z>>27))*0x94D049BB133111EBULL;
+  return(z^(z>>31));
+}
+
+void read_input_parameters(int argc, char **argv, long *first, long *rounds,
+			   long *resamples, double *level, long *seed,
+			   long *threads, long *allpairs)
+{
+  long i;
+
+  /* set default */
+  strcpy (measure, "map");
+  (*rounds)=100000;
+  (*resamples)=10000;
+  (*level)=0.95;
+  (*seed)=1;
+  (*threads)=MAX(1,sysconf(_SC_NPROCESSORS_ONLN));
+  (*allpairs)=0;
+  verbosity=1;
+
+  for(i=1;(i<argc) && ((argv[i])[0] == '-');i++) {
+    switch ((argv[i])[1])
+      {
+      case 'h': print_help(); exit(0);
+      case 'm': i++; strncpy(measure,argv[i],99); break;
+      case 'r': i++; (*rounds)=atol(argv[i]); break;
+      case 'b': i++; (*resamples)=atol(argv[i]); break;
+      case 'l': i++; (*level)=atof(argv[i]); break;
+      case 's': i++; (*seed)=atol(argv[i]); break;
+      case 'j': i++; (*threads)=atol(argv[i]); break;
+      case 'a': (*allpairs)=1; break;
+      case 'v': i++; verbosity=atol(argv[i]); break;
+      default: printf("\nUnrecognized option %s!\n\n",argv[i]);
+	       print_help();
+	       exit(0);
+      }
+  }
+  if((i+1)>=argc) {
+    printf("\nNot enough input parameters!\n\n");
+    print_help();
+    exit(0);
+  }
+  (*first)=i;
+  if(((*rounds) < 1) || ((*resamples) < 0) || ((*threads) < 1)
+     || ((*level) <= 0) || ((*level) >= 1)) {
+    printf("\nPermutations and threads must be at least 1, and the level in (0,1)!\n\n");
+    print_help();
+    exit(0);
+  }
+}
+
+void print_help(void)
+{
+  printf("\nSignificance tests for SVM-rank, based on SVM-light %s\n",VERSION);
+  copyright_notice();
+  printf("   usage: svm_rank_significance [options] baseline_file system_file ...\n\n");
+  printf("Compares the per-query values of a retrieval measure of each system with\n");
+  printf("the baseline, on the queries they have in common, as\n");
+  printf("SetRetrievalComparator.java: sign test and randomization test (one-sided\n");
+  printf("p-values that the system is better by chance), two-sided randomization\n");
+  printf("test, and a bootstrap interval of the difference of the means. The\n");
+  printf("files hold the output of svm_rank_classify --o (trec_eval text or JSON)\n");
+  printf("or of TrecEvaluator.java.\n\n");
+  printf("options: -h         -> this help\n");
+  printf("         -m string  -> measure, as named in the files (default map)\n");
+  printf("         -r int     -> permutations of the randomization test\n");
+  printf("                       (default 100000)\n");
+  printf("         -b int     -> bootstrap samples (default 10000, 0 for none)\n");
+  printf("         -l float   -> level of the bootstrap interval (default 0.95)\n");
+  printf("         -s int     -> random seed (default 1). The results do not depend\n");
+  printf("                       on the number of threads.\n");
+  printf("         -j int     -> threads (default: number of CPUs)\n");
+  printf("         -a         -> compare all pairs of files, not only each with\n");
+  printf("                       the first\n");
+  printf("         -v [0,1]   -> verbosity level (default 1)\n\n");
+}
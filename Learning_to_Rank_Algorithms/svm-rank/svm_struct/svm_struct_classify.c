@@ -17,6 +17,9 @@
 /************************************************************************/
 
 #include <stdio.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sched.h>
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -27,45 +30,94 @@ extern "C" {
 #include "../svm_struct_api.h"
 #include "svm_struct_common.h"
 
+#define MAX(x,y)      ((x) < (y) ? (y) : (x))
+
 char testfile[200];
 char modelfile[200];
 char predictionsfile[200];
+char latencyfile[200];
 
-void read_input_parameters(int, char **, char *, char *, char *, 
-			   STRUCT_LEARN_PARM *, long*, long *);
+void read_input_parameters(int, char **, char *, char *, char *, char *,
+			   STRUCT_LEARN_PARM *, long*, long *, long *);
 void print_help(void);
+long read_model_list(char *, char ***);
+long is_model_file(char *);
+int  compare_file_names(const void *, const void *);
 
 
 int main (int argc, char* argv[])
 {
-  long correct=0,incorrect=0,no_accuracy=0;
-  long i;
-  double t1,runtime=0;
-  double avgloss=0,l;
-  FILE *predfl;
-  STRUCTMODEL model; 
+  long *correct,*incorrect,no_accuracy=0;
+  long i,j,m,nmodels,num_features=0,threads,next,*qdocs=NULL;
+  long slots,slot,first;
+  double t1,t2,runtime=0,elapsed=0;
+  double *avgloss,*losses,l,*qlatency=NULL;
+  FILE **predfl,**measfl;
+  STRUCTMODEL *model; 
   STRUCT_LEARN_PARM sparm;
-  STRUCT_TEST_STATS teststats;
+  STRUCT_TEST_STATS *teststats,*qstats;
   SAMPLE testsample;
-  LABEL y;
+  LABEL *ys,*y;
+  char **modelfiles,**predfiles,**measfiles,*name,*done,mname[30];
 
   svm_struct_classify_api_init(argc,argv);
 
-  read_input_parameters(argc,argv,testfile,modelfile,predictionsfile,&sparm,
-			&verbosity,&struct_verbosity);
+  read_input_parameters(argc,argv,testfile,modelfile,predictionsfile,
+			latencyfile,&sparm,&verbosity,&struct_verbosity,
+			&threads);
+
+  /* model_file is a model, a directory of models, or a file with one
+     model file per line. All models score the test examples in one
+     pass, and each writes its own predictions file. */
+  nmodels=read_model_list(modelfile,&modelfiles);
+  if(nmodels == 0) {
+    printf("\nNo models found in %s!\n\n",modelfile);
+    exit(1);
+  }
 
   if(struct_verbosity>=1) {
-    printf("Reading model..."); fflush(stdout);
+    if(nmodels == 1)
+      printf("Reading model..."); 
+    else
+      printf("Reading %ld models...",nmodels); 
+    fflush(stdout);
+  }
+  if((nmodels > 1) && sparm.cascade_file[0]) {
+    printf("\nNOTE: The cascade (--l) applies to a single model only.\n");
+    sparm.cascade_file[0]=0;
   }
-  model=read_struct_model(modelfile,&sparm);
+  model=(STRUCTMODEL *)my_malloc(sizeof(STRUCTMODEL)*nmodels);
+  for(m=0;m<nmodels;m++) {
+    model[m]=read_struct_model(modelfiles[m],&sparm);
+    if(model[m].svm_model->kernel_parm.kernel_type == LINEAR) { /* linear kernel */
+      /* compute weight vector */
+      add_weight_vector_to_linear_model(model[m].svm_model);
+      model[m].w=model[m].svm_model->lin_weights;
+    }
+    num_features=MAX(num_features,sparm.num_features);
+  }
+  /* the test examples keep the features of the largest model, and
+     classify_struct_example_models gives each model only its own */
+  sparm.num_features=num_features;
   if(struct_verbosity>=1) {
     fprintf(stdout, "done.\n");
   }
-
-  if(model.svm_model->kernel_parm.kernel_type == LINEAR) { /* linear kernel */
-    /* compute weight vector */
-    add_weight_vector_to_linear_model(model.svm_model);
-    model.w=model.svm_model->lin_weights;
+  for(m=0;(m<nmodels) && (threads>1);m++)
+    if(model[m].svm_model->kernel_parm.kernel_type == CUSTOM) {
+      printf("\nNOTE: User defined kernels are scored with one thread only (-j).\n");
+      threads=1;
+    }
+  if((threads > 1) && sparm.topk_early) {
+    printf("\nNOTE: Early termination (--e) applies to one thread only (-j).\n");
+    sparm.topk_early=0;
+  }
+  if(nmodels > 1) {
+    if(sparm.topk_early) {
+      printf("\nNOTE: Early termination (--e) applies to a single model only.\n");
+      sparm.topk_early=0;
+    }
+    /* the linear models score each document together */
+    stack_struct_models(model,nmodels,&sparm);
   }
   
   if(struct_verbosity>=1) {
@@ -80,65 +132,304 @@ int main (int argc, char* argv[])
     printf("Classifying test examples..."); fflush(stdout);
   }
 
-  if ((predfl = fopen (predictionsfile, "w")) == NULL)
-  { perror (predictionsfile); exit (1); }
+  /* with several models, the predictions of model file name go to
+     output_file.name */
+  predfl=(FILE **)my_malloc(sizeof(FILE *)*nmodels);
+  predfiles=(char **)my_malloc(sizeof(char *)*nmodels);
+  for(m=0;m<nmodels;m++) {
+    if(nmodels == 1) 
+      name=predictionsfile;
+    else {
+      name=(name=strrchr(modelfiles[m],'/')) ? name+1 : modelfiles[m];
+      predfiles[m]=(char *)my_malloc(strlen(predictionsfile)+strlen(name)+2);
+      sprintf(predfiles[m],"%s.%s",predictionsfile,name);
+      name=predfiles[m];
+    }
+    if ((predfl[m] = fopen (name, "w")) == NULL)
+    { perror (name); exit (1); }
+  }
+  /* and the retrieval measures of model file name to measures_file.name */
+  measfl=(FILE **)my_malloc(sizeof(FILE *)*nmodels);
+  measfiles=(char **)my_malloc(sizeof(char *)*nmodels);
+  for(m=0;m<nmodels;m++) {
+    measfl[m]=NULL;
+    if(!sparm.measures_file[0]) 
+      continue;
+    if(nmodels == 1) 
+      name=sparm.measures_file;
+    else {
+      name=(name=strrchr(modelfiles[m],'/')) ? name+1 : modelfiles[m];
+      measfiles[m]=(char *)my_malloc(strlen(sparm.measures_file)
+				     +strlen(name)+2);
+      sprintf(measfiles[m],"%s.%s",sparm.measures_file,name);
+      name=measfiles[m];
+    }
+    if ((measfl[m] = fopen (name, "w")) == NULL)
+    { perror (name); exit (1); }
+  }
+  correct=(long *)my_malloc(sizeof(long)*nmodels);
+  incorrect=(long *)my_malloc(sizeof(long)*nmodels);
+  avgloss=(double *)my_malloc(sizeof(double)*nmodels);
+  teststats=(STRUCT_TEST_STATS *)my_malloc(sizeof(STRUCT_TEST_STATS)*nmodels);
+  for(m=0;m<nmodels;m++) {
+    correct[m]=incorrect[m]=0;
+    avgloss[m]=0;
+  }
+
+  /* With -j, several threads classify and evaluate queries at once.
+     The predictions of a query wait in a ring of slots until all
+     queries before it are written, and the statistics of each query
+     are added up in the order of the examples, so that the output is
+     the same as with one thread. Query i uses slot i % slots, and
+     waits until the query that used it last is written. */
+  slots=(threads > 1) ? 4*threads : 1;
+  ys=(LABEL *)my_malloc(sizeof(LABEL)*slots*nmodels);
+  losses=(double *)my_malloc(sizeof(double)*slots*nmodels);
+  qstats=(STRUCT_TEST_STATS *)my_malloc(sizeof(STRUCT_TEST_STATS)
+					*slots*nmodels);
+  done=(char *)my_malloc(slots);
+  for(i=0;i<slots;i++)
+    done[i]=0;
+  next=0;
+  if(latencyfile[0]) { /* wall-clock time to classify each query */
+    qlatency=(double *)my_malloc(sizeof(double)*(testsample.n+1));
+    qdocs=(long *)my_malloc(sizeof(long)*(testsample.n+1));
+  }
+  elapsed=get_wall_time();
 
+#pragma omp parallel for num_threads(threads) private(t1,t2,m,y,l,slot,first) schedule(dynamic) reduction(+:runtime)
   for(i=0;i<testsample.n;i++) {
-    t1=get_runtime();
-    y=classify_struct_example(testsample.examples[i].x,&model,&sparm);
-    runtime+=(get_runtime()-t1);
-
-    write_label(predfl,y);
-    l=loss(testsample.examples[i].y,y,&sparm);
-    avgloss+=l;
-    if(l == 0) 
-      correct++;
+    slot=i % slots;
+    for(;;) {
+#pragma omp atomic read
+      first=next;
+      if(i-first < slots)
+	break;
+      sched_yield(); /* the slot still holds query i-slots */
+    }
+    y=ys+slot*nmodels;
+    t1=get_thread_runtime();
+    t2=get_wall_time();
+    if(nmodels == 1)
+      y[0]=classify_struct_example(testsample.examples[i].x,&model[0],&sparm);
     else
-      incorrect++;
-    eval_prediction(i,testsample.examples[i],y,&model,&sparm,&teststats);
-
-    if(empty_label(testsample.examples[i].y)) 
-      { no_accuracy=1; } /* test data is not labeled */
-    if(struct_verbosity>=2) {
-      if((i+1) % 100 == 0) {
-	printf("%ld..",i+1); fflush(stdout);
+      classify_struct_example_models(testsample.examples[i].x,model,
+				     nmodels,&sparm,y);
+    runtime+=(get_thread_runtime()-t1);
+    if(qlatency) {
+      qlatency[i]=get_wall_time()-t2;
+      qdocs[i]=testsample.examples[i].x.totdoc;
+    }
+    for(m=0;m<nmodels;m++) {
+      losses[slot*nmodels+m]=loss(testsample.examples[i].y,y[m],&sparm);
+      eval_prediction(0,testsample.examples[i],y[m],&model[m],&sparm,
+		      &qstats[slot*nmodels+m]);
+    }
+
+#pragma omp critical (classify_output)
+    {
+      /* write all queries that are complete up to the first missing */
+      done[slot]=1;
+      for(first=next;(first<testsample.n) && done[first % slots];first++) {
+	slot=first % slots;
+	done[slot]=0;
+	y=ys+slot*nmodels;
+	for(m=0;m<nmodels;m++) {
+	  if(sparm.topk > 0)
+	    write_ranked_label(predfl[m],testsample.examples[first].x,y[m],
+			       &sparm);
+	  else
+	    write_label(predfl[m],y[m]);
+	  l=losses[slot*nmodels+m];
+	  avgloss[m]+=l;
+	  if(l == 0) 
+	    correct[m]++;
+	  else
+	    incorrect[m]++;
+	  if(first == 0)
+	    teststats[m]=qstats[m];
+	  else
+	    add_struct_test_stats(&teststats[m],&qstats[slot*nmodels+m]);
+	  if(measfl[m])
+	    write_query_measures(measfl[m],first,testsample.examples[first],
+				 &qstats[slot*nmodels+m],&sparm);
+	  free_label(y[m]);
+	}
+
+	if(empty_label(testsample.examples[first].y)) 
+	  { no_accuracy=1; } /* test data is not labeled */
+	if(struct_verbosity>=2) {
+	  if((first+1) % 100 == 0) {
+	    printf("%ld..",first+1); fflush(stdout);
+	  }
+	}
       }
+#pragma omp atomic write
+      next=first;
     }
-    free_label(y);
   }  
-  avgloss/=testsample.n;
-  fclose(predfl);
+  elapsed=get_wall_time()-elapsed;
+  if(qlatency) {
+    write_latency_report(latencyfile,qlatency,qdocs,testsample.n,elapsed,
+			 threads);
+    free(qlatency);
+    free(qdocs);
+  }
+  for(m=0;m<nmodels;m++) {
+    avgloss[m]/=testsample.n;
+    fclose(predfl[m]);
+    if(measfl[m]) {
+      write_mean_measures(measfl[m],&teststats[m],&sparm);
+      fclose(measfl[m]);
+    }
+  }
 
   if(struct_verbosity>=1) {
     printf("done\n");
     printf("Runtime (without IO) in cpu-seconds: %.2f\n",
 	   (float)(runtime/100.0));    
+    if(threads > 1)
+      printf("Elapsed time with %ld threads (with output): %.2f seconds\n",
+	     threads,elapsed);
+  }
+  if(nmodels == 1) {
+    if((!no_accuracy) && (struct_verbosity>=1)) {
+      printf("Average loss on test set: %.4f\n",(float)avgloss[0]);
+      printf("Zero/one-error on test set: %.2f%% (%ld correct, %ld incorrect, %d total)\n",(float)100.0*incorrect[0]/testsample.n,correct[0],incorrect[0],testsample.n);
+    }
+    print_struct_testing_stats(testsample,&model[0],&sparm,&teststats[0]);
   }
-  if((!no_accuracy) && (struct_verbosity>=1)) {
-    printf("Average loss on test set: %.4f\n",(float)avgloss);
-    printf("Zero/one-error on test set: %.2f%% (%ld correct, %ld incorrect, %d total)\n",(float)100.0*incorrect/testsample.n,correct,incorrect,testsample.n);
+  else if(struct_verbosity>=1) {
+    for(m=0;m<nmodels;m++) {
+      printf("%s -> %s",modelfiles[m],predfiles[m]);
+      if(!no_accuracy)
+	printf(": average loss %.4f, zero/one-error %.2f%%",(float)avgloss[m],
+	       (float)100.0*incorrect[m]/testsample.n);
+      for(j=0;j<sparm.measures_n;j++)
+	printf(", %s %.4f",ranking_metric_name(sparm.measure[j],
+					       sparm.measure_k[j],mname),
+	       teststats[m].measure[j]/MAX(1,teststats[m].queries));
+      printf("\n");
+    }
   }
-  print_struct_testing_stats(testsample,&model,&sparm,&teststats);
   free_struct_sample(testsample);
-  free_struct_model(model);
+  for(m=0;m<nmodels;m++) {
+    free_struct_model(model[m]);
+    free(modelfiles[m]);
+    if(nmodels > 1) free(predfiles[m]);
+    if((nmodels > 1) && measfl[m]) free(measfiles[m]);
+  }
+  free(model);
+  free(modelfiles);
+  free(predfiles);
+  free(predfl);
+  free(measfiles);
+  free(measfl);
+  free(ys);
+  free(losses);
+  free(qstats);
+  free(done);
+  free(correct);
+  free(incorrect);
+  free(avgloss);
+  free(teststats);
 
   svm_struct_classify_api_exit();
 
   return(0);
 }
 
+long read_model_list(char *name, char ***files)
+     /* Returns the number of models that name stands for, and their
+	file names in files: name itself if it is a model, the models in
+	directory name ordered by file name, or the files listed in
+	name, one per line. */
+{
+  struct stat st;
+  DIR *dir;
+  struct dirent *e;
+  FILE *fl;
+  char *path,line[1000];
+  long n=0,max=16,len;
+
+  (*files)=(char **)my_malloc(sizeof(char *)*max);
+  if((stat(name,&st) == 0) && S_ISDIR(st.st_mode)) {
+    if((dir=opendir(name)) == NULL)
+    { perror (name); exit (1); }
+    while((e=readdir(dir)) != NULL) {
+      path=(char *)my_malloc(strlen(name)+strlen(e->d_name)+2);
+      sprintf(path,"%s/%s",name,e->d_name);
+      if((stat(path,&st) == 0) && S_ISREG(st.st_mode) && is_model_file(path)) {
+	if(n == max)
+	  (*files)=(char **)realloc(*files,sizeof(char *)*(max*=2));
+	(*files)[n++]=path;
+      }
+      else
+	free(path);
+    }
+    closedir(dir);
+    qsort(*files,n,sizeof(char *),compare_file_names);
+  }
+  else if(is_model_file(name)) {
+    (*files)[n]=(char *)my_malloc(strlen(name)+1);
+    strcpy((*files)[n++],name);
+  }
+  else {
+    if ((fl = fopen (name, "r")) == NULL)
+    { perror (name); exit (1); }
+    while(fgets(line,sizeof(line),fl)) {
+      len=strlen(line);
+      while((len>0) && isspace((int)line[len-1]))
+	line[--len]=0;
+      if((len == 0) || (line[0] == '#'))
+	continue;
+      if(n == max)
+	(*files)=(char **)realloc(*files,sizeof(char *)*(max*=2));
+      (*files)[n]=(char *)my_malloc(len+1);
+      strcpy((*files)[n++],line);
+    }
+    fclose(fl);
+  }
+  return(n);
+}
+
+long is_model_file(char *file)
+     /* 1, if file is a model in text or binary format */
+{
+  FILE *fl;
+  char line[20];
+  long model;
+
+  if(is_binary_model(file))
+    return(1);
+  if ((fl = fopen (file, "r")) == NULL)
+    return(0);
+  model=((fgets(line,sizeof(line),fl) != NULL)
+	 && (strncmp(line,"SVM-light Version",17) == 0));
+  fclose(fl);
+  return(model);
+}
+
+int compare_file_names(const void *a, const void *b)
+{
+  return(strcmp(*(char * const *)a,*(char * const *)b));
+}
+
 void read_input_parameters(int argc,char *argv[],char *testfile,
 			   char *modelfile,char *predictionsfile,
-			   STRUCT_LEARN_PARM *struct_parm,
-			   long *verbosity,long *struct_verbosity)
+			   char *latencyfile,STRUCT_LEARN_PARM *struct_parm,
+			   long *verbosity,long *struct_verbosity,
+			   long *threads)
 {
   long i;
   
   /* set default */
   strcpy (modelfile, "svm_model");
   strcpy (predictionsfile, "svm_predictions"); 
+  latencyfile[0]=0;
   (*verbosity)=0;/*verbosity for svm_light*/
   (*struct_verbosity)=1; /*verbosity for struct learning portion*/
+  (*threads)=1;
   struct_parm->custom_argc=0;
 
   for(i=1;(i<argc) && ((argv[i])[0] == '-');i++) {
@@ -146,9 +437,13 @@ void read_input_parameters(int argc,char *argv[],char *testfile,
       { 
       case 'h': print_help(); exit(0);
       case '?': print_help(); exit(0);
-      case '-': strcpy(struct_parm->custom_argv[struct_parm->custom_argc++],argv[i]);i++; strcpy(struct_parm->custom_argv[struct_parm->custom_argc++],argv[i]);break; 
+      case '-': if(strcmp(argv[i],"--latency-report") == 0) {
+		  i++; strcpy(latencyfile,argv[i]); break;
+		}
+		strcpy(struct_parm->custom_argv[struct_parm->custom_argc++],argv[i]);i++; strcpy(struct_parm->custom_argv[struct_parm->custom_argc++],argv[i]);break; 
       case 'v': i++; (*struct_verbosity)=atol(argv[i]); break;
       case 'y': i++; (*verbosity)=atol(argv[i]); break;
+      case 'j': i++; (*threads)=atol(argv[i]); break;
       default: printf("\nUnrecognized option %s!\n\n",argv[i]);
 	       print_help();
 	       exit(0);
@@ -164,6 +459,14 @@ void read_input_parameters(int argc,char *argv[],char *testfile,
   if((i+2)<argc) {
     strcpy (predictionsfile, argv[i+2]);
   }
+  if((*threads) < 1) {
+    printf("\nThe number of threads (-j) must be at least 1!\n\n");
+    print_help();
+    exit(0);
+  }
+#ifndef _OPENMP
+  (*threads)=1;  /* built without OpenMP */
+#endif
 
   parse_struct_parameters_classify(struct_parm);
 }
@@ -175,8 +478,18 @@ void print_help(void)
   printf("   includes SVM-light %s quadratic optimizer, %s\n",VERSION,VERSION_DATE);
   copyright_notice();
   printf("   usage: svm_struct_classify [options] example_file model_file output_file\n\n");
+  printf("model_file can also be a directory of models or a file that lists one\n");
+  printf("model file per line. The examples are then read once and scored with\n");
+  printf("all models, and the predictions of model file m go to output_file.m\n\n");
   printf("options: -h         -> this help\n");
-  printf("         -v [0..3]  -> verbosity level (default 2)\n\n");
+  printf("         -v [0..3]  -> verbosity level (default 2)\n");
+  printf("         -j int     -> number of threads that classify queries at the same\n");
+  printf("                       time. The output is the same as with one thread.\n");
+  printf("                       (default 1)\n");
+  printf("         --latency-report file\n");
+  printf("                    -> write the wall-clock latency of each query as\n");
+  printf("                       percentiles, documents per second, and latency\n");
+  printf("                       by query size to file in JSON format\n\n");
 
   print_struct_help_classify();
 }
@@ -126,6 +126,7 @@ void svm_learn_struct(SAMPLE sample, STRUCT_LEARN_PARM *sparm,
   if(kcache)
     kernel_cache_cleanup(kcache);
   add_weight_vector_to_linear_model(svmModel);
+  add_kernel_block_to_model(svmModel);
   sm->svm_model=svmModel;
   sm->w=svmModel->lin_weights; /* short cut to weight vector */
 
@@ -335,6 +336,7 @@ void svm_learn_struct(SAMPLE sample, STRUCT_LEARN_PARM *sparm,
 	       linear. If not, ignore the weight vector since its
 	       content is bogus. */
 	    add_weight_vector_to_linear_model(svmModel);
+	    add_kernel_block_to_model(svmModel);
 	    sm->svm_model=svmModel;
 	    sm->w=svmModel->lin_weights; /* short cut to weight vector */
 	    optcount++;
@@ -472,6 +474,19 @@ void svm_learn_struct(SAMPLE sample, STRUCT_LEARN_PARM *sparm,
 void svm_learn_struct_joint(SAMPLE sample, STRUCT_LEARN_PARM *sparm,
 			    LEARN_PARM *lparm, KERNEL_PARM *kparm, 
 			    STRUCTMODEL *sm, int alg_type)
+{
+  svm_learn_struct_joint_warm(sample,sparm,lparm,kparm,sm,alg_type,NULL);
+}
+
+void svm_learn_struct_joint_warm(SAMPLE sample, STRUCT_LEARN_PARM *sparm,
+				 LEARN_PARM *lparm, KERNEL_PARM *kparm, 
+				 STRUCTMODEL *sm, int alg_type, 
+				 WARM_START *warm)
+     /* Same as svm_learn_struct_joint. If warm holds the state of a
+	run with a different C on the same sample, training starts
+	from its working set, with the dual variables scaled to the
+	new bound C, and from its constraint cache. On return, warm
+	holds the state of this run. */
 {
   int         i,j;
   int         numIt=0;
@@ -506,7 +521,7 @@ void svm_learn_struct_joint(SAMPLE sample, STRUCT_LEARN_PARM *sparm,
   int         cache_size=0;
   */
   CCACHE      *ccache=NULL;
-  int         cached_constraint;
+  int         cached_constraint,limited;
   double      viol,viol_est,epsilon_est=0;
   long        uptr=0;
   long        *randmapping=NULL;
@@ -542,25 +557,54 @@ void svm_learn_struct_joint(SAMPLE sample, STRUCT_LEARN_PARM *sparm,
 				     using constraints constructed
 				     from the constraint cache */
 
-  cset=init_struct_constraints(sample, sm, sparm);
-  if(cset.m > 0) {
-    alpha=(double *)realloc(alpha,sizeof(double)*cset.m);
-    alphahist=(long *)realloc(alphahist,sizeof(long)*cset.m);
+  if(warm && (warm->C > 0)) {
+    /* The constraints do not depend on C, so the working set of the
+       previous run is still valid. Scaling its alphas keeps them
+       feasible for sum(alpha) <= C. */
+    cset=warm->cset;
+    alpha=warm->alpha;
+    alphahist=warm->alphahist;
     for(i=0; i<cset.m; i++) {
-      alpha[i]=0;
-      alphahist[i]=-1; /* -1 makes sure these constraints are never removed */
+      alpha[i]*=sparm->C/warm->C;
+      if(alphahist[i] > -1)
+	alphahist[i]=0;
+    }
+    epsilon=MAX(warm->epsilon,sparm->epsilon);
+    epsilon_cached=epsilon;
+    if(struct_verbosity>=1) 
+      printf("Starting from the working set of C=%g (%d constraints).\n",
+	     warm->C,cset.m);
+  }
+  else {
+    cset=init_struct_constraints(sample, sm, sparm);
+    if(cset.m > 0) {
+      alpha=(double *)realloc(alpha,sizeof(double)*cset.m);
+      alphahist=(long *)realloc(alphahist,sizeof(long)*cset.m);
+      for(i=0; i<cset.m; i++) {
+	alpha[i]=0;
+	alphahist[i]=-1; /* -1 makes sure these constraints are never removed */
+      }
     }
   }
   kparm->gram_matrix=NULL;
-  if((alg_type == ONESLACK_DUAL_ALG) || (alg_type == ONESLACK_DUAL_CACHE_ALG))
+  if(warm && warm->gram_matrix) 
+    kparm->gram_matrix=warm->gram_matrix; /* kernel does not depend on C */
+  else if((alg_type == ONESLACK_DUAL_ALG) 
+	  || (alg_type == ONESLACK_DUAL_CACHE_ALG))
     kparm->gram_matrix=init_kernel_matrix(&cset,kparm);
 
   /* set initial model and slack variables */
   svmModel=(MODEL *)my_malloc(sizeof(MODEL));
   lparm->epsilon_crit=epsilon;
+  kernel_type_org=kparm->kernel_type;
+  if(kparm->gram_matrix) /* a warm start has non-zero alphas */
+    kparm->kernel_type=GRAM;
   svm_learn_optimization(cset.lhs,cset.rhs,cset.m,sizePsi,
 			 lparm,kparm,NULL,svmModel,alpha);
+  kparm->kernel_type=kernel_type_org; 
+  svmModel->kernel_parm.kernel_type=kernel_type_org;
   add_weight_vector_to_linear_model(svmModel);
+  add_kernel_block_to_model(svmModel);
   sm->svm_model=svmModel;
   sm->w=svmModel->lin_weights; /* short cut to weight vector */
 
@@ -582,7 +626,12 @@ void svm_learn_struct_joint(SAMPLE sample, STRUCT_LEARN_PARM *sparm,
 
   /* initialize the constraint cache */
   if(alg_type == ONESLACK_DUAL_CACHE_ALG) {
-    ccache=create_constraint_cache(sample,sparm,sm);
+    if(warm && warm->ccache) {
+      ccache=warm->ccache;
+      ccache->sm=sm;
+    }
+    else
+      ccache=create_constraint_cache(sample,sparm,sm);
     /* NOTE:  */
     for(i=0;i<n;i++) 
       if(loss(ex[i].y,ex[i].y,sparm) != 0) {
@@ -607,8 +656,9 @@ void svm_learn_struct_joint(SAMPLE sample, STRUCT_LEARN_PARM *sparm,
   /*****************/
   do { /* iteratively find and add constraints to working set */
 
+      numIt++;
       if(struct_verbosity>=1) { 
-	printf("Iter %i: ",++numIt); 
+	printf("Iter %i: ",numIt); 
 	fflush(stdout);
       }
       
@@ -800,6 +850,7 @@ void svm_learn_struct_joint(SAMPLE sample, STRUCT_LEARN_PARM *sparm,
 	   linear. If not, ignore the weight vector since its
 	   content is bogus. */
 	add_weight_vector_to_linear_model(svmModel);
+	add_kernel_block_to_model(svmModel);
 	sm->svm_model=svmModel;
 	sm->w=svmModel->lin_weights; /* short cut to weight vector */
 	optcount++;
@@ -829,43 +880,56 @@ void svm_learn_struct_joint(SAMPLE sample, STRUCT_LEARN_PARM *sparm,
 
       rt_total+=MAX(get_runtime()-rt1,0);
 
-  } while(cached_constraint || (ceps > sparm->epsilon) || 
-	  finalize_iteration(ceps,cached_constraint,sample,sm,cset,alpha,sparm)
+  } while((cached_constraint || (ceps > sparm->epsilon) || 
+	   finalize_iteration(ceps,cached_constraint,sample,sm,cset,alpha,sparm))
+	  && ((sparm->max_iterations <= 0) || (numIt < sparm->max_iterations))
 	 );
+  limited=cached_constraint || (ceps > sparm->epsilon);
+  if((struct_verbosity>=1) && limited)
+    printf("Stopped after %d iterations (limit) before reaching epsilon.\n",
+	   numIt);
   
 
   if(struct_verbosity>=1) {
     printf("Final epsilon on KKT-Conditions: %.5f\n",
 	   MAX(svmModel->maxdiff,ceps));
 
-    slack=0;
-    for(j=0;j<cset.m;j++) 
-      slack=MAX(slack,
-		cset.rhs[j]-classify_example(svmModel,cset.lhs[j]));
-    alphasum=0;
-    for(i=0; i<cset.m; i++)  
-      alphasum+=alpha[i]*cset.rhs[i];
-    if(kparm->kernel_type == LINEAR)
-      modellength=model_length_n(svmModel);
-    else
-      modellength=model_length_s(svmModel);
-    dualitygap=(0.5*modellength*modellength+sparm->C*viol)
-               -(alphasum-0.5*modellength*modellength);
+    /* The objective and slack take kernel evaluations over all
+       constraints, which are not spent on a run that only stopped at
+       the iteration limit and will be continued. */
+    if(!limited) {
+      slack=0;
+      for(j=0;j<cset.m;j++) 
+	slack=MAX(slack,
+		  cset.rhs[j]-classify_example(svmModel,cset.lhs[j]));
+      alphasum=0;
+      for(i=0; i<cset.m; i++)  
+	alphasum+=alpha[i]*cset.rhs[i];
+      if(kparm->kernel_type == LINEAR)
+	modellength=model_length_n(svmModel);
+      else
+	modellength=model_length_s(svmModel);
+      dualitygap=(0.5*modellength*modellength+sparm->C*viol)
+	         -(alphasum-0.5*modellength*modellength);
     
-    printf("Upper bound on duality gap: %.5f\n", dualitygap);
-    printf("Dual objective value: dval=%.5f\n",
-	    alphasum-0.5*modellength*modellength);
-    printf("Primal objective value: pval=%.5f\n",
-	    0.5*modellength*modellength+sparm->C*viol);
+      printf("Upper bound on duality gap: %.5f\n", dualitygap);
+      printf("Dual objective value: dval=%.5f\n",
+	     alphasum-0.5*modellength*modellength);
+      printf("Primal objective value: pval=%.5f\n",
+	     0.5*modellength*modellength+sparm->C*viol);
+    }
     printf("Total number of constraints in final working set: %i (of %i)\n",(int)cset.m,(int)totconstraints);
     printf("Number of iterations: %d\n",numIt);
     printf("Number of calls to 'find_most_violated_constraint': %ld\n",argmax_count);
     printf("Number of SV: %ld \n",svmModel->sv_num-1);
-    printf("Norm of weight vector: |w|=%.5f\n",modellength);
-    printf("Value of slack variable (on working set): xi=%.5f\n",slack);
+    if(!limited) {
+      printf("Norm of weight vector: |w|=%.5f\n",modellength);
+      printf("Value of slack variable (on working set): xi=%.5f\n",slack);
+    }
     printf("Value of slack variable (global): xi=%.5f\n",viol);
-    printf("Norm of longest difference vector: ||Psi(x,y)-Psi(x,ybar)||=%.5f\n",
-	   length_of_longest_document_vector(cset.lhs,cset.m,kparm));
+    if(!limited)
+      printf("Norm of longest difference vector: ||Psi(x,y)-Psi(x,ybar)||=%.5f\n",
+	     length_of_longest_document_vector(cset.lhs,cset.m,kparm));
     if(struct_verbosity>=2) 
       printf("Runtime in cpu-seconds: %.2f (%.2f%% for QP, %.2f%% for kernel, %.2f%% for Argmax, %.2f%% for Psi, %.2f%% for init, %.2f%% for cache update, %.2f%% for cache const, %.2f%% for cache add (incl. %.2f%% for sum))\n",
 	   rt_total/100.0, (100.0*rt_opt)/rt_total, (100.0*rt_kernel)/rt_total,
@@ -897,22 +961,196 @@ void svm_learn_struct_joint(SAMPLE sample, STRUCT_LEARN_PARM *sparm,
 
   if(lhs_n)
     free_nvector(lhs_n);
-  if(ccache)    
-    free_constraint_cache(ccache);
   for(i=0;i<n;i++)
     if(fycache[i])
       free_svector(fycache[i]);
   free(fycache);
-  free(alpha); 
-  free(alphahist); 
-  free(cset.rhs); 
-  for(i=0;i<cset.m;i++) 
-    free_example(cset.lhs[i],1);
-  free(cset.lhs);
+  if(warm) {
+    warm->converged=(!cached_constraint) && (ceps <= sparm->epsilon);
+    warm->C=sparm->C;
+    warm->epsilon=epsilon;
+    warm->cset=cset;
+    warm->alpha=alpha;
+    warm->alphahist=alphahist;
+    warm->ccache=ccache;
+    warm->gram_matrix=kparm->gram_matrix;
+    kparm->gram_matrix=NULL;
+  }
+  else {
+    if(ccache)    
+      free_constraint_cache(ccache);
+    free(alpha); 
+    free(alphahist); 
+    free(cset.rhs); 
+    for(i=0;i<cset.m;i++) 
+      free_example(cset.lhs[i],1);
+    free(cset.lhs);
+  }
   if(kparm->gram_matrix)
     free_matrix(kparm->gram_matrix);
 }
 
+void init_warm_start(WARM_START *warm)
+     /* empty state: the next run starts from scratch */
+{
+  warm->C=0;
+  warm->epsilon=0;
+  warm->cset.m=0;
+  warm->cset.lhs=NULL;
+  warm->cset.rhs=NULL;
+  warm->alpha=NULL;
+  warm->alphahist=NULL;
+  warm->ccache=NULL;
+  warm->gram_matrix=NULL;
+  warm->converged=0;
+}
+
+void free_warm_start(WARM_START *warm)
+     /* frees the state left by svm_learn_struct_joint_warm and empties
+	warm */
+{
+  int i;
+
+  if(warm->ccache)    
+    free_constraint_cache(warm->ccache);
+  if(warm->gram_matrix)
+    free_matrix(warm->gram_matrix);
+  free(warm->alpha); 
+  free(warm->alphahist); 
+  free(warm->cset.rhs); 
+  for(i=0;i<warm->cset.m;i++) 
+    free_example(warm->cset.lhs[i],1);
+  free(warm->cset.lhs);
+  init_warm_start(warm);
+}
+
+/* Working sets are saved in the byte order and type sizes of the
+   machine, which are checked when reading. Layout: magic,
+   sizeof(long), sizeof(WORD), C, epsilon (double), number of constraints
+   (long), and for each constraint its rhs, alpha (double), alphahist,
+   number of SVECTORs (long), and for each SVECTOR its factor
+   (double), kernel_id, docid, number of words (long) and the words
+   without terminator. Then follows 1 (long) and the kernel matrix of
+   the constraints in this order (double), if there is one, and 0
+   otherwise. The constraint cache is not saved. */
+# define WARM_START_MAGIC "SVMRWS02"
+
+void write_warm_start(char *file, WARM_START *warm)
+{
+  FILE *fl;
+  long i,j,n,nwords,size[2],m;
+  SVECTOR *v;
+  DOC **lhs;
+
+  if ((fl = fopen (file, "wb")) == NULL)
+  { perror (file); exit (1); }
+  size[0]=sizeof(long);
+  size[1]=sizeof(WORD);
+  m=warm->cset.m;
+  fwrite(WARM_START_MAGIC,1,8,fl);
+  fwrite(size,sizeof(long),2,fl);
+  fwrite(&warm->C,sizeof(double),1,fl);
+  fwrite(&warm->epsilon,sizeof(double),1,fl);
+  fwrite(&m,sizeof(long),1,fl);
+  for(i=0;i<m;i++) {
+    fwrite(&warm->cset.rhs[i],sizeof(double),1,fl);
+    fwrite(&warm->alpha[i],sizeof(double),1,fl);
+    fwrite(&warm->alphahist[i],sizeof(long),1,fl);
+    for(n=0,v=warm->cset.lhs[i]->fvec;v;v=v->next) 
+      n++;
+    fwrite(&n,sizeof(long),1,fl);
+    for(v=warm->cset.lhs[i]->fvec;v;v=v->next) {
+      for(nwords=0;v->words[nwords].wnum;nwords++);
+      fwrite(&v->factor,sizeof(double),1,fl);
+      fwrite(&v->kernel_id,sizeof(long),1,fl);
+      fwrite(&v->docid,sizeof(long),1,fl);
+      fwrite(&nwords,sizeof(long),1,fl);
+      fwrite(v->words,sizeof(WORD),nwords,fl);
+    }
+  }
+  n=(warm->gram_matrix != NULL);
+  fwrite(&n,sizeof(long),1,fl);
+  lhs=warm->cset.lhs;
+  for(i=0;n && (i<m);i++) 
+    for(j=0;j<m;j++) 
+      fwrite(&warm->gram_matrix->element[lhs[i]->kernelid][lhs[j]->kernelid],
+	     sizeof(double),1,fl);
+  if(ferror(fl) || fclose(fl))
+  { perror (file); exit (1); }
+}
+
+int read_warm_start(char *file, WARM_START *warm)
+     /* reads a working set written by write_warm_start into the empty
+	warm. Returns 0 and leaves warm empty, if the file cannot be
+	read or was not written on this kind of machine. */
+{
+  FILE *fl;
+  char magic[8];
+  long i,j,n,nwords,size[2],m,kernel_id,docid;
+  double factor;
+  SVECTOR *v,*list,*last;
+  WORD *words=NULL;
+  int ok;
+
+  if ((fl = fopen (file, "rb")) == NULL)
+    return(0);
+  ok=((fread(magic,1,8,fl) == 8) && (!memcmp(magic,WARM_START_MAGIC,8))
+      && (fread(size,sizeof(long),2,fl) == 2) 
+      && (size[0] == sizeof(long)) && (size[1] == sizeof(WORD))
+      && (fread(&warm->C,sizeof(double),1,fl) == 1)
+      && (fread(&warm->epsilon,sizeof(double),1,fl) == 1)
+      && (fread(&m,sizeof(long),1,fl) == 1) && (m >= 0));
+  if(ok) {
+    warm->cset.lhs=(DOC **)my_malloc(sizeof(DOC *)*(m+1));
+    warm->cset.rhs=(double *)my_malloc(sizeof(double)*(m+1));
+    warm->alpha=(double *)my_malloc(sizeof(double)*(m+1));
+    warm->alphahist=(long *)my_malloc(sizeof(long)*(m+1));
+  }
+  for(i=0;ok && (i<m);i++) {
+    ok=((fread(&warm->cset.rhs[i],sizeof(double),1,fl) == 1)
+	&& (fread(&warm->alpha[i],sizeof(double),1,fl) == 1)
+	&& (fread(&warm->alphahist[i],sizeof(long),1,fl) == 1)
+	&& (fread(&n,sizeof(long),1,fl) == 1));
+    list=last=NULL;
+    for(j=0;ok && (j<n);j++) {
+      ok=((fread(&factor,sizeof(double),1,fl) == 1)
+	  && (fread(&kernel_id,sizeof(long),1,fl) == 1)
+	  && (fread(&docid,sizeof(long),1,fl) == 1)
+	  && (fread(&nwords,sizeof(long),1,fl) == 1) && (nwords >= 0));
+      if(!ok)
+	break;
+      words=(WORD *)realloc(words,sizeof(WORD)*(nwords+1));
+      ok=(fread(words,sizeof(WORD),nwords,fl) == nwords);
+      words[nwords].wnum=0;
+      v=create_svector(words,NULL,factor);
+      v->kernel_id=kernel_id;
+      v->docid=docid;
+      if(last)
+	last->next=v;
+      else
+	list=v;
+      last=v;
+    }
+    warm->cset.lhs[i]=create_example(i,0,1,1,list);
+    warm->cset.m=i+1;
+  }
+  ok=(ok && (fread(&n,sizeof(long),1,fl) == 1));
+  if(ok && n) {
+    /* create_example above has set kernelid=i */
+    warm->gram_matrix=create_matrix(m+50,m+50);
+    for(i=0;ok && (i<m);i++) 
+      ok=(fread(warm->gram_matrix->element[i],sizeof(double),m,fl) == m);
+  }
+  free(words);
+  fclose(fl);
+  if(!ok) {
+    free_warm_start(warm);
+    return(0);
+  }
+  warm->converged=0;
+  return(1);
+}
+
 
 void find_most_violated_constraint(SVECTOR **fydelta, double *rhs, 
 				   EXAMPLE *ex, SVECTOR *fycached, long n, 
@@ -1010,6 +1248,7 @@ MATRIX *init_kernel_matrix(CONSTSET *cset, KERNEL_PARM *kparm)
   int i,j;
   double kval;
   MATRIX *matrix;
+  KERNEL_BLOCK *block;
 
   /* assign kernel id to each new constraint */
   for(i=0;i<cset->m;i++) 
@@ -1019,11 +1258,16 @@ MATRIX *init_kernel_matrix(CONSTSET *cset, KERNEL_PARM *kparm)
   matrix=create_matrix(i+50,i+50);
 
   for(j=0;j<cset->m;j++) {
+    block=create_constraint_kernel_block(cset->lhs[j],kparm);
     for(i=j;i<cset->m;i++) {
-      kval=kernel(kparm,cset->lhs[j],cset->lhs[i]);
+      if(block)
+	kval=kernel_block_eval(kparm,block,NULL,0,cset->lhs[i]->fvec,NULL);
+      else
+	kval=kernel(kparm,cset->lhs[j],cset->lhs[i]);
       matrix->element[j][i]=kval;
       matrix->element[i][j]=kval;
     }
+    free_kernel_block(block);
   }
   return(matrix);
 }
@@ -1036,6 +1280,7 @@ MATRIX *update_kernel_matrix(MATRIX *matrix, int newpos, CONSTSET *cset,
   int i,maxkernelid=0,newid;
   double kval;
   double *used;
+  KERNEL_BLOCK *block;
 
   /* find free kernelid to assign to new constraint */
   for(i=0;i<cset->m;i++) 
@@ -1055,14 +1300,36 @@ MATRIX *update_kernel_matrix(MATRIX *matrix, int newpos, CONSTSET *cset,
   if((!matrix) || (maxkernelid>=matrix->m))
     matrix=realloc_matrix(matrix,maxkernelid+50,maxkernelid+50);
 
+  block=create_constraint_kernel_block(cset->lhs[newpos],kparm);
   for(i=0;i<cset->m;i++) {
-    kval=kernel(kparm,cset->lhs[newpos],cset->lhs[i]);
+    if(block)
+      kval=kernel_block_eval(kparm,block,NULL,0,cset->lhs[i]->fvec,NULL);
+    else
+      kval=kernel(kparm,cset->lhs[newpos],cset->lhs[i]);
     matrix->element[newid][cset->lhs[i]->kernelid]=kval;
     matrix->element[cset->lhs[i]->kernelid][newid]=kval;
   }
+  free_kernel_block(block);
   return(matrix);
 }
 
+KERNEL_BLOCK *create_constraint_kernel_block(DOC *lhs, KERNEL_PARM *kparm)
+     /* packs the list of feature vectors of a constraint into a dense
+	kernel block, so that its kernel with all other constraints can
+	be computed in batches. Returns NULL, if not worthwhile. */
+{
+  SVECTOR *f;
+  long maxfeat=0;
+  WORD *w;
+
+  for(f=lhs->fvec;f;f=f->next)
+    for(w=f->words;w->wnum;w++)
+      maxfeat=MAX(maxfeat,w->wnum);
+  if(!kernel_block_applicable(kparm,&lhs->fvec,1,maxfeat+1))
+    return(NULL);
+  return(create_kernel_block(&lhs->fvec,NULL,1,maxfeat+1));
+}
+
 CCACHE *create_constraint_cache(SAMPLE sample, STRUCT_LEARN_PARM *sparm, 
 				STRUCTMODEL *sm)
      /* create new constraint cache for training set */
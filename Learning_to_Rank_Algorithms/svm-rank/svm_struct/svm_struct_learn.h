@@ -65,6 +65,23 @@ typedef struct ccache {
 			     last iter? */
 } CCACHE;
 
+typedef struct warm_start {
+  /* working set that svm_learn_struct_joint_warm hands from one
+     value of C to the next one on the same sample */
+  double   C;                /* C of the run that left this state,
+				0 if there is none yet */
+  double   epsilon;          /* precision its QP was solved to last */
+  CONSTSET cset;             /* working set of that run */
+  double   *alpha;           /* its dual variables */
+  long     *alphahist;       /* -1 for constraints that are never removed */
+  CCACHE   *ccache;          /* constraint cache of ONESLACK_DUAL_CACHE_ALG */
+  MATRIX   *gram_matrix;     /* kernel matrix of cset, indexed by the
+				kernelid of its constraints */
+  int      converged;        /* 0, if that run stopped at
+				sparm->max_iterations before reaching
+				epsilon */
+} WARM_START;
+
 void find_most_violated_constraint(SVECTOR **fydelta, double *lossval, 
 				   EXAMPLE *ex, SVECTOR *fycached, long n, 
 				   STRUCTMODEL *sm,STRUCT_LEARN_PARM *sparm,
@@ -87,6 +104,13 @@ void svm_learn_struct(SAMPLE sample, STRUCT_LEARN_PARM *sparm,
 void svm_learn_struct_joint(SAMPLE sample, STRUCT_LEARN_PARM *sparm,
 		      LEARN_PARM *lparm, KERNEL_PARM *kparm, 
 		      STRUCTMODEL *sm, int alg_type);
+void svm_learn_struct_joint_warm(SAMPLE sample, STRUCT_LEARN_PARM *sparm,
+		      LEARN_PARM *lparm, KERNEL_PARM *kparm, 
+		      STRUCTMODEL *sm, int alg_type, WARM_START *warm);
+void init_warm_start(WARM_START *warm);
+void free_warm_start(WARM_START *warm);
+void write_warm_start(char *file, WARM_START *warm);
+int  read_warm_start(char *file, WARM_START *warm);
 void svm_learn_struct_joint_custom(SAMPLE sample, STRUCT_LEARN_PARM *sparm,
 		      LEARN_PARM *lparm, KERNEL_PARM *kparm, 
 		      STRUCTMODEL *sm);
@@ -95,6 +119,7 @@ void remove_inactive_constraints(CONSTSET *cset, double *alpha,
 MATRIX *init_kernel_matrix(CONSTSET *cset, KERNEL_PARM *kparm); 
 MATRIX *update_kernel_matrix(MATRIX *matrix, int newpos, CONSTSET *cset,
 			     KERNEL_PARM *kparm);
+KERNEL_BLOCK *create_constraint_kernel_block(DOC *lhs, KERNEL_PARM *kparm);
 /*
 SVECTOR *find_reduced_set_approximation(SVECTOR *psi,long rsize,KERNEL_PARM *kparm,STRUCTMODEL *sm);
 double *compute_expansion_coefficients(SVECTOR *psi,long rsize,SVECTOR **expansion,KERNEL_PARM *kparm);
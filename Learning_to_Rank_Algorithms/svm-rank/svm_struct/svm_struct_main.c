@@ -34,14 +34,94 @@ extern "C" {
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/select.h>
 /* } */
 
-char trainfile[200];           /* file with training examples */
+#define MAX(x,y)      ((x) < (y) ? (y) : (x))
+
+#define STOP_FOLD     -1       /* commands to a waiting fold process */
+#define SAVE_FOLD     -2
+
+char trainfile[1000];          /* file with training examples */
 char modelfile[200];           /* file for resulting classifier */
 
+#define MAX_SWEEP 100          /* maximum number of values for -c and -g */
+double sweep_C[MAX_SWEEP];     /* values of C to train with */
+double sweep_gamma[MAX_SWEEP]; /* values of gamma to train with */
+int    sweep_C_n=0,sweep_gamma_n=0;
+
+long   cv_folds=0;             /* --cv: number of cross-validation folds */
+long   cv_workers=0;           /* --jobs: folds trained at a time, 0 for
+				  one per CPU */
+double cv_memory=0;            /* --memory: megabytes that the folds
+				  trained at a time may use, 0 for no
+				  limit */
+char   cv_metric_name[20]="MAP"; /* --metric: retrieval measure that
+				    selects the best C and gamma */
+int    cv_metric=METRIC_MAP;
+long   cv_metric_k=0;
+double cv_halving=0;           /* --halving: keep the best 1/cv_halving of
+				  the combinations of C and gamma after
+				  each round of successive halving, 0 to
+				  train all of them to epsilon */
+long   cv_budget=10;           /* --budget: iterations of the first round
+				  of successive halving */
+long   cv_tidy=0;              /* --tidy: remove the fold files of all
+				  combinations but the best */
+
+typedef struct cv_result {
+  /* what the process that trains a fold reports back */
+  long   queries,docs;         /* held-out queries and their documents */
+  double avgloss;              /* average loss on the held-out queries */
+  double zeroone;              /* fraction of held-out rankings with loss */
+  double swappedpairs;         /* total number of swapped pairs */
+  double fracswappedpairs;     /* swapped pairs per ranking, averaged */
+  double metric;               /* retrieval measure cv_metric, averaged */
+  double runtime;              /* training time in cpu-seconds */
+  double cpu;                  /* cpu-seconds of the process(es) that
+				  trained the fold, from getrusage */
+  double memory;               /* megabytes the process used at most */
+  int    converged;            /* 0, if training stopped at the
+				  iteration limit of a round */
+  int    waiting;              /* 1, if the process waits for the budget
+				  of the next round */
+} CV_RESULT;
+
+typedef struct fold_worker {
+  /* the process that trains a fold, kept from one round of
+     successive halving to the next */
+  pid_t  pid;                  /* 0, if there is none */
+  int    cmd,res;              /* pipes to and from it */
+  int    training;             /* 0, while it waits */
+  double memory;               /* megabytes it is expected to use */
+  double cpu;                  /* cpu-seconds of the earlier processes of
+				  the fold */
+} FOLD_WORKER;
+
 void   read_input_parameters(int, char **, char *, char *,long *, long *,
 			     STRUCT_LEARN_PARM *, LEARN_PARM *, KERNEL_PARM *,
 			     int *);
+int    parse_value_list(char *, double *, int);
+void   train_struct_model(SAMPLE, STRUCT_LEARN_PARM *, LEARN_PARM *, 
+			  KERNEL_PARM *, STRUCTMODEL *, int, WARM_START *);
+int    compare_values(const void *, const void *);
+SAMPLE read_fold_files(char *, STRUCT_LEARN_PARM *, long **);
+void   cross_validate(SAMPLE, long *, STRUCT_LEARN_PARM *, LEARN_PARM *,
+		      KERNEL_PARM *, int);
+void   run_fold_jobs(SAMPLE, long *, STRUCT_LEARN_PARM *, LEARN_PARM *,
+		     KERNEL_PARM *, int, long *, long, long, long, long,
+		     CV_RESULT *, FOLD_WORKER *, double *, double *, FILE *);
+void   stop_fold_worker(FOLD_WORKER *, long);
+void   report_combination(long, long, long, CV_RESULT *, double *, FILE *);
+void   train_fold(SAMPLE, long *, long, STRUCT_LEARN_PARM *, LEARN_PARM *,
+		  KERNEL_PARM *, int, char *, long, int, CV_RESULT *, int,
+		  int);
+void   grid_file(char *, long);
+void   remove_grid_files(long);
+double fold_memory_estimate(SAMPLE);
 void   wait_any_key();
 void   print_help();
 
@@ -54,6 +134,14 @@ int main (int argc, char* argv[])
   STRUCT_LEARN_PARM struct_parm;
   STRUCTMODEL structmodel;
   int alg_type;
+  int ic,ig;
+  LEARN_PARM sweep_lparm;
+  KERNEL_PARM sweep_kparm;
+  STRUCT_LEARN_PARM sweep_sparm;
+  char sweep_modelfile[300];
+  WARM_START warm;
+  long i,j,*fold;
+  double epsilon;
 
   svm_struct_learn_api_init(argc,argv);
 
@@ -61,6 +149,47 @@ int main (int argc, char* argv[])
 			&struct_verbosity,&struct_parm,&learn_parm,
 			&kernel_parm,&alg_type);
 
+  if(cv_folds) {
+    /* The examples are read once. Query i is held out in fold
+       i mod cv_folds, or, with a comma separated list of files, the
+       queries of the k-th file are held out in fold k. Each
+       combination of C and gamma is cross-validated. */
+    if(struct_verbosity>=1) {
+      printf("Reading training examples..."); fflush(stdout);
+    }
+    epsilon=struct_parm.epsilon;
+    if(strchr(trainfile,','))
+      sample=read_fold_files(trainfile,&struct_parm,&fold);
+    else {
+      sample=read_struct_examples(trainfile,&struct_parm);
+      fold=(long *)my_malloc(sizeof(long)*(sample.n+1));
+      for(i=0;i<sample.n;i++)
+	fold[i]=i%cv_folds;
+    }
+    struct_parm.epsilon=epsilon; /* each fold adjusts it to its queries */
+    if(struct_verbosity>=1) {
+      printf("done\n"); fflush(stdout);
+    }
+    if(sample.n < cv_folds) {
+      printf("\nThere are only %d queries for %ld folds!\n\n",sample.n,
+	     cv_folds);
+      exit(1);
+    }
+    for(j=0;j<cv_folds;j++) {
+      for(i=0;(i<sample.n) && (fold[i] != j);i++);
+      if(i == sample.n) {
+	printf("\nFold %ld has no queries!\n\n",j+1);
+	exit(1);
+      }
+    }
+    cross_validate(sample,fold,&struct_parm,&learn_parm,&kernel_parm,
+		   alg_type);
+    free(fold);
+    free_struct_sample(sample);
+    svm_struct_learn_api_exit();
+    return 0;
+  }
+
    if(struct_verbosity>=1) {
     printf("Reading training examples..."); fflush(stdout);
   }
@@ -70,39 +199,790 @@ int main (int argc, char* argv[])
     printf("done\n"); fflush(stdout);
   }
   
-  /* Do the learning and return structmodel. */
+  if((sweep_C_n == 1) && (sweep_gamma_n == 1)) {
+    /* Do the learning and return structmodel. */
+    train_struct_model(sample,&struct_parm,&learn_parm,&kernel_parm,
+		       &structmodel,alg_type,NULL);
+
+    /* Warning: The model contains references to the original data 'docs'.
+       If you want to free the original data, and only keep the model, you 
+       have to make a deep copy of 'model'. */
+    if(struct_verbosity>=1) {
+      printf("Writing learned model...");fflush(stdout);
+    }
+    write_struct_model(modelfile,&structmodel,&struct_parm);
+    if(struct_verbosity>=1) {
+      printf("done\n");fflush(stdout);
+    }
+    free_struct_model(structmodel);
+  }
+  else {
+    /* Train one model for each combination of C and gamma on the
+       same sample. The kernel store that the first run computes is
+       handed on to the following runs. For a given gamma, the values
+       of C are trained in increasing order, each starting from the
+       working set and constraint cache of the one before. */
+    struct_parm.reuse_sample=1;
+    init_warm_start(&warm);
+    for(ig=0;ig<sweep_gamma_n;ig++) {
+      if(kernel_parm.store && (kernel_parm.kernel_type == CUSTOM)) {
+	free_kernel_store(kernel_parm.store); /* may depend on gamma */
+	kernel_parm.store=NULL;
+      }
+      free_warm_start(&warm);   /* constraints depend on gamma */
+      for(ic=0;ic<sweep_C_n;ic++) {
+	sweep_sparm=struct_parm;
+	sweep_lparm=learn_parm;
+	sweep_kparm=kernel_parm;
+	sweep_sparm.C=sweep_C[ic];
+	sweep_kparm.rbf_gamma=sweep_gamma[ig];
+	strcpy(sweep_modelfile,modelfile);
+	if(sweep_C_n > 1)
+	  sprintf(sweep_modelfile+strlen(sweep_modelfile),".c%g",sweep_C[ic]);
+	if(sweep_gamma_n > 1)
+	  sprintf(sweep_modelfile+strlen(sweep_modelfile),".g%g",
+		  sweep_gamma[ig]);
+	if(struct_verbosity>=1) 
+	  printf("Training with C=%g, gamma=%g (model %s)\n",sweep_C[ic],
+		 sweep_gamma[ig],sweep_modelfile);
+	train_struct_model(sample,&sweep_sparm,&sweep_lparm,&sweep_kparm,
+			   &structmodel,alg_type,&warm);
+	kernel_parm.store=sweep_kparm.store;
+	if(struct_verbosity>=1) {
+	  printf("Writing learned model...");fflush(stdout);
+	}
+	write_struct_model(sweep_modelfile,&structmodel,&sweep_sparm);
+	if(struct_verbosity>=1) {
+	  printf("done\n");fflush(stdout);
+	}
+	free_struct_model(structmodel);
+      }
+    }
+    free_warm_start(&warm);
+  }
+
+  if(kernel_parm.store)
+    free_kernel_store(kernel_parm.store);
+  free_struct_sample(sample);
+
+  svm_struct_learn_api_exit();
+
+  return 0;
+}
+
+void train_struct_model(SAMPLE sample, STRUCT_LEARN_PARM *sparm,
+			LEARN_PARM *lparm, KERNEL_PARM *kparm,
+			STRUCTMODEL *sm, int alg_type, WARM_START *warm)
+     /* runs the learning algorithm selected by alg_type. The one-slack
+	algorithms start from and update warm, unless it is NULL. */
+{
+  reset_qp_optimizer();
   if(alg_type == 0)
-    svm_learn_struct(sample,&struct_parm,&learn_parm,&kernel_parm,&structmodel,NSLACK_ALG);
+    svm_learn_struct(sample,sparm,lparm,kparm,sm,NSLACK_ALG);
   else if(alg_type == 1)
-    svm_learn_struct(sample,&struct_parm,&learn_parm,&kernel_parm,&structmodel,NSLACK_SHRINK_ALG);
+    svm_learn_struct(sample,sparm,lparm,kparm,sm,NSLACK_SHRINK_ALG);
   else if(alg_type == 2)
-    svm_learn_struct_joint(sample,&struct_parm,&learn_parm,&kernel_parm,&structmodel,ONESLACK_PRIMAL_ALG);
+    svm_learn_struct_joint_warm(sample,sparm,lparm,kparm,sm,ONESLACK_PRIMAL_ALG,
+				warm);
   else if(alg_type == 3)
-    svm_learn_struct_joint(sample,&struct_parm,&learn_parm,&kernel_parm,&structmodel,ONESLACK_DUAL_ALG);
+    svm_learn_struct_joint_warm(sample,sparm,lparm,kparm,sm,ONESLACK_DUAL_ALG,
+				warm);
   else if(alg_type == 4)
-    svm_learn_struct_joint(sample,&struct_parm,&learn_parm,&kernel_parm,&structmodel,ONESLACK_DUAL_CACHE_ALG);
+    svm_learn_struct_joint_warm(sample,sparm,lparm,kparm,sm,ONESLACK_DUAL_CACHE_ALG,
+				warm);
   else if(alg_type == 9)
-    svm_learn_struct_joint_custom(sample,&struct_parm,&learn_parm,&kernel_parm,&structmodel);
+    svm_learn_struct_joint_custom(sample,sparm,lparm,kparm,sm);
   else
     exit(1);
+}
 
-  /* Warning: The model contains references to the original data 'docs'.
-     If you want to free the original data, and only keep the model, you 
-     have to make a deep copy of 'model'. */
-  if(struct_verbosity>=1) {
-    printf("Writing learned model...");fflush(stdout);
+SAMPLE read_fold_files(char *list, STRUCT_LEARN_PARM *sparm, long **fold)
+     /* reads the examples of the comma separated files in list into
+	one sample. fold[i] is the position in list of the file that
+	query i comes from. */
+{
+  SAMPLE sample,part;
+  char *file,*copy;
+  long k,i;
+
+  copy=(char *)my_malloc(strlen(list)+1);
+  strcpy(copy,list);
+  sample.n=0;
+  sample.examples=NULL;
+  (*fold)=NULL;
+  for(k=0,file=strtok(copy,",");file;k++,file=strtok(NULL,",")) {
+    part=read_struct_examples(file,sparm);
+    sample.examples=(EXAMPLE *)realloc(sample.examples,
+				       sizeof(EXAMPLE)*(sample.n+part.n));
+    (*fold)=(long *)realloc(*fold,sizeof(long)*(sample.n+part.n));
+    for(i=0;i<part.n;i++) {
+      sample.examples[sample.n]=part.examples[i];
+      (*fold)[sample.n++]=k;
+    }
+    free(part.examples);
+  }
+  free(copy);
+  if(k != cv_folds) {
+    printf("\n%ld files are given for %ld folds (--cv)!\n\n",k,cv_folds);
+    exit(1);
+  }
+  return(sample);
+}
+
+void cross_validate(SAMPLE sample, long *fold, STRUCT_LEARN_PARM *sparm,
+		    LEARN_PARM *lparm, KERNEL_PARM *kparm, int alg_type)
+     /* trains and tests one model for each fold and each combination
+	of C and gamma. The model of fold k is written to
+	model_file.fold<k>, the predictions for its held-out queries to
+	model_file.fold<k>.predictions, and its output to
+	model_file.fold<k>.log. With several values of C or gamma,
+	model_file is extended by .c<C> and .g<gamma>, each combination
+	is reported in model_file.results as soon as its folds are
+	done, and with cv_tidy only the files of the best combination
+	are kept.
+	With cv_halving, all combinations are first trained for
+	cv_budget iterations. After each round, the best 1/cv_halving
+	of them are kept and continue from their working sets for
+	cv_halving times as many iterations, until one is left, which
+	is then trained to epsilon. The cpu time that training all
+	combinations to epsilon would have taken is projected from the
+	first round. */
+{
+  CV_RESULT *result,*first=NULL;
+  FOLD_WORKER *worker;
+  long f,k,c,i,j,configs,n,*config,best,round,iterations,done_iterations;
+  double v[5],mean[5],sdev[5],*cmean,estimate,cpu=0,cpu1,cpun,exhaustive;
+  char prefix[600];
+  FILE *resfl=NULL;
+
+  configs=sweep_C_n*sweep_gamma_n;
+  result=(CV_RESULT *)my_malloc(sizeof(CV_RESULT)*configs*cv_folds);
+  for(j=0;j<configs*cv_folds;j++) {
+    result[j].runtime=result[j].cpu=0;
+    result[j].converged=0;
+  }
+  worker=(FOLD_WORKER *)my_malloc(sizeof(FOLD_WORKER)*configs*cv_folds);
+  for(j=0;j<configs*cv_folds;j++) 
+    worker[j].pid=0;
+  cmean=(double *)my_malloc(sizeof(double)*configs);
+  config=(long *)my_malloc(sizeof(long)*configs);
+  for(c=0;c<configs;c++)
+    config[c]=c;
+  n=configs;
+  estimate=fold_memory_estimate(sample);
+  if(configs > 1) {
+    sprintf(prefix,"%s.results",modelfile);
+    if ((resfl = fopen (prefix, "w")) == NULL)
+    { perror (prefix); exit (1); }
+    fprintf(resfl,"# %sC\tgamma\t%s\tsdev\tavgloss\tcpu-seconds\n",
+	    cv_halving ? "round\titerations\t" : "",cv_metric_name);
+    fflush(resfl);
+  }
+
+  if((!cv_halving) || (configs == 1)) {
+    run_fold_jobs(sample,fold,sparm,lparm,kparm,alg_type,config,n,0,0,0,
+		  result,worker,cmean,&estimate,resfl);
+    /* like Search.java, keep the first combination with the best
+       mean over the folds */
+    for(c=1,best=0;c<configs;c++)
+      if(cmean[c] > cmean[best])
+	best=c;
+    for(c=0;c<configs;c++)
+      if(c != best)
+	remove_grid_files(c);
+  }
+  else {
+    for(round=1,iterations=cv_budget,done_iterations=0;;round++) {
+      if(struct_verbosity>=1) {
+	if(n > 1)
+	  printf("Round %ld: %ld combinations of C and gamma, %ld iterations\n",
+		 round,n,iterations);
+	else
+	  printf("Round %ld: training the best combination to epsilon\n",round);
+	fflush(stdout);
+      }
+      if(n == 1)
+	iterations=done_iterations=0;
+      run_fold_jobs(sample,fold,sparm,lparm,kparm,alg_type,config,n,
+		    iterations-done_iterations,iterations,round,result,worker,
+		    cmean,&estimate,resfl);
+      if(n == 1)
+	break;
+      if(round == 1) {
+	first=(CV_RESULT *)my_malloc(sizeof(CV_RESULT)*configs*cv_folds);
+	memcpy(first,result,sizeof(CV_RESULT)*configs*cv_folds);
+      }
+      /* order the combinations by their mean, the first of equal ones
+	 in front */
+      for(i=1;i<n;i++) 
+	for(j=i;(j>0) && (cmean[config[j]] > cmean[config[j-1]]);j--) {
+	  c=config[j];
+	  config[j]=config[j-1];
+	  config[j-1]=c;
+	}
+      k=maxl(1,(long)(n/cv_halving));
+      for(i=k;i<n;i++) {
+	for(f=0;f<cv_folds;f++)
+	  stop_fold_worker(&worker[config[i]*cv_folds+f],STOP_FOLD);
+	remove_grid_files(config[i]);
+      }
+      n=k;
+      done_iterations=iterations;
+      iterations=(long)(iterations*cv_halving);
+    }
+    best=config[0];
+  }
+
+  for(j=0;j<configs*cv_folds;j++) 
+    cpu+=result[j].cpu;
+  if(configs > 1) {
+    fclose(resfl);
+    grid_file(prefix,best);
+    printf("Best: C=%g, gamma=%g with %s %.5f (models %s.fold<k>, all results in %s.results)\n",
+	   sweep_C[best%sweep_C_n],sweep_gamma[best/sweep_C_n],cv_metric_name,
+	   cmean[best],prefix,modelfile);
+    if(first) {
+      /* a fold that was dropped before it converged would have taken
+	 as much longer than its round 1 as the folds that were trained
+	 on until they converged */
+      for(j=0,cpu1=cpun=0;j<configs*cv_folds;j++) 
+	if((!first[j].converged) && result[j].converged) {
+	  cpu1+=first[j].cpu;
+	  cpun+=result[j].cpu;
+	}
+      for(j=0,exhaustive=0;j<configs*cv_folds;j++) 
+	if(result[j].converged || (cpu1 <= 0))
+	  exhaustive+=result[j].cpu;
+	else
+	  exhaustive+=MAX(result[j].cpu,first[j].cpu*cpun/cpu1);
+      printf("Total: %.2f cpu-seconds for %ld combinations of C and gamma (training all of them to epsilon: %s %.0f cpu-seconds, projected from round 1)\n",
+	     cpu,configs,(cpu1 > 0) ? "about" : "at least",exhaustive);
+      free(first);
+    }
+    else
+      printf("Total: %.2f cpu-seconds for %ld combinations of C and gamma\n",
+	     cpu,configs);
+  }
+  else {
+    /* mean and standard deviation over the folds of average loss,
+       zero/one-error, swapped pairs, retrieval measure and training
+       time */
+    for(k=0;k<5;k++) 
+      mean[k]=sdev[k]=0;
+    for(f=0;f<cv_folds;f++) {
+      printf("Fold %ld: %ld queries, %ld documents: average loss %.4f, zero/one-error %.2f%%, swapped pairs %.2f%% (%.0f), %s %.4f, %.2f cpu-seconds\n",
+	     f+1,result[f].queries,result[f].docs,result[f].avgloss,
+	     100.0*result[f].zeroone,100.0*result[f].fracswappedpairs,
+	     result[f].swappedpairs,cv_metric_name,result[f].metric,
+	     result[f].runtime);
+      v[0]=result[f].avgloss;
+      v[1]=100.0*result[f].zeroone;
+      v[2]=100.0*result[f].fracswappedpairs;
+      v[3]=result[f].metric;
+      v[4]=result[f].runtime;
+      for(k=0;k<5;k++) {
+	mean[k]+=v[k]/cv_folds;
+	sdev[k]+=v[k]*v[k];
+      }
+    }
+    for(k=0;k<5;k++) 
+      sdev[k]=sqrt(MAX(0,(sdev[k]-cv_folds*mean[k]*mean[k])/(cv_folds-1)));
+    printf("Mean over %ld folds: average loss %.4f (+-%.4f), zero/one-error %.2f%% (+-%.2f), swapped pairs %.2f%% (+-%.2f), %s %.4f (+-%.4f), %.2f cpu-seconds\n",
+	   cv_folds,mean[0],sdev[0],mean[1],sdev[1],mean[2],sdev[2],
+	   cv_metric_name,mean[3],sdev[3],mean[4]);
+  }
+  free(result);
+  free(worker);
+  free(cmean);
+  free(config);
+}
+
+void run_fold_jobs(SAMPLE sample, long *fold, STRUCT_LEARN_PARM *sparm,
+		   LEARN_PARM *lparm, KERNEL_PARM *kparm, int alg_type,
+		   long *config, long n, long budget, long iterations,
+		   long round, CV_RESULT *result, FOLD_WORKER *worker,
+		   double *cmean, double *estimate, FILE *resfl)
+     /* trains the folds of the n combinations of C and gamma in
+	config for at most budget more iterations (0 for no limit).
+	Each fold runs in a process of its own, cv_workers at a time, or
+	as many as there are CPUs. With cv_halving, the process of a
+	fold that has not converged waits in worker for the next round
+	and continues from its working set in memory. A fold whose
+	process has ended resumes from the working set it saved. If
+	cv_memory is set, a process is only started if the megabytes
+	that it and the running and waiting ones are expected to use
+	fit into it. If nothing else is running, waiting processes are
+	told to save their working sets and end to make room. The
+	processes share the examples read by this one, and the changes
+	that training makes to them stay in the process. Folds that
+	have converged in an earlier round are not trained again. */
+{
+  CV_RESULT *r,prev;
+  FOLD_WORKER *w;
+  pid_t p;
+  fd_set ready;
+  int fd[2],cmd[2],status,maxfd;
+  long f,c,j,i,*job,started=0,running=0,workers,jobs=0,*done,all;
+  double inuse=0;
+  char prefix[600];
+
+  job=(long *)my_malloc(sizeof(long)*n*cv_folds);
+  done=(long *)my_malloc(sizeof(long)*n);
+  all=sweep_C_n*sweep_gamma_n*cv_folds;
+  for(j=0;j<all;j++) 
+    if(worker[j].pid)
+      inuse+=worker[j].memory;
+  for(i=0;i<n;i++) {
+    done[i]=0;
+    for(f=0;f<cv_folds;f++) {
+      if(result[config[i]*cv_folds+f].converged)
+	done[i]++;
+      else
+	job[jobs++]=config[i]*cv_folds+f;
+    }
+    if(done[i] == cv_folds)
+      report_combination(config[i],round,iterations,result,cmean,resfl);
+  }
+  if(cv_workers)
+    workers=cv_workers;
+  else
+    workers=maxl(1,minl(sysconf(_SC_NPROCESSORS_ONLN),jobs));
+  if((struct_verbosity>=1) && (n == 1) && (!round)) 
+    printf("Training %ld folds, %ld at a time (output in %s.fold<k>.log)\n",
+	   cv_folds,workers,modelfile);
+  else if((struct_verbosity>=1) && (!round)) 
+    printf("Training %ld folds for %ld combinations of C and gamma, %ld at a time\n",
+	   cv_folds,n,workers);
+  fflush(stdout);
+
+  while((started < jobs) || (running > 0)) {
+    /* start jobs in the order of config, one fold after the other */
+    while((started < jobs) && (running < workers)) {
+      w=&worker[job[started]];
+      c=job[started]/cv_folds;
+      f=job[started]%cv_folds;
+      if(w->pid) {
+	if(write(w->cmd,&budget,sizeof(long)) != sizeof(long))
+	{ perror ("write"); exit (1); }
+      }
+      else if((cv_memory > 0) && (inuse+(*estimate) > cv_memory)
+	      && (running > 0))
+	break;
+      else if((cv_memory > 0) && (inuse+(*estimate) > cv_memory)
+	      && (inuse > 0)) {
+	/* only waiting processes are left */
+	for(j=0;(j<all) && ((!worker[j].pid) || worker[j].training);j++);
+	inuse-=worker[j].memory;
+	stop_fold_worker(&worker[j],SAVE_FOLD);
+	continue;
+      }
+      else {
+	if(pipe(fd) || pipe(cmd)) 
+	{ perror ("pipe"); exit (1); }
+	fflush(stdout); /* or the child prints it again */
+	if((p=fork()) < 0)
+	{ perror ("fork"); exit (1); }
+	if(p == 0) {
+	  close(fd[0]);
+	  close(cmd[1]);
+	  for(j=0;j<all;j++) 
+	    if(worker[j].pid) {
+	      close(worker[j].cmd);
+	      close(worker[j].res);
+	    }
+	  sparm->C=sweep_C[c%sweep_C_n];
+	  kparm->rbf_gamma=sweep_gamma[c/sweep_C_n];
+	  grid_file(prefix,c);
+	  train_fold(sample,fold,f,sparm,lparm,kparm,alg_type,prefix,budget,
+		     (round > 1),&result[job[started]],fd[1],cmd[0]);
+	}
+	close(fd[1]);
+	close(cmd[0]);
+	w->pid=p;
+	w->res=fd[0];
+	w->cmd=cmd[1];
+	w->memory=(*estimate);
+	w->cpu=result[job[started]].cpu;
+	inuse+=w->memory;
+      }
+      w->training=1;
+      started++;
+      running++;
+    }
+    /* wait for the result of one of the running jobs */
+    FD_ZERO(&ready);
+    for(j=0,maxfd=0;j<started;j++) 
+      if(worker[job[j]].pid && worker[job[j]].training) {
+	FD_SET(worker[job[j]].res,&ready);
+	maxfd=MAX(maxfd,worker[job[j]].res);
+      }
+    if(select(maxfd+1,&ready,NULL,NULL,NULL) < 0)
+    { perror ("select"); exit (1); }
+    for(j=0;(j<started) && ((!worker[job[j]].pid) || (!worker[job[j]].training)
+			    || (!FD_ISSET(worker[job[j]].res,&ready)));j++);
+    w=&worker[job[j]];
+    c=job[j]/cv_folds;
+    f=job[j]%cv_folds;
+    for(i=0;config[i] != c;i++);
+    r=&result[job[j]];
+    prev=(*r);
+    w->training=0;
+    running--;
+    if(read(w->res,r,sizeof(CV_RESULT)) != sizeof(CV_RESULT)) {
+      grid_file(prefix,c);
+      printf("\nTraining fold %ld failed (see %s.fold%ld.log)!\n\n",f+1,
+	     prefix,f+1);
+      exit(1);
+    }
+    r->runtime+=prev.runtime;
+    r->cpu+=w->cpu;
+    /* the largest job so far is the estimate for the next ones */
+    (*estimate)=MAX((*estimate),r->memory);
+    if(r->waiting) {
+      inuse+=MAX(0,r->memory-w->memory);
+      w->memory=MAX(w->memory,r->memory);
+    }
+    else {
+      if((waitpid(w->pid,&status,0) < 0) || (!WIFEXITED(status))
+	 || WEXITSTATUS(status)) {
+	grid_file(prefix,c);
+	printf("\nTraining fold %ld failed (see %s.fold%ld.log)!\n\n",f+1,
+	       prefix,f+1);
+	exit(1);
+      }
+      close(w->res);
+      close(w->cmd);
+      w->pid=0;
+      inuse-=w->memory;
+    }
+    if((struct_verbosity>=1) && (n == 1) && (!round)) {
+      printf("Fold %ld done.\n",f+1); fflush(stdout);
+    }
+    if(++done[i] == cv_folds)
+      report_combination(c,round,iterations,result,cmean,resfl);
+  }
+  free(job);
+  free(done);
+}
+
+void stop_fold_worker(FOLD_WORKER *w, long command)
+     /* tells the waiting process w to end, after saving the working
+	set of its fold if command is SAVE_FOLD, and waits for it */
+{
+  int status;
+
+  if(!w->pid)
+    return;
+  if((write(w->cmd,&command,sizeof(long)) != sizeof(long))
+     || (waitpid(w->pid,&status,0) < 0) || (!WIFEXITED(status))
+     || WEXITSTATUS(status)) {
+    printf("\nA fold process failed to end!\n\n");
+    exit(1);
   }
-  write_struct_model(modelfile,&structmodel,&struct_parm);
+  close(w->res);
+  close(w->cmd);
+  w->pid=0;
+}
+
+void report_combination(long c, long round, long iterations, 
+			CV_RESULT *result, double *cmean, FILE *resfl)
+     /* puts the mean over the folds of combination c of C and gamma
+	into cmean[c], and reports it in resfl, unless that is NULL */
+{
+  CV_RESULT *r;
+  long f,k;
+  double v[3],mean[3],sdev[3];
+
+  r=result+c*cv_folds;
+  for(k=0;k<3;k++) 
+    mean[k]=sdev[k]=0;
+  for(f=0;f<cv_folds;f++) {
+    v[0]=r[f].metric;
+    v[1]=r[f].avgloss;
+    v[2]=r[f].cpu;
+    for(k=0;k<3;k++) {
+      mean[k]+=v[k]/cv_folds;
+      sdev[k]+=v[k]*v[k];
+    }
+  }
+  sdev[0]=sqrt(MAX(0,(sdev[0]-cv_folds*mean[0]*mean[0])/(cv_folds-1)));
+  cmean[c]=mean[0];
+  if(!resfl)
+    return;
+  if(round)
+    fprintf(resfl,"%ld\t%ld\t",round,iterations);
+  fprintf(resfl,"%g\t%g\t%.5f\t%.5f\t%.5f\t%.2f\n",
+	  sweep_C[c%sweep_C_n],sweep_gamma[c/sweep_C_n],mean[0],sdev[0],
+	  mean[1],mean[2]*cv_folds);
+  fflush(resfl);
   if(struct_verbosity>=1) {
-    printf("done\n");fflush(stdout);
+    printf("C=%g, gamma=%g: %s %.5f (+-%.5f), average loss %.4f, %.2f cpu-seconds\n",
+	   sweep_C[c%sweep_C_n],sweep_gamma[c/sweep_C_n],cv_metric_name,
+	   mean[0],sdev[0],mean[1],mean[2]*cv_folds);
+    fflush(stdout);
   }
+}
 
-  free_struct_sample(sample);
-  free_struct_model(structmodel);
+void grid_file(char *file, long c)
+     /* writes the start of the file names of combination c of C and
+	gamma to file */
+{
+  strcpy(file,modelfile);
+  if(sweep_C_n > 1)
+    sprintf(file+strlen(file),".c%g",sweep_C[c%sweep_C_n]);
+  if(sweep_gamma_n > 1)
+    sprintf(file+strlen(file),".g%g",sweep_gamma[c/sweep_C_n]);
+}
 
-  svm_struct_learn_api_exit();
+void remove_grid_files(long c)
+     /* removes the working sets of the folds of combination c of C and
+	gamma, and with cv_tidy also their models, predictions and
+	logs */
+{
+  char prefix[600],file[700];
+  long f;
 
-  return 0;
+  grid_file(prefix,c);
+  for(f=0;f<cv_folds;f++) {
+    sprintf(file,"%s.fold%ld.state",prefix,f+1);
+    remove(file);
+    if(!cv_tidy)
+      continue;
+    sprintf(file,"%s.fold%ld",prefix,f+1);
+    remove(file);
+    sprintf(file,"%s.fold%ld.predictions",prefix,f+1);
+    remove(file);
+    sprintf(file,"%s.fold%ld.log",prefix,f+1);
+    remove(file);
+  }
+}
+
+double fold_memory_estimate(SAMPLE sample)
+     /* megabytes a fold is expected to use before one has been
+	trained: twice the size of the examples, since training
+	changes most of them in its copy of the process */
+{
+  long i,j;
+  double bytes=0;
+  SVECTOR *f;
+  WORD *w;
+
+  for(i=0;i<sample.n;i++) 
+    for(j=0;j<sample.examples[i].x.totdoc;j++) {
+      bytes+=sizeof(DOC);
+      for(f=sample.examples[i].x.doc[j]->fvec;f;f=f->next) {
+	bytes+=sizeof(SVECTOR)+sizeof(WORD);
+	for(w=f->words;w->wnum;w++)
+	  bytes+=sizeof(WORD);
+      }
+    }
+  return(2*bytes/1024.0/1024.0);
+}
+
+void train_fold(SAMPLE sample, long *fold, long f, STRUCT_LEARN_PARM *sparm,
+		LEARN_PARM *lparm, KERNEL_PARM *kparm, int alg_type,
+		char *prefix, long budget, int resume, CV_RESULT *r,
+		int resfd, int cmdfd)
+     /* trains the model of fold f on the queries of all other folds
+	for at most budget iterations (0 for no limit), scores the
+	queries of fold f with it, and writes r to resfd. Its files are
+	named prefix.fold<f>. With cv_halving, training resumes from
+	the working set saved in prefix.fold<f>.state, if resume is
+	set. Unless the fold has converged, the process then reads the
+	budget of the next round from cmdfd and continues from the
+	working set in memory, until it reads STOP_FOLD, or SAVE_FOLD,
+	which saves the working set first. If training has replaced the
+	kernel by a linear one (--t or the expansion of -d 2), the
+	working set is saved at once, since a new process has to map
+	the examples again. Runs in a process of its own and ends it. */
+{
+  SAMPLE train,test;
+  STRUCTMODEL sm;
+  STRUCT_LEARN_PARM tparm;
+  STRUCT_TEST_STATS teststats;
+  LABEL y,ytrue;
+  WARM_START warm;
+  FILE *predfl;
+  struct rusage usage;
+  char file[700],state[700];
+  long i,j,k,totdoc=0,kernel_type;
+  double sumpairs=0,l,t1;
+  WORD *w;
+
+  sprintf(file,"%s.fold%ld.log",prefix,f+1);
+  if(freopen(file,resume ? "a" : "w",stdout) == NULL)
+  { perror (file); exit (1); }
+
+  train.n=test.n=0;
+  train.examples=(EXAMPLE *)my_malloc(sizeof(EXAMPLE)*sample.n);
+  test.examples=(EXAMPLE *)my_malloc(sizeof(EXAMPLE)*sample.n);
+  for(i=0;i<sample.n;i++) {
+    if(fold[i] == f) {
+      test.examples[test.n++]=sample.examples[i];
+      continue;
+    }
+    train.examples[train.n++]=sample.examples[i];
+    /* number the documents as if they had been read from a training
+       file of their own */
+    for(j=0;j<sample.examples[i].x.totdoc;j++) {
+      sample.examples[i].x.doc[j]->docnum=totdoc;
+      sample.examples[i].x.doc[j]->kernelid=totdoc++;
+    }
+    ytrue=sample.examples[i].y;
+    for(j=0;j<ytrue.totdoc;j++)
+      for(k=0;k<ytrue.totdoc;k++)
+	if(ytrue.class[j] > ytrue.class[k])
+	  sumpairs++;
+  }
+  /* the adjustment of read_struct_examples for the training queries */
+  if(sparm->loss_function == SWAPPEDPAIRS)
+    sparm->epsilon*=sumpairs/(double)train.n;
+
+  init_warm_start(&warm);
+  sprintf(state,"%s.fold%ld.state",prefix,f+1);
+  if(resume && (!read_warm_start(state,&warm))) {
+    printf("\nCannot read working set %s!\n\n",state);
+    exit(1);
+  }
+  kernel_type=kparm->kernel_type;
+  for(;;) {
+    sparm->max_iterations=budget;
+    t1=get_runtime();
+    train_struct_model(train,sparm,lparm,kparm,&sm,alg_type,
+		       cv_halving ? &warm : NULL);
+    r->runtime=(get_runtime()-t1)/100.0;
+    r->converged=1;
+    r->waiting=0;
+    if(cv_halving) {
+      r->converged=warm.converged;
+      if(warm.converged)
+	remove(state);
+      else if(budget && (kparm->kernel_type == kernel_type))
+	r->waiting=1;
+      else
+	write_warm_start(state,&warm);
+    }
+    sprintf(file,"%s.fold%ld",prefix,f+1);
+    write_struct_model(file,&sm,sparm);
+    free_struct_model(sm);
+
+    /* score the held-out queries with the model as written, the same
+       way svm_rank_classify does */
+    tparm=(*sparm);
+    sm=read_struct_model(file,&tparm);
+    if(sm.svm_model->kernel_parm.kernel_type == LINEAR) {
+      add_weight_vector_to_linear_model(sm.svm_model);
+      sm.w=sm.svm_model->lin_weights;
+    }
+    sprintf(file,"%s.fold%ld.predictions",prefix,f+1);
+    if ((predfl = fopen (file, "w")) == NULL)
+    { perror (file); exit (1); }
+    r->queries=test.n;
+    r->docs=0;
+    r->avgloss=0;
+    r->zeroone=0;
+    r->metric=0;
+    memset(&teststats,0,sizeof(teststats));
+    for(i=0;i<test.n;i++) {
+      for(j=0;j<test.examples[i].x.totdoc;j++)
+	for(w=test.examples[i].x.doc[j]->fvec->words;w->wnum;w++)
+	  if(w->wnum>tparm.num_features) {
+	    w->wnum=0;
+	    w->weight=0;
+	  }
+      y=classify_struct_example(test.examples[i].x,&sm,&tparm);
+      write_label(predfl,y);
+      l=loss(test.examples[i].y,y,&tparm);
+      r->avgloss+=l/test.n;
+      if(l != 0) 
+	r->zeroone+=1.0/test.n;
+      r->metric+=ranking_metric(test.examples[i].y,y,cv_metric,
+				cv_metric_k)/test.n;
+      eval_prediction(i,test.examples[i],y,&sm,&tparm,&teststats);
+      r->docs+=y.totdoc;
+      free_label(y);
+    }
+    fclose(predfl);
+    r->swappedpairs=teststats.swappedpairs;
+    r->fracswappedpairs=teststats.fracswappedpairs/test.n;
+    free_struct_model(sm);
+    fflush(stdout);
+
+    getrusage(RUSAGE_SELF,&usage);
+    r->cpu=usage.ru_utime.tv_sec+usage.ru_utime.tv_usec/1e6
+      +usage.ru_stime.tv_sec+usage.ru_stime.tv_usec/1e6;
+    r->memory=usage.ru_maxrss/1024.0;
+    if(write(resfd,r,sizeof(CV_RESULT)) != sizeof(CV_RESULT))
+      exit(1);
+    if(!r->waiting)
+      break;
+    if(read(cmdfd,&budget,sizeof(long)) != sizeof(long))
+      exit(1);
+    if(budget == SAVE_FOLD)
+      write_warm_start(state,&warm);
+    if(budget < 0)
+      break;
+  }
+  free_warm_start(&warm);
+  free(train.examples);
+  free(test.examples);
+  exit(0);
+}
+
+int parse_value_list(char *str, double *list, int max)
+     /* reads a comma separated list of numbers from str into list
+	and returns the number of values. An element from:to:k stands
+	for k values spaced geometrically from 'from' to 'to'. */
+{
+  int n=0,k,j;
+  double from,to;
+  char *end,*list_str=str;
+
+  do {
+    if(n >= max) {
+      printf("\nToo many values in list %s (at most %d)!\n\n",list_str,max);
+      exit(1);
+    }
+    list[n++]=strtod(str,&end);
+    if((end != str) && ((*end) == ':')) {
+      from=list[--n];
+      str=end+1;
+      to=strtod(str,&end);
+      k=0;
+      if((end != str) && ((*end) == ':')) {
+	str=end+1;
+	k=(int)strtol(str,&end,10);
+      }
+      if((end == str) || (k < 2) || (from <= 0) || (to <= 0)) {
+	printf("\nInvalid range of values in list %s (from:to:k with\n",
+	       list_str);
+	printf("from,to > 0 and k >= 2)!\n\n");
+	exit(1);
+      }
+      if(n+k > max) {
+	printf("\nToo many values in list %s (at most %d)!\n\n",list_str,max);
+	exit(1);
+      }
+      for(j=0;j<k;j++) 
+	list[n++]=from*pow(to/from,(double)j/(k-1));
+    }
+    if((end == str) || ((*end) && ((*end) != ','))) {
+      printf("\nInvalid list of values: %s\n\n",list_str);
+      exit(1);
+    }
+    str=end+1;
+  } while(*end);
+  return(n);
+}
+
+int compare_values(const void *a, const void *b)
+     /* qsort order for increasing doubles */
+{
+  if((*(double *)a) < (*(double *)b))
+    return(-1);
+  if((*(double *)a) > (*(double *)b))
+    return(1);
+  return(0);
 }
 
 /*---------------------------------------------------------------------------*/
@@ -114,7 +994,7 @@ void read_input_parameters(int argc,char *argv[],char *trainfile,
 			   LEARN_PARM *learn_parm, KERNEL_PARM *kernel_parm,
 			   int *alg_type)
 {
-  long i;
+  long i,j;
   char type[100];
   
   /* set default */
@@ -128,6 +1008,8 @@ void read_input_parameters(int argc,char *argv[],char *trainfile,
   struct_parm->newconstretrain=100;
   struct_parm->ccache_size=5;
   struct_parm->batch_size=100;
+  struct_parm->reuse_sample=0;
+  struct_parm->max_iterations=0;
 
   strcpy (modelfile, "svm_struct_model");
   strcpy (learn_parm->predfile, "trans_predictions");
@@ -159,6 +1041,7 @@ void read_input_parameters(int argc,char *argv[],char *trainfile,
   kernel_parm->coef_lin=1;
   kernel_parm->coef_const=1;
   strcpy(kernel_parm->custom,"empty");
+  kernel_parm->store=NULL;
   strcpy(type,"c");
 
   for(i=1;(i<argc) && ((argv[i])[0] == '-');i++) {
@@ -166,7 +1049,7 @@ void read_input_parameters(int argc,char *argv[],char *trainfile,
       { 
       case '?': print_help(); exit(0);
       case 'a': i++; strcpy(learn_parm->alphafile,argv[i]); break;
-      case 'c': i++; struct_parm->C=atof(argv[i]); break;
+      case 'c': i++; sweep_C_n=parse_value_list(argv[i],sweep_C,MAX_SWEEP); break;
       case 'p': i++; struct_parm->slack_norm=atol(argv[i]); break;
       case 'e': i++; struct_parm->epsilon=atof(argv[i]); break;
       case 'k': i++; struct_parm->newconstretrain=atol(argv[i]); break;
@@ -182,11 +1065,32 @@ void read_input_parameters(int argc,char *argv[],char *trainfile,
       case 'b': i++; struct_parm->batch_size=atof(argv[i]); break;
       case 't': i++; kernel_parm->kernel_type=atol(argv[i]); break;
       case 'd': i++; kernel_parm->poly_degree=atol(argv[i]); break;
-      case 'g': i++; kernel_parm->rbf_gamma=atof(argv[i]); break;
+      case 'g': i++; sweep_gamma_n=parse_value_list(argv[i],sweep_gamma,MAX_SWEEP); break;
       case 's': i++; kernel_parm->coef_lin=atof(argv[i]); break;
       case 'r': i++; kernel_parm->coef_const=atof(argv[i]); break;
       case 'u': i++; strcpy(kernel_parm->custom,argv[i]); break;
-      case '-': strcpy(struct_parm->custom_argv[struct_parm->custom_argc++],argv[i]);i++; strcpy(struct_parm->custom_argv[struct_parm->custom_argc++],argv[i]);break; 
+      case '-': if(strcmp(argv[i],"--cv") == 0) {
+		  i++; cv_folds=atol(argv[i]); break;
+		}
+		if(strcmp(argv[i],"--jobs") == 0) {
+		  i++; cv_workers=atol(argv[i]); break;
+		}
+		if(strcmp(argv[i],"--memory") == 0) {
+		  i++; cv_memory=atof(argv[i]); break;
+		}
+		if(strcmp(argv[i],"--metric") == 0) {
+		  i++; strncpy(cv_metric_name,argv[i],19); break;
+		}
+		if(strcmp(argv[i],"--halving") == 0) {
+		  i++; cv_halving=atof(argv[i]); break;
+		}
+		if(strcmp(argv[i],"--budget") == 0) {
+		  i++; cv_budget=atol(argv[i]); break;
+		}
+		if(strcmp(argv[i],"--tidy") == 0) {
+		  i++; cv_tidy=atol(argv[i]); break;
+		}
+		strcpy(struct_parm->custom_argv[struct_parm->custom_argc++],argv[i]);i++; strcpy(struct_parm->custom_argv[struct_parm->custom_argc++],argv[i]);break; 
       case 'v': i++; (*struct_verbosity)=atol(argv[i]); break;
       case 'y': i++; (*verbosity)=atol(argv[i]); break;
       default: printf("\nUnrecognized option %s!\n\n",argv[i]);
@@ -204,6 +1108,54 @@ void read_input_parameters(int argc,char *argv[],char *trainfile,
   if((i+1)<argc) {
     strcpy (modelfile, argv[i+1]);
   }
+  if(sweep_C_n == 0)  /* C<0 here makes the check for '-c' below fail */
+    sweep_C[sweep_C_n++]=struct_parm->C;
+  else {
+    for(j=0;j<sweep_C_n;j++) 
+      if(sweep_C[j]<=0) {
+	printf("\nAll values of the parameter '-c' must be greater than zero!\n\n");
+	wait_any_key();
+	print_help();
+	exit(0);
+      }
+  }
+  qsort(sweep_C,sweep_C_n,sizeof(double),compare_values);
+  struct_parm->C=sweep_C[0];
+  if(sweep_gamma_n == 0) 
+    sweep_gamma[sweep_gamma_n++]=kernel_parm->rbf_gamma;
+  for(j=0;j<sweep_gamma_n;j++) 
+    if(sweep_gamma[j]<=0) {
+      printf("\nAll values of the parameter '-g' must be greater than zero!\n\n");
+      wait_any_key();
+      print_help();
+      exit(0);
+    }
+  kernel_parm->rbf_gamma=sweep_gamma[0];
+  if(cv_folds && (cv_folds < 2)) {
+    printf("\nCross-validation (--cv) needs at least 2 folds!\n\n");
+    wait_any_key();
+    print_help();
+    exit(0);
+  }
+  if(!parse_ranking_metric(cv_metric_name,&cv_metric,&cv_metric_k)) {
+    printf("\nUnknown retrieval measure (--metric): %s (MAP, P@k, NDCG@k,\nNDCG or MRR)\n\n",
+	   cv_metric_name);
+    wait_any_key();
+    print_help();
+    exit(0);
+  }
+  if((!cv_folds) && (cv_workers || (cv_memory > 0) || cv_halving) 
+     && (struct_verbosity>=0))
+    printf("NOTE: --jobs, --memory and --halving only apply to cross-validation (--cv).\n");
+  if(cv_folds && cv_halving 
+     && ((cv_halving <= 1) || (cv_budget < 1) 
+	 || (((*alg_type) < 2) || ((*alg_type) > 4)))) {
+    printf("\nSuccessive halving (--halving) needs a factor > 1, a budget (--budget)\n");
+    printf("of at least 1 iteration, and one of the algorithms -w 2, 3 or 4!\n\n");
+    wait_any_key();
+    print_help();
+    exit(0);
+  }
   if(learn_parm->svm_iter_to_shrink == -9999) {
     learn_parm->svm_iter_to_shrink=100;
   }
@@ -339,7 +1291,13 @@ void print_help()
   printf("         -y [0..3]   -> verbosity level for svm_light (default 0)\n");
   printf("Learning Options:\n");
   printf("         -c float    -> C: trade-off between training error\n");
-  printf("                        and margin (default 0.01)\n");
+  printf("                        and margin (default 0.01). A comma separated\n");
+  printf("                        list of values (e.g. 0.1,1,10) trains one model\n");
+  printf("                        for each, written to model_file.c<C>. An element\n");
+  printf("                        from:to:k adds k values spaced geometrically from\n");
+  printf("                        'from' to 'to' (e.g. 0.01:100:5). With -w 2,3,4,\n");
+  printf("                        the values are trained in increasing order, each\n");
+  printf("                        starting from the working set of the one before.\n");
   printf("         -p [1,2]    -> L-norm to use for slack variables. Use 1 for L1-norm,\n");
   printf("                        use 2 for squared slacks. (default 1)\n");
   printf("         -o [1,2]    -> Rescaling method to use for loss.\n");
@@ -386,11 +1344,53 @@ void print_help()
   printf("                        2: radial basis function exp(-gamma ||a-b||^2)\n");
   printf("                        3: sigmoid tanh(s a*b + c)\n");
   printf("                        4: user defined kernel from kernel.h\n");
-  printf("         -d int      -> parameter d in polynomial kernel\n");
-  printf("         -g float    -> parameter gamma in rbf kernel\n");
+  printf("         -d int      -> parameter d in polynomial kernel (see --x for\n");
+  printf("                        d=2)\n");
+  printf("         -g float    -> parameter gamma in rbf kernel. A comma separated\n");
+  printf("                        list of values trains one model for each,\n");
+  printf("                        written to model_file.g<gamma>. The squared\n");
+  printf("                        distances between the training documents are\n");
+  printf("                        computed only once for all values.\n");
   printf("         -s float    -> parameter s in sigmoid/poly kernel\n");
   printf("         -r float    -> parameter c in sigmoid/poly kernel\n");
   printf("         -u string   -> parameter of user defined kernel\n");
+  printf("Cross-Validation Options:\n");
+  printf("         --cv int    -> k-fold cross-validation: train int models, each\n");
+  printf("                        without the queries of one fold, and test it on\n");
+  printf("                        them. Query i is in fold i mod int, or, if\n");
+  printf("                        example_file is a comma separated list of int\n");
+  printf("                        files, the queries of the k-th file are fold k.\n");
+  printf("                        The folds are trained in parallel processes that\n");
+  printf("                        share the examples, which are read only once.\n");
+  printf("                        Fold k writes model_file.fold<k>, its\n");
+  printf("                        predictions to model_file.fold<k>.predictions,\n");
+  printf("                        and its output to model_file.fold<k>.log.\n");
+  printf("                        With lists of values for -c and -g, every\n");
+  printf("                        combination is cross-validated (a grid search),\n");
+  printf("                        its mean over the folds is added to\n");
+  printf("                        model_file.results as soon as it is done, and\n");
+  printf("                        its fold files are model_file.c<C>.g<gamma>.fold<k>.\n");
+  printf("         --jobs int  -> number of folds to train at a time (default:\n");
+  printf("                        number of CPUs)\n");
+  printf("         --memory float -> megabytes the folds trained at a time may\n");
+  printf("                        use. A fold is expected to need as much as the\n");
+  printf("                        largest fold trained so far. (default: no limit)\n");
+  printf("         --metric string -> retrieval measure that is reported for each\n");
+  printf("                        fold and selects the best combination: MAP or\n");
+  printf("                        P@k, as in Search.java, NDCG@k, NDCG (all\n");
+  printf("                        ranks) or MRR (default MAP)\n");
+  printf("         --halving float -> successive halving instead of training all\n");
+  printf("                        combinations to epsilon: train each for the\n");
+  printf("                        --budget iterations, keep the best 1/float of\n");
+  printf("                        them, continue these from their working sets for\n");
+  printf("                        float times as many iterations, and so on,\n");
+  printf("                        until one is left, which is trained to epsilon.\n");
+  printf("                        Needs -w 2, 3 or 4. (default: off)\n");
+  printf("         --budget int -> iterations of the first round of successive\n");
+  printf("                        halving. Halving only saves work if most\n");
+  printf("                        combinations need more. (default 10)\n");
+  printf("         --tidy [0,1] -> remove the fold files of all combinations but\n");
+  printf("                        the best (default 0)\n");
   printf("Output Options:\n");
   printf("         -a string   -> write all alphas to this file after learning\n");
   printf("                        (in the same order as in the training set)\n");
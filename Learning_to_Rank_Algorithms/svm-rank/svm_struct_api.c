@@ -48,6 +48,18 @@ int comparedown(const void *a, const void *b)
 
 double swappedpairs(LABEL y, LABEL ybar);
 double fracswappedpairs(LABEL y, LABEL ybar);
+void   select_top(STRUCT_ID_SCORE *a, long n, long k);
+void   classify_topk_linear(PATTERN x, STRUCTMODEL *sm, long k, 
+			    double *class);
+void   classify_cascade(PATTERN x, STRUCTMODEL *sm, long n, double *class);
+void   sift_down_ranks(long *heap, long n, long pos, double *s);
+char   *document_name(DOC *doc, char *buf, long size);
+void   select_sparse_kernel_basis(DOC **docs, long n, STRUCTMODEL *sm,
+				  STRUCT_LEARN_PARM *sparm, KERNEL_PARM *kparm);
+void   map_to_sparse_kernel_features(DOC **docs, long n, STRUCTMODEL *sm);
+void   expand_sparse_kernel_model(STRUCTMODEL *sm);
+KERNEL_STORE *read_struct_kernel_matrix(STRUCT_LEARN_PARM *sparm, 
+					long kernel_type);
 
 
 void        svm_struct_learn_api_init(int argc, char* argv[])
@@ -85,6 +97,7 @@ SAMPLE      read_struct_examples(char *file, STRUCT_LEARN_PARM *sparm)
   long     n,qid;       /* number of instances */
   long     totwords, totpairs, sumtotpairs, i, j, k;
   double   *labels;
+  WORD     *w;
   DOC      **instances;
 
   /* Using the read_documents function from SVM-light */
@@ -150,6 +163,19 @@ SAMPLE      read_struct_examples(char *file, STRUCT_LEARN_PARM *sparm)
 	    sample.examples[k].x.doc[i]->fvec->words[j].weight=0;
 	  }
 
+  /* range of each feature, for the bounds of top-k ranking with
+     early termination in svm_struct_classify */
+  sparm->feature_maxabs=NULL;
+  if(sparm->topk_early && (sparm->num_features > 0)) {
+    sparm->feature_maxabs=create_nvector(sparm->num_features);
+    clear_nvector(sparm->feature_maxabs,sparm->num_features);
+    for(k=0;k<sample.n;k++) 
+      for(i=0;i<sample.examples[k].x.totdoc;i++)
+	for(w=sample.examples[k].x.doc[i]->fvec->words;w->wnum;w++) 
+	  sparm->feature_maxabs[w->wnum]=MAX(sparm->feature_maxabs[w->wnum],
+					     fabs(w->weight));
+  }
+
   /* add label factors for easy computation of feature vectors */
   sumtotpairs=0;
   for(k=0;k<sample.n;k++) {
@@ -208,6 +234,7 @@ void        init_struct_model(SAMPLE sample, STRUCTMODEL *sm,
      contain the learned weights for the model. */
   long   i,k,totwords=0,totdoc=0;
   WORD   *w;
+  DOC    **docs;
 
   totwords=0;  /* find highest feature number */
   totdoc=0;
@@ -225,6 +252,74 @@ void        init_struct_model(SAMPLE sample, STRUCTMODEL *sm,
     if(sparm->loss_function == SWAPPEDPAIRS) 
       printf("NOTE: Adjusted stopping criterion relative to maximum loss: eps=%lf\n",sparm->epsilon);
   }
+  sm->basis_n=0;
+  sm->basis=NULL;
+  sm->basis_invL=NULL;
+  sm->poly2_expanded=0;
+  sm->linear_bound=NULL;
+  sm->bound_x=NULL;
+  sm->stacked=NULL;
+  sm->cascade_model=NULL;
+  sm->stacked_col=0;
+  sm->bound_prod=NULL;
+  if(sparm->kernel_matrix_file[0] && (!kparm->store))
+    kparm->store=read_struct_kernel_matrix(sparm,kparm->kernel_type);
+  else if(kparm->kernel_type == PRECOMPUTED) {
+    printf("\nThe precomputed kernel needs a kernel matrix (--p)!\n\n");
+    exit(1);
+  }
+  sm->input_kparm=(*kparm);
+  sm->input_totwords=sparm->num_features;
+  if(kparm->kernel_type == LINEAR) {
+    if(sparm->sparse_kernel_type && (struct_verbosity>=0))
+      printf("NOTE: Sparse kernel approximation is ignored for the linear kernel.\n");
+  }
+  else {
+    docs=(DOC **)my_malloc(sizeof(DOC *)*totdoc);
+    for(k=0,totdoc=0;k<sample.n;k++)
+      for(i=0;i<sample.examples[k].x.totdoc;i++) 
+	docs[totdoc++]=sample.examples[k].x.doc[i];
+    if(sparm->sparse_kernel_type && sparm->reuse_sample) {
+      printf("\nSparse kernel approximation (--t) cannot be used with several\n");
+      printf("values of -c or -g!\n\n");
+      exit(1);
+    }
+    if(sparm->sparse_kernel_type) {
+      /* Replace the kernel by an explicit feature map into the space
+	 spanned by a set of basis functions, and learn a linear model
+	 in that space. */
+      select_sparse_kernel_basis(docs,totdoc,sm,sparm,kparm);
+      map_to_sparse_kernel_features(docs,totdoc,sm);
+      if(struct_verbosity>=0)
+	printf("Approximating kernel with %ld basis functions.\n",sm->basis_n);
+      kparm->kernel_type=LINEAR;
+      sparm->num_features=sm->basis_n;
+    }
+    else if((!sparm->reuse_sample) && sparm->poly2_expand
+	    && poly2_expansion_applicable(kparm,docs,totdoc,
+					  sparm->num_features)) {
+      /* The feature map of the polynomial kernel of degree 2 is
+	 small enough to learn a linear model over it directly. */
+      expand_poly2_documents(docs,totdoc,kparm);
+      sm->poly2_expanded=1;
+      kparm->kernel_type=LINEAR;
+      sparm->num_features=poly2_expansion_size(sparm->num_features);
+      if(struct_verbosity>=0)
+	printf("Expanded polynomial kernel into %d features.\n",
+	       sparm->num_features);
+    }
+    else if((sparm->kernel_store_dir[0] || sparm->reuse_sample) 
+	    && (!kparm->store)) {
+      /* look up the kernel between training documents in a store
+	 that is shared with other runs on the same data, or at
+	 least with the following runs of this process */
+      kparm->store=open_kernel_store(sparm->kernel_store_dir[0] ? 
+				     sparm->kernel_store_dir : NULL,
+				     kparm,docs,totdoc);
+      sm->input_kparm=(*kparm);
+    }
+    free(docs);
+  }
   sm->sizePsi=sparm->num_features;
   if(struct_verbosity>=2)
     printf("Size of Phi: %ld\n",sm->sizePsi);
@@ -262,18 +357,157 @@ LABEL       classify_struct_example(PATTERN x, STRUCTMODEL *sm,
      function cannot find a label, it shall return an empty label as
      recognized by the function empty_label(y). */
   LABEL y;
-  int i;
+  long  i;
 
   y.totdoc=x.totdoc;
   y.class=(double *)my_malloc(sizeof(double)*y.totdoc);
   y.factor=NULL;
   y.loss=-1;
+  if(sm->cascade_model) {
+    classify_cascade(x,sm,sparm->cascade_n,y.class);
+    return(y);
+  }
+  if(sparm->topk_early && (sm->linear_bound || sparm->feature_maxabs)) {
+    /* only the top k are needed, and only they are certain to get
+       their score */
+    if(!sm->linear_bound) {
+      sm->linear_bound=create_linear_bound(sm->svm_model,
+					   sparm->feature_maxabs);
+      sm->bound_x=(FVAL *)my_malloc(sizeof(FVAL)*(sm->svm_model->totwords+1));
+      sm->bound_prod=create_nvector(sm->svm_model->totwords);
+      for(i=0;i<=sm->svm_model->totwords;i++) {
+	sm->bound_x[i]=0;
+	sm->bound_prod[i]=0;
+      }
+      sm->bound_mults=sm->bound_saved=0;
+      sm->bound_pruned=0;
+      free_nvector(sparm->feature_maxabs);
+      sparm->feature_maxabs=NULL;
+    }
+    classify_topk_linear(x,sm,sparm->topk,y.class);
+    return(y);
+  }
   /* simply classify by sign of inner product between example vector
      and weight vector */
+  classify_examples(sm->svm_model,x.doc,x.totdoc,y.class);
+  return(y);
+}
+
+void        stack_struct_models(STRUCTMODEL *sm, int n,
+				STRUCT_LEARN_PARM *sparm)
+{
+  /* Lets classify_struct_example_models score the linear models
+     among the n models sm together, with one matrix of their weight
+     vectors. The models must have their weight vectors. The matrix
+     also ignores the features that a model does not have, which
+     classify_example_linear would read past its weight vector. */
+  MODEL **lin;
+  WEIGHT_MATRIX *wm;
+  long i,m=0;
+
+  lin=(MODEL **)my_malloc(sizeof(MODEL *)*(n+1));
+  for(i=0;i<n;i++)
+    if((sm[i].svm_model->kernel_parm.kernel_type == LINEAR)
+       && sm[i].svm_model->lin_weights)
+      lin[m++]=sm[i].svm_model;
+  if(m >= 1) {
+    wm=create_weight_matrix(lin,m);
+    for(i=0,m=0;i<n;i++)
+      if((sm[i].svm_model->kernel_parm.kernel_type == LINEAR)
+	 && sm[i].svm_model->lin_weights) {
+	sm[i].stacked=wm;
+	sm[i].stacked_col=m++;
+      }
+  }
+  free(lin);
+}
+
+static PATTERN truncate_pattern(PATTERN x, long totwords)
+{
+  /* Returns a copy of x without the features above totwords, as
+     read_struct_examples reads x for a model with totwords features,
+     or x itself if x has none of them. The copy shares the
+     userdefined strings of x and is freed with free_truncated_pattern. */
+  PATTERN t;
+  SVECTOR *f;
+  WORD   *w;
+  long   i,n;
+
   for(i=0;i<x.totdoc;i++) {
-    y.class[i]=classify_example(sm->svm_model,x.doc[i]);
+    f=x.doc[i]->fvec;
+    n=num_nonzero_svector(f);
+    if(n && (f->words[n-1].wnum > totwords))
+      break;
   }
-  return(y);
+  if(i == x.totdoc)
+    return(x);
+  t.totdoc=x.totdoc;
+  t.doc=(DOC **)my_malloc(sizeof(DOC *)*t.totdoc);
+  for(i=0;i<x.totdoc;i++) {
+    f=x.doc[i]->fvec;
+    for(n=0;f->words[n].wnum && (f->words[n].wnum <= totwords);n++);
+    w=(WORD *)my_malloc(sizeof(WORD)*(n+1));
+    memcpy(w,f->words,sizeof(WORD)*n);
+    w[n].wnum=0;
+    w[n].weight=0;
+    t.doc[i]=create_example(x.doc[i]->docnum,x.doc[i]->queryid,
+			    x.doc[i]->slackid,x.doc[i]->costfactor,
+			    create_svector_shallow(w,f->userdefined,
+						   f->factor));
+    t.doc[i]->kernelid=x.doc[i]->kernelid;
+    t.doc[i]->fvec->kernel_id=f->kernel_id;
+    t.doc[i]->fvec->docid=f->docid;
+  }
+  return(t);
+}
+
+static void free_truncated_pattern(PATTERN t, PATTERN x)
+{
+  /* Frees t, if truncate_pattern(x,...) has made a copy. */
+  long i;
+
+  if(t.doc == x.doc)
+    return;
+  for(i=0;i<t.totdoc;i++) {
+    t.doc[i]->fvec->userdefined=NULL;
+    free_example(t.doc[i],1);
+  }
+  free(t.doc);
+}
+
+void        classify_struct_example_models(PATTERN x, STRUCTMODEL *sm, 
+					   int n, STRUCT_LEARN_PARM *sparm,
+					   LABEL *y)
+{
+  /* Sets y[i] to classify_struct_example(x,&sm[i],sparm) for each of
+     the n models. The documents of x are scored with all stacked
+     models (stack_struct_models) in one pass. The other models see
+     only their own features, so that their scores are the same as
+     when they classify x alone. */
+  WEIGHT_MATRIX *wm;
+  PATTERN xt;
+  double *dist=NULL;
+  long   i,j;
+
+  for(i=0;i<n;i++) {
+    if(!(wm=sm[i].stacked)) {
+      xt=truncate_pattern(x,sm[i].svm_model->totwords);
+      y[i]=classify_struct_example(xt,&sm[i],sparm);
+      free_truncated_pattern(xt,x);
+      continue;
+    }
+    if(!dist) {
+      dist=(double *)my_malloc(sizeof(double)*(x.totdoc*wm->m+1));
+      classify_examples_stacked(wm,x.doc,x.totdoc,dist);
+    }
+    y[i].totdoc=x.totdoc;
+    y[i].class=(double *)my_malloc(sizeof(double)*y[i].totdoc);
+    y[i].factor=NULL;
+    y[i].loss=-1;
+    for(j=0;j<x.totdoc;j++)
+      y[i].class[j]=dist[j*wm->m+sm[i].stacked_col];
+  }
+  if(dist) free(dist);
 }
 
 LABEL       find_most_violated_constraint_slackrescaling(PATTERN x, LABEL y, 
@@ -326,10 +560,9 @@ LABEL       find_most_violated_constraint_marginrescaling(PATTERN x, LABEL y,
   svm_model=(*sm->svm_model); 
   scaling=0.5*x.scaling;
 
-  for(i=0;i<x.totdoc;i++) {
+  for(i=0;i<x.totdoc;i++) 
     ybar.factor[i]=0;
-    score[i]=classify_example(&svm_model,x.doc[i]);
-  }
+  classify_examples(&svm_model,x.doc,x.totdoc,score);
 
   for(i=0;i<x.totdoc;i++) {
     for(j=0;j<x.totdoc;j++) {
@@ -473,6 +706,18 @@ void        print_struct_learning_stats(SAMPLE sample, STRUCTMODEL *sm,
      the model sm. But primarly it allows computing and printing any
      kind of statistic (e.g. training error) you might want. */
   MODEL *model=sm->svm_model;
+  SVECTOR *f;
+  long i;
+
+  if(model->kernel_parm.store && (!sparm->kernel_matrix_file[0])) {
+    /* the rows of the kernel store are only valid for the training
+       documents, so they are not stored with the model */
+    for(i=1;i<model->sv_num;i++)
+      for(f=model->supvec[i]->fvec;f;f=f->next)
+	f->docid=-1;
+  }
+  /* the store belongs to the caller, who may train further models */
+  model->kernel_parm.store=NULL;
 
   /* Replace SV with single weight vector */
   if(model->kernel_parm.kernel_type == LINEAR) {
@@ -485,6 +730,13 @@ void        print_struct_learning_stats(SAMPLE sample, STRUCTMODEL *sm,
     if(struct_verbosity>=1) {
       printf("done\n"); fflush(stdout);
     }
+    if(sm->basis_n) 
+      expand_sparse_kernel_model(sm);
+    if(sm->poly2_expanded) {
+      /* the weight vector over the feature map is the model */
+      sm->svm_model->kernel_parm=sm->input_kparm;
+      sm->svm_model->kernel_parm.kernel_type=POLY_EXPANDED;
+    }
   }  
 }
 
@@ -497,6 +749,8 @@ void        print_struct_testing_stats(SAMPLE sample, STRUCTMODEL *sm,
      evaluation (e.g. precision/recall) you might want. You can use
      the function eval_prediction to accumulate the necessary
      statistics for each prediction. */
+  long i;
+  char name[30];
 
   printf("NOTE: The loss reported above is the fraction of swapped pairs averaged over\n");
   printf("      all rankings. The zero/one-error is fraction of perfectly correct\n");
@@ -504,6 +758,29 @@ void        print_struct_testing_stats(SAMPLE sample, STRUCTMODEL *sm,
   teststats->fracswappedpairs/=sample.n;
   printf("Total Num Swappedpairs  : %6.0f\n",teststats->swappedpairs);
   printf("Avg Swappedpairs Percent: %6.2f\n",100.0*teststats->fracswappedpairs);
+  if(sparm->measures_n > 0) {
+    printf("Mean over %ld queries:\n",teststats->queries);
+    for(i=0;i<sparm->measures_n;i++) 
+      printf("  %-14s%6.4f\n",
+	     ranking_metric_name(sparm->measure[i],sparm->measure_k[i],name),
+	     teststats->measure[i]/MAX(1,teststats->queries));
+  }
+  if(sm->linear_bound) {
+    printf("Early termination: %.0f of %.0f multiplications saved (%.2f%%), %ld documents abandoned\n",
+	   sm->bound_saved,sm->bound_mults+sm->bound_saved,
+	   100.0*sm->bound_saved/MAX(1,sm->bound_mults+sm->bound_saved),
+	   sm->bound_pruned);
+    printf("NOTE: Abandoned documents are not scored, so the loss above is not\n");
+    printf("      the loss of the full ranking.\n");
+  }
+  if(sm->cascade_model) {
+    printf("Cascade: %ld documents scored by the linear model in %.3f cpu-seconds (%.1f%%),\n",
+	   sm->cascade_docs[0],sm->cascade_time[0]/100.0,
+	   100.0*sm->cascade_time[0]/MAX(1e-9,sm->cascade_time[0]+sm->cascade_time[1]));
+    printf("         %ld re-scored by the kernel model in %.3f cpu-seconds (%.1f%%)\n",
+	   sm->cascade_docs[1],sm->cascade_time[1]/100.0,
+	   100.0*sm->cascade_time[1]/MAX(1e-9,sm->cascade_time[0]+sm->cascade_time[1]));
+  }
 }
 
 void        eval_prediction(long exnum, EXAMPLE ex, LABEL ypred, 
@@ -514,13 +791,53 @@ void        eval_prediction(long exnum, EXAMPLE ex, LABEL ypred,
      prediction matches the labeled example. It is called from
      svm_struct_classify. See also the function
      print_struct_testing_stats. */
+  long i;
+  double value[MAX_MEASURES];
+
   if(exnum == 0) { /* this is the first time the function is
 		      called. So initialize the teststats */
     teststats->swappedpairs=0;
     teststats->fracswappedpairs=0;
+    teststats->queries=0;
+    teststats->num_ret=teststats->num_rel=teststats->num_rel_ret=0;
+    for(i=0;i<MAX_MEASURES;i++)
+      teststats->measure[i]=0;
   }
   teststats->swappedpairs+=swappedpairs(ex.y,ypred);
   teststats->fracswappedpairs+=fracswappedpairs(ex.y,ypred);
+  if(sparm->measures_n > 0) {
+    /* in TREC run format (--k), only the top k are retrieved */
+    teststats->queries++;
+    teststats->num_ret+=(sparm->topk > 0) ? MIN(sparm->topk,ypred.totdoc) 
+                                          : ypred.totdoc;
+    for(i=0;i<ex.y.totdoc;i++)
+      if(ex.y.class[i] > 0)
+	teststats->num_rel++;
+    teststats->num_rel_ret+=ranking_metrics(ex.y,ypred,
+		       (sparm->topk > 0) ? sparm->topk : ypred.totdoc,
+		       sparm->measure,sparm->measure_k,sparm->measures_n,value);
+    for(i=0;i<sparm->measures_n;i++)
+      teststats->measure[i]+=value[i];
+  }
+}
+
+void        add_struct_test_stats(STRUCT_TEST_STATS *teststats,
+				  STRUCT_TEST_STATS *more)
+{
+  /* Adds the statistics more of further predictions to teststats. With
+     several threads, svm_struct_classify evaluates each prediction on
+     its own (exnum 0) and adds up the results in the order of the
+     examples, so that the sums are the same as in a serial run. */
+  long i;
+
+  teststats->swappedpairs+=more->swappedpairs;
+  teststats->fracswappedpairs+=more->fracswappedpairs;
+  teststats->queries+=more->queries;
+  teststats->num_ret+=more->num_ret;
+  teststats->num_rel+=more->num_rel;
+  teststats->num_rel_ret+=more->num_rel_ret;
+  for(i=0;i<MAX_MEASURES;i++)
+    teststats->measure[i]+=more->measure[i];
 }
 
 void        write_struct_model(char *file, STRUCTMODEL *sm, 
@@ -536,12 +853,58 @@ STRUCTMODEL read_struct_model(char *file, STRUCT_LEARN_PARM *sparm)
   /* Reads structural model sm from file file. This function is used
      only in the prediction module, not in the learning module. */
   STRUCTMODEL sm;
+  long i;
   
   sm.svm_model=read_model(file);
+  if(sparm->kernel_matrix_file[0])
+    sm.svm_model->kernel_parm.store=read_struct_kernel_matrix(sparm,
+				      sm.svm_model->kernel_parm.kernel_type);
+  else if(sm.svm_model->kernel_parm.kernel_type == PRECOMPUTED) {
+    printf("\nThe precomputed kernel needs a kernel matrix (--p)!\n\n");
+    exit(1);
+  }
+  add_kernel_block_to_model(sm.svm_model); /* for non-linear kernels */
   sparm->loss_function=FRACSWAPPEDPAIRS;
   sparm->num_features=sm.svm_model->totwords;
   sm.w=sm.svm_model->lin_weights;
   sm.sizePsi=sm.svm_model->totwords;
+  sm.basis_n=0;
+  sm.basis=NULL;
+  sm.basis_invL=NULL;
+  sm.linear_bound=NULL;
+  sm.bound_x=NULL;
+  sm.stacked=NULL;
+  sm.stacked_col=0;
+  sm.bound_prod=NULL;
+  sm.cascade_model=NULL;
+  sm.cascade_time[0]=sm.cascade_time[1]=0;
+  sm.cascade_docs[0]=sm.cascade_docs[1]=0;
+  if(sparm->cascade_file[0]) {
+    /* the test examples keep the features of the kernel model, so
+       that it scores as without the cascade. The linear model of the
+       first stage gets zero weights for the features it does not
+       have, and does not see the features above those of the kernel
+       model. */
+    sm.cascade_model=read_model(sparm->cascade_file);
+    if(sm.cascade_model->kernel_parm.kernel_type != LINEAR) {
+      printf("\nThe first stage of the cascade (--l) must be a linear model!\n\n");
+      exit(1);
+    }
+    add_weight_vector_to_linear_model(sm.cascade_model);
+    if(sm.cascade_model->totwords < sparm->num_features) {
+      sm.cascade_model->lin_weights=(double *)realloc(
+		  sm.cascade_model->lin_weights,
+		  sizeof(double)*(sparm->num_features+1));
+      for(i=sm.cascade_model->totwords+1;i<=sparm->num_features;i++)
+	sm.cascade_model->lin_weights[i]=0;
+    }
+  }
+  if(sparm->topk_early && ((sparm->topk <= 0)
+			   || (sm.svm_model->kernel_parm.kernel_type != LINEAR))) {
+    printf("\nNOTE: Early termination (--e) applies to top-k ranking (--k) with\n");
+    printf("      linear models only.\n");
+    sparm->topk_early=0;
+  }
   return(sm);
 }
 
@@ -554,6 +917,430 @@ void        write_label(FILE *fp, LABEL y)
   }
 }
 
+void        write_ranked_label(FILE *fp, PATTERN x, LABEL y, 
+			       STRUCT_LEARN_PARM *sparm)
+{
+  /* Writes the sparm->topk highest scoring documents of pattern x in
+     TREC run format (qid Q0 docno rank score tag), best first. Ties
+     are ranked in the order of the input file. */
+  STRUCT_ID_SCORE *a;
+  long i,k;
+  char name[300];
+
+  a=(STRUCT_ID_SCORE *)my_malloc(sizeof(STRUCT_ID_SCORE)*(y.totdoc+1));
+  for(i=0;i<y.totdoc;i++) {
+    a[i].id=i;
+    a[i].score=y.class[i];
+    a[i].tiebreak=-i;
+  }
+  k=MIN(sparm->topk,y.totdoc);
+  select_top(a,y.totdoc,k);
+  qsort(a,k,sizeof(STRUCT_ID_SCORE),comparedown);
+  for(i=0;i<k;i++) 
+    fprintf(fp,"%ld Q0 %s %ld %.8f %s\n",x.doc[a[i].id]->queryid,
+	    document_name(x.doc[a[i].id],name,sizeof(name)),i+1,a[i].score,
+	    sparm->run_tag);
+  free(a);
+}
+
+double ranking_metric(LABEL y, LABEL ybar, int metric, long k)
+{
+  /* Returns the retrieval measure metric at cutoff k of the ranking
+     that ybar implies (see ranking_metrics). */
+  /* WARNING: y needs to be the correct ranking, and ybar the prediction. */
+  double value;
+
+  ranking_metrics(y,ybar,ybar.totdoc,&metric,&k,1,&value);
+  return(value);
+}
+
+int comparegain(const void *a, const void *b)
+{
+  double va,vb;
+  va=*((double *)a);
+  vb=*((double *)b);
+  return((va < vb) - (va > vb));
+}
+
+long ranking_metrics(LABEL y, LABEL ybar, long retrieved, int *metric, 
+		     long *k, long n, double *value)
+{
+  /* Computes the n retrieval measures metric[i] at cutoff k[i] of
+     the ranking that ybar implies into value[i]: average precision
+     (METRIC_MAP), precision at rank k (METRIC_P), normalized
+     discounted cumulative gain at rank k (METRIC_NDCG, at all ranks
+     for k=0) and reciprocal rank (METRIC_MRR). Only the first
+     retrieved documents of the ranking are retrieved, as in a TREC
+     run of the top k. Documents with y.class > 0 are relevant, with
+     a gain of 2^y.class-1 in NDCG, as in RetrievalEvaluator.java. Ties
+     are ranked in the order of the input file, as in
+     write_ranked_label. The documents are sorted once for all
+     measures. Returns the number of relevant documents retrieved. */
+  /* WARNING: y needs to be the correct ranking, and ybar the prediction. */
+  STRUCT_ID_SCORE *a;
+  long i,c,relevant=0,*found;
+  double ap=0,rr=0,*dcg,*idcg;
+
+  retrieved=MIN(retrieved,ybar.totdoc);
+  a=(STRUCT_ID_SCORE *)my_malloc(sizeof(STRUCT_ID_SCORE)*(ybar.totdoc+1));
+  found=(long *)my_malloc(sizeof(long)*(ybar.totdoc+1));
+  dcg=(double *)my_malloc(sizeof(double)*(ybar.totdoc+1));
+  idcg=(double *)my_malloc(sizeof(double)*(ybar.totdoc+1));
+  for(i=0;i<ybar.totdoc;i++) {
+    a[i].id=i;
+    a[i].score=ybar.class[i];
+    a[i].tiebreak=-i;
+    if(y.class[i] > 0)
+      idcg[relevant++]=y.class[i];
+  }
+  qsort(a,ybar.totdoc,sizeof(STRUCT_ID_SCORE),comparedown);
+  qsort(idcg,relevant,sizeof(double),comparegain);
+  /* found[i] and dcg[i] hold the relevant documents and the
+     discounted gain in the first i ranks, idcg[i] the gain of the
+     best possible ranking */
+  found[0]=0;
+  dcg[0]=0;
+  for(i=0;i<retrieved;i++) {
+    found[i+1]=found[i];
+    dcg[i+1]=dcg[i];
+    if(y.class[a[i].id] <= 0)
+      continue;
+    found[i+1]++;
+    dcg[i+1]+=(pow(2.0,y.class[a[i].id])-1.0)/log(2.0+i);
+    ap+=(double)found[i+1]/(i+1);
+    if(found[i+1] == 1)
+      rr=1.0/(i+1);
+  }
+  for(i=relevant;i>0;i--)
+    idcg[i]=idcg[i-1];
+  idcg[0]=0;
+  for(i=0;i<relevant;i++)
+    idcg[i+1]=idcg[i]+(pow(2.0,idcg[i+1])-1.0)/log(2.0+i);
+
+  for(i=0;i<n;i++) {
+    c=(k[i] > 0) ? k[i] : ybar.totdoc;
+    if(metric[i] == METRIC_MAP)
+      value[i]=relevant ? ap/relevant : 0;
+    else if(metric[i] == METRIC_P)
+      value[i]=(double)found[MIN(c,retrieved)]/c;
+    else if(metric[i] == METRIC_NDCG)
+      value[i]=(idcg[MIN(c,relevant)] > 0) 
+	? dcg[MIN(c,retrieved)]/idcg[MIN(c,relevant)] : 0;
+    else
+      value[i]=rr;
+  }
+  c=found[retrieved];
+  free(a);
+  free(found);
+  free(dcg);
+  free(idcg);
+  return(c);
+}
+
+int parse_ranking_metric(char *name, int *metric, long *k)
+{
+  /* Reads the name of a retrieval measure as in Search.java: MAP,
+     P@k, NDCG@k, NDCG (at all ranks) or MRR. Returns 0 if name is
+     not one of them. */
+  char *end;
+
+  (*k)=0;
+  if(strcmp(name,"MAP") == 0) {
+    (*metric)=METRIC_MAP;
+    return(1);
+  }
+  if(strcmp(name,"MRR") == 0) {
+    (*metric)=METRIC_MRR;
+    return(1);
+  }
+  if(strcmp(name,"NDCG") == 0) {
+    (*metric)=METRIC_NDCG;
+    return(1);
+  }
+  if((strncmp(name,"P@",2) == 0) || (strncmp(name,"NDCG@",5) == 0)) {
+    (*metric)=(name[0] == 'P') ? METRIC_P : METRIC_NDCG;
+    name=strchr(name,'@')+1;
+    (*k)=strtol(name,&end,10);
+    return((end != name) && (!(*end)) && ((*k) > 0));
+  }
+  return(0);
+}
+
+char *ranking_metric_name(int metric, long k, char *name)
+{
+  /* Writes the name of retrieval measure metric at cutoff k in
+     trec_eval output to name (at least 30 characters) and returns
+     it. */
+  if(metric == METRIC_MAP)
+    strcpy(name,"map");
+  else if(metric == METRIC_MRR)
+    strcpy(name,"recip_rank");
+  else if(metric == METRIC_P)
+    sprintf(name,"P%ld",k);
+  else if(k > 0)
+    sprintf(name,"ndcg%ld",k);
+  else
+    strcpy(name,"ndcg");
+  return(name);
+}
+
+void write_query_measures(FILE *fp, long exnum, EXAMPLE ex, 
+			  STRUCT_TEST_STATS *qstats, STRUCT_LEARN_PARM *sparm)
+{
+  /* Writes the retrieval measures of example exnum, which eval_prediction
+     has evaluated on its own into qstats, in the trec_eval format of
+     TrecEvaluator.java (measure qid value), or as an element of the
+     JSON array "queries". */
+  long i,qid;
+  char name[30];
+
+  qid=ex.x.totdoc ? ex.x.doc[0]->queryid : exnum+1;
+  if(sparm->measures_json) {
+    fprintf(fp,"%s{\"qid\": %ld, \"num_ret\": %ld, \"num_rel\": %ld, \"num_rel_ret\": %ld",
+	    exnum ? ",\n" : "{\"queries\": [\n",qid,qstats->num_ret,
+	    qstats->num_rel,qstats->num_rel_ret);
+    for(i=0;i<sparm->measures_n;i++) 
+      fprintf(fp,", \"%s\": %.6f",
+	      ranking_metric_name(sparm->measure[i],sparm->measure_k[i],name),
+	      qstats->measure[i]);
+    fprintf(fp,"}");
+    return;
+  }
+  fprintf(fp,"%-16s%3ld %ld\n","num_ret",qid,qstats->num_ret);
+  fprintf(fp,"%-16s%3ld %ld\n","num_rel",qid,qstats->num_rel);
+  fprintf(fp,"%-16s%3ld %ld\n","num_rel_ret",qid,qstats->num_rel_ret);
+  for(i=0;i<sparm->measures_n;i++) 
+    fprintf(fp,"%-16s%3ld %6.4f\n",
+	    ranking_metric_name(sparm->measure[i],sparm->measure_k[i],name),
+	    qid,qstats->measure[i]);
+}
+
+void write_mean_measures(FILE *fp, STRUCT_TEST_STATS *teststats, 
+			 STRUCT_LEARN_PARM *sparm)
+{
+  /* Writes the totals and the means over all queries of the
+     retrieval measures after those of the queries (write_query_measures):
+     as query "all" in trec_eval format, or as the JSON object
+     "all". */
+  long i;
+  char name[30];
+
+  if(sparm->measures_json) {
+    fprintf(fp,"%s\n],\n\"all\": {\"num_q\": %ld, \"num_ret\": %ld, \"num_rel\": %ld, \"num_rel_ret\": %ld",
+	    teststats->queries ? "" : "{\"queries\": [",teststats->queries,
+	    teststats->num_ret,teststats->num_rel,teststats->num_rel_ret);
+    for(i=0;i<sparm->measures_n;i++) 
+      fprintf(fp,", \"%s\": %.6f",
+	      ranking_metric_name(sparm->measure[i],sparm->measure_k[i],name),
+	      teststats->measure[i]/MAX(1,teststats->queries));
+    fprintf(fp,"}}\n");
+    return;
+  }
+  fprintf(fp,"%-16s%3s %ld\n","num_q","all",teststats->queries);
+  fprintf(fp,"%-16s%3s %ld\n","num_ret","all",teststats->num_ret);
+  fprintf(fp,"%-16s%3s %ld\n","num_rel","all",teststats->num_rel);
+  fprintf(fp,"%-16s%3s %ld\n","num_rel_ret","all",teststats->num_rel_ret);
+  for(i=0;i<sparm->measures_n;i++) 
+    fprintf(fp,"%-16s%3s %6.4f\n",
+	    ranking_metric_name(sparm->measure[i],sparm->measure_k[i],name),
+	    "all",teststats->measure[i]/MAX(1,teststats->queries));
+}
+
+/* document a ranks before document b */
+#define ranks_before(s,a,b) (((s)[a]>(s)[b]) || (((s)[a]==(s)[b]) && ((a)<(b))))
+
+void classify_topk_linear(PATTERN x, STRUCTMODEL *sm, long k, double *class)
+     /* scores the documents of x with a linear model, but abandons a
+	document as soon as the bounds of sm->linear_bound show that
+	it cannot enter the top k (MaxScore). The top k documents and
+	their scores are exactly those of classify_examples; abandoned
+	documents get the score -DBL_MAX. */
+{
+  MODEL *model=sm->svm_model;
+  LINEAR_BOUND *bound=sm->linear_bound;
+  long i,n,pos,nnz,mults,*heap;
+  double threshold,sum;
+  WORD *w;
+  int inrange;
+
+  heap=(long *)my_malloc(sizeof(long)*(k+1));
+  for(n=0,i=0;i<x.totdoc;i++) {
+    /* document as dense vector; documents outside the ranges of the
+       bounds are scored in full */
+    nnz=0;
+    inrange=(x.doc[i]->fvec->next == NULL);
+    for(w=x.doc[i]->fvec->words;w->wnum;w++,nnz++) {
+      sm->bound_x[w->wnum]=w->weight;
+      if(fabs(w->weight) > bound->maxabs[w->wnum])
+	inrange=0;
+    }
+    threshold=(n == k) ? class[heap[0]] : -DBL_MAX;
+    mults=0;
+    if(!inrange) {
+      class[i]=classify_example(model,x.doc[i]);
+      mults=nnz;
+    }
+    else if(bounded_linear_products(model,bound,sm->bound_x,sm->bound_prod,
+				    threshold,&mults)) {
+      for(sum=0,w=x.doc[i]->fvec->words;w->wnum;w++) 
+	sum+=sm->bound_prod[w->wnum];
+      class[i]=x.doc[i]->fvec->factor*sum-model->b;
+    }
+    else {
+      class[i]=-DBL_MAX;
+      sm->bound_pruned++;
+    }
+    sm->bound_mults+=mults;
+    sm->bound_saved+=nnz-mults;
+    for(w=x.doc[i]->fvec->words;w->wnum;w++) {
+      sm->bound_x[w->wnum]=0;
+      sm->bound_prod[w->wnum]=0;
+    }
+
+    /* keep the k best documents in a heap with the worst at the root */
+    if(n < k) {
+      heap[n++]=i;
+      if(n == k)
+	for(pos=k/2-1;pos>=0;pos--)
+	  sift_down_ranks(heap,k,pos,class);
+    }
+    else if(ranks_before(class,i,heap[0])) {
+      heap[0]=i;
+      sift_down_ranks(heap,k,0,class);
+    }
+  }
+  free(heap);
+}
+
+void classify_cascade(PATTERN x, STRUCTMODEL *sm, long n, double *class)
+     /* scores all documents of x with the linear model
+	sm->cascade_model, and the n best of them (ties in the order of
+	the input file) again with sm->svm_model. The other documents
+	keep their linear score, shifted so that they rank after the re-
+	scored documents in their linear order. */
+{
+  STRUCT_ID_SCORE *a;
+  DOC    **top;
+  double *s,t,low,high;
+  long   i;
+
+  t=get_thread_runtime();
+  a=(STRUCT_ID_SCORE *)my_malloc(sizeof(STRUCT_ID_SCORE)*(x.totdoc+1));
+  for(i=0;i<x.totdoc;i++) {
+    class[i]=classify_example_linear(sm->cascade_model,x.doc[i]);
+    a[i].id=i;
+    a[i].score=class[i];
+    a[i].tiebreak=-i;
+  }
+  n=MIN(n,x.totdoc);
+  select_top(a,x.totdoc,n);
+  t=get_thread_runtime()-t;
+  /* svm_struct_classify -j scores several queries at once */
+#pragma omp atomic
+  sm->cascade_time[0]+=t;
+#pragma omp atomic
+  sm->cascade_docs[0]+=x.totdoc;
+
+  t=get_thread_runtime();
+  top=(DOC **)my_malloc(sizeof(DOC *)*(n+1));
+  s=(double *)my_malloc(sizeof(double)*(n+1));
+  for(i=0;i<n;i++)
+    top[i]=x.doc[a[i].id];
+  classify_examples(sm->svm_model,top,n,s);
+  t=get_thread_runtime()-t;
+#pragma omp atomic
+  sm->cascade_time[1]+=t;
+#pragma omp atomic
+  sm->cascade_docs[1]+=n;
+
+  if(n < x.totdoc) {
+    for(low=DBL_MAX,i=0;i<n;i++)
+      low=MIN(low,s[i]);
+    for(high=-DBL_MAX,i=n;i<x.totdoc;i++)
+      high=MAX(high,a[i].score);
+    for(i=n;i<x.totdoc;i++)
+      class[a[i].id]+=low-high-1;
+  }
+  for(i=0;i<n;i++)
+    class[a[i].id]=s[i];
+  free(s);
+  free(top);
+  free(a);
+}
+
+void sift_down_ranks(long *heap, long n, long pos, double *s)
+     /* restores the heap property below pos for a heap whose root is
+	the document that ranks last */
+{
+  long child,tmp;
+
+  while((child=2*pos+1) < n) {
+    if((child+1 < n) && ranks_before(s,heap[child],heap[child+1]))
+      child++;
+    if(!ranks_before(s,heap[pos],heap[child]))
+      break;
+    tmp=heap[pos]; heap[pos]=heap[child]; heap[child]=tmp;
+    pos=child;
+  }
+}
+
+void select_top(STRUCT_ID_SCORE *a, long n, long k)
+     /* partial selection (quickselect): moves the k elements that
+	comparedown orders first to a[0..k-1], in no particular order,
+	in expected time O(n) */
+{
+  long lo=0,hi=n-1,i,j;
+  STRUCT_ID_SCORE pivot,tmp;
+
+  if((k <= 0) || (k >= n))
+    return;
+  while(lo < hi) {
+    pivot=a[lo+(hi-lo)/2];
+    i=lo;
+    j=hi;
+    while(i <= j) {
+      while(comparedown(&a[i],&pivot) < 0) i++;
+      while(comparedown(&a[j],&pivot) > 0) j--;
+      if(i <= j) {
+	tmp=a[i]; a[i]=a[j]; a[j]=tmp;
+	i++;
+	j--;
+      }
+    }
+    /* now a[lo..j] come before a[i..hi]; continue in the part that
+       contains position k-1 */
+    if(k-1 <= j)
+      hi=j;
+    else if(k-1 >= i)
+      lo=i;
+    else
+      break;
+  }
+}
+
+char *document_name(DOC *doc, char *buf, long size)
+     /* the document id from the comment of doc: the value of 'docid'
+	(as in '#docid = GX000-00-0000000'), or else the first word of
+	the comment. Without comment, the line number of the
+	document. */
+{
+  char *c=doc->fvec->userdefined,*p;
+  long n;
+
+  if(c && (p=strstr(c,"docid"))) {
+    c=p+5;
+    while(((*c) == ' ') || ((*c) == '\t') || ((*c) == '=')) c++;
+  }
+  while(c && (((*c) == ' ') || ((*c) == '\t'))) c++;
+  for(n=0;c && c[n] && (!isspace((int)c[n])) && (n<size-1);n++)
+    buf[n]=c[n];
+  if(n == 0) 
+    snprintf(buf,size,"%ld",doc->docnum+1);
+  else
+    buf[n]=0;
+  return(buf);
+}
+
 void        free_pattern(PATTERN x) {
   /* Frees the memory of x. */
   int i;
@@ -574,8 +1361,19 @@ void        free_struct_model(STRUCTMODEL sm)
   /* Frees the memory of model. */
 
   /* if(sm.w) free(sm.w); */ /* this is free'd in free_model */
-  if(sm.svm_model) free_model(sm.svm_model,1);
   /* add free calls for user defined data here */
+  if(sm.svm_model && sm.svm_model->kernel_parm.store) 
+    free_kernel_store(sm.svm_model->kernel_parm.store);
+  if(sm.svm_model) free_model(sm.svm_model,1);
+  if(sm.basis_invL) free_matrix(sm.basis_invL);
+  if(sm.linear_bound) {
+    free_linear_bound(sm.linear_bound);
+    free(sm.bound_x);
+    free(sm.bound_prod);
+  }
+  if(sm.stacked && (sm.stacked_col == 0))
+    free_weight_matrix(sm.stacked);
+  if(sm.cascade_model) free_model(sm.cascade_model,1);
 }
 
 void        free_struct_sample(SAMPLE s)
@@ -599,6 +1397,38 @@ void        print_struct_help()
   printf("NOTE: SVM-light in '-z p' mode and SVM-rank with loss %d are equivalent for\n",SWAPPEDPAIRS);
   printf("      c_light = c_rank/n, where n is the number of training rankings (i.e. \n");
   printf("      queries).\n\n");
+  printf("Options for approximating non-linear kernels (-t 1,2,3):\n");
+  printf("         --t [0..2] -> approximate the kernel by a linear model over the\n");
+  printf("                       kernel values with a set of basis functions:\n");
+  printf("                       0: no approximation, use exact kernel\n");
+  printf("                       1: Nystrom method with randomly sampled basis\n");
+  printf("                       2: basis selected by incomplete Cholesky\n");
+  printf("                       (default 0)\n");
+  printf("         --k long   -> number of basis functions (default %d)\n",DEFAULT_SPARSE_KERNEL_SIZE);
+  printf("         --r long   -> seed for random basis selection (default 0)\n");
+  printf("         --x [0,1]  -> for -t 1 -d 2 with -s >0, -r >=0 and up to %d\n",POLY2_EXPAND_MAXWORDS);
+  printf("                       features:\n");
+  printf("                       0: train with the exact kernel\n");
+  printf("                       1: train a linear model over the explicit feature\n");
+  printf("                          map of the kernel, which is faster. The model\n");
+  printf("                          is written as kernel type %d, which older\n",POLY_EXPANDED);
+  printf("                          versions of svm_rank_classify cannot read, and\n");
+  printf("                          its scores can differ slightly from those of 0.\n");
+  printf("                       (default 0)\n\n");
+  printf("Options for precomputed kernels:\n");
+  printf("         --p file   -> precomputed kernel matrix, stored as n*n 32-bit floats\n");
+  printf("                       row by row. Each document selects its row with\n");
+  printf("                       did:<n> in the input file (counting from 1). Use\n");
+  printf("                       with -t 7, or with -t 2 and --m 1.\n");
+  printf("         --m [0,1]  -> 0: matrix holds kernel values (default)\n");
+  printf("                       1: matrix holds squared euclidian distances for the\n");
+  printf("                          rbf kernel, so that -g can be varied\n");
+  printf("         --s dir    -> compute the kernel between all training documents\n");
+  printf("                       once and keep it in a file in dir. Later runs on the\n");
+  printf("                       same data with the same kernel parameters (e.g. with\n");
+  printf("                       a different -c) reuse the file. For the rbf kernel\n");
+  printf("                       the file holds squared distances, which also serve\n");
+  printf("                       any -g.\n\n");
   printf("The algorithms implemented in SVM-perf are described in:\n");
   printf("- T. Joachims, A Support Vector Method for Multivariate Performance Measures,\n");
   printf("  Proceedings of the International Conference on Machine Learning (ICML), 2005.\n");
@@ -615,10 +1445,32 @@ void         parse_struct_parameters(STRUCT_LEARN_PARM *sparm)
   /* set number of features to -1, indicating that it will be computed
      in init_struct_model() */
   sparm->num_features=-1;
+  sparm->sparse_kernel_type=0;
+  sparm->sparse_kernel_size=DEFAULT_SPARSE_KERNEL_SIZE;
+  sparm->randseed=0;
+  sparm->poly2_expand=0;
+  sparm->kernel_matrix_file[0]=0;
+  sparm->kernel_matrix_sqdist=0;
+  sparm->kernel_store_dir[0]=0;
+  sparm->topk=0;
+  sparm->topk_early=0;
+  sparm->feature_maxabs=NULL;
+  sparm->cascade_file[0]=0;
+  sparm->cascade_n=0;
+  sparm->measures_n=0;
+  sparm->measures_file[0]=0;
+  sparm->measures_json=0;
 
   for(i=0;(i<sparm->custom_argc) && ((sparm->custom_argv[i])[0] == '-');i++) {
     switch ((sparm->custom_argv[i])[2]) 
       { 
+      case 't': i++; sparm->sparse_kernel_type=atol(sparm->custom_argv[i]); break;
+      case 'x': i++; sparm->poly2_expand=atol(sparm->custom_argv[i]); break;
+      case 'k': i++; sparm->sparse_kernel_size=atol(sparm->custom_argv[i]); break;
+      case 'r': i++; sparm->randseed=atol(sparm->custom_argv[i]); break;
+      case 'p': i++; strcpy(sparm->kernel_matrix_file,sparm->custom_argv[i]); break;
+      case 'm': i++; sparm->kernel_matrix_sqdist=atol(sparm->custom_argv[i]); break;
+      case 's': i++; strcpy(sparm->kernel_store_dir,sparm->custom_argv[i]); break;
       default: printf("\nUnrecognized option %s!\n\n",sparm->custom_argv[i]);
 	       exit(0);
       }
@@ -629,6 +1481,39 @@ void        print_struct_help_classify()
 {
   /* Prints a help text that is appended to the common help text of
      svm_struct_classify. */
+  printf("Ranking options:\n");
+  printf("         --k int    -> write the k highest scoring documents of each\n");
+  printf("                       query in TREC run format (qid Q0 docno rank\n");
+  printf("                       score tag) instead of one score per line. The\n");
+  printf("                       docno is the value of 'docid' in the comment of\n");
+  printf("                       the document, or else the first word of the\n");
+  printf("                       comment. (default 0: write scores)\n");
+  printf("         --n string -> tag of the run in TREC run format (default svm_rank)\n");
+  printf("         --e [0,1]  -> with --k and a linear model, stop scoring a document\n");
+  printf("                       as soon as it cannot enter the top k. The top k\n");
+  printf("                       are the same, but the other documents get no\n");
+  printf("                       score. (default 0)\n");
+  printf("         --l file   -> cascade: score all documents with the linear model in\n");
+  printf("                       file first, and re-score only the best of each\n");
+  printf("                       query with model_file. The other documents keep\n");
+  printf("                       their linear score, shifted below the re-scored\n");
+  printf("                       ones. (default: no cascade)\n");
+  printf("         --r int    -> documents of each query re-scored in the cascade\n");
+  printf("                       (default 100)\n");
+  printf("         --p file   -> kernel matrix for models with a precomputed kernel\n");
+  printf("         --m [0,1]  -> the kernel matrix holds squared distances (rbf)\n");
+  printf("Evaluation options:\n");
+  printf("         --t string -> comma separated list of retrieval measures that\n");
+  printf("                       are evaluated on each query and printed as means:\n");
+  printf("                       MAP, P@k, NDCG@k, NDCG (all ranks) and MRR.\n");
+  printf("                       Documents with a target value > 0 are relevant.\n");
+  printf("                       With --k, only the top k are retrieved. (default:\n");
+  printf("                       none, or the measures of TrecEvaluator.java with --o)\n");
+  printf("         --o file   -> write the measures of each query and their means\n");
+  printf("                       (query 'all') to this file\n");
+  printf("         --f string -> format of that file: trec (trec_eval output, as\n");
+  printf("                       written by TrecEvaluator.java) or json\n");
+  printf("                       (default trec)\n");
 }
 
 void         parse_struct_parameters_classify(STRUCT_LEARN_PARM *sparm)
@@ -636,15 +1521,69 @@ void         parse_struct_parameters_classify(STRUCT_LEARN_PARM *sparm)
   /* Parses the command line parameters that start with -- for the
      classification module */
   int i;
+  char measures[1000]="",*name;
+
+  sparm->kernel_matrix_file[0]=0;
+  sparm->kernel_matrix_sqdist=0;
+  sparm->topk=0;
+  strcpy(sparm->run_tag,"svm_rank");
+  sparm->topk_early=0;
+  sparm->feature_maxabs=NULL;
+  sparm->cascade_file[0]=0;
+  sparm->cascade_n=100;
+  sparm->measures_n=0;
+  sparm->measures_file[0]=0;
+  sparm->measures_json=0;
 
   for(i=0;(i<sparm->custom_argc) && ((sparm->custom_argv[i])[0] == '-');i++) {
     switch ((sparm->custom_argv[i])[2]) 
       { 
       /* case 'x': i++; strcpy(xvalue,sparm->custom_argv[i]); break; */
+      case 'p': i++; strcpy(sparm->kernel_matrix_file,sparm->custom_argv[i]); break;
+      case 'm': i++; sparm->kernel_matrix_sqdist=atol(sparm->custom_argv[i]); break;
+      case 'k': i++; sparm->topk=atol(sparm->custom_argv[i]); break;
+      case 'e': i++; sparm->topk_early=atol(sparm->custom_argv[i]); break;
+      case 'l': i++; strcpy(sparm->cascade_file,sparm->custom_argv[i]); break;
+      case 'r': i++; sparm->cascade_n=atol(sparm->custom_argv[i]); break;
+      case 'n': i++; strncpy(sparm->run_tag,sparm->custom_argv[i],
+			     sizeof(sparm->run_tag)-1); 
+	        sparm->run_tag[sizeof(sparm->run_tag)-1]=0; break;
+      case 't': i++; strncpy(measures,sparm->custom_argv[i],sizeof(measures)-1);
+	        break;
+      case 'o': i++; strcpy(sparm->measures_file,sparm->custom_argv[i]); break;
+      case 'f': i++; 
+	        if(strcmp(sparm->custom_argv[i],"json") == 0)
+		  sparm->measures_json=1;
+		else if(strcmp(sparm->custom_argv[i],"trec") != 0) {
+		  printf("\nUnknown output format %s (--f)!\n\n",
+			 sparm->custom_argv[i]);
+		  exit(0);
+		}
+		break;
       default: printf("\nUnrecognized option %s!\n\n",sparm->custom_argv[i]);
 	       exit(0);
       }
   }
+  if(sparm->cascade_file[0] && (sparm->cascade_n < 1)) {
+    printf("\nThe cascade must re-score at least one document (--r)!\n\n");
+    exit(0);
+  }
+  if(sparm->measures_file[0] && (!measures[0]))
+    strcpy(measures,DEFAULT_MEASURES);
+  for(name=strtok(measures,",");name;name=strtok(NULL,",")) {
+    if(sparm->measures_n == MAX_MEASURES) {
+      printf("\nAt most %d retrieval measures (--t)!\n\n",MAX_MEASURES);
+      exit(0);
+    }
+    if(!parse_ranking_metric(name,&sparm->measure[sparm->measures_n],
+			     &sparm->measure_k[sparm->measures_n])) {
+      printf("\nUnknown retrieval measure %s (--t)!\n\n",name);
+      exit(0);
+    }
+    sparm->measures_n++;
+  }
+  if(sparm->measures_json && (!sparm->measures_file[0]))
+    printf("\nNOTE: The output format (--f) applies to the measures file (--o) only.\n");
 }
 
 
@@ -692,3 +1631,174 @@ double fracswappedpairs(LABEL y, LABEL ybar)
     return(0);
 }
 
+
+void select_sparse_kernel_basis(DOC **docs, long n, STRUCTMODEL *sm,
+				STRUCT_LEARN_PARM *sparm, KERNEL_PARM *kparm)
+     /* Selects the basis functions for approximating the kernel from
+	the n training vectors in docs and computes the inverse of the
+	Cholesky factor of their kernel matrix. Basis functions that
+	are (close to) linearly dependent on the others are dropped, so
+	the number of basis functions can be smaller than requested. */
+{
+  long   i,j,k,size,*order,*index;
+  double *indep;
+  MATRIX *K,*L;
+
+  size=MIN(sparm->sparse_kernel_size,n);
+  if(size < 1) {
+    printf("\nNumber of basis functions must be positive (--k)!\n\n");
+    exit(1);
+  }
+  if(sparm->sparse_kernel_type == 1) {      /* Nystrom with random basis */
+    srand(sparm->randseed);
+    order=random_order(n);
+    K=create_matrix(size,size);
+    for(i=0;i<size;i++)
+      for(j=0;j<=i;j++) 
+	K->element[i][j]=K->element[j][i]=kernel(kparm,docs[order[i]],
+						  docs[order[j]]);
+    indep=find_indep_subset_of_matrix(K,SPARSE_KERNEL_EPSILON);
+    index=(long *)my_malloc(sizeof(long)*(size+1));
+    for(i=0,k=0;i<size;i++)
+      if(indep[i] > 0) 
+	index[k++]=order[i];
+    index[k]=-1;
+    free(indep);
+    free_matrix(K);
+    free(order);
+    K=create_matrix(k,k);
+    for(i=0;i<k;i++)
+      for(j=0;j<=i;j++) 
+	K->element[i][j]=K->element[j][i]=kernel(kparm,docs[index[i]],
+						  docs[index[j]]);
+    L=cholesky_matrix(K);
+    free_matrix(K);
+  }
+  else if(sparm->sparse_kernel_type == 2) { /* incomplete Cholesky */
+    L=incomplete_cholesky(docs,n,size,SPARSE_KERNEL_EPSILON,kparm,&index);
+    for(k=0;index[k]>=0;k++);
+  }
+  else {
+    printf("\nUnknown type of kernel approximation %d (--t)!\n\n",
+	   sparm->sparse_kernel_type);
+    exit(1);
+  }
+  sm->basis_n=k;
+  sm->basis=(DOC **)my_malloc(sizeof(DOC *)*k);
+  for(i=0;i<k;i++) 
+    sm->basis[i]=create_example(i,0,0,1,copy_svector(docs[index[i]]->fvec));
+  sm->basis_invL=invert_ltriangle_matrix(L);
+  free_matrix(L);
+  free(index);
+}
+
+void map_to_sparse_kernel_features(DOC **docs, long n, STRUCTMODEL *sm)
+     /* Replaces the feature vector of each of the n docs by its
+	coordinates phi(x)=invL*k(x) in the space spanned by the basis
+	functions, where k(x) is the vector of kernel values between x
+	and the basis functions. The inner product phi(x)*phi(z)
+	approximates the kernel k(x,z). */
+{
+  long   i,j,r=sm->basis_n,dim=0;
+  double *kx,*phi,*vec;
+  SVECTOR **lists,*f;
+  WORD   *w;
+  KERNEL_BLOCK *block=NULL;
+  KERNEL_PARM *kparm=&(sm->input_kparm);
+
+  lists=(SVECTOR **)my_malloc(sizeof(SVECTOR *)*r);
+  for(j=0;j<r;j++) {
+    lists[j]=sm->basis[j]->fvec;
+    for(w=lists[j]->words;w->wnum;w++) 
+      if(dim < w->wnum) 
+	dim=w->wnum;
+  }
+  if(kernel_block_applicable(kparm,lists,r,dim+1))
+    block=create_kernel_block(lists,NULL,r,dim+1);
+
+#pragma omp parallel for private(j,kx,phi,vec,f) schedule(dynamic,16) if(block)
+  for(i=0;i<n;i++) {
+    kx=create_nvector(r);
+    if(block) 
+      kernel_block_eval(kparm,block,NULL,0,docs[i]->fvec,kx);
+    else
+      for(j=0;j<r;j++)
+	kx[j]=kernel(kparm,sm->basis[j],docs[i]);
+    phi=prod_ltmatrix_nvector(sm->basis_invL,kx);
+    vec=create_nvector(r);
+    vec[0]=0;
+    for(j=0;j<r;j++) 
+      vec[j+1]=phi[j];
+    f=create_svector_n(vec,r,docs[i]->fvec->userdefined,1.0);
+    free_svector(docs[i]->fvec);
+    docs[i]->fvec=f;
+    free(vec);
+    free(phi);
+    free(kx);
+  }
+
+  if(block) free_kernel_block(block);
+  free(lists);
+}
+
+void expand_sparse_kernel_model(STRUCTMODEL *sm)
+     /* Turns the linear model over the coordinates phi(x) back into a
+	kernel expansion over the basis functions. Since
+	w*phi(x)=w*invL*k(x), the coefficients of the basis functions
+	are beta=invL^T*w. The resulting model has the usual format of
+	a kernel model and needs no special treatment in
+	classification. Takes over the basis from sm. */
+{
+  MODEL  *model=sm->svm_model,*kmodel;
+  long   i,j,r=sm->basis_n;
+  double sum;
+
+  kmodel=(MODEL *)my_malloc(sizeof(MODEL));
+  (*kmodel)=(*model);
+  kmodel->supvec=(DOC **)my_malloc(sizeof(DOC *)*(r+1));
+  kmodel->alpha=(double *)my_malloc(sizeof(double)*(r+1));
+  kmodel->index=NULL;
+  kmodel->lin_weights=NULL;
+  kmodel->kernel_block=NULL;
+  kmodel->supvec[0]=NULL;
+  kmodel->alpha[0]=0;
+  for(j=0;j<r;j++) {
+    for(sum=0,i=j;i<r;i++)
+      sum+=sm->basis_invL->element[i][j]*sm->w[i+1];
+    kmodel->supvec[j+1]=sm->basis[j];
+    kmodel->alpha[j+1]=sum;
+  }
+  kmodel->sv_num=r+1;
+  kmodel->at_upper_bound=0;
+  kmodel->kernel_parm=sm->input_kparm;
+  kmodel->totwords=sm->input_totwords;
+  free_model(model,1);
+  add_kernel_block_to_model(kmodel);
+
+  sm->svm_model=kmodel;
+  sm->w=NULL;
+  sm->sizePsi=kmodel->totwords;
+  free(sm->basis);
+  sm->basis=NULL;
+  sm->basis_n=0;
+  free_matrix(sm->basis_invL);
+  sm->basis_invL=NULL;
+}
+
+KERNEL_STORE *read_struct_kernel_matrix(STRUCT_LEARN_PARM *sparm, 
+					long kernel_type)
+     /* maps the precomputed matrix given with --p after checking that
+	it fits the kernel type */
+{
+  if(sparm->kernel_matrix_sqdist && (kernel_type != RBF)) {
+    printf("\nA matrix of squared distances (--m 1) needs the rbf kernel (-t 2)!\n\n");
+    exit(1);
+  }
+  if((!sparm->kernel_matrix_sqdist) && (kernel_type != PRECOMPUTED)) {
+    printf("\nA precomputed kernel matrix (--p) needs kernel type %d (-t %d)!\n\n",
+	   PRECOMPUTED,PRECOMPUTED);
+    exit(1);
+  }
+  return(read_kernel_matrix(sparm->kernel_matrix_file,
+			    sparm->kernel_matrix_sqdist));
+}
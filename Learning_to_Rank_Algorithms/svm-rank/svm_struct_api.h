@@ -41,6 +41,11 @@ LABEL       find_most_violated_constraint_marginrescaling(PATTERN x, LABEL y,
 						     STRUCT_LEARN_PARM *sparm);
 LABEL       classify_struct_example(PATTERN x, STRUCTMODEL *sm, 
 				    STRUCT_LEARN_PARM *sparm);
+void        stack_struct_models(STRUCTMODEL *sm, int n,
+				STRUCT_LEARN_PARM *sparm);
+void        classify_struct_example_models(PATTERN x, STRUCTMODEL *sm, 
+					   int n, STRUCT_LEARN_PARM *sparm,
+					   LABEL *y);
 int         empty_label(LABEL y);
 SVECTOR     *psi(PATTERN x, LABEL y, STRUCTMODEL *sm, 
 	        STRUCT_LEARN_PARM *sparm);
@@ -58,10 +63,24 @@ void        print_struct_testing_stats(SAMPLE sample, STRUCTMODEL *sm,
 void        eval_prediction(long exnum, EXAMPLE ex, LABEL prediction, 
 			    STRUCTMODEL *sm, STRUCT_LEARN_PARM *sparm,
 			    STRUCT_TEST_STATS *teststats);
+void        add_struct_test_stats(STRUCT_TEST_STATS *teststats,
+				  STRUCT_TEST_STATS *more);
 void        write_struct_model(char *file,STRUCTMODEL *sm, 
 			       STRUCT_LEARN_PARM *sparm);
 STRUCTMODEL read_struct_model(char *file, STRUCT_LEARN_PARM *sparm);
 void        write_label(FILE *fp, LABEL y);
+void        write_ranked_label(FILE *fp, PATTERN x, LABEL y, 
+			       STRUCT_LEARN_PARM *sparm);
+double      ranking_metric(LABEL y, LABEL ybar, int metric, long k);
+long        ranking_metrics(LABEL y, LABEL ybar, long retrieved, 
+			    int *metric, long *k, long n, double *value);
+int         parse_ranking_metric(char *name, int *metric, long *k);
+char        *ranking_metric_name(int metric, long k, char *name);
+void        write_query_measures(FILE *fp, long exnum, EXAMPLE ex, 
+				 STRUCT_TEST_STATS *qstats,
+				 STRUCT_LEARN_PARM *sparm);
+void        write_mean_measures(FILE *fp, STRUCT_TEST_STATS *teststats,
+				STRUCT_LEARN_PARM *sparm);
 void        free_pattern(PATTERN x);
 void        free_label(LABEL y);
 void        free_struct_model(STRUCTMODEL sm);
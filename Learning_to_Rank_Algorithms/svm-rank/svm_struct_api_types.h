@@ -31,6 +31,17 @@
 #define SWAPPEDPAIRS     1
 #define FRACSWAPPEDPAIRS 2
 
+/* Identifiers for retrieval measures (ranking_metric) */
+#define METRIC_MAP       1
+#define METRIC_P         2
+#define METRIC_NDCG      3
+#define METRIC_MRR       4
+/* most retrieval measures that svm_rank_classify evaluates at once */
+#define MAX_MEASURES     32
+/* the measures that TrecEvaluator.java writes (without R-prec and
+   bpref), evaluated by svm_rank_classify with --o but without --t */
+#define DEFAULT_MEASURES "MAP,NDCG,NDCG@1,NDCG@2,NDCG@3,NDCG@4,NDCG@5,NDCG@10,NDCG@15,NDCG@20,MRR,P@1,P@2,P@3,P@4,P@5,P@10,P@15,P@20,P@30,P@100,P@200,P@500,P@1000"
+
 /* default precision for solving the optimization problem */
 # define DEFAULT_EPS         0.001 
 /* default loss rescaling method: 1=slack_rescaling, 2=margin_rescaling */
@@ -55,6 +66,12 @@
      10E-10 if COMPACT_CACHED_VECTORS is 2 or 3 
 */
 # define COMPACT_ROUNDING_THRESH 10E-15
+/* default number of basis functions for the sparse kernel
+   approximation (--k option) */
+# define DEFAULT_SPARSE_KERNEL_SIZE 500
+/* basis functions whose remaining norm in the Cholesky decomposition
+   falls below this value are treated as linearly dependent */
+# define SPARSE_KERNEL_EPSILON   1E-6
 
 
 typedef struct pattern {
@@ -80,6 +97,40 @@ typedef struct structmodel {
   double *w;          /* pointer to the learned weights */
   MODEL  *svm_model;  /* the learned SVM model */
   long   sizePsi;     /* maximum number of weights in w */
+  /* sparse approximation of a non-linear kernel (--t option). The
+     training vectors are replaced by their coordinates with respect
+     to the basis functions, and a linear model is learned. */
+  long   basis_n;        /* number of basis functions, 0 if not used */
+  DOC    **basis;        /* the basis functions in input space */
+  MATRIX *basis_invL;    /* inverse of the Cholesky factor of the
+			    kernel matrix of the basis functions */
+  long   poly2_expanded; /* 1, if the training vectors are replaced by
+			    the explicit feature map of the polynomial
+			    kernel of degree 2 */
+  KERNEL_PARM input_kparm; /* the kernel that is approximated or
+			      expanded */
+  long   input_totwords; /* number of features of the input space */
+  /* top-k ranking with early termination (--e option of
+     svm_rank_classify) */
+  LINEAR_BOUND *linear_bound; /* order of the features, NULL if not
+				 used */
+  FVAL   *bound_x;       /* current document as dense vector */
+  double *bound_prod;    /* its products with the weights */
+  double bound_mults;    /* products computed */
+  double bound_saved;    /* products skipped */
+  long   bound_pruned;   /* documents abandoned */
+  /* several models scored in one pass (svm_rank_classify with a list
+     of models) */
+  WEIGHT_MATRIX *stacked; /* weight vectors of this and the other
+			     linear models, NULL if not used */
+  long   stacked_col;    /* column of this model in stacked. The model
+			    with column 0 frees the matrix. */
+  /* two-stage ranking (--l option of svm_rank_classify) */
+  MODEL  *cascade_model; /* linear model that scores all documents
+			    before svm_model re-scores the best, NULL if
+			    not used */
+  double cascade_time[2]; /* cpu-seconds/100 spent in both stages */
+  long   cascade_docs[2]; /* documents scored in both stages */
   /* other information that is needed for the stuctural model can be
      added here, e.g. the grammar rules for NLP parsing */
 } STRUCTMODEL;
@@ -109,8 +160,54 @@ typedef struct struct_learn_parm {
   int    loss_function;        /* select between different loss
 				  functions via -l command line
 				  option */
+  int    reuse_sample;         /* 1, if several models are trained on
+				  the same sample (e.g. for a list of
+				  values of -c or -g), so that
+				  init_struct_model() must leave the
+				  examples unchanged */
+  long   max_iterations;       /* the one-slack algorithms stop after
+				  this many iterations, even if they
+				  have not reached epsilon. 0 for no
+				  limit. */
   /* further parameters that are passed to init_struct_model() */
   int num_features;
+  int    sparse_kernel_type;   /* 0: use exact kernel, 1: Nystrom
+				  approximation with random basis, 2:
+				  basis from incomplete Cholesky */
+  long   sparse_kernel_size;   /* number of basis functions */
+  long   poly2_expand;         /* 1, if a polynomial kernel of degree 2
+				  may be trained over its explicit
+				  feature map */
+  long   randseed;             /* seed for selecting random basis */
+  char   kernel_matrix_file[300]; /* precomputed kernel matrix indexed
+				     by the did: of the documents */
+  long   kernel_matrix_sqdist; /* 1, if the matrix holds squared
+				  distances for the rbf kernel */
+  char   kernel_store_dir[300]; /* directory with kernel stores that
+				   are reused across runs */
+  long   topk;                 /* svm_rank_classify: if > 0, write the
+				  topk best documents of each query in
+				  TREC run format instead of the scores */
+  char   run_tag[100];         /* name of the run in TREC run format */
+  long   topk_early;           /* 1, if documents that cannot make the
+				  top k of a linear model are abandoned
+				  while they are scored */
+  double *feature_maxabs;      /* largest absolute value of each
+				  feature in the test set, for the
+				  bounds of topk_early */
+  char   cascade_file[300];    /* svm_rank_classify: linear model of
+				  the first stage of a cascade */
+  long   cascade_n;            /* documents of each query that the
+				  second stage re-scores */
+  long   measures_n;           /* svm_rank_classify: number of
+				  retrieval measures evaluated for each
+				  query, 0 for none */
+  int    measure[MAX_MEASURES];   /* their METRIC_... identifiers */
+  long   measure_k[MAX_MEASURES]; /* and their cutoffs */
+  char   measures_file[300];   /* per-query and mean values of the
+				  measures go here */
+  int    measures_json;        /* 1, if they are written in JSON
+				  instead of trec_eval text */
 } STRUCT_LEARN_PARM;
 
 typedef struct struct_test_stats {
@@ -119,6 +216,13 @@ typedef struct struct_test_stats {
      function eval_prediction and print_struct_testing_stats. */
   double swappedpairs;
   double fracswappedpairs;
+  long   queries;              /* evaluated queries */
+  long   num_ret;              /* documents retrieved (all, or the top
+				  k in TREC run format) */
+  long   num_rel;              /* relevant documents */
+  long   num_rel_ret;          /* relevant documents retrieved */
+  double measure[MAX_MEASURES]; /* sums of the retrieval measures
+				   sparm->measure over the queries */
 } STRUCT_TEST_STATS;
 
 typedef struct struct_id_score {
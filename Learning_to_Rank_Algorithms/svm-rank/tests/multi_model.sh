@@ -0,0 +1,45 @@
+#!/bin/sh
+# Checks that svm_rank_classify with several models writes the same
+# predictions as one run per model, also when the models have
+# different numbers of features: an RBF model with 3 features and a
+# linear model with 5 score test examples with 5 features. A cascade
+# of the linear model and the RBF model re-scores all documents of these
+# short queries, so it also has to write the predictions of the RBF
+# model alone.
+# Run from the svm-rank directory, e.g. with 'make check'.
+
+set -e
+dir=${TMPDIR:-/tmp}/svm_rank_test.$$
+mkdir -p $dir/models
+trap 'rm -rf $dir' EXIT
+
+# deterministic examples: 20 queries of 10 documents
+gen() {
+  awk -v seed=$1 -v nf=$2 'BEGIN {
+    srand(seed);
+    for(q=1;q<=20;q++)
+      for(d=1;d<=10;d++) {
+        line=int(rand()*3) " qid:" q;
+        for(j=1;j<=nf;j++)
+          line=line " " j ":" sprintf("%.4f",rand());
+        print line;
+      }
+  }'
+}
+gen 1 3 > $dir/train3
+gen 2 5 > $dir/train5
+gen 3 5 > $dir/test
+
+./svm_rank_learn -v 0 -c 1 -t 2 -g 0.5 $dir/train3 $dir/models/rbf > /dev/null
+./svm_rank_learn -v 0 -c 1 $dir/train5 $dir/models/lin > /dev/null
+
+./svm_rank_classify -v 0 $dir/test $dir/models $dir/all > /dev/null
+./svm_rank_classify -v 0 -j 2 $dir/test $dir/models $dir/allj > /dev/null
+for m in rbf lin; do
+  ./svm_rank_classify -v 0 $dir/test $dir/models/$m $dir/one.$m > /dev/null
+  cmp $dir/all.$m $dir/one.$m
+  cmp $dir/allj.$m $dir/one.$m
+done
+./svm_rank_classify -v 0 --l $dir/models/lin $dir/test $dir/models/rbf $dir/cascade > /dev/null
+cmp $dir/cascade $dir/one.rbf
+echo "multi_model: OK"